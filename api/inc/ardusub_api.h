@@ -12,6 +12,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 // ------------------------------------------------------------------------------
 //   Defines
@@ -53,6 +54,171 @@ typedef struct __mavlink_named_value_float_t {
                        F_STORAGE_LOG | \
                        F_STORAGE_INI)
 
+// store raw payload of msg nobody handles right now,
+// decode on first read after a new frame.
+#define F_MSG_LAZY_DECODE (1U << 16)
+
+// keep newest decoded msg of each msgid in a mailbox instead of message_queue,
+// read with as_api_mailbox_read. takes precedence over F_MSG_LAZY_DECODE
+// for primary component.
+#define F_MSG_MAILBOX (1U << 17)
+
+// internal queues, see as_api_set_queue_policy
+#define AS_QUEUE_MESSAGE (0U)
+#define AS_QUEUE_STATUSTEX (1U)
+#define AS_QUEUE_NAMED_VAL_FLOAT (2U)
+#define AS_QUEUE_SERIAL_WRITE_BUF (3U)
+#define AS_QUEUE_COUNT (4U)
+
+// backpressure policy, applies when queue is full
+// drop oldest: lowest latency, newest data always gets in.
+// drop newest: queued data is kept, newest is lost.
+// block: sender waits for space up to timeout, then drops newest.
+//        only for AS_QUEUE_SERIAL_WRITE_BUF, I/O thread never waits.
+// coalesce: replace queued item with same key (msgid, text or name),
+//           drop oldest if no such item. not for AS_QUEUE_SERIAL_WRITE_BUF.
+#define AS_QUEUE_DROP_OLDEST (0U)
+#define AS_QUEUE_DROP_NEWEST (1U)
+#define AS_QUEUE_BLOCK (2U)
+#define AS_QUEUE_COALESCE (3U)
+
+// subscription executor
+// inline: callback runs on I/O thread right after decode, keep it short.
+// worker: callback runs on a worker thread with a copy of the message.
+#define F_SUBSCRIBE_INLINE (0U)
+#define F_SUBSCRIBE_WORKER (1U)
+
+// msg points to decoded mavlink struct of msgid, e.g. mavlink_attitude_t.
+// as_api_unsubscribe waits for running callbacks, never call it in its own callback.
+typedef void (*as_api_subscribe_callback_t)(uint8_t target_system,
+                                            uint32_t msgid,
+                                            const void *msg,
+                                            void *user_data);
+
+// state of parameter sync, see as_api_param_sync
+#define AS_PARAM_SYNC_IDLE (0)
+#define AS_PARAM_SYNC_RUNNING (1)
+#define AS_PARAM_SYNC_DONE (2)
+#define AS_PARAM_SYNC_FAILED (3)
+
+// count is 0 until first PARAM_VALUE
+typedef void (*as_api_param_progress_callback_t)(uint8_t target_system,
+                                                 uint16_t received,
+                                                 uint16_t count,
+                                                 int state,
+                                                 void *user_data);
+
+// command result, MAV_RESULT from COMMAND_ACK or one of these
+#define AS_COMMAND_TIMEOUT (-1)   // no ack after all retries
+#define AS_COMMAND_CANCELLED (-2) // by as_api_command_cancel or as_api_deinit
+#define AS_COMMAND_FAILED (-3)    // not sent, e.g. vehicle not found
+
+// called once per command, on I/O thread for an ack, keep it short.
+typedef void (*as_api_command_callback_t)(uint8_t target_system,
+                                          uint8_t target_component,
+                                          uint16_t command,
+                                          int result,
+                                          void *user_data);
+
+// rate of one message in a stream profile
+typedef struct Stream_Rate_s
+{
+    uint32_t msgid;
+    float rate_hz; /*<  0 to stop the message*/
+} Stream_Rate_t;
+
+// vehicle clock estimate from TIMESYNC, vehicle time is time since boot
+typedef struct Timesync_Stats_s
+{
+    int synced;        /*<  0 until TIMESYNC_MIN_SAMPLES replies*/
+    int64_t offset;    /*< [us] Vehicle time - host monotonic time, now*/
+    double skew_ppm;   /*<  Vehicle clock rate - host clock rate*/
+    int64_t rtt_min;   /*< [us] Shortest round trip in window*/
+    int64_t rtt_last;  /*< [us]*/
+    uint32_t samples;  /*<  Replies used since start*/
+    uint32_t rejected; /*<  Replies dropped for round trip*/
+} Timesync_Stats_t;
+
+// latency probe request, see as_api_latency_probe_start
+#define AS_LATENCY_PROBE_TIMESYNC (0U)
+#define AS_LATENCY_PROBE_PING (1U)
+
+// round trip of latency probe, in microseconds, percentiles are bucket
+// upper bounds of a log-linear histogram, within 25%
+typedef struct Latency_Stats_s
+{
+    uint64_t sent;
+    uint64_t received;
+    uint64_t lost;     /*<  No reply in LATENCY_PROBE_TIMEOUT*/
+    int64_t min;
+    int64_t mean;
+    int64_t p50;
+    int64_t p99;
+    int64_t max;
+    int alarm;         /*<  1 while latency or loss is above alarm threshold*/
+} Latency_Stats_t;
+
+// called on latency worker thread when alarm is raised or cleared,
+// stats is of the last alarm window
+typedef void (*as_api_latency_alarm_callback_t)(uint8_t target_system,
+                                                int alarm,
+                                                const Latency_Stats_t *stats,
+                                                void *user_data);
+
+// frame accounting of one (link, sysid, compid)
+typedef struct Link_Loss_Stats_s
+{
+    uint32_t link_id;      /*<  UDP source or serial port, numbered in order of first frame*/
+    uint8_t sysid;
+    uint8_t compid;
+    uint64_t received;     /*<  Frames passed CRC check*/
+    uint64_t lost;         /*<  Frames missing in seq, late frames included*/
+    uint64_t out_of_order; /*<  Frames with seq behind the last one, duplicates included*/
+    uint64_t crc_failed;   /*<  Frames dropped by CRC check*/
+    float loss_rate;       /*<  lost / (received + lost) in last finished window*/
+    int64_t last_time;     /*< [us] Monotonic time of last frame*/
+} Link_Loss_Stats_t;
+
+// msgid with own counter in Link_Stats_t, others are counted together
+#define LINK_STATS_MSGID_COUNT (256)
+
+// live counters of one vehicle, totals since as_api_init
+typedef struct Link_Stats_s
+{
+    int64_t monotonic_time;
+    float rate_interval;                         /*< [s] Interval rates are measured over*/
+
+    uint64_t msg_received[LINK_STATS_MSGID_COUNT]; /*<  Frames by msgid*/
+    uint64_t msg_received_other;                 /*<  Frames with msgid >= LINK_STATS_MSGID_COUNT*/
+    float msg_rate[LINK_STATS_MSGID_COUNT];      /*< [1/s] Frames by msgid*/
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    float bytes_in_rate;                         /*< [B/s]*/
+    float bytes_out_rate;                        /*< [B/s]*/
+    uint64_t parse_errors;                       /*<  CRC and signature failures, by sysid in header*/
+
+    uint32_t message_queue_depth;
+    uint32_t message_queue_high;                 /*<  High-water mark*/
+    uint32_t statustex_queue_depth;
+    uint32_t statustex_queue_high;
+    uint32_t named_val_float_queue_depth;
+    uint32_t named_val_float_queue_high;
+    uint32_t serial_write_buf_queue_depth;       /*<  0 for UDP vehicle*/
+    uint32_t serial_write_buf_queue_high;
+
+    uint64_t drop_not_ready;                     /*<  Frames before vehicle is found*/
+    uint64_t drop_component;                     /*<  Frames over MAX_COMPONENT*/
+    uint64_t drop_message_queue;                 /*<  Items dropped when queue is full, by its policy*/
+    uint64_t drop_statustex_queue;               /*<  Items dropped when queue is full, by its policy*/
+    uint64_t drop_named_val_float_queue;         /*<  Items dropped when queue is full, by its policy*/
+    uint64_t drop_subscribe_task;                /*<  Newest dropped at MAX_SUBSCRIBE_WORKER_TASK*/
+    uint64_t drop_serial_write_buf;              /*<  Items dropped when queue is full, 0 for UDP vehicle*/
+
+    // shared by all vehicles, source is unknown when dropped
+    uint64_t drop_udp_source;                    /*<  Datagrams over MAX_UDP_SOURCE*/
+    uint64_t drop_udp_parse_queue;               /*<  Datagrams dropped at MAX_UDP_PARSE_QUEUE*/
+} Link_Stats_t;
+
 typedef struct Vehicle_Data_s
 {
     int64_t monotonic_time;
@@ -219,8 +385,90 @@ typedef enum system_status_enum
     SYS_INITIATING = 1,
     SYS_DISARMED = 2,
     SYS_ARMED = 3,
+    // no heartbeat in lost timeout, workers stopped until it rejoins.
+    // latency probe is held and commands in flight are cancelled, but
+    // periodic executors (NULL vehicle_data), depth control and
+    // subscriptions are kept, stop them if they should not resume.
+    SYS_LOST = 4,
 } system_status_t;
 
+// one field of Vehicle_Data_t copied by a projection, use VEHICLE_DATA_FIELD
+typedef struct Vehicle_Data_Field_s
+{
+    uint16_t src_offset; /*<  Offset in Vehicle_Data_t*/
+    uint16_t dst_offset; /*<  Offset in caller struct*/
+    uint16_t size;
+} Vehicle_Data_Field_t;
+
+// e.g. VEHICLE_DATA_FIELD(My_Data_t, depth, press_abs2),
+// monotonic_time is set to time of copy, same as as_api_get_vehicle_data2
+#define VEHICLE_DATA_FIELD(dst_type, dst_member, src_member)     \
+    {                                                            \
+        offsetof(Vehicle_Data_t, src_member),                    \
+            offsetof(dst_type, dst_member),                      \
+            sizeof(((Vehicle_Data_t *)0)->src_member)            \
+    }
+
+// built once by as_api_projection_new, fields are merged and sorted
+typedef struct Vehicle_Data_Projection_s Vehicle_Data_Projection_t;
+
+// periodic executor options, see as_api_periodic_start
+// sched fifo: run thread with SCHED_FIFO at given priority, needs CAP_SYS_NICE.
+// mlock: lock all pages of process in memory, no page fault in loop.
+#define F_PERIODIC_NONE (0U)
+#define F_PERIODIC_SCHED_FIFO (1U)
+#define F_PERIODIC_MLOCK (1U << 1)
+
+// timing of a periodic executor, in nanoseconds, since start
+typedef struct Periodic_Stats_s
+{
+    uint64_t cycles;
+    uint64_t overruns;   /*<  Callback finished after next deadline*/
+    uint64_t skipped;    /*<  Deadlines skipped after overruns*/
+    int64_t jitter_min;  /*<  Wake up time - deadline*/
+    int64_t jitter_max;
+    int64_t jitter_mean;
+    int64_t exec_max;    /*<  Callback execution time*/
+    int64_t exec_last;
+} Periodic_Stats_t;
+
+// runs on executor thread each period, vehicle_data is a snapshot taken
+// right before the call, NULL if vehicle is not found.
+typedef void (*as_api_periodic_callback_t)(uint8_t target_system,
+                                           const Vehicle_Data_t *vehicle_data,
+                                           uint64_t cycle,
+                                           void *user_data);
+
+// depth controller input, depth is negative below surface as alt
+// global position int: alt of GLOBAL_POSITION_INT.
+// scaled pressure2: press_abs of SCALED_PRESSURE2, with surface pressure and density.
+#define AS_CONTROL_INPUT_GLOBAL_POSITION_INT (0U)
+#define AS_CONTROL_INPUT_SCALED_PRESSURE2 (1U)
+
+// depth controller output, in PWM offset from 1500
+// rc override: RC_CHANNELS_OVERRIDE with rc_mix sign on each channel.
+// manual control: z of MANUAL_CONTROL, 400 PWM offset is full range.
+#define AS_CONTROL_OUTPUT_RC_OVERRIDE (0U)
+#define AS_CONTROL_OUTPUT_MANUAL_CONTROL (1U)
+
+// see as_api_depth_control_default for default values
+typedef struct Depth_Control_Config_s
+{
+    float kp;
+    float ki;
+    float kd;
+    float i_min;            /*<  I term clamp, prevents integral windup*/
+    float i_max;
+    float vel_limit;        /*< [m/s] Clamp of depth rate, prevents setpoint kick in D term*/
+    float output_limit;     /*<  Clamp of output, in PWM offset*/
+    unsigned int input;     /*<  AS_CONTROL_INPUT_...*/
+    unsigned int output;    /*<  AS_CONTROL_OUTPUT_...*/
+    int8_t rc_mix[8];       /*<  Sign of output on RC channel 1 - 8, 0 for neutral 1500*/
+    float surface_pressure; /*< [hPa] For AS_CONTROL_INPUT_SCALED_PRESSURE2*/
+    float fluid_density;    /*< [kg/m^3] For AS_CONTROL_INPUT_SCALED_PRESSURE2*/
+    unsigned int period_us; /*<  0 runs on subscribe worker on each input frame, else on periodic executor*/
+} Depth_Control_Config_t;
+
 typedef struct Debug_Info_Bite_s
 {
     uint64_t b000_b063;
@@ -241,6 +489,10 @@ extern "C"
 
     extern void as_api_vehicle_arm(uint8_t target_system, uint8_t target_autopilot);
     extern void as_api_vehicle_disarm(uint8_t target_system, uint8_t target_autopilot);
+    extern int as_api_vehicle_arm_async(uint8_t target_system, uint8_t target_autopilot,
+                                        as_api_command_callback_t callback, void *user_data);
+    extern int as_api_vehicle_disarm_async(uint8_t target_system, uint8_t target_autopilot,
+                                           as_api_command_callback_t callback, void *user_data);
     extern void as_api_set_mode(uint8_t target_system, control_mode_t mode);
 
     extern mavlink_statustext_t *as_api_statustex_queue_pop(uint8_t target_system);
@@ -249,17 +501,104 @@ extern "C"
 
     extern Vehicle_Data_t *as_api_get_vehicle_data(uint8_t target_system);
     extern int as_api_get_vehicle_data2(uint8_t target_system, Vehicle_Data_t *vehicle_data);
+    extern int as_api_get_fleet_snapshot(Vehicle_Data_t *vehicle_data, uint8_t *sysid, int max_count);
+    extern Vehicle_Data_Projection_t *as_api_projection_new(const Vehicle_Data_Field_t *fields, int count);
+    extern void as_api_projection_free(Vehicle_Data_Projection_t *projection);
+    extern int as_api_get_vehicle_data_projection(uint8_t target_system,
+                                                  const Vehicle_Data_Projection_t *projection,
+                                                  void *data);
 
     extern int as_api_statustex_count(uint8_t target_system);
 
     extern int as_api_check_vehicle(uint8_t sysid);
+    extern system_status_t as_api_get_vehicle_status(uint8_t target_system);
+    extern void as_api_set_vehicle_lost_timeout(unsigned int timeout_ms);
+    extern int as_api_check_component(uint8_t sysid, uint8_t compid);
+    extern int as_api_get_component_list(uint8_t sysid, uint8_t *compid_list, int max_count);
+    extern int as_api_get_component_message(uint8_t sysid, uint8_t compid, uint32_t msgid,
+                                            void *msg, uint64_t *time_stamp);
+
+    extern int as_api_timesync_get_stats(uint8_t target_system, Timesync_Stats_t *stats);
+    extern int as_api_vehicle_to_host_time(uint8_t target_system, uint64_t vehicle_time_us,
+                                           int64_t *host_time_us);
+    extern int as_api_host_to_vehicle_time(uint8_t target_system, int64_t host_time_us,
+                                           uint64_t *vehicle_time_us);
+
+    extern int as_api_latency_probe_start(uint8_t target_system, unsigned int method,
+                                          unsigned int rate_hz, unsigned int alarm_p99_us,
+                                          float alarm_loss,
+                                          as_api_latency_alarm_callback_t callback,
+                                          void *user_data);
+    extern int as_api_latency_probe_stop(uint8_t target_system);
+    extern int as_api_latency_get_stats(uint8_t target_system, Latency_Stats_t *stats);
+
+    extern int as_api_get_link_loss(uint8_t sysid, Link_Loss_Stats_t *stats, int max_count);
+    extern int as_api_get_link_stats(uint8_t sysid, Link_Stats_t *stats);
+
+    extern int as_api_mailbox_read(uint8_t sysid, uint32_t msgid, void *msg,
+                                   uint32_t *generation, uint64_t *time_stamp);
+
+    extern int as_api_set_queue_policy(unsigned int queue, unsigned int policy,
+                                       unsigned int capacity, unsigned int timeout_ms);
+
+    extern int as_api_subscribe(uint8_t sysid, uint32_t msgid,
+                                as_api_subscribe_callback_t callback,
+                                void *user_data, unsigned int options);
+    extern int as_api_subscribe_component(uint8_t sysid, uint8_t compid, uint32_t msgid,
+                                          as_api_subscribe_callback_t callback,
+                                          void *user_data, unsigned int options);
+    extern int as_api_unsubscribe(int subscription_id);
+
+    extern int as_api_command_long_async(uint8_t target_system, uint8_t target_component,
+                                         uint16_t command, const float *param,
+                                         unsigned int timeout_ms, unsigned int retries,
+                                         as_api_command_callback_t callback, void *user_data);
+    extern int as_api_command_long_wait(uint8_t target_system, uint8_t target_component,
+                                        uint16_t command, const float *param,
+                                        unsigned int timeout_ms, unsigned int retries);
+    extern int as_api_command_cancel(int command_id);
+
+    extern int as_api_param_sync(uint8_t target_system,
+                                 as_api_param_progress_callback_t callback, void *user_data);
+    extern int as_api_param_sync_progress(uint8_t target_system,
+                                          uint16_t *received, uint16_t *count);
+    extern int as_api_param_get(uint8_t target_system, const char *param_id, float *value);
+    extern int as_api_param_set(uint8_t target_system, const char *param_id, float value);
+    extern int as_api_add_stream_profile(const char *name, const Stream_Rate_t *rate,
+                                         int count, float other_rate_hz);
+    extern int as_api_set_stream_profile(const char *name);
+    extern int as_api_apply_stream_profile(uint8_t target_system);
+    extern int as_api_periodic_start(uint8_t target_system, unsigned int period_us,
+                                     as_api_periodic_callback_t callback, void *user_data,
+                                     unsigned int options, int priority, int cpu);
+    extern int as_api_periodic_stop(int periodic_id);
+    extern int as_api_periodic_get_stats(int periodic_id, Periodic_Stats_t *stats);
+    extern void as_api_depth_control_default(Depth_Control_Config_t *config);
+    extern int as_api_depth_control_start(uint8_t target_system,
+                                          const Depth_Control_Config_t *config, float setpoint);
+    extern int as_api_depth_control_set_config(uint8_t target_system,
+                                               const Depth_Control_Config_t *config);
+    extern int as_api_depth_control_set_setpoint(uint8_t target_system, float setpoint);
+    extern int as_api_depth_control_stop(uint8_t target_system);
     extern void as_api_manual_control(int16_t x, int16_t y, int16_t z, int16_t r, uint16_t buttons, ...);
+    extern void as_api_set_manual_control_rate(unsigned int rate_hz, unsigned int min_interval_ms);
+
+    extern void as_api_send_command_long(uint8_t target_system, uint8_t target_component,
+                                         uint16_t command, float param1, float param2,
+                                         float param3, float param4, float param5,
+                                         float param6, float param7);
 
     extern void as_api_set_servo(uint8_t target_system, uint8_t target_autopilot,
                                  float servo_no, float pwm);
+    extern int as_api_set_servo_async(uint8_t target_system, uint8_t target_autopilot,
+                                      float servo_no, float pwm,
+                                      as_api_command_callback_t callback, void *user_data);
 
     extern void as_api_motor_test(uint8_t target_system, uint8_t target_autopilot,
                                   float motor_no, float pwm);
+    extern int as_api_motor_test_async(uint8_t target_system, uint8_t target_autopilot,
+                                       float motor_no, float pwm,
+                                       as_api_command_callback_t callback, void *user_data);
 
     extern void as_api_send_rc_channels_override(uint8_t target_system, uint8_t target_autopilot,
                                                  uint16_t ch1, uint16_t ch2, uint16_t ch3, uint16_t ch4,
@@ -0,0 +1,60 @@
+/**
+ * @file ardusub_command.h
+ * @author ztluo (me@ztluo.dev)
+ * @brief
+ * @version
+ * @date 2019-05-27
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#pragma once
+
+#include "ardusub_msg.h"
+
+// max COMMAND_LONG in flight at the same time, all vehicles
+#define MAX_COMMAND_IN_FLIGHT (256)
+
+// per attempt timeout of as_api_command_long_async when 0 is given, in milliseconds
+#define COMMAND_TIMEOUT (1000)
+
+// resend count of arm, disarm, servo and motor test commands with ack
+#define COMMAND_RETRIES (3)
+
+// max wait of command worker, in microseconds
+#define COMMAND_WORKER_INTERVAL (100000)
+
+typedef struct Command_s
+{
+    volatile gint active;
+    volatile gint id;      // generation id, changes when slot is reused
+    gint64 deadline;       // monotonic time of next retry or timeout
+    gint64 timeout;        // per attempt, in microseconds
+    guint retries;         // retries left
+    gboolean in_progress;  // MAV_RESULT_IN_PROGRESS received, no retry
+    mavlink_command_long_t cmd;
+    as_api_command_callback_t callback;
+    gpointer user_data;
+} Command_t;
+
+// completion of as_api_command_long_wait
+typedef struct Command_Wait_s
+{
+    GMutex mutex;
+    GCond cond;
+    gboolean done;
+    gint result;
+} Command_Wait_t;
+
+int as_api_command_long_async(uint8_t target_system, uint8_t target_component,
+                              uint16_t command, const float *param,
+                              unsigned int timeout_ms, unsigned int retries,
+                              as_api_command_callback_t callback, void *user_data);
+int as_api_command_long_wait(uint8_t target_system, uint8_t target_component,
+                             uint16_t command, const float *param,
+                             unsigned int timeout_ms, unsigned int retries);
+int as_api_command_cancel(int command_id);
+void as_command_cancel_vehicle(guint8 target_system);
+
+void as_command_deinit();
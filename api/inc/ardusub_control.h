@@ -0,0 +1,57 @@
+/**
+ * @file ardusub_control.h
+ * @author ztluo (me@ztluo.dev)
+ * @brief
+ * @version
+ * @date 2019-06-03
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#pragma once
+
+#include "ardusub_def.h"
+
+// setpoint and error are logged to as_command on setpoint change and
+// at this interval, in microseconds
+#define CONTROL_LOG_INTERVAL (1000000)
+
+// input older than this is not used by periodic step, in microseconds
+#define CONTROL_INPUT_TIMEOUT (500000)
+
+// gravity for depth from pressure, in m/s^2
+#define CONTROL_GRAVITY (9.80665f)
+
+// PWM offset of full range MANUAL_CONTROL z
+#define CONTROL_MANUAL_FULL_RANGE (400.0f)
+
+// depth controller of one vehicle, guarded by its mutex
+typedef struct Depth_Control_s
+{
+    GMutex mutex;
+    gboolean active;
+    Depth_Control_Config_t config;
+    gfloat setpoint;
+    gint subscription_id;
+    gint periodic_id;
+    gint64 depth_time;       // receive time of depth, 0 for none
+    gfloat depth;            // newest input
+    gint64 step_time;        // input time of last step, 0 for none
+    gfloat step_depth;       // input of last step
+    gfloat i_term;
+    gfloat error;
+    gfloat output;
+    gint64 log_time;
+    gboolean setpoint_changed;
+} Depth_Control_t;
+
+void as_api_depth_control_default(Depth_Control_Config_t *config);
+int as_api_depth_control_start(uint8_t target_system,
+                               const Depth_Control_Config_t *config, float setpoint);
+int as_api_depth_control_set_config(uint8_t target_system,
+                                    const Depth_Control_Config_t *config);
+int as_api_depth_control_set_setpoint(uint8_t target_system, float setpoint);
+int as_api_depth_control_stop(uint8_t target_system);
+
+void as_control_deinit();
@@ -57,6 +57,7 @@
 #define STATION_SYSYEM_ID (255)
 #define STATION_COMPONENT_ID (0)
 
+// default queue capacities, set at runtime with as_api_set_queue_policy or ini
 #define MAX_STATUSTEX (512)
 #define MAX_NAMED_VALUE_FLOAT (512)
 #define MAX_MESSAGE (512)
@@ -65,6 +66,18 @@
 
 #define MIN_MSG_INTERVAL (1000) // in microseconds
 
+// default MANUAL_CONTROL send rate, see as_api_set_manual_control_rate
+#define MANUAL_CONTROL_RATE (10)          // in Hz
+#define MANUAL_CONTROL_MIN_INTERVAL (20) // in milliseconds
+
+// one slot for each sysid, sysid 255 included
+#define MAX_VEHICLE_SLOT (256)
+
+#define CACHE_LINE_SIZE (64)
+
+// max components tracked for one sysid, autopilot included
+#define MAX_COMPONENT (8)
+
 // ------------------------------------------------------------------------------
 //   Data Structures
 // ------------------------------------------------------------------------------
@@ -73,6 +86,7 @@ typedef struct Time_Stamps_s
 {
     uint64_t heartbeat;
     uint64_t sys_status;
+    uint64_t ping;
     uint64_t battery_status;
     uint64_t radio_status;
     uint64_t local_position_ned;
@@ -205,6 +219,9 @@ typedef struct messages_set_s
 
     guint msg_id;
 
+    // Msg_Lazy_Set_t, raw frames not decoded yet, NULL until first lazy frame
+    gpointer lazy_set;
+
 } Mavlink_Messages_t;
 
 typedef struct Mavlink_Parameter_s
@@ -213,3 +230,35 @@ typedef struct Mavlink_Parameter_s
     mavlink_param_union_t param_value;
     enum MAV_PARAM_TYPE param_type; // NOTE: if param_type == 0 , then this Parameter is empty.
 } Mavlink_Parameter_t;
+
+// per vehicle state, published by as_system_add, never removed.
+// slot is cache line aligned, vehicles on different cores don't share lines.
+typedef struct Vehicle_Slot_s
+{
+    volatile gint ready; // TRUE after all pointers below are set
+    Mavlink_Messages_t *messages; // primary component (autopilot)
+    Mavlink_Parameter_t *parameter;
+    gpointer target; // GSocket for UDP, serial chan for serial port
+    mavlink_manual_control_t *manual_control;
+    gboolean manual_control_changed; // guarded by manual_control_mutex
+    gpointer mailbox; // Msg_Mailbox_t of primary component, NULL without F_MSG_MAILBOX
+
+    // components of this sysid, index 0 is primary component.
+    // components are added under component_mutex, by any parse thread,
+    // comp_index and component_* are set before component_count.
+    GMutex component_mutex;
+    guint8 primary_compid;
+    volatile gint component_count;
+    guint8 comp_index[256]; // compid -> index + 1, 0 for unknown compid
+    guint8 component_id[MAX_COMPONENT];
+    Mavlink_Messages_t *component_messages[MAX_COMPONENT];
+} __attribute__((aligned(CACHE_LINE_SIZE))) Vehicle_Slot_t;
+
+// copy ranges of Vehicle_Data_t, sorted by src_offset,
+// adjacent fields in both structs are merged into one range
+struct Vehicle_Data_Projection_s
+{
+    guint count;
+    gint monotonic_time_offset; // in caller struct, -1 if not requested
+    Vehicle_Data_Field_t range[];
+};
@@ -15,6 +15,7 @@
 
 gboolean as_config_log_file;
 gboolean as_config_log_stdout;
+gint as_config_udp_parse_threads;
 
 void as_read_ini_file();
 void as_init_ini_file();
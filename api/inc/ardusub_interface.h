@@ -26,26 +26,27 @@ guint8 *sys_key[255];
 system_status_t vehicle_status[255];
 control_mode_t vehicle_mode[255];
 
-// maybe a hash table is no need, a simple array is enough
-GHashTable *message_hash_table;
-GHashTable *parameter_hash_table;
-GHashTable *manual_control_table;
+// indexed by sysid, check ready before use
+Vehicle_Slot_t vehicle_slot[MAX_VEHICLE_SLOT];
 
 Vehicle_Data_t *vehicle_data_array[255];
 
+// sysid of added vehicles in add order, count is published after sysid
+guint8 active_sysid[MAX_VEHICLE_SLOT];
+volatile gint active_sysid_count;
+
 // globle mutex
 GMutex message_mutex[255];
 GMutex parameter_mutex[255];
 GMutex manual_control_mutex[255];
 GMutex vehicle_data_mutex[255];
 
-GRWLock message_hash_table_lock;
-GRWLock parameter_hash_table_lock;
-GRWLock manual_control_hash_table_lock;
+// signalled when manual control input changes
+GCond manual_control_cond[255];
 
-GAsyncQueue *statustex_queue[255];
-GAsyncQueue *named_val_float_queue[255];
-GAsyncQueue *message_queue[255];
+As_Queue_t *statustex_queue[255];
+As_Queue_t *named_val_float_queue[255];
+As_Queue_t *message_queue[255];
 
 // ------------------------------------------------------------------------------
 //   Prototypes
@@ -57,19 +58,45 @@ GAsyncQueue *message_queue[255];
 void as_api_init(const char *subnet_address, const unsigned int flag);
 void as_api_deinit();
 int as_api_check_vehicle(uint8_t sysid);
+int as_api_check_component(uint8_t sysid, uint8_t compid);
+int as_api_get_component_list(uint8_t sysid, uint8_t *compid_list, int max_count);
+int as_api_get_component_message(uint8_t sysid, uint8_t compid, uint32_t msgid,
+                                 void *msg, uint64_t *time_stamp);
+int as_api_mailbox_read(uint8_t sysid, uint32_t msgid, void *msg,
+                        uint32_t *generation, uint64_t *time_stamp);
+void as_api_send_command_long(uint8_t target_system, uint8_t target_component,
+                              uint16_t command, float param1, float param2,
+                              float param3, float param4, float param5,
+                              float param6, float param7);
 void as_api_vehicle_arm(uint8_t target_system, uint8_t target_autopilot);
 void as_api_vehicle_disarm(uint8_t target_system, uint8_t target_autopilot);
+int as_api_vehicle_arm_async(uint8_t target_system, uint8_t target_autopilot,
+                             as_api_command_callback_t callback, void *user_data);
+int as_api_vehicle_disarm_async(uint8_t target_system, uint8_t target_autopilot,
+                                as_api_command_callback_t callback, void *user_data);
 void as_api_manual_control(int16_t x, int16_t y, int16_t z, int16_t r, uint16_t buttons, ...);
 int as_api_statustex_count(uint8_t target_system);
 mavlink_statustext_t *as_api_statustex_queue_pop(uint8_t target_system);
 mavlink_named_value_float_t *as_api_named_val_float_queue_pop(guint8 target_system);
 Vehicle_Data_t *as_api_get_vehicle_data(uint8_t target_system);
 int as_api_get_vehicle_data2(uint8_t target_system, Vehicle_Data_t *vehicle_data);
+int as_api_get_fleet_snapshot(Vehicle_Data_t *vehicle_data, uint8_t *sysid, int max_count);
+Vehicle_Data_Projection_t *as_api_projection_new(const Vehicle_Data_Field_t *fields, int count);
+void as_api_projection_free(Vehicle_Data_Projection_t *projection);
+int as_api_get_vehicle_data_projection(uint8_t target_system,
+                                       const Vehicle_Data_Projection_t *projection,
+                                       void *data);
 void as_api_set_mode(uint8_t target_system, control_mode_t mode);
 void as_api_set_servo(uint8_t target_system, uint8_t target_autopilot,
                       float servo_no, float pwm);
+int as_api_set_servo_async(uint8_t target_system, uint8_t target_autopilot,
+                           float servo_no, float pwm,
+                           as_api_command_callback_t callback, void *user_data);
 void as_api_motor_test(uint8_t target_system, uint8_t target_autopilot,
                        float motor_no, float pwm);
+int as_api_motor_test_async(uint8_t target_system, uint8_t target_autopilot,
+                            float motor_no, float pwm,
+                            as_api_command_callback_t callback, void *user_data);
 void as_api_send_rc_channels_override(uint8_t target_system, uint8_t target_autopilot,
                                       uint16_t ch1, uint16_t ch2, uint16_t ch3, uint16_t ch4,
                                       uint16_t ch5, uint16_t ch6, uint16_t ch7, uint16_t ch8);
@@ -92,10 +119,13 @@ void as_system_add(guint8 target_system, guint8 target_autopilot,
                    Mavlink_Parameter_t *current_parameter,
                    GSocket *current_target_socket,
                    guint8 *current_targer_serial_port);
+void as_system_start(guint8 target_system);
+void as_system_rejoin(guint8 target_system);
 
 Mavlink_Messages_t *as_get_message(uint8_t sysid);
 
 void as_request_full_parameters(guint8 target_system, guint8 target_component);
+void as_request_full_parameters_join(guint8 target_system);
 
 void as_send_request_data_stream(guint8 target_system, guint8 target_component,
                                  guint8 req_stream_id, guint16 req_message_rate,
@@ -107,11 +137,11 @@ void as_insert_command(as_command_t as_commadn);
 //
 // func inside low leval
 
-mavlink_statustext_t *statustex_queue_pop(guint8 target_system);
+mavlink_statustext_t *statustex_queue_pop(guint8 target_system, volatile gint *worker_run);
 void statustex_queue_push(guint8 target_system, Mavlink_Messages_t *current_messages);
 
-mavlink_named_value_float_t *named_val_float_queue_pop(guint8 target_system);
+mavlink_named_value_float_t *named_val_float_queue_pop(guint8 target_system, volatile gint *worker_run);
 void named_val_float_queue_push(guint8 target_system, Mavlink_Messages_t *current_messages);
 
-Mavlink_Messages_t *message_queue_pop(guint8 target_system);
-void message_queue_push(guint8 target_system, Mavlink_Messages_t *current_messages);
+Mavlink_Messages_t *message_queue_pop(guint8 target_system, volatile gint *worker_run);
+void message_queue_push(guint8 target_system, Mavlink_Messages_t *item);
@@ -12,18 +12,41 @@
 #pragma once
 
 #include "ardusub_def.h"
+#include "ardusub_queue.h"
 
 #ifndef NO_SERISL
 #include <libserialport.h>
 #endif
 
-char *subnet_address;
+// max size of one UDP datagram
+#define MAX_UDP_DATAGRAM (65535)
+
+// max UDP sources (address and port) with own parser state
+#define MAX_UDP_SOURCE (1024)
+
+// max datagrams waiting for one parse thread, newest is dropped when full
+#define MAX_UDP_PARSE_QUEUE (1024)
 
-GHashTable *target_hash_table;
+// parser state of one UDP source, frames of different sources never mix
+typedef struct Udp_Source_s
+{
+    guint64 key;                  // IPv4 address << 16 | port
+    guint shard;                  // parse thread of this source
+    guint link_id;                // link of this source in link loss stats
+    mavlink_message_t rx_message; // parser state
+    mavlink_status_t rx_status;   // parser state
+} Udp_Source_t;
 
-GAsyncQueue *serial_write_buf_queue[MAVLINK_COMM_NUM_BUFFERS];
+typedef struct Udp_Datagram_s
+{
+    Udp_Source_t *source;
+    gsize len;
+    guint8 buf[];
+} Udp_Datagram_t;
 
-GRWLock target_hash_table_lock;
+char *subnet_address;
+
+As_Queue_t *serial_write_buf_queue[MAVLINK_COMM_NUM_BUFFERS];
 
 extern guint8 *sys_key[255];
 
@@ -35,6 +58,10 @@ void as_serial_read_init();
 void as_serial_write_init();
 #endif
 
+Udp_Source_t *as_udp_source_lookup(GSocketAddress *address);
+void as_udp_parse_datagram(Udp_Source_t *source, const guint8 *buf, gsize len);
+void udp_parse_queue_push(Udp_Source_t *source, const guint8 *buf, gsize len);
+
 gboolean as_find_new_system(mavlink_message_t message,
                             guint8 *targer_serial_chan);
 
@@ -43,6 +70,10 @@ void send_mavlink_message(guint8 target_system, mavlink_message_t *message);
 void send_heartbeat(guint8 target_system);
 void send_param_request_list(guint8 target_system, guint8 target_autopilot);
 void send_param_request_read(guint8 target_system, guint8 target_component, gint16 param_index);
+void send_param_request_read_by_id(guint8 target_system, guint8 target_component,
+                                   const gchar *param_id);
+void send_param_set(guint8 target_system, guint8 target_component,
+                    const gchar *param_id, gfloat param_value, guint8 param_type);
 
 #ifndef NO_SERISL
 gchar *serial_write_buf_queue_pop(guint8 chan);
@@ -0,0 +1,84 @@
+/**
+ * @file ardusub_latency.h
+ * @author ztluo (me@ztluo.dev)
+ * @brief
+ * @version
+ * @date 2019-06-06
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#pragma once
+
+#include "ardusub_def.h"
+
+// requests in flight of one vehicle, older ones are lost
+#define LATENCY_PROBE_IN_FLIGHT (64)
+
+// request without reply in this time is lost, in microseconds
+#define LATENCY_PROBE_TIMEOUT (1000000)
+
+// max request rate of as_api_latency_probe_start
+#define LATENCY_PROBE_MAX_RATE (100)
+
+// alarm is checked on stats of each window, in microseconds
+#define LATENCY_ALARM_WINDOW (5000000)
+
+// 4 buckets per octave up to 2^24 us
+#define LATENCY_HISTOGRAM_BUCKETS (96)
+
+typedef struct Latency_Histogram_s
+{
+    guint64 count[LATENCY_HISTOGRAM_BUCKETS];
+    guint64 total;
+    gint64 sum;
+    gint64 min;
+    gint64 max;
+} Latency_Histogram_t;
+
+typedef struct Latency_Request_s
+{
+    gboolean pending;
+    guint32 seq;
+    gint64 sent_time; // in microseconds
+} Latency_Request_t;
+
+// probe of one vehicle, guarded by its mutex
+typedef struct Latency_Probe_s
+{
+    GMutex mutex;
+    gboolean active;
+    gboolean suspended; // vehicle is lost, nothing sent until it rejoins
+    guint method;
+    gint64 interval;    // in microseconds
+    gint64 next_send;
+    guint32 seq;
+    Latency_Request_t request[LATENCY_PROBE_IN_FLIGHT];
+    guint64 sent;
+    guint64 lost;
+    Latency_Histogram_t histogram;        // since start
+    Latency_Histogram_t window_histogram; // of alarm window
+    guint64 window_sent;
+    guint64 window_lost;
+    gint64 window_start;
+    gint64 alarm_p99;   // in microseconds, 0 for no latency alarm
+    gfloat alarm_loss;  // 0 - 1, 0 for no loss alarm
+    gboolean alarm;
+    as_api_latency_alarm_callback_t callback;
+    gpointer user_data;
+} Latency_Probe_t;
+
+void as_latency_ping_received(guint8 target_system, const mavlink_ping_t *ping);
+void as_latency_timesync_received(guint8 target_system, gint64 ts1);
+void as_latency_suspend(guint8 target_system);
+void as_latency_resume(guint8 target_system);
+void as_latency_deinit();
+
+int as_api_latency_probe_start(uint8_t target_system, unsigned int method,
+                               unsigned int rate_hz, unsigned int alarm_p99_us,
+                               float alarm_loss,
+                               as_api_latency_alarm_callback_t callback,
+                               void *user_data);
+int as_api_latency_probe_stop(uint8_t target_system);
+int as_api_latency_get_stats(uint8_t target_system, Latency_Stats_t *stats);
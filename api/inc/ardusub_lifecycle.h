@@ -0,0 +1,43 @@
+/**
+ * @file ardusub_lifecycle.h
+ * @author ztluo (me@ztluo.dev)
+ * @brief
+ * @version
+ * @date 2019-06-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#pragma once
+
+#include "ardusub_def.h"
+
+// vehicle without autopilot heartbeat in this time is lost, in milliseconds
+#define VEHICLE_LOST_TIMEOUT (3000)
+
+// heartbeat timeout check interval, in microseconds
+#define LIFECYCLE_CHECK_INTERVAL (200000)
+
+// workers of vehicle to be started by lifecycle worker
+#define LIFECYCLE_START_NONE (0)
+#define LIFECYCLE_START_NEW (1)
+#define LIFECYCLE_START_REJOIN (2)
+
+// heartbeat watch of one vehicle
+typedef struct Vehicle_Lifecycle_s
+{
+    gint64 heartbeat_time; // in microseconds, guarded by message_mutex
+    volatile gint parked;  // TRUE after workers of lost vehicle are stopped
+    volatile gint start;   // LIFECYCLE_START_NEW ..., taken by lifecycle worker
+    guint32 lost_count;
+} Vehicle_Lifecycle_t;
+
+void as_lifecycle_start();
+void as_lifecycle_request_start(guint8 target_system, gboolean rejoin);
+void as_lifecycle_heartbeat(guint8 target_system, guint8 target_component);
+gboolean as_lifecycle_unpark(guint8 target_system);
+void as_lifecycle_deinit();
+
+system_status_t as_api_get_vehicle_status(uint8_t target_system);
+void as_api_set_vehicle_lost_timeout(unsigned int timeout_ms);
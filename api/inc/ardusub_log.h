@@ -15,6 +15,42 @@
 
 #define MAX_LOG_STR (512)
 
+// rate limit for repeated log sites
+#define LOG_RATE_LIMIT_BURST (5)
+#define LOG_RATE_LIMIT_INTERVAL (5000000) // in microseconds
+#define LOG_RATE_LIMIT_MAX_KEYS (1024)
+#define LOG_RATE_LIMIT_STALE (60000000) // key not seen this long is evicted, in microseconds
+
+/**
+ * @brief log with rate limit, keyed by call site plus sysid/msgid.
+ * 
+ * the first LOG_RATE_LIMIT_BURST messages of a key are logged as usual,
+ * after that at most one message per LOG_RATE_LIMIT_INTERVAL is logged,
+ * carrying the count of messages suppressed since the last one. counts
+ * with no later message are logged by a timer, and at deinit.
+ */
+#define as_log_rate_limited(log_level, sysid, msgid, format, ...)          \
+    do                                                                  \
+    {                                                                   \
+        guint suppressed_count_ = 0;                                    \
+        if (TRUE == as_log_rate_limit_check(G_LOG_DOMAIN, (log_level),  \
+                                            G_STRLOC, (sysid), (msgid), \
+                                            &suppressed_count_))        \
+        {                                                               \
+            if (0 == suppressed_count_)                                 \
+            {                                                           \
+                g_log(G_LOG_DOMAIN, (log_level),                        \
+                      format, ##__VA_ARGS__);                           \
+            }                                                           \
+            else                                                        \
+            {                                                           \
+                g_log(G_LOG_DOMAIN, (log_level),                        \
+                      format " (%u similar messages suppressed)",       \
+                      ##__VA_ARGS__, suppressed_count_);                \
+            }                                                           \
+        }                                                               \
+    } while (0)
+
 void my_log_handler(const gchar *log_domain,
                     GLogLevelFlags log_level,
                     const gchar *message,
@@ -23,12 +59,18 @@ void my_log_handler(const gchar *log_domain,
 void as_set_log_handler();
 
 gchar *pop_log_str();
+void wake_log_str();
 void push_log_str(gchar *log_str);
 
 void log_to_file(const gchar *log_domain,
                  GLogLevelFlags log_level,
                  const gchar *message,
                  gpointer unused_data);
+gboolean as_log_rate_limit_check(const gchar *log_domain, GLogLevelFlags log_level,
+                                 const gchar *call_site, guint8 sysid,
+                                 guint32 msgid, guint *suppressed_count);
+void as_log_rate_limit_deinit();
+
 void log_to_stdout(const gchar *log_domain,
                    GLogLevelFlags log_level,
                    const gchar *message,
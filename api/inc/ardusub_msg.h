@@ -14,9 +14,133 @@
 #include "ardusub_def.h"
 #include "ardusub_interface.h"
 
-guint8 as_handle_messages(mavlink_message_t message);
+// all msgid handled by this api are less than this,
+// msgid out of range is handled as unknown msgid.
+#define MSG_DISPATCH_TABLE_SIZE (256)
+
+// max user handlers for one msgid
+#define MSG_DISPATCH_MAX_HANDLER (16)
+
+// decode message into storage slot
+typedef void (*as_msg_decode_func_t)(const mavlink_message_t *message,
+                                     gpointer storage);
+
+// built-in handler, called after decode with message_mutex locked
+typedef void (*as_msg_builtin_func_t)(guint8 target_system,
+                                      Mavlink_Messages_t *current_messages,
+                                      Mavlink_Parameter_t *current_parameter);
+
+// copy of a decoded struct, packed struct is never larger than payload
+typedef union Msg_Decoded_u
+{
+    guint8 data[MAVLINK_MAX_PAYLOAD_LEN];
+    guint64 align;
+} Msg_Decoded_t;
+
+// user handler, called after decode without lock held,
+// decoded is a copy on stack of the I/O thread
+typedef void (*as_msg_handler_func_t)(guint8 target_system,
+                                      guint8 target_component,
+                                      guint32 msgid,
+                                      gconstpointer decoded,
+                                      gpointer user_data);
+
+typedef struct Msg_Handler_s
+{
+    as_msg_handler_func_t func;
+    gpointer user_data;
+} Msg_Handler_t;
+
+typedef struct Msg_Dispatch_Entry_s
+{
+    gboolean known;               // FALSE for unknown msgid
+    volatile gint enabled;        // FALSE to skip before decode
+    as_msg_decode_func_t decode;  // NULL for known but unhandled msgid
+    glong storage_offset;         // storage slot in Mavlink_Messages_t
+    gsize storage_size;           // size of decoded struct
+    glong time_stamp_offset;      // time stamp in Mavlink_Messages_t, -1 for none
+    gboolean queue_push;          // push to message_queue after decode
+    as_msg_builtin_func_t builtin;
+    volatile gint handler_count;
+    Msg_Handler_t handlers[MSG_DISPATCH_MAX_HANDLER];
+} Msg_Dispatch_Entry_t;
+
+// raw frame of one msgid, only len and payload are kept
+typedef struct Msg_Lazy_s
+{
+    gboolean pending; // TRUE if raw frame is newer than decoded storage
+    mavlink_message_t message;
+} Msg_Lazy_t;
+
+typedef struct Msg_Lazy_Set_s
+{
+    Msg_Lazy_t *lazy[MSG_DISPATCH_TABLE_SIZE];
+} Msg_Lazy_Set_t;
+
+// newest decoded msg of one msgid, seqlock: sequence is odd while written,
+// written with message_mutex of this sysid locked.
+typedef struct Msg_Mailbox_Slot_s
+{
+    volatile gint sequence;
+    guint64 time_stamp;
+    guint8 data[];
+} Msg_Mailbox_Slot_t;
+
+typedef struct Msg_Mailbox_s
+{
+    Msg_Mailbox_Slot_t *slot[MSG_DISPATCH_TABLE_SIZE]; // NULL for msgid not decoded
+    volatile gint post_count; // changed by every post
+    volatile gint waiting;    // readers in as_msg_mailbox_wait, post skips signal if 0
+    GMutex mutex;
+    GCond cond;               // broadcast on post with a waiting reader, and on wake
+} Msg_Mailbox_t;
+
+// generation of each msgid seen by a reader, for msg changed since last read
+typedef struct Msg_Mailbox_Reader_s
+{
+    guint next_msgid;
+    guint32 generation[MSG_DISPATCH_TABLE_SIZE];
+    gint post_count;             // post_count of mailbox at end of last wait
+    Mavlink_Messages_t messages; // msg read is decoded here
+} Msg_Mailbox_Reader_t;
+
+// seqlock reads retried this many times before yielding to the writer
+#define MSG_MAILBOX_SPIN (16)
+
+guint8 as_handle_messages(mavlink_message_t message, guint link_id);
+gint as_component_add(guint8 target_system, guint8 target_component);
 void as_handle_message_id(mavlink_message_t message,
                           Mavlink_Messages_t *current_messages,
                           Mavlink_Parameter_t *current_parameter);
 void as_handle_named_value_float(guint8 target_system,
                                 Mavlink_Messages_t *current_messages);
+
+void as_msg_dispatch_init();
+void as_msg_dispatch_register(guint32 msgid,
+                              as_msg_decode_func_t decode,
+                              glong storage_offset,
+                              gsize storage_size,
+                              glong time_stamp_offset,
+                              gboolean queue_push,
+                              as_msg_builtin_func_t builtin);
+void as_msg_dispatch_set_enabled(guint32 msgid, gboolean enabled);
+gsize as_msg_dispatch_storage_size(guint32 msgid);
+void as_msg_lazy_decode(guint32 msgid, Mavlink_Messages_t *current_messages);
+gboolean as_msg_dispatch_copy(guint32 msgid,
+                              Mavlink_Messages_t *current_messages,
+                              gpointer msg,
+                              guint64 *time_stamp);
+Msg_Mailbox_t *as_msg_mailbox_new();
+gint as_msg_mailbox_read(Msg_Mailbox_t *mailbox, guint32 msgid, gpointer msg,
+                         guint32 *generation, guint64 *time_stamp);
+Mavlink_Messages_t *as_msg_mailbox_next(Msg_Mailbox_t *mailbox,
+                                        Msg_Mailbox_Reader_t *reader);
+void as_msg_mailbox_wait(Msg_Mailbox_t *mailbox, Msg_Mailbox_Reader_t *reader,
+                         volatile gint *worker_run);
+void as_msg_mailbox_wake(Msg_Mailbox_t *mailbox);
+gboolean as_msg_dispatch_add_handler(guint32 msgid,
+                                     as_msg_handler_func_t func,
+                                     gpointer user_data);
+gboolean as_msg_dispatch_remove_handler(guint32 msgid,
+                                        as_msg_handler_func_t func,
+                                        gpointer user_data);
@@ -0,0 +1,96 @@
+/**
+ * @file ardusub_param.h
+ * @author ztluo (me@ztluo.dev)
+ * @brief
+ * @version
+ * @date 2019-05-29
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#pragma once
+
+#include "ardusub_def.h"
+
+// window of PARAM_REQUEST_READ in flight, grows by one on each reply,
+// halves on each timeout
+#define PARAM_SYNC_MIN_WINDOW (4)
+#define PARAM_SYNC_MAX_WINDOW (32)
+
+// PARAM_REQUEST_READ timeout and max attempts of one index
+#define PARAM_SYNC_TIMEOUT (500000) // in microseconds
+#define PARAM_SYNC_RETRIES (5)
+
+// stream of PARAM_REQUEST_LIST is taken as finished after this idle time
+#define PARAM_SYNC_STREAM_IDLE (300000) // in microseconds
+
+// PARAM_REQUEST_LIST is resent if no PARAM_VALUE in this time
+#define PARAM_SYNC_LIST_TIMEOUT (3000000) // in microseconds
+#define PARAM_SYNC_LIST_RETRIES (3)
+
+// hash of all parameters, read by name, value is int32 in float bits
+#define PARAM_HASH_CHECK_ID "_HASH_CHECK"
+
+// max wait of _HASH_CHECK, in microseconds
+#define PARAM_HASH_CHECK_TIMEOUT (1000000)
+
+// parameter cache of a vehicle, by sysid, autopilot and type in HEARTBEAT
+#define PARAM_CACHE_FILE "param_cache_%d_%d_%d.ini"
+
+// PARAM_SET timeout of echoed PARAM_VALUE and max attempts
+#define PARAM_SET_TIMEOUT (1000000) // in microseconds
+#define PARAM_SET_RETRIES (3)
+
+typedef struct Param_Request_s
+{
+    guint16 index;
+    guint8 attempts;
+    gint64 sent_time;
+} Param_Request_t;
+
+// as_api_param_set waiting for echoed PARAM_VALUE
+typedef struct Param_Set_Wait_s
+{
+    char param_id[16];
+    gboolean done;
+    gfloat value; // echoed value
+} Param_Set_Wait_t;
+
+// parameter download of one vehicle, guarded by its mutex
+typedef struct Param_Sync_s
+{
+    GMutex mutex;
+    GCond cond;               // broadcast on PARAM_VALUE and stop
+    GList *set_wait;          // Param_Set_Wait_t
+    volatile gint state;      // AS_PARAM_SYNC_IDLE ...
+    guint16 param_count;      // from PARAM_VALUE, 0 until first one
+    guint16 received_count;
+    guint8 *received;         // bitmap of param_count bits
+    gint64 start_time;
+    gint64 last_receive_time;
+    gboolean streaming;       // PARAM_REQUEST_LIST stream not finished
+    gboolean hash_received;   // _HASH_CHECK of vehicle
+    guint32 vehicle_hash;
+    guint window;
+    guint outstanding_count;
+    Param_Request_t outstanding[PARAM_SYNC_MAX_WINDOW];
+    guint16 next_index;       // gap scan position
+    as_api_param_progress_callback_t callback;
+    gpointer user_data;
+} Param_Sync_t;
+
+void as_param_sync_received(guint8 target_system,
+                            const mavlink_param_value_t *param_value);
+void as_param_sync_run(guint8 target_system, guint8 target_component);
+void as_param_sync_stop(guint8 target_system);
+void as_param_sync_start(guint8 target_system, guint8 target_component);
+void as_param_index_update(guint8 target_system, guint16 param_index);
+
+int as_api_param_get(uint8_t target_system, const char *param_id, float *value);
+int as_api_param_set(uint8_t target_system, const char *param_id, float value);
+
+int as_api_param_sync(uint8_t target_system,
+                      as_api_param_progress_callback_t callback, void *user_data);
+int as_api_param_sync_progress(uint8_t target_system,
+                               uint16_t *received, uint16_t *count);
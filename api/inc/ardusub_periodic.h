@@ -0,0 +1,48 @@
+/**
+ * @file ardusub_periodic.h
+ * @author ztluo (me@ztluo.dev)
+ * @brief
+ * @version
+ * @date 2019-06-02
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#pragma once
+
+#include "ardusub_def.h"
+
+// max periodic executors alive at the same time
+#define MAX_PERIODIC (16)
+
+// shortest period of as_api_periodic_start, in microseconds
+#define PERIODIC_MIN_PERIOD (100)
+
+// stack touched before first cycle, no page fault in loop with mlock
+#define PERIODIC_PREFAULT_STACK (64 * 1024)
+
+typedef struct Periodic_s
+{
+    volatile gint active;
+    volatile gint id;          // generation id, changes when slot is reused
+    volatile gint run;
+    GThread *thread;
+    guint8 target_system;
+    gint64 period;             // in nanoseconds
+    guint options;
+    gint priority;             // SCHED_FIFO priority
+    gint cpu;                  // -1 for no pinning
+    as_api_periodic_callback_t callback;
+    gpointer user_data;
+    GMutex stats_mutex;
+    Periodic_Stats_t stats;
+} Periodic_t;
+
+int as_api_periodic_start(uint8_t target_system, unsigned int period_us,
+                          as_api_periodic_callback_t callback, void *user_data,
+                          unsigned int options, int priority, int cpu);
+int as_api_periodic_stop(int periodic_id);
+int as_api_periodic_get_stats(int periodic_id, Periodic_Stats_t *stats);
+
+void as_periodic_deinit();
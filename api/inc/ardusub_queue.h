@@ -0,0 +1,60 @@
+/**
+ * @file ardusub_queue.h
+ * @author ztluo (me@ztluo.dev)
+ * @brief
+ * @version
+ * @date 2019-05-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#pragma once
+
+// included by ardusub_io.h, only depends on glib and public api
+#include <glib.h>
+#include "ardusub_api.h"
+
+typedef enum queue_push_enum
+{
+    QUEUE_PUSHED = 0,
+    QUEUE_DROPPED_OLDEST, // pushed, oldest item freed
+    QUEUE_DROPPED_NEWEST, // not pushed, item freed
+    QUEUE_COALESCED,      // replaced queued item with same key
+} queue_push_t;
+
+// policy and capacity of one kind of queue, read on every push
+typedef struct As_Queue_Config_s
+{
+    volatile gint policy;     // AS_QUEUE_DROP_OLDEST ...
+    volatile gint capacity;
+    volatile gint timeout_ms; // for AS_QUEUE_BLOCK
+} As_Queue_Config_t;
+
+// bounded queue of g_malloc items, freed with g_free when dropped
+typedef struct As_Queue_s
+{
+    guint kind;            // AS_QUEUE_MESSAGE ...
+    GMutex mutex;
+    GCond cond;            // signalled on pop, for AS_QUEUE_BLOCK
+    GCond not_empty;       // signalled on push and on wake, for waiting pop
+    guint pop_waiting;     // readers waiting on not_empty
+    GQueue queue;
+    GHashTable *key_index; // item -> its link, for AS_QUEUE_COALESCE
+    gpointer last_pop;     // freed on next as_queue_pop_last
+} As_Queue_t;
+
+As_Queue_t *as_queue_new(guint kind);
+queue_push_t as_queue_push(As_Queue_t *queue, gpointer item, gint *depth);
+gpointer as_queue_try_pop(As_Queue_t *queue);
+gpointer as_queue_pop_last(As_Queue_t *queue);
+gpointer as_queue_wait_pop_last(As_Queue_t *queue, volatile gint *worker_run);
+void as_queue_wake(As_Queue_t *queue);
+gint as_queue_length(As_Queue_t *queue);
+void as_queue_clear(As_Queue_t *queue);
+
+gint as_queue_policy_from_string(const gchar *policy);
+const gchar *as_queue_name(guint kind);
+
+int as_api_set_queue_policy(unsigned int queue, unsigned int policy,
+                            unsigned int capacity, unsigned int timeout_ms);
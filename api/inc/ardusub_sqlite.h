@@ -24,6 +24,9 @@ typedef struct as_command_s
     float attitude_hold_roll;
     uint8_t flip_trick_type;
     float flip_trick_value;
+    float control_setpoint;
+    float control_error;
+    float control_output;
 } as_command_t;
 
 #include <sqlite3.h>
@@ -38,3 +41,5 @@ void as_sql_test_start(const gchar *test_info, const gchar *test_note);
 void as_sql_test_stop();
 void as_sql_check_command_table();
 void as_sql_insert_command(as_command_t as_command);
+void as_sql_check_link_loss_table();
+void as_sql_insert_link_loss(const Link_Loss_Stats_t *link_loss_stats);
@@ -0,0 +1,115 @@
+/**
+ * @file ardusub_stats.h
+ * @author ztluo (me@ztluo.dev)
+ * @brief
+ * @version
+ * @date 2019-05-20
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#pragma once
+
+#include "ardusub_def.h"
+#include "ardusub_interface.h"
+
+// max links tracked for one component, e.g. UDP and serial at the same time
+#define MAX_LINK_PER_COMPONENT (4)
+
+// seq gap at least this is taken as a late frame, not a loss
+#define LINK_LOSS_MAX_GAP (128)
+
+// consecutive frames out of LINK_LOSS_MAX_GAP to resync seq, e.g. sender restarted
+#define LINK_LOSS_RESYNC (3)
+
+// loss rate window, in microseconds
+#define LINK_LOSS_WINDOW (1000000)
+
+// interval of link_loss rows in database, in microseconds
+#define LINK_LOSS_DB_INTERVAL (1000000)
+
+// min interval of rates in Link_Stats_t, in microseconds
+#define LINK_STATS_RATE_WINDOW (1000000)
+
+typedef enum stats_queue_enum
+{
+    STATS_QUEUE_MESSAGE = 0,
+    STATS_QUEUE_STATUSTEX,
+    STATS_QUEUE_NAMED_VAL_FLOAT,
+    STATS_QUEUE_COUNT
+} stats_queue_t;
+
+typedef enum stats_drop_enum
+{
+    STATS_DROP_NOT_READY = 0,
+    STATS_DROP_COMPONENT,
+    STATS_DROP_MESSAGE,
+    STATS_DROP_STATUSTEX,
+    STATS_DROP_NAMED_VAL_FLOAT,
+    STATS_DROP_SUBSCRIBE_TASK,
+    STATS_DROP_COUNT
+} stats_drop_t;
+
+typedef enum stats_global_drop_enum
+{
+    STATS_DROP_UDP_SOURCE = 0,
+    STATS_DROP_UDP_PARSE_QUEUE,
+    STATS_GLOBAL_DROP_COUNT
+} stats_global_drop_t;
+
+// counters of one sysid, updated with atomic add on hot path,
+// gsize is 64 bits on 64 bits platforms.
+typedef struct Pipeline_Counter_s
+{
+    volatile gsize msg_received[LINK_STATS_MSGID_COUNT + 1]; // last one for msgid out of range
+    volatile gsize bytes_in;
+    volatile gsize bytes_out;
+    volatile gsize parse_errors;
+    volatile gint queue_high[STATS_QUEUE_COUNT];
+    volatile gsize drop[STATS_DROP_COUNT];
+} Pipeline_Counter_t;
+
+// last sample of counters, for rates
+typedef struct Pipeline_Rate_s
+{
+    gint64 sample_time;
+    gsize msg_received[LINK_STATS_MSGID_COUNT];
+    gsize bytes_in;
+    gsize bytes_out;
+    gfloat interval;
+    gfloat msg_rate[LINK_STATS_MSGID_COUNT];
+    gfloat bytes_in_rate;
+    gfloat bytes_out_rate;
+} Pipeline_Rate_t;
+
+typedef struct Link_Loss_s
+{
+    gboolean used;
+    gboolean seq_valid;      // FALSE until first frame
+    guint8 last_seq;
+    guint8 out_of_range;     // consecutive frames out of LINK_LOSS_MAX_GAP
+    gint64 window_start;     // monotonic time, in microseconds
+    guint64 window_received;
+    guint64 window_lost;
+    Link_Loss_Stats_t stats; // copied out by as_api_get_link_loss
+} Link_Loss_t;
+
+guint as_link_id_new();
+void as_link_loss_frame(guint link_id, const mavlink_message_t *message, gint index);
+void as_link_loss_crc_failed(guint link_id, guint8 target_system, guint8 target_component);
+
+int as_api_get_link_loss(uint8_t sysid, Link_Loss_Stats_t *stats, int max_count);
+
+void as_stats_frame(const mavlink_message_t *message);
+void as_stats_parse_error(guint8 target_system);
+void as_stats_bytes_out(guint8 target_system, gsize len);
+void as_stats_queue_depth(guint8 target_system, stats_queue_t queue, gint depth);
+void as_stats_drop(guint8 target_system, stats_drop_t drop);
+void as_stats_drop_global(stats_global_drop_t drop);
+#ifndef NO_SERISL
+void as_stats_serial_queue_depth(guint8 chan, gint depth);
+void as_stats_serial_drop(guint8 chan);
+#endif
+
+int as_api_get_link_stats(uint8_t sysid, Link_Stats_t *stats);
@@ -0,0 +1,57 @@
+/**
+ * @file ardusub_stream.h
+ * @author ztluo (me@ztluo.dev)
+ * @brief
+ * @version
+ * @date 2019-05-30
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#pragma once
+
+#include "ardusub_def.h"
+
+// profiles, built-in ones included
+#define MAX_STREAM_PROFILE (16)
+#define MAX_STREAM_PROFILE_NAME (32)
+
+// legacy, default and control
+#define STREAM_PROFILE_BUILTIN (3)
+
+// explicit rates of one profile
+#define MAX_STREAM_RATE (32)
+
+// SET_MESSAGE_INTERVAL timeout of each attempt and resend count
+#define STREAM_COMMAND_TIMEOUT (500) // in milliseconds
+#define STREAM_COMMAND_RETRIES (2)
+
+typedef struct Stream_Profile_s
+{
+    gchar name[MAX_STREAM_PROFILE_NAME];
+    gboolean legacy; // REQUEST_DATA_STREAM groups instead of message intervals
+    guint count;
+    Stream_Rate_t rate[MAX_STREAM_RATE];
+    gfloat other_rate_hz; // rate of other telemetry messages, < 0 to keep
+} Stream_Profile_t;
+
+// SET_MESSAGE_INTERVAL of one vehicle, one command in flight at a time
+typedef struct Stream_Apply_s
+{
+    guint8 target_system;
+    guint8 target_component;
+    gchar name[MAX_STREAM_PROFILE_NAME];
+    guint count;
+    guint next; // index of next one to send
+    guint accepted;
+    Stream_Rate_t rate[MAX_STREAM_RATE * 2];
+    gint64 start_time;
+} Stream_Apply_t;
+
+gboolean as_stream_start(guint8 target_system, guint8 target_component);
+
+int as_api_add_stream_profile(const char *name, const Stream_Rate_t *rate,
+                              int count, float other_rate_hz);
+int as_api_set_stream_profile(const char *name);
+int as_api_apply_stream_profile(uint8_t target_system);
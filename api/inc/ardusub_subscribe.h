@@ -0,0 +1,56 @@
+/**
+ * @file ardusub_subscribe.h
+ * @author ztluo (me@ztluo.dev)
+ * @brief
+ * @version
+ * @date 2019-05-08
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#pragma once
+
+#include "ardusub_msg.h"
+
+// max subscriptions alive at the same time
+#define MAX_SUBSCRIPTION (256)
+
+// worker executors, one thread each, so one subscription keeps msg order
+#define SUBSCRIBE_WORKER_COUNT (2)
+
+// max pending tasks of one worker executor, newest task is dropped when full
+#define MAX_SUBSCRIBE_WORKER_TASK (1024)
+
+typedef struct Subscription_s
+{
+    volatile gint active;
+    volatile gint id;           // generation id, changes when slot is reused
+    volatile gint running;      // dispatches and worker tasks in flight
+    guint8 sysid;               // 0 for all vehicles
+    guint8 compid;              // 0 for primary component
+    guint32 msgid;
+    as_api_subscribe_callback_t callback;
+    gpointer user_data;
+    guint options;
+    struct Subscription_s *next; // next subscription of same msgid
+} Subscription_t;
+
+typedef struct Subscribe_Task_s
+{
+    Subscription_t *subscription;
+    gint id;
+    guint8 target_system;
+    guint32 msgid;
+    guint8 msg[];               // copy of decoded struct
+} Subscribe_Task_t;
+
+int as_api_subscribe(uint8_t sysid, uint32_t msgid,
+                     as_api_subscribe_callback_t callback,
+                     void *user_data, unsigned int options);
+int as_api_subscribe_component(uint8_t sysid, uint8_t compid, uint32_t msgid,
+                               as_api_subscribe_callback_t callback,
+                               void *user_data, unsigned int options);
+int as_api_unsubscribe(int subscription_id);
+
+void as_subscribe_deinit();
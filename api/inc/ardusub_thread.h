@@ -13,15 +13,17 @@
 
 #include "ardusub_def.h"
 
-// TODO: command watch thread
-// check command ack msg
+// max udp parse threads, set by [udp] parse_threads in ini file
+#define MAX_UDP_PARSE_THREAD (16)
+
+// serial port read blocks at most this, so serial thread sees shutdown, in milliseconds
+#define SERIAL_READ_TIMEOUT (10)
 
 //
 // thread ptr
 GMainLoop *as_main_loop;
 GThread *manual_control_thread[255];
-GThread *parameters_request_thread;
-GThread *request_data_stream_thread;
+GThread *parameters_request_thread[255];
 GThread *named_val_float_handle_thread[255];
 GThread *vehicle_data_update_thread[255];
 GThread *db_update_thread[255];
@@ -29,10 +31,16 @@ GThread *statustex_wall_thread[255];
 GThread *heartbeat_thread[255];
 GThread *log_str_write_thread;
 GThread *as_api_main_thread;
+GThread *udp_parse_thread[MAX_UDP_PARSE_THREAD];
+GThread *db_insert_command_thread;
+#ifndef NO_SERISL
+GThread *serial_port_thread[MAVLINK_COMM_NUM_BUFFERS];
+#endif
 
 //
 // thread running flag
 volatile gint manual_control_worker_run[255];
+volatile gint parameters_request_worker_run[255];
 volatile gint named_val_float_handle_worker_run[255];
 volatile gint vehicle_data_update_worker_run[255];
 volatile gint db_update_worker_run[255];
@@ -40,15 +48,29 @@ volatile gint statustex_wall_worker_run[255];
 volatile gint heartbeat_worker_run[255];
 volatile gint log_str_write_worker_run;
 
+// datagrams waiting for each udp parse thread
+GAsyncQueue *udp_parse_queue[MAX_UDP_PARSE_THREAD];
+
+// commands waiting for db_insert_command_worker
+GAsyncQueue *db_insert_command_queue;
+
 void as_thread_init_ptr_flag();
 void as_thread_stop_all_join();
+void as_thread_init_vehicle_flag(guint8 target_system);
+void as_thread_stop_vehicle_join(guint8 target_system);
 void as_thread_msleep(gint ms);
+void as_thread_shutdown();
+gboolean as_thread_shutdown_requested();
+void as_thread_main_loop_ready(GMainLoop *main_loop);
+void as_thread_wait_main_loop();
+void as_thread_manual_control_wake(guint8 target_system);
+void db_insert_command_queue_push(gpointer as_command);
+void as_api_set_manual_control_rate(unsigned int rate_hz, unsigned int min_interval_ms);
 
 //
 // thread worker func
 gpointer manual_control_worker(gpointer data);
 gpointer parameters_request_worker(gpointer data);
-gpointer request_data_stream_worker(gpointer data);
 gpointer named_val_float_handle_worker(gpointer data);
 gpointer vehicle_data_update_worker(gpointer data);
 gpointer db_update_worker(gpointer data);
@@ -56,9 +78,10 @@ gpointer log_str_write_worker(gpointer data);
 gpointer db_insert_command_worker(gpointer data);
 gpointer statustex_wall_worker(gpointer data);
 gpointer heartbeat_worker(gpointer data);
+gpointer udp_parse_worker(gpointer data);
 gboolean udp_read_callback(GIOChannel *channel,
                            GIOCondition condition,
-                           gpointer socket_udp_write); // udp read worker
+                           gpointer socket_udp_read); // udp read worker
 
 #ifndef NO_SERISL
 gpointer serial_port_read_write_worker(gpointer data);
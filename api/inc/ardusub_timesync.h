@@ -0,0 +1,72 @@
+/**
+ * @file ardusub_timesync.h
+ * @author ztluo (me@ztluo.dev)
+ * @brief
+ * @version
+ * @date 2019-06-05
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#pragma once
+
+#include "ardusub_def.h"
+
+// TIMESYNC request interval, fast one until offset is estimated
+#define TIMESYNC_INTERVAL (1000000)     // in microseconds
+#define TIMESYNC_FAST_INTERVAL (100000) // in microseconds
+
+// samples kept for offset and skew fit
+#define TIMESYNC_WINDOW (32)
+
+// synced after this many samples
+#define TIMESYNC_MIN_SAMPLES (4)
+
+// skew is fitted only if samples span at least this, in nanoseconds
+#define TIMESYNC_MIN_SPAN (2000000000)
+
+// reply with longer round trip is dropped, in nanoseconds
+#define TIMESYNC_MAX_RTT (50000000)
+
+// sample with round trip above 2 * min + margin is not used in fit, in nanoseconds
+#define TIMESYNC_RTT_MARGIN (1000000)
+
+// offset jump of vehicle reboot, window is restarted, in nanoseconds
+#define TIMESYNC_RESET_THRESHOLD (1000000000)
+
+typedef struct Timesync_Sample_s
+{
+    gint64 host_time; // in nanoseconds, host time of reply
+    gint64 offset;    // in nanoseconds, vehicle time - host time
+    gint64 rtt;       // in nanoseconds
+} Timesync_Sample_t;
+
+// clock estimate of one vehicle, guarded by its mutex,
+// vehicle time = host time + offset + skew * (host time - ref_time)
+typedef struct Timesync_s
+{
+    GMutex mutex;
+    gint64 next_send;     // in microseconds
+    guint count;
+    guint next;           // ring index of next sample
+    Timesync_Sample_t sample[TIMESYNC_WINDOW];
+    gboolean synced;
+    gint64 ref_time;      // in nanoseconds
+    gint64 offset;        // in nanoseconds, at ref_time
+    gdouble skew;
+    gint64 rtt_min;       // in nanoseconds, of window
+    gint64 rtt_last;
+    guint32 samples;
+    guint32 rejected;
+} Timesync_t;
+
+void as_timesync_start();
+void as_timesync_received(guint8 target_system, const mavlink_timesync_t *timesync_msg);
+void as_timesync_deinit();
+
+int as_api_timesync_get_stats(uint8_t target_system, Timesync_Stats_t *stats);
+int as_api_vehicle_to_host_time(uint8_t target_system, uint64_t vehicle_time_us,
+                                int64_t *host_time_us);
+int as_api_host_to_vehicle_time(uint8_t target_system, int64_t host_time_us,
+                                uint64_t *vehicle_time_us);
@@ -0,0 +1,492 @@
+/**
+ * @file ardusub_command.c
+ * @author ztluo (me@ztluo.dev)
+ * @brief COMMAND_LONG in flight, matched with COMMAND_ACK, retried on timeout.
+ * @version
+ * @date 2019-05-27
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#define G_LOG_DOMAIN "[ardusub command   ]"
+
+#include "../inc/ardusub_command.h"
+#include "../inc/ardusub_interface.h"
+
+// slots are never freed, same as subscriptions
+static Command_t command_in_flight[MAX_COMMAND_IN_FLIGHT];
+static GMutex command_mutex;
+static GCond command_cond; // signalled on new command and stop
+static GThread *command_thread;
+static volatile gint command_worker_run;
+
+static void as_command_ack_handler(guint8 target_system,
+                                   guint8 target_component,
+                                   guint32 msgid,
+                                   gconstpointer decoded,
+                                   gpointer user_data);
+static gpointer command_worker(gpointer data);
+
+/**
+ * @brief encode and send COMMAND_LONG.
+ *
+ * @param cmd
+ */
+static void as_command_send(const mavlink_command_long_t *cmd)
+{
+    mavlink_message_t message;
+    mavlink_msg_command_long_encode(STATION_SYSYEM_ID, STATION_COMPONENT_ID, &message, cmd);
+
+    send_mavlink_message(cmd->target_system, &message);
+}
+
+/**
+ * @brief call callback of a finished command, without command_mutex locked.
+ *
+ * @param finished copy of slot
+ * @param target_component
+ * @param result
+ */
+static void as_command_finish(const Command_t *finished,
+                              guint8 target_component, gint result)
+{
+    if (NULL != finished->callback)
+    {
+        finished->callback(finished->cmd.target_system, target_component,
+                           finished->cmd.command, result, finished->user_data);
+    }
+}
+
+/**
+ * @brief send COMMAND_LONG and track it until COMMAND_ACK, resend with
+ * confirmation + 1 on timeout. only one command of the same id can be
+ * in flight to a component.
+ *
+ * @param target_system
+ * @param target_component
+ * @param command MAV_CMD
+ * @param param param1 - param7, NULL for all 0
+ * @param timeout_ms per attempt, 0 for COMMAND_TIMEOUT
+ * @param retries resend count after first attempt
+ * @param callback NULL-able, called once with MAV_RESULT or AS_COMMAND_TIMEOUT ...
+ * @param user_data
+ * @return int command id, 0 for failed and callback is not called
+ */
+int as_api_command_long_async(uint8_t target_system, uint8_t target_component,
+                              uint16_t command, const float *param,
+                              unsigned int timeout_ms, unsigned int retries,
+                              as_api_command_callback_t callback, void *user_data)
+{
+    if (0 == as_api_check_component(target_system, target_component))
+    {
+        g_warning("no component id:%d of vehicle id:%d, in file: %s, func: %s, line: %d",
+                  target_component, target_system, __FILE__, __FUNCTION__, __LINE__);
+        return 0;
+    }
+
+    g_mutex_lock(&command_mutex);
+
+    if (NULL == command_thread)
+    {
+        if (FALSE == as_msg_dispatch_add_handler(MAVLINK_MSG_ID_COMMAND_ACK,
+                                                 &as_command_ack_handler, NULL))
+        {
+            g_mutex_unlock(&command_mutex);
+            return 0;
+        }
+
+        g_atomic_int_set(&command_worker_run, 1);
+        command_thread = g_thread_new("command_worker", &command_worker, NULL);
+    }
+
+    gint index = -1;
+    for (gint i = 0; i < MAX_COMMAND_IN_FLIGHT; i++)
+    {
+        Command_t *in_flight = command_in_flight + i;
+
+        if (FALSE == in_flight->active)
+        {
+            if (0 > index)
+            {
+                index = i;
+            }
+            continue;
+        }
+
+        // ack carries only command id, can not tell two of them apart
+        if (in_flight->cmd.target_system == target_system &&
+            in_flight->cmd.target_component == target_component &&
+            in_flight->cmd.command == command)
+        {
+            g_mutex_unlock(&command_mutex);
+            g_warning("command %d to vehicle id:%d component id:%d is in flight.",
+                      command, target_system, target_component);
+            return 0;
+        }
+    }
+
+    if (0 > index)
+    {
+        g_mutex_unlock(&command_mutex);
+        g_warning("MAX_COMMAND_IN_FLIGHT reached!");
+        return 0;
+    }
+
+    Command_t *my_command = command_in_flight + index;
+
+    memset(&my_command->cmd, 0, sizeof(mavlink_command_long_t));
+    my_command->cmd.target_system = target_system;
+    my_command->cmd.target_component = target_component;
+    my_command->cmd.command = command;
+    my_command->cmd.confirmation = 0;
+
+    if (NULL != param)
+    {
+        my_command->cmd.param1 = param[0];
+        my_command->cmd.param2 = param[1];
+        my_command->cmd.param3 = param[2];
+        my_command->cmd.param4 = param[3];
+        my_command->cmd.param5 = param[4];
+        my_command->cmd.param6 = param[5];
+        my_command->cmd.param7 = param[6];
+    }
+
+    my_command->timeout =
+        (gint64)((0 == timeout_ms) ? COMMAND_TIMEOUT : timeout_ms) * G_TIME_SPAN_MILLISECOND;
+    my_command->deadline = g_get_monotonic_time() + my_command->timeout;
+    my_command->retries = retries;
+    my_command->in_progress = FALSE;
+    my_command->callback = callback;
+    my_command->user_data = user_data;
+
+    // id = generation * MAX_COMMAND_IN_FLIGHT + index, stale id never matches a reused slot
+    gint generation = g_atomic_int_get(&my_command->id) / MAX_COMMAND_IN_FLIGHT + 1;
+    if (generation >= G_MAXINT / MAX_COMMAND_IN_FLIGHT)
+    {
+        generation = 1;
+    }
+
+    g_atomic_int_set(&my_command->id, generation * MAX_COMMAND_IN_FLIGHT + index);
+    g_atomic_int_set(&my_command->active, TRUE);
+
+    mavlink_command_long_t cmd = my_command->cmd;
+    gint id = my_command->id;
+
+    // worker waits until next deadline
+    g_cond_signal(&command_cond);
+
+    g_mutex_unlock(&command_mutex);
+
+    as_command_send(&cmd);
+
+    return id;
+}
+
+/**
+ * @brief as_command_wait_callback
+ *
+ * @param target_system
+ * @param target_component
+ * @param command
+ * @param result
+ * @param user_data Command_Wait_t
+ */
+static void as_command_wait_callback(uint8_t target_system G_GNUC_UNUSED,
+                                     uint8_t target_component G_GNUC_UNUSED,
+                                     uint16_t command G_GNUC_UNUSED,
+                                     int result,
+                                     void *user_data)
+{
+    Command_Wait_t *wait = user_data;
+
+    g_mutex_lock(&wait->mutex);
+    wait->result = result;
+    wait->done = TRUE;
+    g_cond_signal(&wait->cond);
+    g_mutex_unlock(&wait->mutex);
+}
+
+/**
+ * @brief send COMMAND_LONG and wait for its result, as as_api_command_long_async.
+ * do not call it in a subscription callback, ack is handled on the same thread.
+ *
+ * @param target_system
+ * @param target_component
+ * @param command MAV_CMD
+ * @param param param1 - param7, NULL for all 0
+ * @param timeout_ms per attempt, 0 for COMMAND_TIMEOUT
+ * @param retries resend count after first attempt
+ * @return int MAV_RESULT or AS_COMMAND_TIMEOUT ...
+ */
+int as_api_command_long_wait(uint8_t target_system, uint8_t target_component,
+                             uint16_t command, const float *param,
+                             unsigned int timeout_ms, unsigned int retries)
+{
+    Command_Wait_t wait;
+
+    g_mutex_init(&wait.mutex);
+    g_cond_init(&wait.cond);
+    wait.done = FALSE;
+    wait.result = AS_COMMAND_FAILED;
+
+    if (0 != as_api_command_long_async(target_system, target_component, command,
+                                       param, timeout_ms, retries,
+                                       &as_command_wait_callback, &wait))
+    {
+        g_mutex_lock(&wait.mutex);
+        while (FALSE == wait.done)
+        {
+            g_cond_wait(&wait.cond, &wait.mutex);
+        }
+        g_mutex_unlock(&wait.mutex);
+    }
+
+    g_cond_clear(&wait.cond);
+    g_mutex_clear(&wait.mutex);
+
+    return wait.result;
+}
+
+/**
+ * @brief stop tracking a command, callback is called with AS_COMMAND_CANCELLED.
+ *
+ * @param command_id
+ * @return int 1 for success, 0 for not found or finished
+ */
+int as_api_command_cancel(int command_id)
+{
+    if (command_id <= 0)
+    {
+        return 0;
+    }
+
+    Command_t *my_command = command_in_flight + command_id % MAX_COMMAND_IN_FLIGHT;
+
+    g_mutex_lock(&command_mutex);
+
+    if ((FALSE == my_command->active) || (command_id != my_command->id))
+    {
+        g_mutex_unlock(&command_mutex);
+        return 0;
+    }
+
+    g_atomic_int_set(&my_command->active, FALSE);
+    Command_t finished = *my_command;
+
+    g_mutex_unlock(&command_mutex);
+
+    as_command_finish(&finished, finished.cmd.target_component, AS_COMMAND_CANCELLED);
+
+    return 1;
+}
+
+/**
+ * @brief cancel all commands in flight to a vehicle, e.g. lost vehicle.
+ *
+ * @param target_system
+ */
+void as_command_cancel_vehicle(guint8 target_system)
+{
+    for (gint i = 0; i < MAX_COMMAND_IN_FLIGHT; i++)
+    {
+        Command_t *my_command = command_in_flight + i;
+        gint id = 0;
+
+        g_mutex_lock(&command_mutex);
+        if (TRUE == my_command->active && target_system == my_command->cmd.target_system)
+        {
+            id = my_command->id;
+        }
+        g_mutex_unlock(&command_mutex);
+
+        // callback is called out of command_mutex
+        as_api_command_cancel(id);
+    }
+}
+
+/**
+ * @brief stop command worker and cancel commands in flight,
+ * call after I/O is stopped.
+ *
+ */
+void as_command_deinit()
+{
+    g_mutex_lock(&command_mutex);
+
+    GThread *this_thread = command_thread;
+    command_thread = NULL;
+
+    g_atomic_int_set(&command_worker_run, 0);
+    g_cond_signal(&command_cond);
+
+    g_mutex_unlock(&command_mutex);
+
+    if (NULL == this_thread)
+    {
+        return;
+    }
+
+    g_thread_join(this_thread);
+
+    as_msg_dispatch_remove_handler(MAVLINK_MSG_ID_COMMAND_ACK,
+                                   &as_command_ack_handler, NULL);
+
+    for (gint i = 0; i < MAX_COMMAND_IN_FLIGHT; i++)
+    {
+        as_api_command_cancel(g_atomic_int_get(&command_in_flight[i].id));
+    }
+
+    g_message("exit command_worker.");
+}
+
+/**
+ * @brief COMMAND_ACK handler, finish command in flight with its result.
+ *
+ * @param target_system
+ * @param target_component sender of ack
+ * @param msgid
+ * @param decoded mavlink_command_ack_t
+ * @param user_data
+ */
+static void as_command_ack_handler(guint8 target_system,
+                                   guint8 target_component,
+                                   guint32 msgid G_GNUC_UNUSED,
+                                   gconstpointer decoded,
+                                   gpointer user_data G_GNUC_UNUSED)
+{
+    const mavlink_command_ack_t *ack = decoded;
+
+    // ack to another GCS, target_system is 0 from MAVLink 1 senders
+    if (0 != ack->target_system && STATION_SYSYEM_ID != ack->target_system)
+    {
+        return;
+    }
+
+    gboolean found = FALSE;
+    Command_t finished;
+
+    g_mutex_lock(&command_mutex);
+
+    for (gint i = 0; i < MAX_COMMAND_IN_FLIGHT; i++)
+    {
+        Command_t *my_command = command_in_flight + i;
+
+        if (FALSE == my_command->active ||
+            my_command->cmd.target_system != target_system ||
+            my_command->cmd.command != ack->command ||
+            (my_command->cmd.target_component != target_component &&
+             0 != my_command->cmd.target_component))
+        {
+            continue;
+        }
+
+        if (MAV_RESULT_IN_PROGRESS == ack->result)
+        {
+            // long running command, wait for final ack without resending
+            my_command->in_progress = TRUE;
+            my_command->deadline = g_get_monotonic_time() + my_command->timeout;
+        }
+        else
+        {
+            g_atomic_int_set(&my_command->active, FALSE);
+            finished = *my_command;
+            found = TRUE;
+        }
+
+        break;
+    }
+
+    g_mutex_unlock(&command_mutex);
+
+    if (TRUE == found)
+    {
+        as_command_finish(&finished, target_component, ack->result);
+    }
+}
+
+/**
+ * @brief command_worker, resend or time out commands past deadline.
+ *
+ * @param data
+ * @return gpointer
+ */
+static gpointer command_worker(gpointer data)
+{
+    g_assert(NULL == data);
+
+    mavlink_command_long_t resend[MAX_COMMAND_IN_FLIGHT];
+    Command_t expired[MAX_COMMAND_IN_FLIGHT];
+
+    g_mutex_lock(&command_mutex);
+
+    while (1 == g_atomic_int_get(&command_worker_run))
+    {
+        gint64 now = g_get_monotonic_time();
+        gint64 next_deadline = now + COMMAND_WORKER_INTERVAL;
+        gint resend_count = 0;
+        gint expired_count = 0;
+
+        for (gint i = 0; i < MAX_COMMAND_IN_FLIGHT; i++)
+        {
+            Command_t *my_command = command_in_flight + i;
+
+            if (FALSE == my_command->active)
+            {
+                continue;
+            }
+
+            if (my_command->deadline <= now)
+            {
+                if (0 < my_command->retries && FALSE == my_command->in_progress)
+                {
+                    my_command->retries--;
+                    if (G_MAXUINT8 > my_command->cmd.confirmation)
+                    {
+                        my_command->cmd.confirmation++;
+                    }
+                    my_command->deadline = now + my_command->timeout;
+
+                    resend[resend_count++] = my_command->cmd;
+                }
+                else
+                {
+                    g_atomic_int_set(&my_command->active, FALSE);
+                    expired[expired_count++] = *my_command;
+                    continue;
+                }
+            }
+
+            next_deadline = MIN(next_deadline, my_command->deadline);
+        }
+
+        if (0 < resend_count || 0 < expired_count)
+        {
+            // send and call back without lock, an ack may come at once
+            g_mutex_unlock(&command_mutex);
+
+            for (gint i = 0; i < resend_count; i++)
+            {
+                as_command_send(resend + i);
+            }
+
+            for (gint i = 0; i < expired_count; i++)
+            {
+                g_warning("command %d to vehicle id:%d component id:%d timeout.",
+                          expired[i].cmd.command, expired[i].cmd.target_system,
+                          expired[i].cmd.target_component);
+                as_command_finish(expired + i, expired[i].cmd.target_component,
+                                  AS_COMMAND_TIMEOUT);
+            }
+
+            g_mutex_lock(&command_mutex);
+            continue;
+        }
+
+        g_cond_wait_until(&command_cond, &command_mutex, next_deadline);
+    }
+
+    g_mutex_unlock(&command_mutex);
+
+    return NULL;
+}
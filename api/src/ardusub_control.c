@@ -0,0 +1,522 @@
+/**
+ * @file ardusub_control.c
+ * @author ztluo (me@ztluo.dev)
+ * @brief depth PID controller, one hop from depth frame to actuator frame.
+ * @version
+ * @date 2019-06-03
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#define G_LOG_DOMAIN "[ardusub control   ]"
+
+#include "../inc/ardusub_control.h"
+#include "../inc/ardusub_interface.h"
+
+static Depth_Control_t depth_control[MAX_VEHICLE_SLOT];
+
+// start and stop of one vehicle, subscription and executor are not
+// changed under control mutex, their callbacks lock it
+static GMutex depth_control_start_mutex;
+
+/**
+ * @brief fill config with gains of examples/depth_pid.c.
+ *
+ * @param config
+ */
+void as_api_depth_control_default(Depth_Control_Config_t *config)
+{
+    g_assert(NULL != config);
+
+    memset(config, 0, sizeof(Depth_Control_Config_t));
+
+    config->kp = 300;
+    config->ki = 0;
+    config->kd = 0;
+    config->i_min = -200;
+    config->i_max = 200;
+    config->vel_limit = 1;
+    config->output_limit = 150;
+    config->input = AS_CONTROL_INPUT_GLOBAL_POSITION_INT;
+    config->output = AS_CONTROL_OUTPUT_RC_OVERRIDE;
+
+    // vertical thrusters of BlueROV2 heavy, channel 5 - 8
+    config->rc_mix[4] = 1;
+    config->rc_mix[5] = -1;
+    config->rc_mix[6] = -1;
+    config->rc_mix[7] = 1;
+
+    config->surface_pressure = 1013.25;
+    config->fluid_density = 1000;
+    config->period_us = 0;
+}
+
+/**
+ * @brief check config values.
+ *
+ * @param config
+ * @return gboolean
+ */
+static gboolean as_control_check_config(const Depth_Control_Config_t *config)
+{
+    return NULL != config &&
+           config->i_min <= config->i_max &&
+           0 <= config->vel_limit &&
+           0 <= config->output_limit &&
+           AS_CONTROL_INPUT_SCALED_PRESSURE2 >= config->input &&
+           AS_CONTROL_OUTPUT_MANUAL_CONTROL >= config->output &&
+           (AS_CONTROL_INPUT_SCALED_PRESSURE2 != config->input || 0 < config->fluid_density);
+}
+
+/**
+ * @brief one PID step on a new depth, call with control mutex locked.
+ * D term is on measurement, setpoint change does not kick it.
+ *
+ * @param my_control
+ * @param input_time monotonic time of depth, in microseconds
+ * @param depth
+ */
+static void as_control_step(Depth_Control_t *my_control, gint64 input_time, gfloat depth)
+{
+    const Depth_Control_Config_t *config = &my_control->config;
+
+    gfloat dt = 0;
+    gfloat vel = 0;
+
+    if (0 != my_control->step_time)
+    {
+        dt = (input_time - my_control->step_time) / (gfloat)G_USEC_PER_SEC;
+    }
+
+    if (0 < dt)
+    {
+        vel = CLAMP((depth - my_control->step_depth) / dt,
+                    -config->vel_limit, config->vel_limit);
+    }
+
+    my_control->step_time = input_time;
+    my_control->step_depth = depth;
+    my_control->error = my_control->setpoint - depth;
+
+    if (0 == config->ki)
+    {
+        my_control->i_term = 0;
+    }
+    else
+    {
+        my_control->i_term = CLAMP(my_control->i_term + config->ki * my_control->error * dt,
+                                   config->i_min, config->i_max);
+    }
+
+    my_control->output = CLAMP(config->kp * my_control->error +
+                                   my_control->i_term -
+                                   config->kd * vel,
+                               -config->output_limit, config->output_limit);
+}
+
+/**
+ * @brief send output of last step, call with control mutex locked.
+ *
+ * @param target_system
+ * @param my_control
+ */
+static void as_control_send(guint8 target_system, const Depth_Control_t *my_control)
+{
+    const Depth_Control_Config_t *config = &my_control->config;
+    Vehicle_Slot_t *my_slot = vehicle_slot + target_system;
+
+    if (AS_CONTROL_OUTPUT_RC_OVERRIDE == config->output)
+    {
+        guint16 ch[8];
+        for (guint i = 0; i < 8; i++)
+        {
+            ch[i] = 1500 + (gint)(config->rc_mix[i] * my_control->output);
+        }
+
+        as_api_send_rc_channels_override(target_system, my_slot->primary_compid,
+                                         ch[0], ch[1], ch[2], ch[3],
+                                         ch[4], ch[5], ch[6], ch[7]);
+        return;
+    }
+
+    // arm first, same as manual_control_worker
+    if (SYS_ARMED != g_atomic_int_get(vehicle_status + target_system))
+    {
+        return;
+    }
+
+    // keep x, y, r and buttons of as_api_manual_control, manual_control_worker
+    // resends the new z at its rate
+    mavlink_manual_control_t manual_control;
+
+    g_mutex_lock(&manual_control_mutex[target_system]);
+    my_slot->manual_control->target = target_system;
+    my_slot->manual_control->z =
+        CLAMP(500 + my_control->output * 500 / CONTROL_MANUAL_FULL_RANGE, 0, 1000);
+    manual_control = *my_slot->manual_control;
+    g_mutex_unlock(&manual_control_mutex[target_system]);
+
+    mavlink_message_t message;
+    mavlink_msg_manual_control_encode(STATION_SYSYEM_ID, STATION_COMPONENT_ID,
+                                      &message, &manual_control);
+    send_mavlink_message(target_system, &message);
+}
+
+/**
+ * @brief log setpoint and error to as_command on change and at
+ * CONTROL_LOG_INTERVAL, call with control mutex locked.
+ *
+ * @param target_system
+ * @param my_control
+ */
+static void as_control_log(guint8 target_system, Depth_Control_t *my_control)
+{
+    if (0 == (thread_flag & F_STORAGE_DATABASE))
+    {
+        return;
+    }
+
+    gint64 now = g_get_monotonic_time();
+    if (FALSE == my_control->setpoint_changed &&
+        now - my_control->log_time < CONTROL_LOG_INTERVAL)
+    {
+        return;
+    }
+
+    my_control->setpoint_changed = FALSE;
+    my_control->log_time = now;
+
+    as_command_t as_command = {0};
+    as_command.target_system = target_system;
+    as_command.control_setpoint = my_control->setpoint;
+    as_command.control_error = my_control->error;
+    as_command.control_output = my_control->output;
+
+    as_insert_command(as_command);
+}
+
+/**
+ * @brief depth of input frame, negative below surface.
+ *
+ * @param config
+ * @param msgid
+ * @param msg
+ * @return gfloat [m]
+ */
+static gfloat as_control_depth(const Depth_Control_Config_t *config,
+                               guint32 msgid, gconstpointer msg)
+{
+    if (MAVLINK_MSG_ID_SCALED_PRESSURE2 == msgid)
+    {
+        const mavlink_scaled_pressure2_t *scaled_pressure2 = msg;
+
+        // hPa to Pa
+        return -(scaled_pressure2->press_abs - config->surface_pressure) * 100 /
+               (config->fluid_density * CONTROL_GRAVITY);
+    }
+
+    const mavlink_global_position_int_t *global_position_int = msg;
+
+    return global_position_int->alt / 1000.0f; // mm to m
+}
+
+/**
+ * @brief input subscription. without period it runs on subscribe worker
+ * and steps and sends at once, else it runs on I/O thread right after
+ * decode and keeps depth for periodic step.
+ *
+ * @param target_system
+ * @param msgid
+ * @param msg
+ * @param user_data Depth_Control_t
+ */
+static void as_control_input_callback(uint8_t target_system, uint32_t msgid,
+                                      const void *msg, void *user_data)
+{
+    Depth_Control_t *my_control = (Depth_Control_t *)user_data;
+
+    g_mutex_lock(&my_control->mutex);
+
+    // callback running while unsubscribe
+    if (FALSE == my_control->active)
+    {
+        g_mutex_unlock(&my_control->mutex);
+        return;
+    }
+
+    my_control->depth_time = g_get_monotonic_time();
+    my_control->depth = as_control_depth(&my_control->config, msgid, msg);
+
+    if (0 == my_control->config.period_us)
+    {
+        as_control_step(my_control, my_control->depth_time, my_control->depth);
+        as_control_send(target_system, my_control);
+        as_control_log(target_system, my_control);
+    }
+
+    g_mutex_unlock(&my_control->mutex);
+}
+
+/**
+ * @brief periodic step on newest depth, skipped if input or vehicle is lost.
+ *
+ * @param target_system
+ * @param vehicle_data NULL if vehicle is not found
+ * @param cycle
+ * @param user_data Depth_Control_t
+ */
+static void as_control_periodic_callback(uint8_t target_system,
+                                         const Vehicle_Data_t *vehicle_data,
+                                         uint64_t cycle,
+                                         void *user_data)
+{
+    Depth_Control_t *my_control = (Depth_Control_t *)user_data;
+
+    // no output to a vehicle not found
+    if (NULL == vehicle_data)
+    {
+        return;
+    }
+
+    g_mutex_lock(&my_control->mutex);
+
+    if (TRUE == my_control->active && 0 != my_control->depth_time &&
+        g_get_monotonic_time() - my_control->depth_time < CONTROL_INPUT_TIMEOUT)
+    {
+        // same frame again keeps integration and rate of last step
+        if (my_control->depth_time != my_control->step_time)
+        {
+            as_control_step(my_control, my_control->depth_time, my_control->depth);
+        }
+        as_control_send(target_system, my_control);
+        as_control_log(target_system, my_control);
+    }
+    else if (TRUE == my_control->active)
+    {
+        as_log_rate_limited(G_LOG_LEVEL_WARNING, target_system, my_control->config.input,
+                            "depth input of vehicle id:%d lost, step skipped at cycle %" G_GUINT64_FORMAT ".",
+                            target_system, cycle);
+    }
+
+    g_mutex_unlock(&my_control->mutex);
+}
+
+/**
+ * @brief start depth controller of vehicle, output is sent on each step
+ * until as_api_depth_control_stop.
+ *
+ * @param target_system
+ * @param config NULL for as_api_depth_control_default
+ * @param setpoint [m] desired depth, negative below surface
+ * @return int 0 for failed or already started
+ */
+int as_api_depth_control_start(uint8_t target_system,
+                               const Depth_Control_Config_t *config, float setpoint)
+{
+    Depth_Control_Config_t default_config;
+    if (NULL == config)
+    {
+        as_api_depth_control_default(&default_config);
+        config = &default_config;
+    }
+
+    if (0 == as_api_check_vehicle(target_system) || FALSE == as_control_check_config(config))
+    {
+        return 0;
+    }
+
+    Depth_Control_t *my_control = depth_control + target_system;
+
+    g_mutex_lock(&depth_control_start_mutex);
+
+    if (0 != my_control->subscription_id)
+    {
+        g_mutex_unlock(&depth_control_start_mutex);
+        g_warning("depth control of vehicle id:%d is running.", target_system);
+        return 0;
+    }
+
+    g_mutex_lock(&my_control->mutex);
+    my_control->config = *config;
+    my_control->setpoint = setpoint;
+    my_control->depth_time = 0;
+    my_control->step_time = 0;
+    my_control->i_term = 0;
+    my_control->error = 0;
+    my_control->output = 0;
+    my_control->log_time = 0;
+    my_control->setpoint_changed = TRUE;
+    my_control->active = TRUE;
+    g_mutex_unlock(&my_control->mutex);
+
+    guint32 msgid = (AS_CONTROL_INPUT_SCALED_PRESSURE2 == config->input)
+                        ? MAVLINK_MSG_ID_SCALED_PRESSURE2
+                        : MAVLINK_MSG_ID_GLOBAL_POSITION_INT;
+
+    // send and log of a step stay off I/O thread, only storing depth is inline
+    guint options = (0 == config->period_us) ? F_SUBSCRIBE_WORKER : F_SUBSCRIBE_INLINE;
+
+    my_control->subscription_id = as_api_subscribe(target_system, msgid,
+                                                   &as_control_input_callback, my_control,
+                                                   options);
+
+    if (0 != my_control->subscription_id && 0 != config->period_us)
+    {
+        my_control->periodic_id = as_api_periodic_start(target_system, config->period_us,
+                                                        &as_control_periodic_callback,
+                                                        my_control, F_PERIODIC_NONE, 0, -1);
+        if (0 == my_control->periodic_id)
+        {
+            as_api_unsubscribe(my_control->subscription_id);
+            my_control->subscription_id = 0;
+        }
+    }
+
+    if (0 == my_control->subscription_id)
+    {
+        g_mutex_lock(&my_control->mutex);
+        my_control->active = FALSE;
+        g_mutex_unlock(&my_control->mutex);
+    }
+
+    g_mutex_unlock(&depth_control_start_mutex);
+
+    return 0 != my_control->subscription_id;
+}
+
+/**
+ * @brief change gains and limits of running depth controller, input,
+ * output and period are kept.
+ *
+ * @param target_system
+ * @param config
+ * @return int 0 for not running or bad config
+ */
+int as_api_depth_control_set_config(uint8_t target_system,
+                                    const Depth_Control_Config_t *config)
+{
+    if (FALSE == as_control_check_config(config))
+    {
+        return 0;
+    }
+
+    Depth_Control_t *my_control = depth_control + target_system;
+
+    g_mutex_lock(&my_control->mutex);
+
+    if (FALSE == my_control->active)
+    {
+        g_mutex_unlock(&my_control->mutex);
+        return 0;
+    }
+
+    Depth_Control_Config_t *my_config = &my_control->config;
+    my_config->kp = config->kp;
+    my_config->ki = config->ki;
+    my_config->kd = config->kd;
+    my_config->i_min = config->i_min;
+    my_config->i_max = config->i_max;
+    my_config->vel_limit = config->vel_limit;
+    my_config->output_limit = config->output_limit;
+    memcpy(my_config->rc_mix, config->rc_mix, sizeof(my_config->rc_mix));
+    my_config->surface_pressure = config->surface_pressure;
+    my_config->fluid_density = config->fluid_density;
+
+    my_control->i_term = CLAMP(my_control->i_term, my_config->i_min, my_config->i_max);
+
+    g_mutex_unlock(&my_control->mutex);
+
+    return 1;
+}
+
+/**
+ * @brief change desired depth of running depth controller.
+ *
+ * @param target_system
+ * @param setpoint [m]
+ * @return int 0 for not running
+ */
+int as_api_depth_control_set_setpoint(uint8_t target_system, float setpoint)
+{
+    Depth_Control_t *my_control = depth_control + target_system;
+
+    g_mutex_lock(&my_control->mutex);
+
+    gboolean active = my_control->active;
+    if (active && my_control->setpoint != setpoint)
+    {
+        my_control->setpoint = setpoint;
+        my_control->setpoint_changed = TRUE;
+    }
+
+    g_mutex_unlock(&my_control->mutex);
+
+    return active;
+}
+
+/**
+ * @brief stop depth controller, RC override is released or MANUAL_CONTROL
+ * z is set back to zero level.
+ *
+ * @param target_system
+ * @return int 0 for not running
+ */
+int as_api_depth_control_stop(uint8_t target_system)
+{
+    Depth_Control_t *my_control = depth_control + target_system;
+
+    g_mutex_lock(&depth_control_start_mutex);
+
+    if (0 == my_control->subscription_id)
+    {
+        g_mutex_unlock(&depth_control_start_mutex);
+        return 0;
+    }
+
+    // running callbacks see it and return
+    g_mutex_lock(&my_control->mutex);
+    my_control->active = FALSE;
+    guint output = my_control->config.output;
+    g_mutex_unlock(&my_control->mutex);
+
+    as_api_periodic_stop(my_control->periodic_id);
+    as_api_unsubscribe(my_control->subscription_id);
+    my_control->periodic_id = 0;
+    my_control->subscription_id = 0;
+
+    g_mutex_unlock(&depth_control_start_mutex);
+
+    if (AS_CONTROL_OUTPUT_RC_OVERRIDE == output)
+    {
+        // 0 releases channel back to RC
+        as_api_send_rc_channels_override(target_system,
+                                         vehicle_slot[target_system].primary_compid,
+                                         0, 0, 0, 0, 0, 0, 0, 0);
+    }
+    else
+    {
+        g_mutex_lock(&manual_control_mutex[target_system]);
+        vehicle_slot[target_system].manual_control->z = 500;
+        vehicle_slot[target_system].manual_control_changed = TRUE;
+        g_cond_signal(&manual_control_cond[target_system]);
+        g_mutex_unlock(&manual_control_mutex[target_system]);
+    }
+
+    return 1;
+}
+
+/**
+ * @brief stop depth controllers of all vehicles, call before I/O is stopped.
+ *
+ */
+void as_control_deinit()
+{
+    for (guint i = 0; i < MAX_VEHICLE_SLOT; i++)
+    {
+        if (0 != depth_control[i].subscription_id)
+        {
+            as_api_depth_control_stop(i);
+        }
+    }
+}
@@ -13,6 +13,8 @@
 
 #include "../inc/ardusub_ini.h"
 
+static void as_read_ini_queue(GKeyFile *key_file);
+
 /**
  * @brief read config file. if not exist, creat one.
  * 
@@ -24,6 +26,7 @@ void as_read_ini_file()
 
     as_config_log_file = TRUE;
     as_config_log_stdout = TRUE;
+    as_config_udp_parse_threads = 1;
 
     // load ini file
     GKeyFileFlags flag = G_KEY_FILE_KEEP_COMMENTS;
@@ -46,6 +49,83 @@ void as_read_ini_file()
     {
         as_config_log_file = g_key_file_get_boolean(key_file, "log", "file", &error);
         as_config_log_stdout = g_key_file_get_boolean(key_file, "log", "stdout", &error);
+        g_clear_error(&error);
+
+        // optional, config file from older version doesn't have it
+        gint parse_threads = g_key_file_get_integer(key_file, "udp", "parse_threads", &error);
+        if (NULL == error)
+        {
+            as_config_udp_parse_threads = CLAMP(parse_threads, 1, MAX_UDP_PARSE_THREAD);
+        }
+        g_clear_error(&error);
+
+        as_read_ini_queue(key_file);
+
+        // optional, config file from older version doesn't have it
+        gint rate_hz = g_key_file_get_integer(key_file, "manual_control", "rate_hz", &error);
+        if (NULL == error)
+        {
+            gint min_interval_ms = g_key_file_get_integer(key_file, "manual_control",
+                                                          "min_interval_ms", &error);
+            if (NULL != error)
+            {
+                min_interval_ms = MANUAL_CONTROL_MIN_INTERVAL;
+            }
+
+            as_api_set_manual_control_rate(MAX(rate_hz, 0), MAX(min_interval_ms, 0));
+        }
+        g_clear_error(&error);
+
+        // optional, config file from older version doesn't have it
+        g_autofree gchar *stream_profile = g_key_file_get_string(key_file, "stream",
+                                                                 "profile", &error);
+        if (NULL != stream_profile)
+        {
+            as_api_set_stream_profile(stream_profile);
+        }
+        g_clear_error(&error);
+    }
+}
+
+/**
+ * @brief read optional [queue] section, keys are
+ * <queue>_policy, <queue>_capacity and <queue>_timeout_ms.
+ * 
+ * @param key_file 
+ */
+static void as_read_ini_queue(GKeyFile *key_file)
+{
+    g_autoptr(GError) error = NULL;
+
+    for (guint i = 0; i < AS_QUEUE_COUNT; i++)
+    {
+        g_autofree gchar *policy_key = g_strdup_printf("%s_policy", as_queue_name(i));
+        g_autofree gchar *capacity_key = g_strdup_printf("%s_capacity", as_queue_name(i));
+        g_autofree gchar *timeout_key = g_strdup_printf("%s_timeout_ms", as_queue_name(i));
+
+        g_autofree gchar *policy_str = g_key_file_get_string(key_file, "queue", policy_key, &error);
+        g_clear_error(&error);
+
+        if (NULL == policy_str)
+        {
+            continue;
+        }
+
+        gint policy = as_queue_policy_from_string(policy_str);
+
+        if (0 > policy)
+        {
+            g_warning("unknown queue policy: %s = %s", policy_key, policy_str);
+            continue;
+        }
+
+        gint capacity = g_key_file_get_integer(key_file, "queue", capacity_key, &error);
+        g_clear_error(&error);
+
+        gint timeout_ms = g_key_file_get_integer(key_file, "queue", timeout_key, &error);
+        g_clear_error(&error);
+
+        as_api_set_queue_policy(i, policy, MAX(capacity, 0), MAX(timeout_ms, 0));
     }
 }
 
@@ -77,6 +157,51 @@ void as_init_ini_file()
     g_key_file_set_comment(key_file, "log", "stdout", "log to stdout?", &error);
     g_clear_error(&error);
 
+    g_key_file_set_integer(key_file, "udp", "parse_threads", 1);
+    g_clear_error(&error);
+
+    g_key_file_set_comment(key_file, "udp", NULL, "udp config", &error);
+    g_clear_error(&error);
+
+    g_key_file_set_comment(key_file, "udp", "parse_threads",
+                           "threads parsing UDP frames, sharded by source address", &error);
+    g_clear_error(&error);
+
+    g_key_file_set_string(key_file, "queue", "message_policy", "drop_oldest");
+    g_clear_error(&error);
+
+    g_key_file_set_integer(key_file, "queue", "message_capacity", MAX_MESSAGE);
+    g_clear_error(&error);
+
+    g_key_file_set_comment(key_file, "queue", NULL,
+                           "queue config, keys: <queue>_policy, <queue>_capacity, <queue>_timeout_ms\n"
+                           "queues: message, statustext, named_value_float, serial_write_buf\n"
+                           "policies: drop_oldest, drop_newest, block, coalesce\n"
+                           "coalesce is not for serial_write_buf, block is only for it",
+                           &error);
+    g_clear_error(&error);
+
+    g_key_file_set_integer(key_file, "manual_control", "rate_hz", MANUAL_CONTROL_RATE);
+    g_clear_error(&error);
+
+    g_key_file_set_integer(key_file, "manual_control", "min_interval_ms",
+                           MANUAL_CONTROL_MIN_INTERVAL);
+    g_clear_error(&error);
+
+    g_key_file_set_comment(key_file, "manual_control", NULL,
+                           "MANUAL_CONTROL send rate, changed input is sent at once\n"
+                           "but not within min_interval_ms of last send",
+                           &error);
+    g_clear_error(&error);
+
+    g_key_file_set_string(key_file, "stream", "profile", "default");
+    g_clear_error(&error);
+
+    g_key_file_set_comment(key_file, "stream", NULL,
+                           "telemetry rates of found vehicles, profiles: legacy, default, control",
+                           &error);
+    g_clear_error(&error);
+
     // Save as a file.
     g_info("creating config file.");
     if (!g_key_file_save_to_file(key_file, "ardusub_config.ini", &error))
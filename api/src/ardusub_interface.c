@@ -12,6 +12,20 @@
 #define G_LOG_DOMAIN "[ardusub interface ]"
 
 #include "../inc/ardusub_interface.h"
+#include "../inc/ardusub_msg.h"
+#include "../inc/ardusub_subscribe.h"
+#include "../inc/ardusub_command.h"
+#include "../inc/ardusub_param.h"
+#include "../inc/ardusub_stats.h"
+#include "../inc/ardusub_stream.h"
+#include "../inc/ardusub_periodic.h"
+#include "../inc/ardusub_control.h"
+#include "../inc/ardusub_timesync.h"
+#include "../inc/ardusub_latency.h"
+#include "../inc/ardusub_lifecycle.h"
+
+// held by as_api_init and as_api_deinit
+static GMutex as_init_mutex;
 
 /**
  * @brief init api before use.
@@ -20,8 +34,7 @@
  */
 void as_api_init(const char *p_subnet_address, const unsigned int flag)
 {
-    static GMutex my_mutex;
-    g_mutex_lock(&my_mutex);
+    g_mutex_lock(&as_init_mutex);
 
     //! only init once
     if (TRUE != as_init_status)
@@ -54,10 +67,7 @@ void as_api_init(const char *p_subnet_address, const unsigned int flag)
 
         as_thread_init_ptr_flag();
 
-        message_hash_table = g_hash_table_new(g_int_hash, g_int_equal);
-        parameter_hash_table = g_hash_table_new(g_int_hash, g_int_equal);
-        manual_control_table = g_hash_table_new(g_int_hash, g_int_equal);
-        target_hash_table = g_hash_table_new(g_int_hash, g_int_equal);
+        as_msg_dispatch_init();
 
         // load ini config file
         if (thread_flag & F_STORAGE_INI)
@@ -98,27 +108,42 @@ void as_api_init(const char *p_subnet_address, const unsigned int flag)
         as_init_status = TRUE;
     }
 
-    g_mutex_unlock(&my_mutex);
+    g_mutex_unlock(&as_init_mutex);
 }
 
 /**
- * @brief deinit api.
+ * @brief deinit api, waits for an as_api_init in progress.
  * 
  */
 void as_api_deinit()
 {
-    gint wait_count = 0;
-    while (TRUE != as_init_status)
+    g_mutex_lock(&as_init_mutex);
+
+    if (TRUE != as_init_status)
     {
-        g_usleep(100000);
-        wait_count++;
-        if (wait_count++ > 100)
-        {
-            return;
-        }
+        g_mutex_unlock(&as_init_mutex);
+        return;
     }
 
+    // no vehicle is started or rejoined after this
+    as_lifecycle_deinit();
+
+    // user control loops may still send
+    as_control_deinit();
+    as_periodic_deinit();
+    as_timesync_deinit();
+    as_latency_deinit();
+
+    // log writer is still running
+    as_log_rate_limit_deinit();
+
     as_thread_stop_all_join();
+
+    as_subscribe_deinit();
+
+    as_command_deinit();
+
+    g_mutex_unlock(&as_init_mutex);
 }
 
 /**
@@ -131,15 +156,60 @@ gpointer as_run(gpointer data)
 {
     g_assert(NULL == data);
 
-    as_main_loop = g_main_loop_new(NULL, FALSE);
-    g_main_loop_run(as_main_loop);
+    GMainLoop *main_loop = g_main_loop_new(NULL, FALSE);
+    as_thread_main_loop_ready(main_loop);
+    g_main_loop_run(main_loop);
     // g_main_loop_unref(as_main_loop);
 
     return NULL;
 }
 
 /**
- * @brief add system.
+ * @brief start workers of a vehicle, on add and rejoin.
+ * 
+ * @param target_system 
+ */
+static void as_system_thread_start(guint8 target_system)
+{
+    guint8 *p_sysid = g_atomic_pointer_get(sys_key + target_system);
+    g_assert(NULL != p_sysid);
+
+    heartbeat_thread[target_system] =
+        g_thread_new("heartbeat_worker", &heartbeat_worker, p_sysid);
+
+    // init manual_control_worker thread
+    manual_control_thread[target_system] =
+        g_thread_new("manual_control_worker", &manual_control_worker, p_sysid);
+
+    // init named_val_float_handle_worker thread
+    if (thread_flag & F_THREAD_NAMED_VAL_FLOAT)
+    {
+        named_val_float_handle_thread[target_system] =
+            g_thread_new("named_val_float_handle_worker", &named_val_float_handle_worker, p_sysid);
+    }
+
+    // init vehicle_data_update_worker thread
+    vehicle_data_update_thread[target_system] =
+        g_thread_new("vehicle_data_update_worker", &vehicle_data_update_worker, p_sysid);
+
+    // init db_update_worker thread
+    if (thread_flag & F_STORAGE_DATABASE)
+    {
+        db_update_thread[target_system] =
+            g_thread_new("db_update_worker", &db_update_worker, p_sysid);
+    }
+
+    // statustex_wall_thread
+    if (thread_flag & F_THREAD_STATUSTEX_WALL)
+    {
+        statustex_wall_thread[target_system] =
+            g_thread_new("statustex_wall_worker", &statustex_wall_worker, p_sysid);
+    }
+}
+
+/**
+ * @brief add system, publish its slot and queues with message_mutex locked,
+ * workers are started later by as_system_start.
  * 
  * @param target_system 
  * @param target_autopilot 
@@ -168,20 +238,24 @@ void as_system_add(guint8 target_system, guint8 target_autopilot,
     }
     *p_sysid = target_system;
 
-    // lock the hash table
-    g_rw_lock_writer_lock(&message_hash_table_lock);
-    g_rw_lock_writer_lock(&parameter_hash_table_lock);
-    g_rw_lock_writer_lock(&target_hash_table_lock);
+    Vehicle_Slot_t *my_slot = vehicle_slot + target_system;
+    g_assert(FALSE == g_atomic_int_get(&my_slot->ready));
 
-    g_hash_table_insert(message_hash_table, p_sysid, current_messages);
+    my_slot->messages = current_messages;
+    my_slot->parameter = current_parameter;
 
-    g_hash_table_insert(parameter_hash_table, p_sysid, current_parameter);
+    // autopilot is the primary component
+    my_slot->primary_compid = target_autopilot;
+    my_slot->component_id[0] = target_autopilot;
+    my_slot->component_messages[0] = current_messages;
+    my_slot->comp_index[target_autopilot] = 1;
+    g_atomic_int_set(&my_slot->component_count, 1);
 
     if (NULL != current_target_socket)
     {
         // UDP
         as_udp_write_init(target_system, current_target_socket);
-        g_hash_table_insert(target_hash_table, p_sysid, current_target_socket);
+        my_slot->target = current_target_socket;
     }
 
 #ifndef NO_SERISL
@@ -189,22 +263,29 @@ void as_system_add(guint8 target_system, guint8 target_autopilot,
     {
         // serial port
         as_serial_write_init();
-        g_hash_table_insert(target_hash_table, p_sysid, current_targer_serial_chan);
+        my_slot->target = current_targer_serial_chan;
     }
 #endif
 
     mavlink_manual_control_t *p_manual_control = g_new0(mavlink_manual_control_t, 1);
+    if (NULL == p_manual_control)
+    {
+        g_error("Out of memory!");
+    }
     p_manual_control->z = 500; // 500 is z axis zero leval
-    g_hash_table_insert(manual_control_table, p_sysid, p_manual_control);
+    my_slot->manual_control = p_manual_control;
 
-    // unlock the message hash table
-    g_rw_lock_writer_unlock(&message_hash_table_lock);
-    g_rw_lock_writer_unlock(&parameter_hash_table_lock);
-    g_rw_lock_writer_unlock(&target_hash_table_lock);
+    if (thread_flag & F_MSG_MAILBOX)
+    {
+        my_slot->mailbox = as_msg_mailbox_new();
+    }
+
+    // publish slot, atomic set is a full barrier
+    g_atomic_int_set(&my_slot->ready, TRUE);
 
-    statustex_queue[target_system] = g_async_queue_new();
-    named_val_float_queue[target_system] = g_async_queue_new();
-    message_queue[target_system] = g_async_queue_new();
+    statustex_queue[target_system] = as_queue_new(AS_QUEUE_STATUSTEX);
+    named_val_float_queue[target_system] = as_queue_new(AS_QUEUE_NAMED_VAL_FLOAT);
+    message_queue[target_system] = as_queue_new(AS_QUEUE_MESSAGE);
 
     Vehicle_Data_t *p_vehicle_data = g_new0(Vehicle_Data_t, 1);
     if (NULL == p_vehicle_data)
@@ -215,44 +296,74 @@ void as_system_add(guint8 target_system, guint8 target_autopilot,
 
     g_atomic_pointer_set(sys_key + target_system, p_sysid);
 
-    heartbeat_thread[target_system] =
-        g_thread_new("heartbeat_worker", &heartbeat_worker, p_sysid);
+    static GMutex active_sysid_mutex;
+
+    g_mutex_lock(&active_sysid_mutex);
+    gint active_count = g_atomic_int_get(&active_sysid_count);
+    active_sysid[active_count] = target_system;
+    // atomic set is a full barrier, readers see sysid before count
+    g_atomic_int_set(&active_sysid_count, active_count + 1);
+    g_mutex_unlock(&active_sysid_mutex);
+}
+
+/**
+ * @brief start workers, parameter sync and streams of an added system,
+ * runs on lifecycle worker without message_mutex.
+ * 
+ * @param target_system 
+ */
+void as_system_start(guint8 target_system)
+{
+    guint8 target_autopilot = vehicle_slot[target_system].primary_compid;
+
+    as_system_thread_start(target_system);
 
     if (thread_flag & F_THREAD_FETCH_FULL_PARAM)
     {
-        as_request_full_parameters(target_system, target_autopilot);
+        as_param_sync_start(target_system, target_autopilot);
     }
 
-    as_reauest_data_stream(target_system, target_autopilot);
+    as_stream_start(target_system, target_autopilot);
 
-    // init manual_control_worker thread
-    manual_control_thread[target_system] =
-        g_thread_new("manual_control_worker", &manual_control_worker, p_sysid);
+    as_timesync_start();
+}
 
-    // init named_val_float_handle_worker thread
-    if (thread_flag & F_THREAD_NAMED_VAL_FLOAT)
-    {
-        named_val_float_handle_thread[target_system] =
-            g_thread_new("named_val_float_handle_worker", &named_val_float_handle_worker, p_sysid);
-    }
+/**
+ * @brief rejoin a lost vehicle on its autopilot heartbeat, runs on
+ * lifecycle worker without message_mutex. slot, messages, parameters
+ * and vehicle data are kept from before it was lost, workers are started
+ * again and streams are requested again, since vehicle may have rebooted.
+ * 
+ * @param target_system 
+ */
+void as_system_rejoin(guint8 target_system)
+{
+    Vehicle_Slot_t *my_slot = vehicle_slot + target_system;
+    guint8 target_autopilot = my_slot->primary_compid;
 
-    // init vehicle_data_update_worker thread
-    vehicle_data_update_thread[target_system] =
-        g_thread_new("vehicle_data_update_worker", &vehicle_data_update_worker, p_sysid);
+    g_mutex_lock(&manual_control_mutex[target_system]); // lock
+    // clear manual_control value of before
+    my_slot->manual_control->x = 0;
+    my_slot->manual_control->y = 0;
+    my_slot->manual_control->z = 500;
+    my_slot->manual_control->r = 0;
+    my_slot->manual_control->buttons = 0;
+    my_slot->manual_control_changed = FALSE;
+    g_mutex_unlock(&manual_control_mutex[target_system]); // unlock
 
-    // init db_update_worker thread
-    if (thread_flag & F_STORAGE_DATABASE)
-    {
-        db_update_thread[target_system] =
-            g_thread_new("db_update_worker", &db_update_worker, p_sysid);
-    }
+    as_thread_init_vehicle_flag(target_system);
+    as_system_thread_start(target_system);
 
-    // statustex_wall_thread
-    if (thread_flag & F_THREAD_STATUSTEX_WALL)
+    // cached parameters are used, download again only if last one is not done
+    if ((thread_flag & F_THREAD_FETCH_FULL_PARAM) &&
+        AS_PARAM_SYNC_DONE != as_api_param_sync_progress(target_system, NULL, NULL))
     {
-        statustex_wall_thread[target_system] =
-            g_thread_new("statustex_wall_worker", &statustex_wall_worker, p_sysid);
+        as_param_sync_start(target_system, target_autopilot);
     }
+
+    as_stream_start(target_system, target_autopilot);
+
+    as_latency_resume(target_system);
 }
 
 /**
@@ -286,19 +397,30 @@ void as_api_manual_control(int16_t x, int16_t y, int16_t z, int16_t r, uint16_t
         return;
     }
 
-    g_rw_lock_reader_lock(&manual_control_hash_table_lock);
-    mavlink_manual_control_t *p_manual_control =
-        g_hash_table_lookup(manual_control_table,
-                            g_atomic_pointer_get(sys_key + sys_id));
-    g_rw_lock_reader_unlock(&manual_control_hash_table_lock);
+    if (FALSE == g_atomic_int_get(&vehicle_slot[sys_id].ready))
+    {
+        return;
+    }
+
+    mavlink_manual_control_t *p_manual_control = vehicle_slot[sys_id].manual_control;
 
     g_mutex_lock(&manual_control_mutex[sys_id]); // lock
-    p_manual_control->target = sys_id;
-    p_manual_control->x = x;
-    p_manual_control->y = y;
-    p_manual_control->z = z;
-    p_manual_control->r = r;
-    p_manual_control->buttons = buttons;
+    if (p_manual_control->target != sys_id ||
+        p_manual_control->x != x || p_manual_control->y != y ||
+        p_manual_control->z != z || p_manual_control->r != r ||
+        p_manual_control->buttons != buttons)
+    {
+        p_manual_control->target = sys_id;
+        p_manual_control->x = x;
+        p_manual_control->y = y;
+        p_manual_control->z = z;
+        p_manual_control->r = r;
+        p_manual_control->buttons = buttons;
+
+        // wake manual_control_worker to send it now
+        vehicle_slot[sys_id].manual_control_changed = TRUE;
+        g_cond_signal(&manual_control_cond[sys_id]);
+    }
     g_mutex_unlock(&manual_control_mutex[sys_id]); // unlock
 }
 
@@ -369,21 +491,198 @@ int as_api_get_vehicle_data2(uint8_t target_system, Vehicle_Data_t *vehicle_data
 }
 
 /**
- * @brief get message
+ * @brief get vehicles data of all ready vehicles in one call, each one is
+ * copied under its own mutex, same as as_api_get_vehicle_data2.
+ * 
+ * @param vehicle_data array of max_count
+ * @param sysid [out] sysid of each vehicle_data, may be NULL
+ * @param max_count 
+ * @return int number of vehicles filled
+ */
+int as_api_get_fleet_snapshot(Vehicle_Data_t *vehicle_data, uint8_t *sysid, int max_count)
+{
+    g_assert(NULL != vehicle_data);
+
+    gint active_count = g_atomic_int_get(&active_sysid_count);
+    gint64 monotonic_time = g_get_monotonic_time();
+    int count = 0;
+
+    for (gint i = 0; i < active_count && count < max_count; i++)
+    {
+        guint8 target_system = active_sysid[i];
+
+        if (0 == as_api_check_vehicle(target_system))
+        {
+            continue;
+        }
+
+        g_mutex_lock(&vehicle_data_mutex[target_system]);
+        memcpy(
+            (void *)(vehicle_data + count),
+            (void *)g_atomic_pointer_get(vehicle_data_array + target_system),
+            sizeof(Vehicle_Data_t));
+        g_mutex_unlock(&vehicle_data_mutex[target_system]);
+
+        vehicle_data[count].monotonic_time = monotonic_time;
+
+        if (NULL != sysid)
+        {
+            sysid[count] = target_system;
+        }
+
+        count++;
+    }
+
+    return count;
+}
+
+static gint as_projection_field_compare(gconstpointer a, gconstpointer b)
+{
+    return (gint)((const Vehicle_Data_Field_t *)a)->src_offset -
+           (gint)((const Vehicle_Data_Field_t *)b)->src_offset;
+}
+
+/**
+ * @brief build a projection of Vehicle_Data_t once, for
+ * as_api_get_vehicle_data_projection.
+ * 
+ * @param fields built with VEHICLE_DATA_FIELD
+ * @param count 
+ * @return Vehicle_Data_Projection_t* NULL if a field is out of Vehicle_Data_t
+ */
+Vehicle_Data_Projection_t *as_api_projection_new(const Vehicle_Data_Field_t *fields, int count)
+{
+    g_assert(NULL != fields || 0 == count);
+
+    Vehicle_Data_Projection_t *projection =
+        g_malloc0(sizeof(Vehicle_Data_Projection_t) +
+                  sizeof(Vehicle_Data_Field_t) * MAX(count, 0));
+    if (NULL == projection)
+    {
+        g_error("Out of memory!");
+    }
+
+    projection->monotonic_time_offset = -1;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (0 == fields[i].size ||
+            fields[i].src_offset + fields[i].size > sizeof(Vehicle_Data_t))
+        {
+            g_warning("invalid field %d of projection, offset: %u, size: %u.",
+                      i, fields[i].src_offset, fields[i].size);
+            g_free(projection);
+            return NULL;
+        }
+
+        if (offsetof(Vehicle_Data_t, monotonic_time) == fields[i].src_offset)
+        {
+            // set on copy, not copied
+            projection->monotonic_time_offset = fields[i].dst_offset;
+            continue;
+        }
+
+        projection->range[projection->count++] = fields[i];
+    }
+
+    // copy in order of Vehicle_Data_t
+    qsort(projection->range, projection->count, sizeof(Vehicle_Data_Field_t),
+          as_projection_field_compare);
+
+    guint merged = 0;
+
+    for (guint i = 1; i < projection->count; i++)
+    {
+        Vehicle_Data_Field_t *last = projection->range + merged;
+        const Vehicle_Data_Field_t *field = projection->range + i;
+
+        if (last->src_offset + last->size == field->src_offset &&
+            last->dst_offset + last->size == field->dst_offset)
+        {
+            last->size += field->size;
+        }
+        else
+        {
+            projection->range[++merged] = *field;
+        }
+    }
+
+    if (0 != projection->count)
+    {
+        projection->count = merged + 1;
+    }
+
+    return projection;
+}
+
+/**
+ * @brief as_api_projection_free
+ * 
+ * @param projection 
+ */
+void as_api_projection_free(Vehicle_Data_Projection_t *projection)
+{
+    g_free(projection);
+}
+
+/**
+ * @brief get fields of vehicles data in projection, copied under the same
+ * mutex as as_api_get_vehicle_data2.
+ * 
+ * @param target_system 
+ * @param projection from as_api_projection_new
+ * @param data caller struct of projection
+ * @return int 1 for success
+ */
+int as_api_get_vehicle_data_projection(uint8_t target_system,
+                                       const Vehicle_Data_Projection_t *projection,
+                                       void *data)
+{
+    g_assert(NULL != projection);
+    g_assert(NULL != data);
+
+    if (0 == as_api_check_vehicle(target_system))
+    {
+        as_log_rate_limited(G_LOG_LEVEL_WARNING, target_system, 0,
+                            "no vehicle id:%d, in func: %s",
+                            target_system, __FUNCTION__);
+        return 0;
+    }
+
+    const guint8 *src = g_atomic_pointer_get(vehicle_data_array + target_system);
+    guint8 *dst = data;
+
+    g_mutex_lock(&vehicle_data_mutex[target_system]);
+    for (guint i = 0; i < projection->count; i++)
+    {
+        memcpy(dst + projection->range[i].dst_offset,
+               src + projection->range[i].src_offset,
+               projection->range[i].size);
+    }
+    g_mutex_unlock(&vehicle_data_mutex[target_system]);
+
+    if (0 <= projection->monotonic_time_offset)
+    {
+        int64_t monotonic_time = g_get_monotonic_time();
+        memcpy(dst + projection->monotonic_time_offset,
+               &monotonic_time, sizeof(monotonic_time));
+    }
+
+    return 1;
+}
+
+/**
+ * @brief get message, with F_MSG_LAZY_DECODE some msg may not be decoded,
+ * read with as_msg_dispatch_copy instead.
  * 
  * @param sysid 
  * @return Mavlink_Messages_t* 
  */
 Mavlink_Messages_t *as_get_message(uint8_t sysid)
 {
-    gpointer system_key_ = g_atomic_pointer_get(sys_key + sysid);
-    g_assert(NULL != system_key_);
-
-    g_rw_lock_reader_lock(&message_hash_table_lock);
-    Mavlink_Messages_t *p_message = g_hash_table_lookup(message_hash_table, system_key_);
-    g_rw_lock_reader_unlock(&message_hash_table_lock);
+    g_assert(TRUE == g_atomic_int_get(&vehicle_slot[sysid].ready));
 
-    g_assert(NULL != p_message);
+    Mavlink_Messages_t *p_message = vehicle_slot[sysid].messages;
 
     return p_message;
 }
@@ -398,7 +697,8 @@ int as_api_check_vehicle(uint8_t sysid)
 {
     if ((NULL == g_atomic_pointer_get(sys_key + sysid)) ||
         (SYS_UN_INIT == g_atomic_int_get(vehicle_status + sysid)) ||
-        (SYS_INITIATING == g_atomic_int_get(vehicle_status + sysid)))
+        (SYS_INITIATING == g_atomic_int_get(vehicle_status + sysid)) ||
+        (SYS_LOST == g_atomic_int_get(vehicle_status + sysid)))
     {
         return 0;
     }
@@ -408,6 +708,143 @@ int as_api_check_vehicle(uint8_t sysid)
     }
 }
 
+/**
+ * @brief check if a component of vehicle is found.
+ * 
+ * @param sysid 
+ * @param compid 
+ * @return int 0 for not found.
+ */
+int as_api_check_component(uint8_t sysid, uint8_t compid)
+{
+    Vehicle_Slot_t *my_slot = vehicle_slot + sysid;
+
+    if (FALSE == g_atomic_int_get(&my_slot->ready))
+    {
+        return 0;
+    }
+
+    // read count first, comp_index is set before count
+    gint count = g_atomic_int_get(&my_slot->component_count);
+    gint index = my_slot->comp_index[compid];
+
+    return (0 != index) && (index <= count);
+}
+
+/**
+ * @brief get compid of all components of vehicle, primary component first.
+ * 
+ * @param sysid 
+ * @param compid_list 
+ * @param max_count size of compid_list
+ * @return int count of compid in compid_list
+ */
+int as_api_get_component_list(uint8_t sysid, uint8_t *compid_list, int max_count)
+{
+    g_assert(NULL != compid_list);
+
+    Vehicle_Slot_t *my_slot = vehicle_slot + sysid;
+
+    if (FALSE == g_atomic_int_get(&my_slot->ready))
+    {
+        return 0;
+    }
+
+    gint count = g_atomic_int_get(&my_slot->component_count);
+
+    if (count > max_count)
+    {
+        count = max_count;
+    }
+
+    for (gint i = 0; i < count; i++)
+    {
+        compid_list[i] = my_slot->component_id[i];
+    }
+
+    return count;
+}
+
+/**
+ * @brief copy last msg of a component.
+ * 
+ * @param sysid 
+ * @param compid 
+ * @param msgid 
+ * @param msg decoded mavlink struct of msgid, e.g. mavlink_attitude_t
+ * @param time_stamp NULL-able, monotonic time of last msg
+ * @return int 1 for success, 0 if component or msg is not received
+ */
+int as_api_get_component_message(uint8_t sysid, uint8_t compid, uint32_t msgid,
+                                 void *msg, uint64_t *time_stamp)
+{
+    g_assert(NULL != msg);
+
+    if (0 == as_api_check_component(sysid, compid))
+    {
+        return 0;
+    }
+
+    Vehicle_Slot_t *my_slot = vehicle_slot + sysid;
+    Mavlink_Messages_t *current_messages =
+        my_slot->component_messages[my_slot->comp_index[compid] - 1];
+
+    g_mutex_lock(&message_mutex[sysid]);
+    gboolean copied = as_msg_dispatch_copy(msgid, current_messages,
+                                           msg, (guint64 *)time_stamp);
+    g_mutex_unlock(&message_mutex[sysid]);
+
+    return (TRUE == copied) ? 1 : 0;
+}
+
+/**
+ * @brief send COMMAND_LONG to a component.
+ * 
+ * @param target_system 
+ * @param target_component 
+ * @param command MAV_CMD
+ * @param param1 
+ * @param param2 
+ * @param param3 
+ * @param param4 
+ * @param param5 
+ * @param param6 
+ * @param param7 
+ */
+void as_api_send_command_long(uint8_t target_system, uint8_t target_component,
+                              uint16_t command, float param1, float param2,
+                              float param3, float param4, float param5,
+                              float param6, float param7)
+{
+    if (0 == as_api_check_component(target_system, target_component))
+    {
+        g_warning("no component id:%d of vehicle id:%d, in file: %s, func: %s, line: %d",
+                  target_component, target_system, __FILE__, __FUNCTION__, __LINE__);
+        return;
+    }
+
+    mavlink_command_long_t cmd = {0};
+
+    cmd.target_system = target_system;
+    cmd.target_component = target_component;
+    cmd.command = command;
+    cmd.confirmation = 0;
+    cmd.param1 = param1;
+    cmd.param2 = param2;
+    cmd.param3 = param3;
+    cmd.param4 = param4;
+    cmd.param5 = param5;
+    cmd.param6 = param6;
+    cmd.param7 = param7;
+
+    // Encode
+    mavlink_message_t message;
+    mavlink_msg_command_long_encode(STATION_SYSYEM_ID, STATION_COMPONENT_ID, &message, &cmd);
+
+    // Send the message
+    send_mavlink_message(target_system, &message);
+}
+
 /**
  * @brief 
  * 
@@ -435,6 +872,28 @@ void as_api_set_servo(uint8_t target_system,
     send_mavlink_message(target_system, &message);
 }
 
+/**
+ * @brief as_api_set_servo with ack, resent COMMAND_RETRIES times.
+ * 
+ * @param target_system 
+ * @param target_autopilot 
+ * @param servo_no 
+ * @param pwm 
+ * @param callback NULL-able, called once with MAV_RESULT or AS_COMMAND_TIMEOUT ...
+ * @param user_data 
+ * @return int command id, 0 for failed and callback is not called
+ */
+int as_api_set_servo_async(uint8_t target_system, uint8_t target_autopilot,
+                           float servo_no, float pwm,
+                           as_api_command_callback_t callback, void *user_data)
+{
+    float param[7] = {servo_no, pwm, 0, 0, 0, 0, 0};
+
+    return as_api_command_long_async(target_system, target_autopilot,
+                                     MAV_CMD_DO_SET_SERVO, param, 0, COMMAND_RETRIES,
+                                     callback, user_data);
+}
+
 /**
  * @brief as_api_motor_test
  * 
@@ -466,6 +925,29 @@ void as_api_motor_test(uint8_t target_system,
     send_mavlink_message(target_system, &message);
 }
 
+/**
+ * @brief as_api_motor_test with ack, resent COMMAND_RETRIES times.
+ * 
+ * @param target_system 
+ * @param target_autopilot 
+ * @param motor_no 
+ * @param pwm 
+ * @param callback NULL-able, called once with MAV_RESULT or AS_COMMAND_TIMEOUT ...
+ * @param user_data 
+ * @return int command id, 0 for failed and callback is not called
+ */
+int as_api_motor_test_async(uint8_t target_system, uint8_t target_autopilot,
+                            float motor_no, float pwm,
+                            as_api_command_callback_t callback, void *user_data)
+{
+    float param[7] = {motor_no - 1, MOTOR_TEST_THROTTLE_PWM, pwm, 10, 8,
+                      MOTOR_TEST_ORDER_DEFAULT, 0};
+
+    return as_api_command_long_async(target_system, target_autopilot,
+                                     MAV_CMD_DO_MOTOR_TEST, param, 0, COMMAND_RETRIES,
+                                     callback, user_data);
+}
+
 /**
  * @brief set vehicle mode
  * 
@@ -488,10 +970,14 @@ void as_api_set_mode(uint8_t target_system, control_mode_t mode)
     printf("sys_id: %d, set mode to %d \n", target_system, mode);
 
     g_atomic_int_set(vehicle_mode + target_system, mode);
+    as_thread_manual_control_wake(target_system);
 }
 
+// guards parameters_request_thread on start and join
+static GMutex parameters_request_mutex;
+
 /**
- * @brief request full parameters
+ * @brief request full parameters, sync state is set running by caller.
  * 
  * @param target_system 
  * @param target_component 
@@ -504,8 +990,36 @@ void as_request_full_parameters(guint8 target_system, guint8 target_component)
     *target_ = target_system << 8;
     *target_ |= target_component;
 
-    parameters_request_thread =
+    g_mutex_lock(&parameters_request_mutex);
+
+    // last sync of this vehicle is finished
+    if (NULL != parameters_request_thread[target_system])
+    {
+        g_thread_join(parameters_request_thread[target_system]);
+    }
+
+    parameters_request_thread[target_system] =
         g_thread_new("parameters_request_worker", &parameters_request_worker, target_);
+
+    g_mutex_unlock(&parameters_request_mutex);
+}
+
+/**
+ * @brief join parameters_request_worker of a vehicle, sync is stopped by caller.
+ * 
+ * @param target_system 
+ */
+void as_request_full_parameters_join(guint8 target_system)
+{
+    g_mutex_lock(&parameters_request_mutex);
+
+    if (NULL != parameters_request_thread[target_system])
+    {
+        g_thread_join(parameters_request_thread[target_system]);
+        parameters_request_thread[target_system] = NULL;
+    }
+
+    g_mutex_unlock(&parameters_request_mutex);
 }
 
 /**
@@ -612,21 +1126,57 @@ void as_send_request_data_stream(guint8 target_system, guint8 target_component,
 }
 
 /**
- * @brief as_reauest_data_stream
+ * @brief send REQUEST_DATA_STREAM of all stream groups back-to-back,
+ * for vehicle without SET_MESSAGE_INTERVAL.
  * 
  * @param target_system 
  * @param target_component 
  */
 void as_reauest_data_stream(guint8 target_system, guint8 target_component)
 {
-    guint16 *target_ = NULL;
-    target_ = g_new0(guint16, 1);
-    g_assert(NULL != target_);
-    *target_ = target_system << 8;
-    *target_ |= target_component;
+    as_send_request_data_stream(target_system, target_component, 1, 10, 1);
+    as_send_request_data_stream(target_system, target_component, 2, 4, 1);
+    as_send_request_data_stream(target_system, target_component, 3, 4, 1);
+    as_send_request_data_stream(target_system, target_component, 6, 10, 1);
+    as_send_request_data_stream(target_system, target_component, 10, 10, 1);
+    as_send_request_data_stream(target_system, target_component, 11, 10, 1);
+    as_send_request_data_stream(target_system, target_component, 12, 3, 1);
+}
 
-    request_data_stream_thread =
-        g_thread_new("request_data_stream_worker", &request_data_stream_worker, target_);
+/**
+ * @brief clear manual control value and set vehicle status, on arm or disarm.
+ * 
+ * @param target_system 
+ * @param arm TRUE for arm
+ */
+static void as_vehicle_arm_state(uint8_t target_system, gboolean arm)
+{
+    g_assert(TRUE == g_atomic_int_get(&vehicle_slot[target_system].ready));
+    mavlink_manual_control_t *p_manual_control = vehicle_slot[target_system].manual_control;
+
+    g_mutex_lock(&manual_control_mutex[target_system]); // lock
+    // clear manual_control value
+    p_manual_control->x = 0;
+    p_manual_control->y = 0;
+    p_manual_control->z = 500;
+    p_manual_control->r = 0;
+    p_manual_control->buttons = 0;
+    g_mutex_unlock(&manual_control_mutex[target_system]); // unlock
+
+    // lost vehicle stays lost until it rejoins
+    if (TRUE == arm)
+    {
+        if (TRUE == g_atomic_int_compare_and_exchange(vehicle_status + target_system,
+                                                      SYS_DISARMED, SYS_ARMED))
+        {
+            as_thread_manual_control_wake(target_system);
+        }
+    }
+    else
+    {
+        g_atomic_int_compare_and_exchange(vehicle_status + target_system,
+                                          SYS_ARMED, SYS_DISARMED);
+    }
 }
 
 /**
@@ -655,27 +1205,36 @@ void as_api_vehicle_arm(uint8_t target_system, uint8_t target_autopilot)
     mavlink_message_t message;
     mavlink_msg_command_long_encode(STATION_SYSYEM_ID, STATION_COMPONENT_ID, &message, &cmd);
 
-    g_rw_lock_reader_lock(&manual_control_hash_table_lock);
-    mavlink_manual_control_t *p_manual_control =
-        g_hash_table_lookup(manual_control_table,
-                            g_atomic_pointer_get(sys_key + target_system));
-    g_rw_lock_reader_unlock(&manual_control_hash_table_lock);
+    as_vehicle_arm_state(target_system, TRUE);
 
-    g_assert(NULL != p_manual_control);
+    // Send the message
+    send_mavlink_message(target_system, &message);
+}
 
-    g_mutex_lock(&manual_control_mutex[target_system]); // lock
-    // clear manual_control value
-    p_manual_control->x = 0;
-    p_manual_control->y = 0;
-    p_manual_control->z = 500;
-    p_manual_control->r = 0;
-    p_manual_control->buttons = 0;
-    g_mutex_unlock(&manual_control_mutex[target_system]); // unlock
+/**
+ * @brief as_api_vehicle_arm with ack, resent COMMAND_RETRIES times.
+ * 
+ * @param target_system 
+ * @param target_autopilot 
+ * @param callback NULL-able, called once with MAV_RESULT or AS_COMMAND_TIMEOUT ...
+ * @param user_data 
+ * @return int command id, 0 for failed and callback is not called
+ */
+int as_api_vehicle_arm_async(uint8_t target_system, uint8_t target_autopilot,
+                             as_api_command_callback_t callback, void *user_data)
+{
+    float param[7] = {1.0F, 0, 0, 0, 0, 0, 0};
 
-    g_atomic_int_set(vehicle_status + target_system, SYS_ARMED);
+    int command_id = as_api_command_long_async(target_system, target_autopilot,
+                                               MAV_CMD_COMPONENT_ARM_DISARM, param, 0,
+                                               COMMAND_RETRIES, callback, user_data);
 
-    // Send the message
-    send_mavlink_message(target_system, &message);
+    if (0 != command_id)
+    {
+        as_vehicle_arm_state(target_system, TRUE);
+    }
+
+    return command_id;
 }
 
 /**
@@ -707,24 +1266,33 @@ void as_api_vehicle_disarm(uint8_t target_system, uint8_t target_autopilot)
     // Send the message
     send_mavlink_message(target_system, &message);
 
-    g_atomic_int_set(vehicle_status + target_system, SYS_DISARMED);
+    as_vehicle_arm_state(target_system, FALSE);
+}
 
-    g_rw_lock_reader_lock(&manual_control_hash_table_lock);
-    mavlink_manual_control_t *p_manual_control =
-        g_hash_table_lookup(manual_control_table,
-                            g_atomic_pointer_get(sys_key + target_system));
-    g_rw_lock_reader_unlock(&manual_control_hash_table_lock);
+/**
+ * @brief as_api_vehicle_disarm with ack, resent COMMAND_RETRIES times.
+ * 
+ * @param target_system 
+ * @param target_autopilot 
+ * @param callback NULL-able, called once with MAV_RESULT or AS_COMMAND_TIMEOUT ...
+ * @param user_data 
+ * @return int command id, 0 for failed and callback is not called
+ */
+int as_api_vehicle_disarm_async(uint8_t target_system, uint8_t target_autopilot,
+                                as_api_command_callback_t callback, void *user_data)
+{
+    float param[7] = {0.0F, 0, 0, 0, 0, 0, 0};
 
-    g_assert(NULL != p_manual_control);
+    int command_id = as_api_command_long_async(target_system, target_autopilot,
+                                               MAV_CMD_COMPONENT_ARM_DISARM, param, 0,
+                                               COMMAND_RETRIES, callback, user_data);
 
-    g_mutex_lock(&manual_control_mutex[target_system]); // lock
-    // clear manual_control value
-    p_manual_control->x = 0;
-    p_manual_control->y = 0;
-    p_manual_control->z = 500;
-    p_manual_control->r = 0;
-    p_manual_control->buttons = 0;
-    g_mutex_unlock(&manual_control_mutex[target_system]); // unlock
+    if (0 != command_id)
+    {
+        as_vehicle_arm_state(target_system, FALSE);
+    }
+
+    return command_id;
 }
 
 /**
@@ -870,7 +1438,7 @@ mavlink_statustext_t *as_api_statustex_queue_pop(uint8_t target_system)
         return NULL;
     }
 
-    return statustex_queue_pop(target_system);
+    return statustex_queue_pop(target_system, NULL);
 }
 
 /**
@@ -889,43 +1457,28 @@ int as_api_statustex_count(uint8_t target_system)
         return 0;
     }
 
-    return g_async_queue_length(statustex_queue[target_system]);
+    return as_queue_length(statustex_queue[target_system]);
 }
 
 /**
  * @brief pop statustex 
  * 
  * @param target_system 
+ * @param worker_run wait for a push while it is set, NULL for no wait
  * @return mavlink_statustext_t* 
  */
-mavlink_statustext_t *statustex_queue_pop(guint8 target_system)
+mavlink_statustext_t *statustex_queue_pop(guint8 target_system, volatile gint *worker_run)
 {
-    static mavlink_statustext_t *last_statustex;
-    static GMutex my_mutex;
-
-    g_mutex_lock(&my_mutex);
-    // only one thread can reach here,
-    // avoid repeat free of last_statustex
+    As_Queue_t *my_queue = g_atomic_pointer_get(statustex_queue + target_system);
 
-    GAsyncQueue *my_statustex_queue =
-        g_atomic_pointer_get(statustex_queue + target_system);
-
-    if (NULL == my_statustex_queue)
+    if (NULL == my_queue)
     {
         return NULL;
     }
 
-    if (NULL != last_statustex)
-    {
-        // free last statustex after pop
-        g_free(last_statustex);
-    }
-
-    last_statustex = g_async_queue_try_pop(my_statustex_queue);
-
-    g_mutex_unlock(&my_mutex);
-
-    return last_statustex;
+    // valid until next pop of this vehicle
+    return (NULL == worker_run) ? as_queue_pop_last(my_queue)
+                                : as_queue_wait_pop_last(my_queue, worker_run);
 }
 
 /**
@@ -939,30 +1492,31 @@ void statustex_queue_push(guint8 target_system,
 {
     g_assert(NULL != current_messages);
 
-    GAsyncQueue *my_statustex_queue =
-        g_atomic_pointer_get(statustex_queue + target_system);
+    As_Queue_t *my_queue = g_atomic_pointer_get(statustex_queue + target_system);
 
-    if (NULL == my_statustex_queue)
+    if (NULL == my_queue)
     {
         return;
     }
 
-    if (g_async_queue_length(my_statustex_queue) > MAX_STATUSTEX)
+    gpointer item = g_memdup(&current_messages->statustext, sizeof(mavlink_statustext_t));
+
+    if (NULL == item)
     {
-        g_critical("MAX_STATUSTEX reached!");
-        statustex_queue_pop(target_system);
+        g_error("Out of memory!");
     }
 
-    gpointer statustex_p = g_memdup(&current_messages->statustext,
-                                    sizeof(mavlink_statustext_t));
+    gint depth;
+    queue_push_t rt = as_queue_push(my_queue, item, &depth);
 
-    if (NULL == statustex_p)
+    if (QUEUE_DROPPED_OLDEST == rt || QUEUE_DROPPED_NEWEST == rt)
     {
-        g_error("Out of memory!");
+        as_log_rate_limited(G_LOG_LEVEL_CRITICAL, target_system, MAVLINK_MSG_ID_STATUSTEXT,
+                            "MAX_STATUSTEX reached! sysid: %d.", target_system);
+        as_stats_drop(target_system, STATS_DROP_STATUSTEX);
     }
 
-    g_async_queue_push(my_statustex_queue, // queue
-                       statustex_p);
+    as_stats_queue_depth(target_system, STATS_QUEUE_STATUSTEX, depth);
 }
 
 mavlink_named_value_float_t *as_api_named_val_float_queue_pop(guint8 target_system)
@@ -975,43 +1529,28 @@ mavlink_named_value_float_t *as_api_named_val_float_queue_pop(guint8 target_syst
         return NULL;
     }
 
-    return named_val_float_queue_pop(target_system);
+    return named_val_float_queue_pop(target_system, NULL);
 }
 
 /**
  * @brief pop named_val_float 
  * 
  * @param target_system 
+ * @param worker_run wait for a push while it is set, NULL for no wait
  * @return mavlink_named_value_float_t* 
  */
-mavlink_named_value_float_t *named_val_float_queue_pop(guint8 target_system)
+mavlink_named_value_float_t *named_val_float_queue_pop(guint8 target_system, volatile gint *worker_run)
 {
-    static mavlink_named_value_float_t *last_named_val_float;
-    static GMutex my_mutex;
-
-    g_mutex_lock(&my_mutex);
-    // only one thread can reach here,
-    // avoid repeat free of last_named_val_float
+    As_Queue_t *my_queue = g_atomic_pointer_get(named_val_float_queue + target_system);
 
-    GAsyncQueue *my_named_val_float_queue =
-        g_atomic_pointer_get(named_val_float_queue + target_system);
-
-    if (NULL == my_named_val_float_queue)
+    if (NULL == my_queue)
     {
         return NULL;
     }
 
-    if (NULL != last_named_val_float)
-    {
-        // free last named_val_float after pop
-        g_free(last_named_val_float);
-    }
-
-    last_named_val_float = g_async_queue_try_pop(my_named_val_float_queue);
-
-    g_mutex_unlock(&my_mutex);
-
-    return last_named_val_float;
+    // valid until next pop of this vehicle
+    return (NULL == worker_run) ? as_queue_pop_last(my_queue)
+                                : as_queue_wait_pop_last(my_queue, worker_run);
 }
 
 /**
@@ -1025,103 +1564,114 @@ void named_val_float_queue_push(guint8 target_system,
 {
     g_assert(NULL != current_messages);
 
-    GAsyncQueue *my_named_val_float_queue =
-        g_atomic_pointer_get(named_val_float_queue + target_system);
+    As_Queue_t *my_queue = g_atomic_pointer_get(named_val_float_queue + target_system);
 
-    if (NULL == my_named_val_float_queue)
+    if (NULL == my_queue)
     {
         return;
     }
 
-    if (g_async_queue_length(my_named_val_float_queue) > MAX_NAMED_VALUE_FLOAT)
+    gpointer item = g_memdup(&current_messages->named_value_float, sizeof(mavlink_named_value_float_t));
+
+    if (NULL == item)
     {
-        g_critical("MAX_NAMED_VALUE_FLOAT reached!");
-        named_val_float_queue_pop(target_system);
+        g_error("Out of memory!");
     }
 
-    gpointer named_val_float_p = g_memdup(&current_messages->named_value_float,
-                                          sizeof(mavlink_named_value_float_t));
+    gint depth;
+    queue_push_t rt = as_queue_push(my_queue, item, &depth);
 
-    if (NULL == named_val_float_p)
+    if (QUEUE_DROPPED_OLDEST == rt || QUEUE_DROPPED_NEWEST == rt)
     {
-        g_error("Out of memory!");
+        as_log_rate_limited(G_LOG_LEVEL_CRITICAL, target_system, MAVLINK_MSG_ID_NAMED_VALUE_FLOAT,
+                            "MAX_NAMED_VALUE_FLOAT reached! sysid: %d.", target_system);
+        as_stats_drop(target_system, STATS_DROP_NAMED_VAL_FLOAT);
     }
 
-    g_async_queue_push(my_named_val_float_queue, // queue
-                       named_val_float_p);
+    as_stats_queue_depth(target_system, STATS_QUEUE_NAMED_VAL_FLOAT, depth);
 }
 
 /**
  * @brief message pop 
  * 
  * @param target_system 
+ * @param worker_run wait for a push while it is set, NULL for no wait
  * @return Mavlink_Messages_t* 
  */
-Mavlink_Messages_t *message_queue_pop(guint8 target_system)
+Mavlink_Messages_t *message_queue_pop(guint8 target_system, volatile gint *worker_run)
 {
-    static Mavlink_Messages_t *last_mavlink_message;
-    static GMutex my_mutex;
-
-    g_mutex_lock(&my_mutex);
-    // only one thread can reach here,
-    // avoid repeat free of last_mavlink_message
+    As_Queue_t *my_queue = g_atomic_pointer_get(message_queue + target_system);
 
-    GAsyncQueue *my_message_queue =
-        g_atomic_pointer_get(message_queue + target_system);
-
-    if (NULL == my_message_queue)
+    if (NULL == my_queue)
     {
         return NULL;
     }
 
-    if (NULL != last_mavlink_message)
-    {
-        // free last mavlink_message after pop
-        g_free(last_mavlink_message);
-    }
-
-    last_mavlink_message = g_async_queue_try_pop(my_message_queue);
-
-    g_mutex_unlock(&my_mutex);
-
-    return last_mavlink_message;
+    // valid until next pop of this vehicle
+    return (NULL == worker_run) ? as_queue_pop_last(my_queue)
+                                : as_queue_wait_pop_last(my_queue, worker_run);
 }
 
 /**
  * @brief message push 
  * 
  * @param target_system 
- * @param current_messages 
+ * @param item g_malloc copy of current_messages, owned by queue after push
  */
 void message_queue_push(guint8 target_system,
-                        Mavlink_Messages_t *current_messages)
+                        Mavlink_Messages_t *item)
 {
-    g_assert(NULL != current_messages);
+    g_assert(NULL != item);
 
-    GAsyncQueue *my_message_queue =
-        g_atomic_pointer_get(message_queue + target_system);
+    As_Queue_t *my_queue = g_atomic_pointer_get(message_queue + target_system);
 
-    if (NULL == my_message_queue)
+    if (NULL == my_queue)
     {
+        g_free(item);
         return;
     }
 
-    if (g_async_queue_length(my_message_queue) > MAX_MESSAGE)
+    // item may be freed by push
+    guint32 msgid = item->msg_id;
+
+    gint depth;
+    queue_push_t rt = as_queue_push(my_queue, item, &depth);
+
+    if (QUEUE_DROPPED_OLDEST == rt || QUEUE_DROPPED_NEWEST == rt)
     {
-        g_critical("MAX_MESSAGE reached!");
-        message_queue_pop(target_system);
+        as_log_rate_limited(G_LOG_LEVEL_CRITICAL, target_system, msgid,
+                            "MAX_MESSAGE reached! sysid: %d.", target_system);
+        as_stats_drop(target_system, STATS_DROP_MESSAGE);
     }
 
-    gpointer mavlink_message_p = g_memdup(current_messages,
-                                          sizeof(Mavlink_Messages_t));
+    as_stats_queue_depth(target_system, STATS_QUEUE_MESSAGE, depth);
+}
 
-    if (NULL == mavlink_message_p)
+/**
+ * @brief read newest msg of msgid from mailbox, needs F_MSG_MAILBOX.
+ * never waits for I/O thread, a reader late for several updates
+ * gets the newest one only.
+ * 
+ * @param sysid 
+ * @param msgid 
+ * @param msg NULL-able, decoded mavlink struct of msgid, e.g. mavlink_attitude_t
+ * @param generation [in, out] generation read last time, 0 for none
+ * @param time_stamp [out] NULL-able, monotonic time of receive, in microseconds
+ * @return int 1 if msg is newer than generation, 0 if not,
+ * -1 if no mailbox for this vehicle or msgid
+ */
+int as_api_mailbox_read(uint8_t sysid, uint32_t msgid, void *msg,
+                        uint32_t *generation, uint64_t *time_stamp)
+{
+    g_assert(NULL != generation);
+
+    if (0 == as_api_check_vehicle(sysid) || NULL == vehicle_slot[sysid].mailbox)
     {
-        g_error("Out of memory!");
+        return -1;
     }
 
-    g_async_queue_push(my_message_queue, // queue
-                       mavlink_message_p);
+    return as_msg_mailbox_read(vehicle_slot[sysid].mailbox, msgid, msg,
+                               generation, time_stamp);
 }
 
 /**
@@ -1150,5 +1700,5 @@ void as_insert_command(as_command_t as_command)
     as_command_t *as_command_p =
         (as_command_t *)g_memdup(&as_command, sizeof(as_command_t));
 
-    g_thread_new("", db_insert_command_worker, (gpointer)as_command_p);
+    db_insert_command_queue_push(as_command_p);
 }
\ No newline at end of file
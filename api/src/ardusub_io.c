@@ -13,6 +13,8 @@
 
 #include "../inc/ardusub_io.h"
 #include "../inc/ardusub_msg.h"
+#include "../inc/ardusub_stats.h"
+#include "../inc/ardusub_lifecycle.h"
 
 /**
  * @brief udp read init
@@ -51,9 +53,167 @@ void as_udp_read_init()
 #endif
 
     g_io_channel_set_encoding(channel, NULL, &error);
-    g_io_add_watch(channel, G_IO_IN, (GIOFunc)udp_read_callback, NULL);
+    g_io_add_watch(channel, G_IO_IN, (GIOFunc)udp_read_callback, socket_udp_read);
+
+    // shard parsing by source, one source always goes to the same thread
+    if (as_config_udp_parse_threads > 1)
+    {
+        for (gint i = 0; i < as_config_udp_parse_threads; i++)
+        {
+            udp_parse_queue[i] = g_async_queue_new();
+            udp_parse_thread[i] =
+                g_thread_new("udp_parse_worker", &udp_parse_worker, udp_parse_queue[i]);
+        }
+    }
+}
+
+/**
+ * @brief get parser state of a UDP source, only called in main loop.
+ * 
+ * @param address source address of datagram
+ * @return Udp_Source_t* NULL if MAX_UDP_SOURCE reached
+ */
+Udp_Source_t *as_udp_source_lookup(GSocketAddress *address)
+{
+    static GHashTable *udp_source_table;
+
+    g_assert(NULL != address);
+
+    if (NULL == udp_source_table)
+    {
+        udp_source_table = g_hash_table_new(g_int64_hash, g_int64_equal);
+    }
+
+    GInetSocketAddress *inet_socket_address = G_INET_SOCKET_ADDRESS(address);
+    const guint8 *ip = g_inet_address_to_bytes(
+        g_inet_socket_address_get_address(inet_socket_address));
+
+    guint64 key = ((guint64)ip[0] << 40) | ((guint64)ip[1] << 32) |
+                  ((guint64)ip[2] << 24) | ((guint64)ip[3] << 16) |
+                  g_inet_socket_address_get_port(inet_socket_address);
+
+    Udp_Source_t *source = g_hash_table_lookup(udp_source_table, &key);
+
+    if (NULL != source)
+    {
+        return source;
+    }
+
+    if (g_hash_table_size(udp_source_table) >= MAX_UDP_SOURCE)
+    {
+        as_log_rate_limited(G_LOG_LEVEL_WARNING, 0, 0, "MAX_UDP_SOURCE reached!");
+        as_stats_drop_global(STATS_DROP_UDP_SOURCE);
+        return NULL;
+    }
+
+    source = g_new0(Udp_Source_t, 1);
+
+    if (NULL == source)
+    {
+        g_error("Out of memory!");
+    }
+
+    source->key = key;
+    source->shard = g_int64_hash(&key) % MAX(as_config_udp_parse_threads, 1);
+    source->link_id = as_link_id_new();
+
+    g_hash_table_insert(udp_source_table, &source->key, source);
+
+    return source;
+}
+
+/**
+ * @brief parse all frames in a datagram with parser state of its source.
+ * 
+ * @param source 
+ * @param buf 
+ * @param len 
+ */
+void as_udp_parse_datagram(Udp_Source_t *source, const guint8 *buf, gsize len)
+{
+    mavlink_message_t message;
+    mavlink_status_t status;
+
+    for (gsize i = 0; i < len; i++)
+    {
+        guint8 framing =
+            mavlink_frame_char_buffer(&source->rx_message, &source->rx_status,
+                                      buf[i], &message, &status);
+
+        if (MAVLINK_FRAMING_OK == framing)
+        {
+            as_find_new_system(message, NULL);
+
+            as_handle_messages(message, source->link_id);
+        }
+        else if (MAVLINK_FRAMING_BAD_CRC == framing)
+        {
+            // message holds header of the bad frame
+            as_link_loss_crc_failed(source->link_id, message.sysid, message.compid);
+            as_stats_parse_error(message.sysid);
+        }
+        else if (MAVLINK_FRAMING_BAD_SIGNATURE == framing)
+        {
+            as_stats_parse_error(message.sysid);
+        }
+    }
 }
 
+/**
+ * @brief push a copy of datagram to the parse thread of its source.
+ * 
+ * @param source 
+ * @param buf 
+ * @param len 
+ */
+void udp_parse_queue_push(Udp_Source_t *source, const guint8 *buf, gsize len)
+{
+    GAsyncQueue *my_queue = udp_parse_queue[source->shard];
+
+    if (g_async_queue_length(my_queue) > MAX_UDP_PARSE_QUEUE)
+    {
+        as_log_rate_limited(G_LOG_LEVEL_WARNING, 0, source->shard,
+                            "MAX_UDP_PARSE_QUEUE reached! parse thread: %d.", source->shard);
+        as_stats_drop_global(STATS_DROP_UDP_PARSE_QUEUE);
+        return;
+    }
+
+    Udp_Datagram_t *datagram = g_malloc(sizeof(Udp_Datagram_t) + len);
+
+    if (NULL == datagram)
+    {
+        g_error("Out of memory!");
+    }
+
+    datagram->source = source;
+    datagram->len = len;
+    memcpy(datagram->buf, buf, len);
+
+    g_async_queue_push(my_queue, datagram);
+}
+
+#ifndef NO_SERISL
+/**
+ * @brief start serial_port_read_write_worker of opened port, handle is
+ * joined in as_thread_stop_all_join.
+ *
+ * @param port
+ */
+static void as_serial_port_thread_new(struct sp_port *port)
+{
+    static gint serial_port_thread_index;
+
+    if (MAVLINK_COMM_NUM_BUFFERS <= serial_port_thread_index)
+    {
+        g_error("MAVLINK_COMM_NUM_BUFFERS reached!");
+    }
+
+    serial_port_thread[serial_port_thread_index++] =
+        g_thread_new("serial_port_read_write_worker",
+                     &serial_port_read_write_worker, port);
+}
+#endif
+
 /**
  * @brief serial read init
  * 
@@ -64,7 +224,7 @@ void as_serial_read_init()
     // prepare serial_write_buf_queue
     for (gint i = 0; i < MAVLINK_COMM_NUM_BUFFERS; i++)
     {
-        serial_write_buf_queue[i] = g_async_queue_new();
+        serial_write_buf_queue[i] = as_queue_new(AS_QUEUE_SERIAL_WRITE_BUF);
     }
 
     struct sp_port **serial_port_list;
@@ -107,9 +267,7 @@ void as_serial_read_init()
                     g_error("port open faild!");
                 }
 
-                g_thread_new("serial_port_read_write_worker",
-                             &serial_port_read_write_worker,
-                             serial_port_list[i]);
+                as_serial_port_thread_new(serial_port_list[i]);
             }
             // ArduPilot Pixhawk1 device vid == 483, pid == 5740
             else if (vid == 1155 && pid == 22336)
@@ -123,9 +281,7 @@ void as_serial_read_init()
                     g_error("port open faild!");
                 }
 
-                g_thread_new("serial_port_read_write_worker",
-                             &serial_port_read_write_worker,
-                             serial_port_list[i]);
+                as_serial_port_thread_new(serial_port_list[i]);
             }
             // Silicon Labs CP210x USB to UART Bridge vid == 4292, pid == 60000
             else if (vid == 4292 && pid == 60000)
@@ -137,9 +293,7 @@ void as_serial_read_init()
                     g_error("port open faild!");
                 }
 
-                g_thread_new("serial_port_read_write_worker",
-                             &serial_port_read_write_worker,
-                             serial_port_list[i]);
+                as_serial_port_thread_new(serial_port_list[i]);
             }
             else
             {
@@ -211,10 +365,17 @@ gboolean as_find_new_system(mavlink_message_t message, guint8 *targer_serial_cha
 
     gboolean new_system = FALSE;
 
-    // NOTE: this doesn't handle multiple compid for one sysid.
     target_system = message.sysid;
     target_autopilot = message.compid;
 
+    // only autopilot heartbeat adds a new system,
+    // other components of this sysid are added in as_handle_messages.
+    if ((MAVLINK_MSG_ID_HEARTBEAT != message.msgid) ||
+        (MAV_AUTOPILOT_INVALID == mavlink_msg_heartbeat_get_autopilot(&message)))
+    {
+        return FALSE;
+    }
+
     g_mutex_lock(&message_mutex[target_system]);
 
     if (SYS_UN_INIT == g_atomic_int_get(vehicle_status + target_system)) // find new system
@@ -246,8 +407,6 @@ gboolean as_find_new_system(mavlink_message_t message, guint8 *targer_serial_cha
                           current_parameter,
                           current_target_socket,
                           NULL);
-            g_atomic_int_set(vehicle_status + target_system, SYS_DISARMED);
-            g_message("New system added: %d", target_system);
         }
         else
         {
@@ -266,12 +425,26 @@ gboolean as_find_new_system(mavlink_message_t message, guint8 *targer_serial_cha
                           current_parameter,
                           NULL,
                           current_targer_serial_chan);
-            g_atomic_int_set(vehicle_status + target_system, SYS_DISARMED);
-            g_message("New system added: %d", target_system);
         }
 
+        // workers are started without message_mutex, status is
+        // SYS_INITIATING until then
+        as_lifecycle_request_start(target_system, FALSE);
+
         new_system = TRUE; // find new system
     }
+    else if (SYS_LOST == g_atomic_int_get(vehicle_status + target_system) &&
+             TRUE == as_lifecycle_unpark(target_system))
+    {
+        // lost system is back, slot and its cached state are reused
+        g_atomic_int_set(vehicle_status + target_system, SYS_INITIATING);
+        g_message("Found lost system: %d", target_system);
+        as_lifecycle_request_start(target_system, TRUE);
+
+        new_system = TRUE;
+    }
+
+    as_lifecycle_heartbeat(target_system, target_autopilot);
 
     g_mutex_unlock(&message_mutex[target_system]);
 
@@ -298,35 +471,33 @@ void send_mavlink_message(guint8 target_system, mavlink_message_t *message)
 
     // make sure msg write interval more than MIN_MSG_INTERVAL
     // TODO: serial port maybe dont need to do this???
-    while (g_get_monotonic_time() - last_monotonic_time < MIN_MSG_INTERVAL)
-    {
-        // g_get_monotonic_time() could return negative value
-        // this will fix it.
-        if (g_get_monotonic_time() - last_monotonic_time < 0)
-        {
-            g_usleep(MIN_MSG_INTERVAL);
-            break;
-        }
+    gint64 elapsed = g_get_monotonic_time() - last_monotonic_time;
 
-        g_usleep(100);
+    // g_get_monotonic_time() could return negative value
+    // this will fix it.
+    if (elapsed < 0)
+    {
+        g_usleep(MIN_MSG_INTERVAL);
+    }
+    else if (elapsed < MIN_MSG_INTERVAL)
+    {
+        // one sleep for the rest of interval
+        g_usleep(MIN_MSG_INTERVAL - elapsed);
     }
     last_monotonic_time = g_get_monotonic_time();
 
-    gpointer my_system_key = g_atomic_pointer_get(sys_key + target_system);
-
-    g_assert(NULL != my_system_key);
+    g_assert(TRUE == g_atomic_int_get(&vehicle_slot[target_system].ready));
     g_assert(NULL != message);
 
-    g_rw_lock_reader_lock(&target_hash_table_lock);
-    gpointer target = g_hash_table_lookup(target_hash_table,
-                                          my_system_key);
-    g_rw_lock_reader_unlock(&target_hash_table_lock);
+    gpointer target = vehicle_slot[target_system].target;
 
     g_assert(NULL != target);
 
     // Translate message to buffer
     msg_len = mavlink_msg_to_send_buffer((uint8_t *)msg_buf, message);
 
+    as_stats_bytes_out(target_system, msg_len);
+
     // Send
     if (NULL != subnet_address)
     {
@@ -426,6 +597,57 @@ void send_param_request_read(guint8 target_system, guint8 target_component, gint
     send_mavlink_message(target_system, &message);
 }
 
+/**
+ * @brief param_request_read by param_id
+ * 
+ * @param target_system 
+ * @param target_component 
+ * @param param_id 
+ */
+void send_param_request_read_by_id(guint8 target_system, guint8 target_component,
+                                   const gchar *param_id)
+{
+    mavlink_param_request_read_t prr = {0};
+
+    prr.target_system = target_system;
+    prr.target_component = target_component;
+    prr.param_index = -1; // use param_id
+    strncpy(prr.param_id, param_id, sizeof(prr.param_id));
+
+    mavlink_message_t message;
+
+    mavlink_msg_param_request_read_encode(STATION_SYSYEM_ID, STATION_COMPONENT_ID, &message, &prr);
+
+    send_mavlink_message(target_system, &message);
+}
+
+/**
+ * @brief param_set
+ * 
+ * @param target_system 
+ * @param target_component 
+ * @param param_id 
+ * @param param_value 
+ * @param param_type MAV_PARAM_TYPE
+ */
+void send_param_set(guint8 target_system, guint8 target_component,
+                    const gchar *param_id, gfloat param_value, guint8 param_type)
+{
+    mavlink_param_set_t ps = {0};
+
+    ps.target_system = target_system;
+    ps.target_component = target_component;
+    strncpy(ps.param_id, param_id, sizeof(ps.param_id));
+    ps.param_value = param_value;
+    ps.param_type = param_type;
+
+    mavlink_message_t message;
+
+    mavlink_msg_param_set_encode(STATION_SYSYEM_ID, STATION_COMPONENT_ID, &message, &ps);
+
+    send_mavlink_message(target_system, &message);
+}
+
 /**
  * @brief serial_write_buf_queue_pop
  * 
@@ -434,32 +656,15 @@ void send_param_request_read(guint8 target_system, guint8 target_component, gint
  */
 gchar *serial_write_buf_queue_pop(guint8 chan)
 {
-    static gchar *last_buf;
-    static GMutex my_mutex;
-
-    g_mutex_lock(&my_mutex);
-    // only one thread can reach here,
-    // avoid repeat free of last_buf
-
-    GAsyncQueue *my_serial_write_buf_queue =
-        g_atomic_pointer_get(serial_write_buf_queue + chan);
+    As_Queue_t *my_queue = g_atomic_pointer_get(serial_write_buf_queue + chan);
 
-    if (NULL == my_serial_write_buf_queue)
+    if (NULL == my_queue)
     {
         return NULL;
     }
 
-    if (NULL != last_buf)
-    {
-        // free last mavlink_message after pop
-        g_free(last_buf);
-    }
-
-    last_buf = g_async_queue_try_pop(my_serial_write_buf_queue);
-
-    g_mutex_unlock(&my_mutex);
-
-    return last_buf;
+    // valid until next pop of this chan
+    return as_queue_pop_last(my_queue);
 }
 
 /**
@@ -474,23 +679,14 @@ void serial_write_buf_queue_push(guint8 chan, gchar *buf, gsize buf_len)
 {
     g_assert(NULL != buf);
 
-    GAsyncQueue *my_serial_write_buf_queue =
-        g_atomic_pointer_get(serial_write_buf_queue + chan);
+    As_Queue_t *my_queue = g_atomic_pointer_get(serial_write_buf_queue + chan);
 
     // serial port not ready
-    if (NULL == my_serial_write_buf_queue)
+    if (NULL == my_queue)
     {
         return;
     }
 
-    if (g_async_queue_length(my_serial_write_buf_queue) >
-        MAX_SERIAL_PORT_WRITE_BUF_COUNT)
-    {
-        g_message("MAX_SERIAL_PORT_WRITE_BUF_COUNT reached!");
-        g_message("dump one msg buf!");
-        serial_write_buf_queue_pop(chan);
-    }
-
     gchar *serial_write_buf_p = (gchar *)g_new0(gchar, buf_len + 1);
 
     if (NULL == serial_write_buf_p)
@@ -502,7 +698,17 @@ void serial_write_buf_queue_push(guint8 chan, gchar *buf, gsize buf_len)
 
     memcpy(serial_write_buf_p + 1, buf, buf_len);
 
-    g_async_queue_push(my_serial_write_buf_queue,
-                       (gpointer)serial_write_buf_p);
+    gint depth;
+    queue_push_t rt = as_queue_push(my_queue, serial_write_buf_p, &depth);
+
+    if (QUEUE_DROPPED_OLDEST == rt || QUEUE_DROPPED_NEWEST == rt)
+    {
+        as_log_rate_limited(G_LOG_LEVEL_MESSAGE, chan, 0,
+                            "MAX_SERIAL_PORT_WRITE_BUF_COUNT reached! dump one msg buf, chan: %d.",
+                            chan);
+        as_stats_serial_drop(chan);
+    }
+
+    as_stats_serial_queue_depth(chan, depth);
 }
 #endif
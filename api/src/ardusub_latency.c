@@ -0,0 +1,596 @@
+/**
+ * @file ardusub_latency.c
+ * @author ztluo (me@ztluo.dev)
+ * @brief round trip latency probe by PING or TIMESYNC, with histogram and alarm.
+ * @version
+ * @date 2019-06-06
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#define G_LOG_DOMAIN "[ardusub latency   ]"
+
+#include "../inc/ardusub_latency.h"
+#include "../inc/ardusub_interface.h"
+
+static Latency_Probe_t latency_probe[MAX_VEHICLE_SLOT];
+
+static GMutex latency_worker_mutex;
+static GCond latency_worker_cond; // signalled on new probe and stop
+static GThread *latency_thread;
+static volatile gint latency_worker_run;
+
+// timeout scan of a probe waiting for next send
+#define LATENCY_WORKER_INTERVAL (100000) // in microseconds
+
+/**
+ * @brief histogram bucket of round trip, linear under 4 us, then 4
+ * buckets per octave.
+ *
+ * @param rtt in microseconds
+ * @return guint
+ */
+static guint as_latency_bucket(gint64 rtt)
+{
+    if (4 > rtt)
+    {
+        return MAX(rtt, 0);
+    }
+
+    guint octave = g_bit_storage(rtt) - 1;
+    guint bucket = 4 * (octave - 1) + ((rtt >> (octave - 2)) & 3);
+
+    return MIN(bucket, LATENCY_HISTOGRAM_BUCKETS - 1);
+}
+
+/**
+ * @brief upper bound of histogram bucket.
+ *
+ * @param bucket
+ * @return gint64 in microseconds
+ */
+static gint64 as_latency_bucket_upper(guint bucket)
+{
+    if (4 > bucket)
+    {
+        return bucket + 1;
+    }
+
+    guint octave = bucket / 4 + 1;
+    gint64 width = (gint64)1 << (octave - 2);
+
+    return (4 + bucket % 4) * width + width;
+}
+
+/**
+ * @brief add round trip to histogram.
+ *
+ * @param histogram
+ * @param rtt in microseconds
+ */
+static void as_latency_histogram_add(Latency_Histogram_t *histogram, gint64 rtt)
+{
+    if (0 == histogram->total || rtt < histogram->min)
+    {
+        histogram->min = rtt;
+    }
+    histogram->max = MAX(histogram->max, rtt);
+    histogram->sum += rtt;
+    histogram->total++;
+    histogram->count[as_latency_bucket(rtt)]++;
+}
+
+/**
+ * @brief percentile of histogram, not above max.
+ *
+ * @param histogram
+ * @param percent 0 - 100
+ * @return gint64 in microseconds, 0 for empty
+ */
+static gint64 as_latency_histogram_percentile(const Latency_Histogram_t *histogram,
+                                              guint percent)
+{
+    if (0 == histogram->total)
+    {
+        return 0;
+    }
+
+    guint64 rank = (histogram->total * percent + 99) / 100;
+    guint64 count = 0;
+
+    for (guint i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+    {
+        count += histogram->count[i];
+        if (count >= rank)
+        {
+            return MIN(as_latency_bucket_upper(i), histogram->max);
+        }
+    }
+
+    return histogram->max;
+}
+
+/**
+ * @brief stats of histogram and counters.
+ *
+ * @param histogram
+ * @param sent
+ * @param lost
+ * @param stats
+ */
+static void as_latency_fill_stats(const Latency_Histogram_t *histogram,
+                                  guint64 sent, guint64 lost, Latency_Stats_t *stats)
+{
+    stats->sent = sent;
+    stats->received = histogram->total;
+    stats->lost = lost;
+    stats->min = histogram->min;
+    stats->mean = (0 == histogram->total) ? 0 : histogram->sum / (gint64)histogram->total;
+    stats->p50 = as_latency_histogram_percentile(histogram, 50);
+    stats->p99 = as_latency_histogram_percentile(histogram, 99);
+    stats->max = histogram->max;
+}
+
+/**
+ * @brief record reply of request, call with probe mutex locked.
+ *
+ * @param my_probe
+ * @param my_request
+ */
+static void as_latency_reply(Latency_Probe_t *my_probe, Latency_Request_t *my_request)
+{
+    gint64 rtt = g_get_monotonic_time() - my_request->sent_time;
+
+    my_request->pending = FALSE;
+
+    as_latency_histogram_add(&my_probe->histogram, rtt);
+    as_latency_histogram_add(&my_probe->window_histogram, rtt);
+}
+
+/**
+ * @brief PING handler, runs on I/O thread, reply addressed to station only.
+ *
+ * @param target_system
+ * @param ping
+ */
+void as_latency_ping_received(guint8 target_system, const mavlink_ping_t *ping)
+{
+    if (STATION_SYSYEM_ID != ping->target_system ||
+        STATION_COMPONENT_ID != ping->target_component)
+    {
+        return;
+    }
+
+    Latency_Probe_t *my_probe = latency_probe + target_system;
+
+    g_mutex_lock(&my_probe->mutex);
+
+    Latency_Request_t *my_request = my_probe->request + ping->seq % LATENCY_PROBE_IN_FLIGHT;
+    if (my_probe->active && my_request->pending && ping->seq == my_request->seq &&
+        (guint64)my_request->sent_time == ping->time_usec)
+    {
+        as_latency_reply(my_probe, my_request);
+    }
+
+    g_mutex_unlock(&my_probe->mutex);
+}
+
+/**
+ * @brief TIMESYNC reply, runs on I/O thread, replies of timesync worker
+ * do not match a probe request.
+ *
+ * @param target_system
+ * @param ts1 in nanoseconds
+ */
+void as_latency_timesync_received(guint8 target_system, gint64 ts1)
+{
+    Latency_Probe_t *my_probe = latency_probe + target_system;
+
+    g_mutex_lock(&my_probe->mutex);
+
+    for (guint i = 0; my_probe->active && i < LATENCY_PROBE_IN_FLIGHT; i++)
+    {
+        Latency_Request_t *my_request = my_probe->request + i;
+        if (my_request->pending && my_request->sent_time * 1000 == ts1)
+        {
+            as_latency_reply(my_probe, my_request);
+            break;
+        }
+    }
+
+    g_mutex_unlock(&my_probe->mutex);
+}
+
+/**
+ * @brief send probe request.
+ *
+ * @param target_system
+ * @param method
+ * @param seq
+ * @param sent_time in microseconds
+ */
+static void as_latency_send(guint8 target_system, guint method, guint32 seq, gint64 sent_time)
+{
+    mavlink_message_t message;
+
+    if (AS_LATENCY_PROBE_PING == method)
+    {
+        mavlink_ping_t ping;
+        ping.time_usec = sent_time;
+        ping.seq = seq;
+        ping.target_system = 0; // 0 for request
+        ping.target_component = 0;
+
+        mavlink_msg_ping_encode(STATION_SYSYEM_ID, STATION_COMPONENT_ID, &message, &ping);
+    }
+    else
+    {
+        mavlink_timesync_t timesync_msg;
+        timesync_msg.tc1 = 0; // 0 for request
+        timesync_msg.ts1 = sent_time * 1000;
+
+        mavlink_msg_timesync_encode(STATION_SYSYEM_ID, STATION_COMPONENT_ID,
+                                    &message, &timesync_msg);
+    }
+
+    send_mavlink_message(target_system, &message);
+}
+
+/**
+ * @brief check alarm on stats of finished window, call with probe mutex locked.
+ *
+ * @param my_probe
+ * @param stats [out] window stats
+ * @return gboolean TRUE if alarm changed
+ */
+static gboolean as_latency_check_alarm(Latency_Probe_t *my_probe, Latency_Stats_t *stats)
+{
+    as_latency_fill_stats(&my_probe->window_histogram, my_probe->window_sent,
+                          my_probe->window_lost, stats);
+
+    gboolean alarm = FALSE;
+
+    if (0 != my_probe->alarm_p99 && stats->p99 > my_probe->alarm_p99)
+    {
+        alarm = TRUE;
+    }
+
+    if (0 < my_probe->alarm_loss && 0 != stats->sent &&
+        (gfloat)stats->lost / stats->sent > my_probe->alarm_loss)
+    {
+        alarm = TRUE;
+    }
+
+    memset(&my_probe->window_histogram, 0, sizeof(Latency_Histogram_t));
+    my_probe->window_sent = 0;
+    my_probe->window_lost = 0;
+
+    gboolean changed = (alarm != my_probe->alarm);
+    my_probe->alarm = alarm;
+    stats->alarm = alarm;
+
+    return changed;
+}
+
+/**
+ * @brief one pass of a probe: send due request, time out old ones and
+ * check alarm at end of window.
+ *
+ * @param target_system
+ * @param now in microseconds
+ * @return gint64 next wake up time of this probe
+ */
+static gint64 as_latency_run_probe(guint8 target_system, gint64 now)
+{
+    Latency_Probe_t *my_probe = latency_probe + target_system;
+
+    g_mutex_lock(&my_probe->mutex);
+
+    if (FALSE == my_probe->active || TRUE == my_probe->suspended)
+    {
+        g_mutex_unlock(&my_probe->mutex);
+        return G_MAXINT64;
+    }
+
+    for (guint i = 0; i < LATENCY_PROBE_IN_FLIGHT; i++)
+    {
+        Latency_Request_t *my_request = my_probe->request + i;
+        if (my_request->pending && now - my_request->sent_time > LATENCY_PROBE_TIMEOUT)
+        {
+            my_request->pending = FALSE;
+            my_probe->lost++;
+            my_probe->window_lost++;
+        }
+    }
+
+    gboolean send = (now >= my_probe->next_send);
+    guint method = my_probe->method;
+    guint32 seq = 0;
+
+    if (send)
+    {
+        seq = my_probe->seq++;
+        Latency_Request_t *my_request = my_probe->request + seq % LATENCY_PROBE_IN_FLIGHT;
+
+        // only at rate over LATENCY_PROBE_IN_FLIGHT per timeout
+        if (my_request->pending)
+        {
+            my_probe->lost++;
+            my_probe->window_lost++;
+        }
+
+        my_request->pending = TRUE;
+        my_request->seq = seq;
+        my_request->sent_time = now;
+        my_probe->sent++;
+        my_probe->window_sent++;
+
+        // fixed rate, no burst after a late pass
+        my_probe->next_send = MAX(my_probe->next_send + my_probe->interval, now);
+    }
+
+    Latency_Stats_t window_stats;
+    gboolean alarm_changed = FALSE;
+    if (now - my_probe->window_start >= LATENCY_ALARM_WINDOW)
+    {
+        my_probe->window_start = now;
+        alarm_changed = as_latency_check_alarm(my_probe, &window_stats);
+    }
+
+    as_api_latency_alarm_callback_t callback = my_probe->callback;
+    gpointer user_data = my_probe->user_data;
+    gint64 next_wake = MIN(my_probe->next_send, now + LATENCY_WORKER_INTERVAL);
+
+    g_mutex_unlock(&my_probe->mutex);
+
+    if (send)
+    {
+        as_latency_send(target_system, method, seq, now);
+    }
+
+    if (alarm_changed)
+    {
+        if (window_stats.alarm)
+        {
+            g_warning("vehicle id:%d latency alarm, p99: %" G_GINT64_FORMAT " us, lost: %" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT ".",
+                      target_system, window_stats.p99, window_stats.lost, window_stats.sent);
+        }
+        else
+        {
+            g_message("vehicle id:%d latency alarm cleared, p99: %" G_GINT64_FORMAT " us.",
+                      target_system, window_stats.p99);
+        }
+
+        if (NULL != callback)
+        {
+            callback(target_system, window_stats.alarm, &window_stats, user_data);
+        }
+    }
+
+    return next_wake;
+}
+
+/**
+ * @brief run latency probes of all vehicles.
+ *
+ * @param data
+ * @return gpointer
+ */
+static gpointer latency_worker(gpointer data)
+{
+    g_assert(NULL == data);
+
+    g_mutex_lock(&latency_worker_mutex);
+
+    while (1 == g_atomic_int_get(&latency_worker_run))
+    {
+        g_mutex_unlock(&latency_worker_mutex);
+
+        gint64 now = g_get_monotonic_time();
+        gint64 wake_time = now + LATENCY_WORKER_INTERVAL;
+
+        gint count = g_atomic_int_get(&active_sysid_count);
+        for (gint i = 0; i < count; i++)
+        {
+            wake_time = MIN(wake_time, as_latency_run_probe(active_sysid[i], now));
+        }
+
+        g_mutex_lock(&latency_worker_mutex);
+
+        if (1 == g_atomic_int_get(&latency_worker_run))
+        {
+            g_cond_wait_until(&latency_worker_cond, &latency_worker_mutex, wake_time);
+        }
+    }
+
+    g_mutex_unlock(&latency_worker_mutex);
+
+    return NULL;
+}
+
+/**
+ * @brief start round trip probe of vehicle, restarts stats if running.
+ *
+ * @param target_system
+ * @param method AS_LATENCY_PROBE_TIMESYNC or AS_LATENCY_PROBE_PING
+ * @param rate_hz requests per second, 1 - LATENCY_PROBE_MAX_RATE
+ * @param alarm_p99_us alarm if p99 of a window is above it, 0 for none
+ * @param alarm_loss alarm if lost / sent of a window is above it, 0 for none
+ * @param callback NULL-able, called when alarm is raised or cleared
+ * @param user_data
+ * @return int 0 for failed
+ */
+int as_api_latency_probe_start(uint8_t target_system, unsigned int method,
+                               unsigned int rate_hz, unsigned int alarm_p99_us,
+                               float alarm_loss,
+                               as_api_latency_alarm_callback_t callback,
+                               void *user_data)
+{
+    if (0 == as_api_check_vehicle(target_system) ||
+        AS_LATENCY_PROBE_PING < method ||
+        0 == rate_hz || LATENCY_PROBE_MAX_RATE < rate_hz)
+    {
+        return 0;
+    }
+
+    Latency_Probe_t *my_probe = latency_probe + target_system;
+    gint64 now = g_get_monotonic_time();
+
+    g_mutex_lock(&my_probe->mutex);
+
+    memset(my_probe->request, 0, sizeof(my_probe->request));
+    memset(&my_probe->histogram, 0, sizeof(Latency_Histogram_t));
+    memset(&my_probe->window_histogram, 0, sizeof(Latency_Histogram_t));
+    my_probe->method = method;
+    my_probe->interval = G_USEC_PER_SEC / rate_hz;
+    my_probe->next_send = now;
+    my_probe->sent = 0;
+    my_probe->lost = 0;
+    my_probe->window_sent = 0;
+    my_probe->window_lost = 0;
+    my_probe->window_start = now;
+    my_probe->alarm_p99 = alarm_p99_us;
+    my_probe->alarm_loss = alarm_loss;
+    my_probe->alarm = FALSE;
+    my_probe->callback = callback;
+    my_probe->user_data = user_data;
+    my_probe->suspended = FALSE;
+    my_probe->active = TRUE;
+
+    g_mutex_unlock(&my_probe->mutex);
+
+    g_mutex_lock(&latency_worker_mutex);
+
+    if (NULL == latency_thread)
+    {
+        g_atomic_int_set(&latency_worker_run, 1);
+        latency_thread = g_thread_new("latency_worker", &latency_worker, NULL);
+    }
+    g_cond_signal(&latency_worker_cond);
+
+    g_mutex_unlock(&latency_worker_mutex);
+
+    return 1;
+}
+
+/**
+ * @brief stop round trip probe of vehicle, stats are kept.
+ *
+ * @param target_system
+ * @return int 0 for not running
+ */
+int as_api_latency_probe_stop(uint8_t target_system)
+{
+    Latency_Probe_t *my_probe = latency_probe + target_system;
+
+    g_mutex_lock(&my_probe->mutex);
+
+    gboolean active = my_probe->active;
+    my_probe->active = FALSE;
+
+    g_mutex_unlock(&my_probe->mutex);
+
+    return active;
+}
+
+/**
+ * @brief hold probe of a lost vehicle, requests in flight are dropped
+ * without counting them as lost.
+ *
+ * @param target_system
+ */
+void as_latency_suspend(guint8 target_system)
+{
+    Latency_Probe_t *my_probe = latency_probe + target_system;
+
+    g_mutex_lock(&my_probe->mutex);
+
+    my_probe->suspended = TRUE;
+    memset(my_probe->request, 0, sizeof(my_probe->request));
+
+    g_mutex_unlock(&my_probe->mutex);
+}
+
+/**
+ * @brief go on with probe of a rejoined vehicle, alarm window starts again.
+ *
+ * @param target_system
+ */
+void as_latency_resume(guint8 target_system)
+{
+    Latency_Probe_t *my_probe = latency_probe + target_system;
+    gint64 now = g_get_monotonic_time();
+
+    g_mutex_lock(&my_probe->mutex);
+
+    gboolean resumed = my_probe->suspended;
+    if (resumed)
+    {
+        memset(&my_probe->window_histogram, 0, sizeof(Latency_Histogram_t));
+        my_probe->window_sent = 0;
+        my_probe->window_lost = 0;
+        my_probe->window_start = now;
+        my_probe->next_send = now;
+        my_probe->suspended = FALSE;
+    }
+
+    g_mutex_unlock(&my_probe->mutex);
+
+    if (resumed)
+    {
+        g_mutex_lock(&latency_worker_mutex);
+        g_cond_signal(&latency_worker_cond);
+        g_mutex_unlock(&latency_worker_mutex);
+    }
+}
+
+/**
+ * @brief get round trip stats of vehicle since probe start.
+ *
+ * @param target_system
+ * @param stats
+ * @return int 0 for never started
+ */
+int as_api_latency_get_stats(uint8_t target_system, Latency_Stats_t *stats)
+{
+    g_assert(NULL != stats);
+
+    Latency_Probe_t *my_probe = latency_probe + target_system;
+
+    g_mutex_lock(&my_probe->mutex);
+
+    gboolean started = (0 != my_probe->interval);
+    if (started)
+    {
+        as_latency_fill_stats(&my_probe->histogram, my_probe->sent, my_probe->lost, stats);
+        stats->alarm = my_probe->alarm;
+    }
+
+    g_mutex_unlock(&my_probe->mutex);
+
+    return started;
+}
+
+/**
+ * @brief stop latency worker, call before I/O is stopped.
+ *
+ */
+void as_latency_deinit()
+{
+    g_mutex_lock(&latency_worker_mutex);
+
+    GThread *this_thread = latency_thread;
+    latency_thread = NULL;
+
+    g_atomic_int_set(&latency_worker_run, 0);
+    g_cond_signal(&latency_worker_cond);
+
+    g_mutex_unlock(&latency_worker_mutex);
+
+    if (NULL != this_thread)
+    {
+        g_thread_join(this_thread);
+        g_message("exit latency_worker.");
+    }
+}
@@ -0,0 +1,298 @@
+/**
+ * @file ardusub_lifecycle.c
+ * @author ztluo (me@ztluo.dev)
+ * @brief lost vehicle on heartbeat timeout, its workers are stopped until it rejoins.
+ * workers of new and rejoined vehicles are started on lifecycle worker too,
+ * out of message_mutex of I/O threads.
+ * @version
+ * @date 2019-06-10
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#define G_LOG_DOMAIN "[ardusub lifecycle ]"
+
+#include "../inc/ardusub_lifecycle.h"
+#include "../inc/ardusub_interface.h"
+#include "../inc/ardusub_command.h"
+#include "../inc/ardusub_latency.h"
+
+static Vehicle_Lifecycle_t lifecycle[MAX_VEHICLE_SLOT];
+
+static volatile gint vehicle_lost_timeout = VEHICLE_LOST_TIMEOUT;
+
+static GMutex lifecycle_worker_mutex;
+static GCond lifecycle_worker_cond; // signalled on stop and start request
+static gboolean lifecycle_worker_wake; // start requested, guarded by lifecycle_worker_mutex
+static GThread *lifecycle_thread;
+static volatile gint lifecycle_worker_run;
+static volatile gint lifecycle_closed; // no rejoin after deinit
+
+/**
+ * @brief autopilot heartbeat of vehicle, runs on I/O thread with
+ * message_mutex locked, in as_find_new_system.
+ *
+ * @param target_system
+ * @param target_component
+ */
+void as_lifecycle_heartbeat(guint8 target_system, guint8 target_component)
+{
+    if (target_component == vehicle_slot[target_system].primary_compid)
+    {
+        lifecycle[target_system].heartbeat_time = g_get_monotonic_time();
+    }
+}
+
+/**
+ * @brief move vehicle to SYS_LOST if its heartbeat timed out.
+ *
+ * @param target_system
+ * @param now
+ * @param timeout in microseconds
+ * @return gboolean TRUE if vehicle is lost now
+ */
+static gboolean as_lifecycle_check(guint8 target_system, gint64 now, gint64 timeout)
+{
+    gboolean lost = FALSE;
+
+    g_mutex_lock(&message_mutex[target_system]);
+
+    // rejoin sets status under message_mutex as well
+    if (now - lifecycle[target_system].heartbeat_time > timeout)
+    {
+        lost = g_atomic_int_compare_and_exchange(vehicle_status + target_system,
+                                                 SYS_DISARMED, SYS_LOST) ||
+               g_atomic_int_compare_and_exchange(vehicle_status + target_system,
+                                                 SYS_ARMED, SYS_LOST);
+    }
+
+    g_mutex_unlock(&message_mutex[target_system]);
+
+    return lost;
+}
+
+/**
+ * @brief stop workers of lost vehicle, drop its queued messages, hold its
+ * latency probe and cancel its commands in flight. slot, messages,
+ * parameters and vehicle data are kept for rejoin.
+ * subscriptions, periodic executors and depth control are kept as well,
+ * they get no msg and NULL vehicle_data until rejoin.
+ *
+ * @param target_system
+ */
+static void as_lifecycle_park(guint8 target_system)
+{
+    Vehicle_Lifecycle_t *my_lifecycle = lifecycle + target_system;
+
+    my_lifecycle->lost_count++;
+
+    g_message("vehicle id:%d lost, no heartbeat in %d ms, lost %u times.",
+              target_system, g_atomic_int_get(&vehicle_lost_timeout),
+              my_lifecycle->lost_count);
+
+    as_thread_stop_vehicle_join(target_system);
+    as_latency_suspend(target_system);
+    as_command_cancel_vehicle(target_system);
+
+    as_queue_clear(g_atomic_pointer_get(message_queue + target_system));
+    as_queue_clear(g_atomic_pointer_get(statustex_queue + target_system));
+    as_queue_clear(g_atomic_pointer_get(named_val_float_queue + target_system));
+
+    // after this, next heartbeat rejoins
+    g_atomic_int_set(&my_lifecycle->parked, TRUE);
+}
+
+/**
+ * @brief take a parked vehicle for rejoin, with message_mutex locked.
+ *
+ * @param target_system
+ * @return gboolean FALSE if vehicle is not parked yet or api is deinit
+ */
+gboolean as_lifecycle_unpark(guint8 target_system)
+{
+    if (1 == g_atomic_int_get(&lifecycle_closed))
+    {
+        return FALSE;
+    }
+
+    return g_atomic_int_compare_and_exchange(&lifecycle[target_system].parked, TRUE, FALSE);
+}
+
+/**
+ * @brief start workers of vehicle from I/O thread, with message_mutex
+ * locked and status SYS_INITIATING. status is SYS_DISARMED once started.
+ *
+ * @param target_system
+ * @param rejoin TRUE for lost vehicle, FALSE for new one
+ */
+void as_lifecycle_request_start(guint8 target_system, gboolean rejoin)
+{
+    g_atomic_int_set(&lifecycle[target_system].start,
+                     rejoin ? LIFECYCLE_START_REJOIN : LIFECYCLE_START_NEW);
+
+    as_lifecycle_start();
+
+    g_mutex_lock(&lifecycle_worker_mutex);
+    lifecycle_worker_wake = TRUE;
+    g_cond_signal(&lifecycle_worker_cond);
+    g_mutex_unlock(&lifecycle_worker_mutex);
+}
+
+/**
+ * @brief start workers of vehicles requested by as_lifecycle_request_start.
+ *
+ */
+static void as_lifecycle_run_start()
+{
+    gint count = g_atomic_int_get(&active_sysid_count);
+    for (gint i = 0; i < count; i++)
+    {
+        guint8 sysid = active_sysid[i];
+        gint start = g_atomic_int_get(&lifecycle[sysid].start);
+
+        if (LIFECYCLE_START_NONE == start ||
+            FALSE == g_atomic_int_compare_and_exchange(&lifecycle[sysid].start,
+                                                       start, LIFECYCLE_START_NONE))
+        {
+            continue;
+        }
+
+        if (LIFECYCLE_START_REJOIN == start)
+        {
+            as_system_rejoin(sysid);
+        }
+        else
+        {
+            as_system_start(sysid);
+        }
+
+        // lifecycle check reads status under message_mutex
+        g_mutex_lock(&message_mutex[sysid]);
+        g_atomic_int_set(vehicle_status + sysid, SYS_DISARMED);
+        g_mutex_unlock(&message_mutex[sysid]);
+
+        if (LIFECYCLE_START_REJOIN == start)
+        {
+            g_message("Lost system rejoined: %d", sysid);
+        }
+        else
+        {
+            g_message("New system added: %d", sysid);
+        }
+    }
+}
+
+/**
+ * @brief check heartbeat timeout of each vehicle.
+ *
+ * @param data
+ * @return gpointer
+ */
+static gpointer lifecycle_worker(gpointer data)
+{
+    g_assert(NULL == data);
+
+    g_mutex_lock(&lifecycle_worker_mutex);
+
+    while (1 == g_atomic_int_get(&lifecycle_worker_run))
+    {
+        g_mutex_unlock(&lifecycle_worker_mutex);
+
+        as_lifecycle_run_start();
+
+        gint64 now = g_get_monotonic_time();
+        gint64 timeout = (gint64)g_atomic_int_get(&vehicle_lost_timeout) * 1000;
+
+        // 0 timeout for vehicles are never lost
+        gint count = (0 != timeout) ? g_atomic_int_get(&active_sysid_count) : 0;
+        for (gint i = 0; i < count; i++)
+        {
+            guint8 sysid = active_sysid[i];
+
+            if (TRUE == as_lifecycle_check(sysid, now, timeout))
+            {
+                as_lifecycle_park(sysid);
+            }
+        }
+
+        g_mutex_lock(&lifecycle_worker_mutex);
+
+        // a start requested while checking is not missed
+        if (1 == g_atomic_int_get(&lifecycle_worker_run) && FALSE == lifecycle_worker_wake)
+        {
+            g_cond_wait_until(&lifecycle_worker_cond, &lifecycle_worker_mutex,
+                              now + LIFECYCLE_CHECK_INTERVAL);
+        }
+        lifecycle_worker_wake = FALSE;
+    }
+
+    g_mutex_unlock(&lifecycle_worker_mutex);
+
+    return NULL;
+}
+
+/**
+ * @brief start lifecycle worker once, on first vehicle, with message_mutex locked.
+ *
+ */
+void as_lifecycle_start()
+{
+    g_mutex_lock(&lifecycle_worker_mutex);
+
+    if (NULL == lifecycle_thread && 0 == g_atomic_int_get(&lifecycle_closed))
+    {
+        g_atomic_int_set(&lifecycle_worker_run, 1);
+        lifecycle_thread = g_thread_new("lifecycle_worker", &lifecycle_worker, NULL);
+    }
+
+    g_mutex_unlock(&lifecycle_worker_mutex);
+}
+
+/**
+ * @brief stop lifecycle worker, start and rejoin, call before workers are stopped.
+ *
+ */
+void as_lifecycle_deinit()
+{
+    g_mutex_lock(&lifecycle_worker_mutex);
+
+    GThread *this_thread = lifecycle_thread;
+    lifecycle_thread = NULL;
+
+    g_atomic_int_set(&lifecycle_closed, 1);
+    g_atomic_int_set(&lifecycle_worker_run, 0);
+    g_cond_signal(&lifecycle_worker_cond);
+
+    g_mutex_unlock(&lifecycle_worker_mutex);
+
+    // starts and rejoins run on lifecycle worker, none after join
+    if (NULL != this_thread)
+    {
+        g_thread_join(this_thread);
+        g_message("exit lifecycle_worker.");
+    }
+}
+
+/**
+ * @brief status of vehicle, SYS_LOST after heartbeat timeout until it rejoins.
+ *
+ * @param target_system
+ * @return system_status_t SYS_UN_INIT for never found
+ */
+system_status_t as_api_get_vehicle_status(uint8_t target_system)
+{
+    return g_atomic_int_get(vehicle_status + target_system);
+}
+
+/**
+ * @brief set heartbeat timeout of lost vehicle.
+ *
+ * @param timeout_ms 0 for vehicles are never lost
+ */
+void as_api_set_vehicle_lost_timeout(unsigned int timeout_ms)
+{
+    g_atomic_int_set(&vehicle_lost_timeout, MIN(timeout_ms, G_MAXINT));
+
+    g_message("vehicle lost timeout: %u ms.", timeout_ms);
+}
@@ -69,7 +69,7 @@ void as_set_log_handler()
 }
 
 /**
- * @brief pop_log_str
+ * @brief pop_log_str, wait for a push if empty, woken by wake_log_str on stop.
  * 
  * @return gchar* 
  */
@@ -87,13 +87,29 @@ gchar *pop_log_str()
         g_free(last_log_str);
     }
 
-    last_log_str = g_async_queue_try_pop(log_str_queue);
+    last_log_str = g_async_queue_pop(log_str_queue);
 
     g_mutex_unlock(&my_mutex);
 
     return last_log_str;
 }
 
+/**
+ * @brief wake log_str_write_worker waiting in pop_log_str, e.g. on stop.
+ * 
+ */
+void wake_log_str()
+{
+    gchar *log_str_p = g_strdup("");
+
+    if (NULL == log_str_p)
+    {
+        g_error("Out of memory!");
+    }
+
+    g_async_queue_push(log_str_queue, log_str_p);
+}
+
 /**
  * @brief push_log_str
  * 
@@ -206,3 +222,255 @@ void log_to_stdout(const gchar *log_domain,
                           message,
                           unused_data);
 }
+
+typedef struct Log_Rate_Limit_s
+{
+    guint64 key; // must be the first member, hashed by g_int64_hash
+    const gchar *log_domain; // G_LOG_DOMAIN and G_STRLOC of log site, literals
+    const gchar *call_site;
+    GLogLevelFlags log_level;
+    guint8 sysid;
+    guint32 msgid;
+    gint64 last_log_time;
+    gint64 last_seen_time;
+    guint log_count;
+    guint suppressed_count;
+} Log_Rate_Limit_t;
+
+static GHashTable *log_rate_limit_table;
+static GMutex log_rate_limit_mutex;
+static guint log_rate_limit_timer;
+
+// shared by new keys while table is full of keys in use
+static Log_Rate_Limit_t log_rate_limit_overflow;
+
+/**
+ * @brief log count of suppressed messages of a key.
+ * 
+ * @param rate_limit copy taken under log_rate_limit_mutex
+ */
+static void as_log_rate_limit_summary(const Log_Rate_Limit_t *rate_limit)
+{
+    g_log(rate_limit->log_domain, rate_limit->log_level,
+          "%u similar messages suppressed at %s, sysid: %d, msgid: %u.",
+          rate_limit->suppressed_count, rate_limit->call_site,
+          rate_limit->sysid, rate_limit->msgid);
+}
+
+/**
+ * @brief move a pending count to summary, call with log_rate_limit_mutex locked.
+ * 
+ * @param rate_limit 
+ * @param summary [out] GArray of Log_Rate_Limit_t
+ * @param now 
+ * @param force ignore LOG_RATE_LIMIT_INTERVAL, at deinit
+ */
+static void as_log_rate_limit_take(Log_Rate_Limit_t *rate_limit, GArray *summary,
+                                   gint64 now, gboolean force)
+{
+    if (0 == rate_limit->suppressed_count ||
+        (FALSE == force && now - rate_limit->last_log_time < LOG_RATE_LIMIT_INTERVAL))
+    {
+        return;
+    }
+
+    g_array_append_val(summary, *rate_limit);
+
+    // a summary counts as a logged message of this key
+    rate_limit->suppressed_count = 0;
+    rate_limit->last_log_time = now;
+}
+
+/**
+ * @brief timer on main loop, logs counts with no later message, and
+ * evicts keys not seen for LOG_RATE_LIMIT_STALE.
+ * 
+ * @param data 
+ * @return gboolean G_SOURCE_REMOVE after as_log_rate_limit_deinit
+ */
+static gboolean as_log_rate_limit_flush(gpointer data)
+{
+    g_assert(NULL == data);
+
+    GArray *summary = g_array_new(FALSE, FALSE, sizeof(Log_Rate_Limit_t));
+    gint64 now = g_get_monotonic_time();
+    GHashTableIter iter;
+    gpointer value;
+
+    g_mutex_lock(&log_rate_limit_mutex);
+
+    // dispatched while deinit removed the timer
+    if (NULL == log_rate_limit_table)
+    {
+        g_mutex_unlock(&log_rate_limit_mutex);
+        g_array_free(summary, TRUE);
+        return G_SOURCE_REMOVE;
+    }
+
+    g_hash_table_iter_init(&iter, log_rate_limit_table);
+
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        Log_Rate_Limit_t *rate_limit = value;
+
+        as_log_rate_limit_take(rate_limit, summary, now, FALSE);
+
+        // evicted key gets a new burst when seen again
+        if (0 == rate_limit->suppressed_count &&
+            now - rate_limit->last_seen_time >= LOG_RATE_LIMIT_STALE)
+        {
+            g_hash_table_iter_remove(&iter);
+        }
+    }
+
+    as_log_rate_limit_take(&log_rate_limit_overflow, summary, now, FALSE);
+
+    g_mutex_unlock(&log_rate_limit_mutex);
+
+    // log without lock, a handler may log rate limited too
+    for (guint i = 0; i < summary->len; i++)
+    {
+        as_log_rate_limit_summary(&g_array_index(summary, Log_Rate_Limit_t, i));
+    }
+
+    g_array_free(summary, TRUE);
+
+    return G_SOURCE_CONTINUE;
+}
+
+/**
+ * @brief check if a rate limited log should be emitted.
+ * 
+ * @param log_domain G_LOG_DOMAIN of the log site, for summary
+ * @param log_level for summary
+ * @param call_site G_STRLOC of the log site
+ * @param sysid 
+ * @param msgid 
+ * @param suppressed_count count of messages suppressed since last emitted one
+ * @return gboolean TRUE if the message should be emitted
+ */
+gboolean as_log_rate_limit_check(const gchar *log_domain, GLogLevelFlags log_level,
+                                 const gchar *call_site, guint8 sysid,
+                                 guint32 msgid, guint *suppressed_count)
+{
+    g_assert(NULL != call_site);
+    g_assert(NULL != suppressed_count);
+
+    gboolean emit = FALSE;
+    gint64 now = g_get_monotonic_time();
+    // unsigned, hash of call site may have its top bit set
+    guint64 key = ((guint64)g_str_hash(call_site) << 32) |
+                  ((guint64)sysid << 24) |
+                  (msgid & 0xFFFFFF);
+
+    *suppressed_count = 0;
+
+    g_mutex_lock(&log_rate_limit_mutex);
+
+    if (NULL == log_rate_limit_table)
+    {
+        log_rate_limit_table =
+            g_hash_table_new_full(g_int64_hash, g_int64_equal, NULL, g_free);
+
+        // default context, run by as_api_main thread
+        log_rate_limit_timer = g_timeout_add(LOG_RATE_LIMIT_INTERVAL / 1000,
+                                             &as_log_rate_limit_flush, NULL);
+    }
+
+    Log_Rate_Limit_t *rate_limit = g_hash_table_lookup(log_rate_limit_table, &key);
+
+    if (NULL == rate_limit &&
+        g_hash_table_size(log_rate_limit_table) >= LOG_RATE_LIMIT_MAX_KEYS)
+    {
+        // noisy link with random msgid, stale keys are evicted by timer
+        rate_limit = &log_rate_limit_overflow;
+    }
+    else if (NULL == rate_limit)
+    {
+        rate_limit = g_new0(Log_Rate_Limit_t, 1);
+        if (NULL == rate_limit)
+        {
+            g_error("Out of memory!");
+        }
+
+        rate_limit->key = key;
+        g_hash_table_insert(log_rate_limit_table, &rate_limit->key, rate_limit);
+    }
+
+    // summary names the last log site of the key
+    rate_limit->log_domain = log_domain;
+    rate_limit->call_site = call_site;
+    rate_limit->log_level = log_level;
+    rate_limit->sysid = sysid;
+    rate_limit->msgid = msgid;
+    rate_limit->last_seen_time = now;
+
+    if (rate_limit->log_count < LOG_RATE_LIMIT_BURST ||
+        now - rate_limit->last_log_time >= LOG_RATE_LIMIT_INTERVAL)
+    {
+        *suppressed_count = rate_limit->suppressed_count;
+        rate_limit->suppressed_count = 0;
+        rate_limit->last_log_time = now;
+
+        if (rate_limit->log_count < G_MAXUINT)
+        {
+            rate_limit->log_count++;
+        }
+
+        emit = TRUE;
+    }
+    else
+    {
+        rate_limit->suppressed_count++;
+    }
+
+    g_mutex_unlock(&log_rate_limit_mutex);
+
+    return emit;
+}
+
+/**
+ * @brief stop flush timer and log all pending counts, on deinit.
+ * 
+ */
+void as_log_rate_limit_deinit()
+{
+    GArray *summary = g_array_new(FALSE, FALSE, sizeof(Log_Rate_Limit_t));
+    gint64 now = g_get_monotonic_time();
+    GHashTableIter iter;
+    gpointer value;
+
+    g_mutex_lock(&log_rate_limit_mutex);
+
+    if (NULL == log_rate_limit_table)
+    {
+        g_mutex_unlock(&log_rate_limit_mutex);
+        g_array_free(summary, TRUE);
+        return;
+    }
+
+    g_source_remove(log_rate_limit_timer);
+    log_rate_limit_timer = 0;
+
+    g_hash_table_iter_init(&iter, log_rate_limit_table);
+
+    while (g_hash_table_iter_next(&iter, NULL, &value))
+    {
+        as_log_rate_limit_take(value, summary, now, TRUE);
+    }
+
+    as_log_rate_limit_take(&log_rate_limit_overflow, summary, now, TRUE);
+
+    g_hash_table_destroy(log_rate_limit_table);
+    log_rate_limit_table = NULL;
+    memset(&log_rate_limit_overflow, 0, sizeof(Log_Rate_Limit_t));
+
+    g_mutex_unlock(&log_rate_limit_mutex);
+
+    for (guint i = 0; i < summary->len; i++)
+    {
+        as_log_rate_limit_summary(&g_array_index(summary, Log_Rate_Limit_t, i));
+    }
+
+    g_array_free(summary, TRUE);
+}
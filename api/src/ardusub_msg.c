@@ -12,49 +12,71 @@
 #define G_LOG_DOMAIN "[ardusub msg       ]"
 
 #include "../inc/ardusub_msg.h"
+#include "../inc/ardusub_stats.h"
+#include "../inc/ardusub_param.h"
+#include "../inc/ardusub_timesync.h"
+#include "../inc/ardusub_latency.h"
 
 /**
  * @brief Handle Messages, parse msg_tmp, if the msg_tmp parse successful, 
- * then decode the message and pass the value to message_hash_table[$sysid].
+ * then decode the message and pass the value to vehicle_slot[$sysid].
  * 
  * @param msg_tmp :buff that contains mavlink_message_t msg data from UDP 
  * @param bytes_read :buff lenth
+ * @param link_id :link the message came from, for link loss stats
  * @return guint8 :FALSE if never parse successful, msgid if parse successful
  */
-guint8 as_handle_messages(mavlink_message_t message)
+guint8 as_handle_messages(mavlink_message_t message, guint link_id)
 {
     guint8 target_system;
-    guint8 target_autopilot;
+    guint8 target_component;
 
     Mavlink_Messages_t *current_messages = NULL;
     Mavlink_Parameter_t *current_parameter = NULL;
 
-    // NOTE: this doesn't handle multiple compid for one sysid.
     target_system = message.sysid;
-    target_autopilot = message.compid;
+    target_component = message.compid;
 
-    // lock the hash table
-    g_rw_lock_reader_lock(&message_hash_table_lock);
-    g_rw_lock_reader_lock(&parameter_hash_table_lock);
+    Vehicle_Slot_t *my_slot = vehicle_slot + target_system;
 
-    // set current message parameter and target_socket.
-    current_messages =
-        g_hash_table_lookup(message_hash_table,
-                            g_atomic_pointer_get(sys_key + target_system));
+    as_stats_frame(&message);
 
-    current_parameter =
-        g_hash_table_lookup(parameter_hash_table,
-                            g_atomic_pointer_get(sys_key + target_system));
+    // drop frames until autopilot of this sysid is found
+    if (FALSE == g_atomic_int_get(&my_slot->ready))
+    {
+        as_stats_drop(target_system, STATS_DROP_NOT_READY);
+        return message.msgid;
+    }
 
-    // unlock the message hash table
-    g_rw_lock_reader_unlock(&message_hash_table_lock);
-    g_rw_lock_reader_unlock(&parameter_hash_table_lock);
+    gint index = my_slot->comp_index[target_component];
 
-    g_assert(current_messages != NULL);
-    g_assert(current_parameter != NULL);
+    if (0 == index)
+    {
+        index = as_component_add(target_system, target_component);
 
-    current_messages->sysid = target_system;
-    current_messages->compid = target_autopilot;
+        if (0 == index)
+        {
+            as_log_rate_limited(G_LOG_LEVEL_WARNING, target_system, target_component,
+                                "MAX_COMPONENT reached! sysid: %d, compid: %d.",
+                                target_system, target_component);
+            as_stats_drop(target_system, STATS_DROP_COMPONENT);
+            return message.msgid;
+        }
+    }
+
+    as_link_loss_frame(link_id, &message, index);
+
+    // set current message parameter.
+    current_messages = my_slot->component_messages[index - 1];
+
+    // parameter and vehicle data only come from primary component
+    if (1 == index)
+    {
+        current_parameter = my_slot->parameter;
+        g_assert(current_parameter != NULL);
+    }
+
+    g_assert(current_messages != NULL);
 
     as_handle_message_id(message,
                          current_messages,
@@ -63,427 +85,928 @@ guint8 as_handle_messages(mavlink_message_t message)
     return message.msgid;
 }
 
+/**
+ * @brief add a non-primary component. frames of one sysid may come from
+ * several UDP sources on different parse threads, so adds are serialized
+ * by component_mutex of the slot.
+ * 
+ * @param target_system 
+ * @param target_component 
+ * @return gint index + 1 in component list, 0 if MAX_COMPONENT reached
+ */
+gint as_component_add(guint8 target_system, guint8 target_component)
+{
+    Vehicle_Slot_t *my_slot = vehicle_slot + target_system;
+
+    g_mutex_lock(&my_slot->component_mutex);
+
+    // added by another parse thread while waiting
+    gint index = my_slot->comp_index[target_component];
+    if (0 != index)
+    {
+        g_mutex_unlock(&my_slot->component_mutex);
+        return index;
+    }
+
+    gint count = g_atomic_int_get(&my_slot->component_count);
+
+    if (count >= MAX_COMPONENT)
+    {
+        g_mutex_unlock(&my_slot->component_mutex);
+        return 0;
+    }
+
+    Mavlink_Messages_t *current_messages = g_new0(Mavlink_Messages_t, 1);
+
+    if (NULL == current_messages)
+    {
+        g_error("Out of memory!");
+    }
+
+    current_messages->sysid = target_system;
+    current_messages->compid = target_component;
+
+    my_slot->component_messages[count] = current_messages;
+    my_slot->component_id[count] = target_component;
+    my_slot->comp_index[target_component] = count + 1;
+
+    // publish component, atomic set is a full barrier
+    g_atomic_int_set(&my_slot->component_count, count + 1);
+
+    g_mutex_unlock(&my_slot->component_mutex);
+
+    g_message("Found a new component: %d, sysid: %d", target_component, target_system);
+
+    return count + 1;
+}
+
+static Msg_Dispatch_Entry_t msg_dispatch_table[MSG_DISPATCH_TABLE_SIZE];
+static GRWLock msg_dispatch_handler_lock;
+
+static void as_msg_lazy_store(const mavlink_message_t *message,
+                              Mavlink_Messages_t *current_messages);
+static void as_msg_mailbox_post(Msg_Mailbox_t *mailbox, guint32 msgid,
+                                gconstpointer decoded, gsize size);
+
 /**
  * @brief as_handle_message_id
  * 
  * @param message 
  * @param current_messages 
- * @param current_parameter 
+ * @param current_parameter NULL for non-primary component,
+ * builtin and message queue are skipped.
  */
 void as_handle_message_id(mavlink_message_t message,
                           Mavlink_Messages_t *current_messages,
                           Mavlink_Parameter_t *current_parameter)
 {
-    g_mutex_lock(&message_mutex[message.sysid]);
-
-    guint8 target_system = current_messages->sysid;
-    current_messages->msg_id = message.msgid;
-    gboolean queue_push = FALSE;
+    Msg_Dispatch_Entry_t *entry = NULL;
 
-    // Handle Message ID
-    switch (message.msgid)
+    if (message.msgid < MSG_DISPATCH_TABLE_SIZE)
     {
+        entry = msg_dispatch_table + message.msgid;
+    }
 
-    case MAVLINK_MSG_ID_HEARTBEAT:
+    if (NULL == entry || FALSE == entry->known)
     {
-        // g_print("MAVLINK_MSG_ID_HEARTBEAT\n");
-        mavlink_msg_heartbeat_decode(&message, &(current_messages->heartbeat));
-
-        /* Queries the system monotonic time. in microseconds (gint64) */
-        // g_get_monotonic_time();
-        /* https://developer.gnome.org/glib/stable/glib-Date-and-Time-Functions.html#g-get-monotonic-time */
+        as_log_rate_limited(G_LOG_LEVEL_WARNING, message.sysid, message.msgid,
+                            "Warning, did not handle message id %i.", message.msgid);
+        return;
+    }
 
-        current_messages->time_stamps.heartbeat = g_get_monotonic_time();
+    // skip unused message before decode
+    if (NULL == entry->decode || FALSE == g_atomic_int_get(&entry->enabled))
+    {
+        return;
+    }
 
-        /* MAY THE SOURCE BE WITH YOU */
-        // g_print("timestamp:%I64d\n", current_messages->time_stamps.heartbeat);
-        // g_print("Received message from sys:%d|comp:%d\n",
-        //        current_messages->sysid, current_messages->compid);
-        // g_print("type:%d, autopilot:%d, base_mode:%d, custom_mode:%d, system_status:%d, mavlink_version:%d \n",
-        //        current_messages->heartbeat.type, current_messages->heartbeat.autopilot,
-        //        current_messages->heartbeat.base_mode, current_messages->heartbeat.custom_mode,
-        //        current_messages->heartbeat.system_status, current_messages->heartbeat.mavlink_version);
+    // mailbox of primary component is written at receive time
+    gboolean mailbox = (thread_flag & F_MSG_MAILBOX) && (NULL != current_parameter);
 
-        // g_message("heartbeat msg from system:%d", current_messages->sysid);
+    // nothing consumes this msg at receive time, decode when it is read
+    gboolean lazy = (thread_flag & F_MSG_LAZY_DECODE) && (FALSE == mailbox) &&
+                    (((NULL == entry->builtin) && (FALSE == entry->queue_push)) ||
+                     (NULL == current_parameter)) &&
+                    (0 == g_atomic_int_get(&entry->handler_count));
 
-        // send heartbeat
-        // send_heartbeat(target_system);
+    g_mutex_lock(&message_mutex[message.sysid]);
 
-        queue_push = TRUE;
+    guint8 target_system = current_messages->sysid;
+    current_messages->msg_id = message.msgid;
 
-        break;
+    if (TRUE == lazy)
+    {
+        as_msg_lazy_store(&message, current_messages);
     }
-
-    case MAVLINK_MSG_ID_SYS_STATUS:
+    else
     {
-        // g_print("MAVLINK_MSG_ID_SYS_STATUS\n");
-        mavlink_msg_sys_status_decode(&message, &(current_messages->sys_status));
-        // g_print("SYS_STATUS: erros_comm %d %d \n", current_messages->sys_status.voltage_battery,
-        //    current_messages->sys_status.current_battery);
-        current_messages->time_stamps.sys_status = g_get_monotonic_time();
-        queue_push = TRUE;
+        entry->decode(&message,
+                      G_STRUCT_MEMBER_P(current_messages, entry->storage_offset));
 
-        break;
+        // raw frame stored before is older than this one
+        Msg_Lazy_Set_t *lazy_set = current_messages->lazy_set;
+        if ((NULL != lazy_set) && (NULL != lazy_set->lazy[message.msgid]))
+        {
+            lazy_set->lazy[message.msgid]->pending = FALSE;
+        }
     }
 
-    case MAVLINK_MSG_ID_PING:
+    /* Queries the system monotonic time. in microseconds (gint64) */
+    /* https://developer.gnome.org/glib/stable/glib-Date-and-Time-Functions.html#g-get-monotonic-time */
+    if (entry->time_stamp_offset >= 0)
     {
-        g_print("MAVLINK_MSG_ID_PING\n");
-        mavlink_msg_ping_decode(&message, &(current_messages->ping));
-
-        g_print("PING: time_usec:%llu, seq:%d, target_system:%d, target_component:%d\n",
-                current_messages->ping.time_usec, current_messages->ping.seq,
-                current_messages->ping.target_system, current_messages->ping.target_component);
-
-        break;
+        G_STRUCT_MEMBER(uint64_t, current_messages, entry->time_stamp_offset) =
+            g_get_monotonic_time();
     }
 
-    case MAVLINK_MSG_ID_BATTERY_STATUS:
+    if (TRUE == lazy)
     {
-        // g_print("MAVLINK_MSG_ID_BATTERY_STATUS\n");
-        mavlink_msg_battery_status_decode(&message, &(current_messages->battery_status));
-        current_messages->time_stamps.battery_status = g_get_monotonic_time();
-        queue_push = TRUE;
-
-        break;
+        g_mutex_unlock(&message_mutex[message.sysid]);
+        return;
     }
 
-    case MAVLINK_MSG_ID_RADIO_STATUS:
+    if ((NULL != entry->builtin) && (NULL != current_parameter))
     {
-        // g_print("MAVLINK_MSG_ID_RADIO_STATUS\n");
-        mavlink_msg_radio_status_decode(&message, &(current_messages->radio_status));
-        current_messages->time_stamps.radio_status = g_get_monotonic_time();
-        break;
+        entry->builtin(target_system, current_messages, current_parameter);
     }
 
-    case MAVLINK_MSG_ID_LOCAL_POSITION_NED:
+    if (TRUE == mailbox)
     {
-        //g_print("MAVLINK_MSG_ID_LOCAL_POSITION_NED\n");
-        mavlink_msg_local_position_ned_decode(&message, &(current_messages->local_position_ned));
-        current_messages->time_stamps.local_position_ned = g_get_monotonic_time();
-        break;
+        as_msg_mailbox_post(vehicle_slot[target_system].mailbox, message.msgid,
+                            G_STRUCT_MEMBER_P(current_messages, entry->storage_offset),
+                            entry->storage_size);
     }
 
-    case MAVLINK_MSG_ID_GLOBAL_POSITION_INT:
+    // storage is written by other parse threads of this sysid after unlock,
+    // queue and handlers get copies taken here
+    Mavlink_Messages_t *queue_item = NULL;
+    if ((TRUE == entry->queue_push) && (NULL != current_parameter) && (FALSE == mailbox))
     {
-        // g_message("MAVLINK_MSG_ID_GLOBAL_POSITION_INT\n");
-        mavlink_msg_global_position_int_decode(&message, &(current_messages->global_position_int));
-        current_messages->time_stamps.global_position_int = g_get_monotonic_time();
-        // g_print("POSITION_INT\n");
-        queue_push = TRUE;
-        break;
+        queue_item = g_memdup(current_messages, sizeof(Mavlink_Messages_t));
+
+        if (NULL == queue_item)
+        {
+            g_error("Out of memory!");
+        }
     }
 
-    case MAVLINK_MSG_ID_POSITION_TARGET_LOCAL_NED:
+    Msg_Decoded_t decoded;
+    gboolean dispatch = (0 < g_atomic_int_get(&entry->handler_count));
+    if (TRUE == dispatch)
     {
-        //g_print("MAVLINK_MSG_ID_POSITION_TARGET_LOCAL_NED\n");
-        mavlink_msg_position_target_local_ned_decode(&message, &(current_messages->position_target_local_ned));
-        current_messages->time_stamps.position_target_local_ned = g_get_monotonic_time();
-        break;
+        memcpy(decoded.data, G_STRUCT_MEMBER_P(current_messages, entry->storage_offset),
+               entry->storage_size);
     }
 
-    case MAVLINK_MSG_ID_POSITION_TARGET_GLOBAL_INT:
+    g_mutex_unlock(&message_mutex[message.sysid]);
+
+    if (NULL != queue_item)
     {
-        // g_print("MAVLINK_MSG_ID_POSITION_TARGET_GLOBAL_INT\n");
-        mavlink_msg_position_target_global_int_decode(&message, &(current_messages->position_target_global_int));
-        current_messages->time_stamps.position_target_global_int = g_get_monotonic_time();
-        break;
+        message_queue_push(target_system, queue_item);
     }
 
-    case MAVLINK_MSG_ID_HIGHRES_IMU:
+    if (TRUE == dispatch)
     {
-        // g_print("MAVLINK_MSG_ID_HIGHRES_IMU\n");
-        mavlink_msg_highres_imu_decode(&message, &(current_messages->highres_imu));
-        current_messages->time_stamps.highres_imu = g_get_monotonic_time();
-        break;
+        Msg_Handler_t handlers[MSG_DISPATCH_MAX_HANDLER];
+        gint handler_count;
+
+        // copy handlers, so a handler can remove itself
+        g_rw_lock_reader_lock(&msg_dispatch_handler_lock);
+        handler_count = entry->handler_count;
+        memcpy(handlers, entry->handlers, sizeof(Msg_Handler_t) * handler_count);
+        g_rw_lock_reader_unlock(&msg_dispatch_handler_lock);
+
+        for (gint i = 0; i < handler_count; i++)
+        {
+            handlers[i].func(target_system, message.compid, message.msgid,
+                             decoded.data, handlers[i].user_data);
+        }
     }
+}
+
+/**
+ * @brief keep len and payload of a frame for as_msg_lazy_decode,
+ * message_mutex of this sysid should be locked.
+ * 
+ * @param message 
+ * @param current_messages 
+ */
+static void as_msg_lazy_store(const mavlink_message_t *message,
+                              Mavlink_Messages_t *current_messages)
+{
+    Msg_Lazy_Set_t *lazy_set = current_messages->lazy_set;
 
-    case MAVLINK_MSG_ID_ATTITUDE:
+    if (NULL == lazy_set)
     {
-        // g_message("MAVLINK_MSG_ID_ATTITUDE\n");
-        mavlink_msg_attitude_decode(&message, &(current_messages->attitude));
-        current_messages->time_stamps.attitude = g_get_monotonic_time();
-        // g_printf("ATTITUDE\n");
-        // g_message("yaw: %f, pitch: %f, roll: %f.", current_messages->attitude.yaw, current_messages->attitude.pitch, current_messages->attitude.roll);
-        queue_push = TRUE;
+        lazy_set = g_new0(Msg_Lazy_Set_t, 1);
 
-        break;
+        if (NULL == lazy_set)
+        {
+            g_error("Out of memory!");
+        }
+
+        current_messages->lazy_set = lazy_set;
     }
 
-    case MAVLINK_MSG_ID_SERVO_OUTPUT_RAW:
+    Msg_Lazy_t *lazy = lazy_set->lazy[message->msgid];
+
+    if (NULL == lazy)
     {
-        // g_print("MAVLINK_MSG_ID_SERVO_OUTPUT_RAW\n");
-        mavlink_msg_servo_output_raw_decode(&message, &(current_messages->servo_output_raw));
-        current_messages->time_stamps.servo_output_raw = g_get_monotonic_time();
-        queue_push = TRUE;
+        lazy = g_new0(Msg_Lazy_t, 1);
 
-        break;
+        if (NULL == lazy)
+        {
+            g_error("Out of memory!");
+        }
+
+        lazy_set->lazy[message->msgid] = lazy;
     }
 
-    case MAVLINK_MSG_ID_COMMAND_ACK:
+    // decoder only reads msgid, len and payload
+    lazy->message.msgid = message->msgid;
+    lazy->message.len = message->len;
+    memcpy(_MAV_PAYLOAD_NON_CONST(&lazy->message), _MAV_PAYLOAD(message), message->len);
+    lazy->pending = TRUE;
+}
+
+/**
+ * @brief decode raw frame stored by as_msg_lazy_store if it is newer,
+ * message_mutex of this sysid should be locked.
+ * 
+ * @param msgid 
+ * @param current_messages 
+ */
+void as_msg_lazy_decode(guint32 msgid, Mavlink_Messages_t *current_messages)
+{
+    Msg_Lazy_Set_t *lazy_set = current_messages->lazy_set;
+
+    if ((NULL == lazy_set) ||
+        (msgid >= MSG_DISPATCH_TABLE_SIZE) ||
+        (NULL == lazy_set->lazy[msgid]) ||
+        (FALSE == lazy_set->lazy[msgid]->pending))
     {
-        // g_print("MAVLINK_MSG_ID_COMMAND_ACK\n");
-        mavlink_msg_command_ack_decode(&message, &(current_messages->command_ack));
-        current_messages->time_stamps.command_ack = g_get_monotonic_time();
-        // g_print("Command_ACK, command:%d, result:%d. \n",
-        //         current_messages->command_ack.command,
-        //         current_messages->command_ack.result);
-        break;
+        return;
     }
 
-    case MAVLINK_MSG_ID_NAMED_VALUE_FLOAT:
+    Msg_Dispatch_Entry_t *entry = msg_dispatch_table + msgid;
+
+    entry->decode(&lazy_set->lazy[msgid]->message,
+                  G_STRUCT_MEMBER_P(current_messages, entry->storage_offset));
+
+    // cached until next frame
+    lazy_set->lazy[msgid]->pending = FALSE;
+}
+
+/**
+ * @brief PING built-in handler
+ * 
+ * @param target_system 
+ * @param current_messages 
+ * @param current_parameter 
+ */
+static void as_handle_ping(guint8 target_system,
+                           Mavlink_Messages_t *current_messages,
+                           Mavlink_Parameter_t *current_parameter)
+{
+    g_assert(NULL != current_parameter);
+
+    as_latency_ping_received(target_system, &current_messages->ping);
+}
+
+/**
+ * @brief STATUSTEXT built-in handler
+ * 
+ * @param target_system 
+ * @param current_messages 
+ * @param current_parameter 
+ */
+static void as_handle_statustext(guint8 target_system,
+                                 Mavlink_Messages_t *current_messages,
+                                 Mavlink_Parameter_t *current_parameter)
+{
+    g_assert(NULL != current_parameter);
+
+    statustex_queue_push(target_system, current_messages);
+}
+
+/**
+ * @brief NAMED_VALUE_FLOAT built-in handler
+ * 
+ * @param target_system 
+ * @param current_messages 
+ * @param current_parameter 
+ */
+static void as_handle_named_value_float_msg(guint8 target_system,
+                                            Mavlink_Messages_t *current_messages,
+                                            Mavlink_Parameter_t *current_parameter)
+{
+    g_assert(NULL != current_parameter);
+
+    as_handle_named_value_float(target_system, current_messages);
+}
+
+/**
+ * @brief TIMESYNC built-in handler
+ * 
+ * @param target_system 
+ * @param current_messages 
+ * @param current_parameter 
+ */
+static void as_handle_timesync(guint8 target_system,
+                               Mavlink_Messages_t *current_messages,
+                               Mavlink_Parameter_t *current_parameter)
+{
+    g_assert(NULL != current_parameter);
+
+    as_timesync_received(target_system, &current_messages->timesync);
+}
+
+/**
+ * @brief PARAM_VALUE built-in handler
+ * 
+ * @param target_system 
+ * @param current_messages 
+ * @param current_parameter 
+ */
+static void as_handle_param_value(guint8 target_system,
+                                  Mavlink_Messages_t *current_messages,
+                                  Mavlink_Parameter_t *current_parameter)
+{
+    guint16 _param_index = current_messages->param_value.param_index;
+
+    if (0 == strncmp(current_messages->param_value.param_id, PARAM_HASH_CHECK_ID,
+                     sizeof(current_messages->param_value.param_id)))
     {
-        // g_print("MAVLINK_MSG_ID_NAMED_VALUE_FLOA\n");
-        mavlink_msg_named_value_float_decode(&message, &(current_messages->named_value_float));
-        current_messages->time_stamps.named_value_float = g_get_monotonic_time();
-        // g_print(current_messages->named_value_float.name);
-        // g_print(": %f \n", current_messages->named_value_float.value);
-        as_handle_named_value_float(target_system, current_messages);
-        break;
+        // not a parameter, for parameter sync only
     }
-
-    case MAVLINK_MSG_ID_VFR_HUD:
+    else if (_param_index > PARAM_COUNT - 1)
     {
-        // g_print("MAVLINK_MSG_ID_VFR_HUD\n");
-        mavlink_msg_vfr_hud_decode(&message, &(current_messages->vfr_hud));
-        current_messages->time_stamps.vfr_hud = g_get_monotonic_time();
-        // g_print("heading:%d\n", current_messages->vfr_hud.heading);
-        break;
+        // param_index out of range!
+        g_warning("param_index out of range! param_index:%s, param_index:%d, PARAM_COUNT:%d\n",
+                  current_messages->param_value.param_id,
+                  _param_index, PARAM_COUNT);
     }
-
-    case MAVLINK_MSG_ID_POWER_STATUS:
+    else
     {
-        // g_print("MAVLINK_MSG_ID_POWER_STATUS\n");
-        mavlink_msg_power_status_decode(&message, &(current_messages->power_status));
-        current_messages->time_stamps.power_status = g_get_monotonic_time();
-        // g_print("Vcc(5V rail voltage in mV):%d, Vservo(servo rail voltage in mV):%d, "
-        // "power supply status flags:%d.\n", current_messages->power_status.Vcc,
-        // current_messages->power_status.Vservo, current_messages->power_status.flags);
-        queue_push = TRUE;
+        g_mutex_lock(&parameter_mutex[target_system]);
+
+        // param_id is not null terminated if it is 16 chars
+        strncpy(current_parameter[_param_index].param_id,
+                current_messages->param_value.param_id,
+                sizeof(current_parameter[_param_index].param_id));
+
+        current_parameter[_param_index].param_type =
+            current_messages->param_value.param_type;
 
-        break;
+        current_parameter[_param_index].param_value.param_float =
+            current_messages->param_value.param_value;
+
+        as_param_index_update(target_system, _param_index);
+
+        g_mutex_unlock(&parameter_mutex[target_system]);
     }
 
-    case MAVLINK_MSG_ID_SYSTEM_TIME:
-    {
-        // g_print("MAVLINK_MSG_ID_SYSTEM_TIME\n");
-        mavlink_msg_system_time_decode(&message, &(current_messages->system_time));
-        current_messages->time_stamps.system_time = g_get_monotonic_time();
-        queue_push = TRUE;
+    // after it is stored, sync may be done with it
+    as_param_sync_received(target_system, &current_messages->param_value);
+}
 
-        break;
+// decode wrapper, decode into storage slot of Mavlink_Messages_t
+#define MSG_DECODER(name)                                             \
+    static void as_decode_##name(const mavlink_message_t *message,    \
+                                 gpointer storage)                    \
+    {                                                                 \
+        mavlink_msg_##name##_decode(message,                          \
+                                    (mavlink_##name##_t *)storage);   \
     }
 
-    case MAVLINK_MSG_ID_MISSION_CURRENT:
+MSG_DECODER(heartbeat)
+MSG_DECODER(sys_status)
+MSG_DECODER(ping)
+MSG_DECODER(battery_status)
+MSG_DECODER(radio_status)
+MSG_DECODER(local_position_ned)
+MSG_DECODER(global_position_int)
+MSG_DECODER(position_target_local_ned)
+MSG_DECODER(position_target_global_int)
+MSG_DECODER(highres_imu)
+MSG_DECODER(attitude)
+MSG_DECODER(servo_output_raw)
+MSG_DECODER(command_ack)
+MSG_DECODER(named_value_float)
+MSG_DECODER(vfr_hud)
+MSG_DECODER(power_status)
+MSG_DECODER(system_time)
+MSG_DECODER(mission_current)
+MSG_DECODER(gps_raw_int)
+MSG_DECODER(nav_controller_output)
+MSG_DECODER(rc_channels)
+MSG_DECODER(vibration)
+MSG_DECODER(raw_imu)
+MSG_DECODER(scaled_pressure)
+MSG_DECODER(scaled_imu2)
+MSG_DECODER(scaled_pressure2)
+MSG_DECODER(rc_channels_raw)
+MSG_DECODER(statustext)
+MSG_DECODER(param_value)
+MSG_DECODER(timesync)
+
+// register msg decoded into Mavlink_Messages_t.name, time stamped at time_stamps.name
+#define MSG_DISPATCH_REGISTER(msgid, name, queue_push, builtin)                  \
+    as_msg_dispatch_register(msgid, &as_decode_##name,                          \
+                             G_STRUCT_OFFSET(Mavlink_Messages_t, name),         \
+                             sizeof(((Mavlink_Messages_t *)0)->name),           \
+                             G_STRUCT_OFFSET(Mavlink_Messages_t, time_stamps.name), \
+                             queue_push, builtin)
+
+/**
+ * @brief init msg dispatch table, only init once.
+ * 
+ */
+void as_msg_dispatch_init()
+{
+    static gsize dispatch_init = 0;
+
+    if (g_once_init_enter(&dispatch_init))
     {
-        // g_print("MAVLINK_MSG_ID_MISSION_CURRENT\n");
-        mavlink_msg_mission_current_decode(&message, &(current_messages->mission_current));
-        current_messages->time_stamps.mission_current = g_get_monotonic_time();
-        break;
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_HEARTBEAT, heartbeat, TRUE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_SYS_STATUS, sys_status, TRUE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_PING, ping, FALSE, &as_handle_ping);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_BATTERY_STATUS, battery_status, TRUE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_RADIO_STATUS, radio_status, FALSE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_LOCAL_POSITION_NED, local_position_ned, FALSE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_GLOBAL_POSITION_INT, global_position_int, TRUE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_POSITION_TARGET_LOCAL_NED, position_target_local_ned, FALSE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_POSITION_TARGET_GLOBAL_INT, position_target_global_int, FALSE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_HIGHRES_IMU, highres_imu, FALSE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_ATTITUDE, attitude, TRUE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_SERVO_OUTPUT_RAW, servo_output_raw, TRUE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_COMMAND_ACK, command_ack, FALSE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_NAMED_VALUE_FLOAT, named_value_float, FALSE, &as_handle_named_value_float_msg);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_VFR_HUD, vfr_hud, FALSE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_POWER_STATUS, power_status, TRUE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_SYSTEM_TIME, system_time, TRUE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_MISSION_CURRENT, mission_current, FALSE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_GPS_RAW_INT, gps_raw_int, FALSE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_NAV_CONTROLLER_OUTPUT, nav_controller_output, FALSE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_RC_CHANNELS, rc_channels, TRUE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_VIBRATION, vibration, FALSE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_RAW_IMU, raw_imu, TRUE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_SCALED_PRESSURE, scaled_pressure, TRUE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_SCALED_IMU2, scaled_imu2, FALSE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_SCALED_PRESSURE2, scaled_pressure2, TRUE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_RC_CHANNELS_RAW, rc_channels_raw, FALSE, NULL);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_STATUSTEXT, statustext, FALSE, &as_handle_statustext);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_PARAM_VALUE, param_value, FALSE, &as_handle_param_value);
+        MSG_DISPATCH_REGISTER(MAVLINK_MSG_ID_TIMESYNC, timesync, FALSE, &as_handle_timesync);
+
+        // todo: deal with these
+        as_msg_dispatch_register(MAVLINK_MSG_ID_MOUNT_STATUS, NULL, 0, 0, -1, FALSE, NULL);
+        as_msg_dispatch_register(MAVLINK_MSG_ID_MEMINFO, NULL, 0, 0, -1, FALSE, NULL);
+        as_msg_dispatch_register(MAVLINK_MSG_ID_SENSOR_OFFSETS, NULL, 0, 0, -1, FALSE, NULL);
+        as_msg_dispatch_register(MAVLINK_MSG_ID_AHRS, NULL, 0, 0, -1, FALSE, NULL);
+        as_msg_dispatch_register(MAVLINK_MSG_ID_HWSTATUS, NULL, 0, 0, -1, FALSE, NULL);
+        as_msg_dispatch_register(MAVLINK_MSG_ID_AHRS2, NULL, 0, 0, -1, FALSE, NULL);
+        as_msg_dispatch_register(MAVLINK_MSG_ID_AHRS3, NULL, 0, 0, -1, FALSE, NULL);
+        as_msg_dispatch_register(MAVLINK_MSG_ID_EKF_STATUS_REPORT, NULL, 0, 0, -1, FALSE, NULL);
+
+        g_once_init_leave(&dispatch_init, 1);
     }
+}
 
-    case MAVLINK_MSG_ID_GPS_RAW_INT:
+/**
+ * @brief register a msgid to dispatch table.
+ * 
+ * @param msgid 
+ * @param decode NULL-able, NULL for known but unhandled msgid
+ * @param storage_offset offset of decoded storage slot in Mavlink_Messages_t
+ * @param storage_size size of decoded struct
+ * @param time_stamp_offset offset of time stamp in Mavlink_Messages_t, -1 for none
+ * @param queue_push push to message_queue after decode
+ * @param builtin NULL-able, called after decode with message_mutex locked
+ */
+void as_msg_dispatch_register(guint32 msgid,
+                              as_msg_decode_func_t decode,
+                              glong storage_offset,
+                              gsize storage_size,
+                              glong time_stamp_offset,
+                              gboolean queue_push,
+                              as_msg_builtin_func_t builtin)
+{
+    if (msgid >= MSG_DISPATCH_TABLE_SIZE)
     {
-        // g_print("MAVLINK_MSG_ID_GPS_RAW_INT\n");
-        mavlink_msg_gps_raw_int_decode(&message, &(current_messages->gps_raw_int));
-        current_messages->time_stamps.gps_raw_int = g_get_monotonic_time();
-        break;
+        g_error("msgid %d out of dispatch table!", msgid);
     }
 
-    case MAVLINK_MSG_ID_NAV_CONTROLLER_OUTPUT:
+    if (storage_size > sizeof(Msg_Decoded_t))
     {
-        // g_print("MAVLINK_MSG_ID_NAV_CONTROLLER_OUTPUT\n");
-        mavlink_msg_nav_controller_output_decode(&message, &(current_messages->nav_controller_output));
-        current_messages->time_stamps.nav_controller_output = g_get_monotonic_time();
-        break;
+        g_error("msgid %d decoded size %" G_GSIZE_FORMAT " out of Msg_Decoded_t!",
+                msgid, storage_size);
     }
 
-    case MAVLINK_MSG_ID_RC_CHANNELS:
-    {
-        // g_print("MAVLINK_MSG_ID_RC_CHANNELS\n");
-        mavlink_msg_rc_channels_decode(&message, &(current_messages->rc_channels));
-        current_messages->time_stamps.rc_channels = g_get_monotonic_time();
-        queue_push = TRUE;
+    Msg_Dispatch_Entry_t *entry = msg_dispatch_table + msgid;
 
-        break;
-    }
+    entry->decode = decode;
+    entry->storage_offset = storage_offset;
+    entry->storage_size = storage_size;
+    entry->time_stamp_offset = time_stamp_offset;
+    entry->queue_push = queue_push;
+    entry->builtin = builtin;
+    g_atomic_int_set(&entry->enabled, TRUE);
+    entry->known = TRUE;
+}
 
-    case MAVLINK_MSG_ID_VIBRATION:
+/**
+ * @brief enable or disable decoding of a msgid.
+ * 
+ * disabled msgid is skipped before decode.
+ * 
+ * @param msgid 
+ * @param enabled 
+ */
+void as_msg_dispatch_set_enabled(guint32 msgid, gboolean enabled)
+{
+    if (msgid >= MSG_DISPATCH_TABLE_SIZE)
     {
-        // g_print("MAVLINK_MSG_ID_VIBRATION\n");
-        mavlink_msg_vibration_decode(&message, &(current_messages->vibration));
-        current_messages->time_stamps.vibration = g_get_monotonic_time();
-        break;
+        return;
     }
 
-    case MAVLINK_MSG_ID_RAW_IMU:
-    {
-        // g_print("MAVLINK_MSG_ID_RAW_IMU\n");
-        mavlink_msg_raw_imu_decode(&message, &(current_messages->raw_imu));
-        current_messages->time_stamps.raw_imu = g_get_monotonic_time();
-        queue_push = TRUE;
+    g_atomic_int_set(&msg_dispatch_table[msgid].enabled, enabled);
+}
 
-        break;
+/**
+ * @brief get size of decoded struct of a msgid.
+ * 
+ * @param msgid 
+ * @return gsize 0 if msgid is not decoded
+ */
+gsize as_msg_dispatch_storage_size(guint32 msgid)
+{
+    if (msgid >= MSG_DISPATCH_TABLE_SIZE ||
+        NULL == msg_dispatch_table[msgid].decode)
+    {
+        return 0;
     }
 
-    case MAVLINK_MSG_ID_SCALED_PRESSURE:
-    {
-        // g_print("MAVLINK_MSG_ID_SCALED_PRESSURE\n");
-        mavlink_msg_scaled_pressure_decode(&message, &(current_messages->scaled_pressure));
-        current_messages->time_stamps.scaled_pressure = g_get_monotonic_time();
-        queue_push = TRUE;
+    return msg_dispatch_table[msgid].storage_size;
+}
 
-        break;
+/**
+ * @brief copy last decoded msg out of current_messages,
+ * message_mutex of this sysid should be locked.
+ * 
+ * @param msgid 
+ * @param current_messages 
+ * @param msg size of decoded struct
+ * @param time_stamp NULL-able, monotonic time of last msg
+ * @return gboolean FALSE if msgid is not decoded or never received
+ */
+gboolean as_msg_dispatch_copy(guint32 msgid,
+                              Mavlink_Messages_t *current_messages,
+                              gpointer msg,
+                              guint64 *time_stamp)
+{
+    if (msgid >= MSG_DISPATCH_TABLE_SIZE ||
+        NULL == msg_dispatch_table[msgid].decode)
+    {
+        return FALSE;
     }
 
-    case MAVLINK_MSG_ID_SCALED_IMU2:
+    Msg_Dispatch_Entry_t *entry = msg_dispatch_table + msgid;
+
+    guint64 last_time_stamp =
+        G_STRUCT_MEMBER(uint64_t, current_messages, entry->time_stamp_offset);
+
+    if (0 == last_time_stamp)
     {
-        // g_print("MAVLINK_MSG_ID_SCALED_IMU2\n");
-        mavlink_msg_scaled_imu2_decode(&message, &(current_messages->scaled_imu2));
-        current_messages->time_stamps.scaled_imu2 = g_get_monotonic_time();
-        break;
+        return FALSE;
     }
 
-    case MAVLINK_MSG_ID_SCALED_PRESSURE2:
-    {
-        // g_print("MAVLINK_MSG_ID_SCALED_PRESSURE2\n");
-        mavlink_msg_scaled_pressure2_decode(&message, &(current_messages->scaled_pressure2));
-        current_messages->time_stamps.scaled_pressure2 = g_get_monotonic_time();
-        queue_push = TRUE;
+    as_msg_lazy_decode(msgid, current_messages);
 
-        // g_print("SCALED_PRESSURE2\n");
-        break;
-    }
+    memcpy(msg, G_STRUCT_MEMBER_P(current_messages, entry->storage_offset),
+           entry->storage_size);
 
-    case MAVLINK_MSG_ID_RC_CHANNELS_RAW:
+    if (NULL != time_stamp)
     {
-        // g_print("MAVLINK_MSG_ID_RC_CHANNELS_RAW\n");
-        mavlink_msg_rc_channels_raw_decode(&message, &(current_messages->rc_channels_raw));
-        current_messages->time_stamps.rc_channels_raw = g_get_monotonic_time();
-        break;
+        *time_stamp = last_time_stamp;
     }
 
-    case MAVLINK_MSG_ID_STATUSTEXT:
+    return TRUE;
+}
+
+/**
+ * @brief new mailbox with a slot for each decoded msgid.
+ * 
+ * @return Msg_Mailbox_t* 
+ */
+Msg_Mailbox_t *as_msg_mailbox_new()
+{
+    Msg_Mailbox_t *mailbox = g_new0(Msg_Mailbox_t, 1);
+
+    if (NULL == mailbox)
     {
-        // g_print("MAVLINK_MSG_ID_STATUSTEXT\n");
-        mavlink_msg_statustext_decode(&message, &(current_messages->statustext));
-        current_messages->time_stamps.statustext = g_get_monotonic_time();
-        statustex_queue_push(target_system, current_messages);
-        // g_print("severity: %d, statustext: ", current_messages->statustext.severity);
-        // g_print(current_messages->statustext.text);
-        // g_print("\n");
-        break;
+        g_error("Out of memory!");
     }
 
-    case MAVLINK_MSG_ID_PARAM_VALUE:
+    g_mutex_init(&mailbox->mutex);
+    g_cond_init(&mailbox->cond);
+
+    for (guint32 msgid = 0; msgid < MSG_DISPATCH_TABLE_SIZE; msgid++)
     {
-        // g_print("MAVLINK_MSG_ID_PARAM_VALUE\n");
-        mavlink_msg_param_value_decode(&message, &(current_messages->param_value));
-        current_messages->time_stamps.param_value = g_get_monotonic_time();
+        if (NULL == msg_dispatch_table[msgid].decode)
+        {
+            continue;
+        }
 
-        guint16 _param_index = current_messages->param_value.param_index;
+        mailbox->slot[msgid] = g_malloc0(sizeof(Msg_Mailbox_Slot_t) +
+                                         msg_dispatch_table[msgid].storage_size);
 
-        if (_param_index > PARAM_COUNT - 1)
+        if (NULL == mailbox->slot[msgid])
         {
-            // param_index out of range!
-            g_warning("param_index out of range! param_index:%s, param_index:%d, PARAM_COUNT:%d\n",
-                      current_messages->param_value.param_id,
-                      _param_index, PARAM_COUNT);
+            g_error("Out of memory!");
         }
-        else
-        {
-            g_mutex_lock(&parameter_mutex[target_system]);
+    }
+
+    return mailbox;
+}
 
-            strcpy(current_parameter[_param_index].param_id,
-                   current_messages->param_value.param_id);
+/**
+ * @brief overwrite slot of msgid, message_mutex of this sysid should be locked.
+ * 
+ * @param mailbox 
+ * @param msgid 
+ * @param decoded 
+ * @param size 
+ */
+static void as_msg_mailbox_post(Msg_Mailbox_t *mailbox, guint32 msgid,
+                                gconstpointer decoded, gsize size)
+{
+    Msg_Mailbox_Slot_t *slot = mailbox->slot[msgid];
 
-            current_parameter[_param_index].param_type =
-                current_messages->param_value.param_type;
+    // atomic inc is a full barrier, readers see odd sequence before data changes
+    g_atomic_int_inc(&slot->sequence);
 
-            current_parameter[_param_index].param_value.param_float =
-                current_messages->param_value.param_value;
+    memcpy(slot->data, decoded, size);
+    slot->time_stamp = g_get_monotonic_time();
 
-            g_mutex_unlock(&parameter_mutex[target_system]);
-        }
+    g_atomic_int_inc(&slot->sequence);
 
-        // g_print("param_id:%s, param_value:%d, param_type:%d, param_count:%d, param_index:%d\n",
-        //        current_messages->param_value.param_id, current_messages->param_value.param_value,
-        //        current_messages->param_value.param_type, current_messages->param_value.param_count,
-        //        current_messages->param_value.param_index);
+    // count is changed before waiting is read, both full barriers, so a
+    // reader going to wait either sees the count or is signalled
+    g_atomic_int_inc(&mailbox->post_count);
 
-        break;
+    if (0 != g_atomic_int_get(&mailbox->waiting))
+    {
+        g_mutex_lock(&mailbox->mutex);
+        g_cond_broadcast(&mailbox->cond);
+        g_mutex_unlock(&mailbox->mutex);
     }
+}
+
+/**
+ * @brief wait for a post since last wait of reader, or for the worker
+ * to be stopped.
+ * 
+ * @param mailbox 
+ * @param reader 
+ * @param worker_run running flag of the reader, cleared before as_msg_mailbox_wake
+ */
+void as_msg_mailbox_wait(Msg_Mailbox_t *mailbox, Msg_Mailbox_Reader_t *reader,
+                         volatile gint *worker_run)
+{
+    g_assert(NULL != mailbox);
+    g_assert(NULL != reader);
+
+    g_mutex_lock(&mailbox->mutex);
 
-    case MAVLINK_MSG_ID_TIMESYNC:
+    g_atomic_int_inc(&mailbox->waiting);
+
+    while (reader->post_count == g_atomic_int_get(&mailbox->post_count) &&
+           1 == g_atomic_int_get(worker_run))
     {
-        // g_print("MAVLINK_MSG_ID_TIMESYNC\n");
-        mavlink_msg_timesync_decode(&message, &(current_messages->timesync));
-        current_messages->time_stamps.timesync = g_get_monotonic_time();
-        break;
+        g_cond_wait(&mailbox->cond, &mailbox->mutex);
     }
 
-    case MAVLINK_MSG_ID_MOUNT_STATUS:
+    g_atomic_int_add(&mailbox->waiting, -1);
+
+    reader->post_count = g_atomic_int_get(&mailbox->post_count);
+
+    g_mutex_unlock(&mailbox->mutex);
+}
+
+/**
+ * @brief wake readers in as_msg_mailbox_wait after their running flag
+ * is cleared.
+ * 
+ * @param mailbox NULL-able
+ */
+void as_msg_mailbox_wake(Msg_Mailbox_t *mailbox)
+{
+    if (NULL == mailbox)
     {
-        // todo: deal with this
-        break;
+        return;
     }
 
-    case MAVLINK_MSG_ID_MEMINFO:
+    g_mutex_lock(&mailbox->mutex);
+    g_cond_broadcast(&mailbox->cond);
+    g_mutex_unlock(&mailbox->mutex);
+}
+
+/**
+ * @brief copy slot of msgid if it is newer than generation, never blocks writer.
+ * 
+ * @param mailbox 
+ * @param msgid 
+ * @param msg NULL-able, size of decoded struct of msgid
+ * @param generation [in, out] generation read last time, 0 for none
+ * @param time_stamp [out] NULL-able
+ * @return gint 1 if copied, 0 if not newer, -1 if msgid is not decoded
+ */
+gint as_msg_mailbox_read(Msg_Mailbox_t *mailbox, guint32 msgid, gpointer msg,
+                         guint32 *generation, guint64 *time_stamp)
+{
+    g_assert(NULL != mailbox);
+    g_assert(NULL != generation);
+
+    if (msgid >= MSG_DISPATCH_TABLE_SIZE || NULL == mailbox->slot[msgid])
     {
-        // todo: deal with this
-        break;
+        return -1;
     }
 
-    case MAVLINK_MSG_ID_SENSOR_OFFSETS:
+    Msg_Mailbox_Slot_t *slot = mailbox->slot[msgid];
+    gsize size = msg_dispatch_table[msgid].storage_size;
+    guint64 slot_time_stamp;
+    gint sequence;
+    guint retry = 0;
+
+    while (TRUE)
     {
-        // todo: deal with this
-        break;
+        // retries past MSG_MAILBOX_SPIN yield, a preempted writer gets to finish
+        if (retry++ > MSG_MAILBOX_SPIN)
+        {
+            g_thread_yield();
+        }
+
+        sequence = g_atomic_int_get(&slot->sequence);
+
+        // generation is count of completed writes
+        if ((guint32)sequence / 2 == *generation)
+        {
+            return 0;
+        }
+
+        // writer is in the middle of a write
+        if (sequence & 1)
+        {
+            continue;
+        }
+
+        if (NULL != msg)
+        {
+            memcpy(msg, slot->data, size);
+        }
+        slot_time_stamp = slot->time_stamp;
+
+        // data loads above stay before sequence is read again
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (sequence == g_atomic_int_get(&slot->sequence))
+        {
+            break;
+        }
     }
 
-    case MAVLINK_MSG_ID_AHRS:
+    *generation = (guint32)sequence / 2;
+
+    if (NULL != time_stamp)
     {
-        // todo: deal with this
-        break;
+        *time_stamp = slot_time_stamp;
     }
 
-    case MAVLINK_MSG_ID_HWSTATUS:
+    return 1;
+}
+
+/**
+ * @brief read next msg of message_queue msgid changed since last call,
+ * round robin over msgid, so a busy msgid doesn't hide others.
+ * 
+ * @param mailbox 
+ * @param reader 
+ * @return Mavlink_Messages_t* reader->messages with msg_id and its msg set,
+ * NULL if nothing changed
+ */
+Mavlink_Messages_t *as_msg_mailbox_next(Msg_Mailbox_t *mailbox,
+                                        Msg_Mailbox_Reader_t *reader)
+{
+    g_assert(NULL != mailbox);
+    g_assert(NULL != reader);
+
+    for (guint i = 0; i < MSG_DISPATCH_TABLE_SIZE; i++)
     {
-        // todo: deal with this
-        break;
+        guint32 msgid = (reader->next_msgid + i) % MSG_DISPATCH_TABLE_SIZE;
+        Msg_Dispatch_Entry_t *entry = msg_dispatch_table + msgid;
+
+        if (FALSE == entry->queue_push)
+        {
+            continue;
+        }
+
+        if (1 == as_msg_mailbox_read(mailbox, msgid,
+                                     G_STRUCT_MEMBER_P(&reader->messages, entry->storage_offset),
+                                     reader->generation + msgid, NULL))
+        {
+            reader->next_msgid = msgid + 1;
+            reader->messages.msg_id = msgid;
+            return &reader->messages;
+        }
     }
 
-    case MAVLINK_MSG_ID_AHRS2:
+    return NULL;
+}
+
+/**
+ * @brief add a handler, called after msgid decoded.
+ * 
+ * @param msgid 
+ * @param func 
+ * @param user_data 
+ * @return gboolean FALSE if msgid is not decoded or too many handlers
+ */
+gboolean as_msg_dispatch_add_handler(guint32 msgid,
+                                     as_msg_handler_func_t func,
+                                     gpointer user_data)
+{
+    g_assert(NULL != func);
+
+    if (msgid >= MSG_DISPATCH_TABLE_SIZE ||
+        NULL == msg_dispatch_table[msgid].decode)
     {
-        // todo: deal with this
-        break;
+        g_warning("can not add handler, msgid %d is not decoded.", msgid);
+        return FALSE;
     }
 
-    case MAVLINK_MSG_ID_AHRS3:
+    Msg_Dispatch_Entry_t *entry = msg_dispatch_table + msgid;
+    gboolean added = FALSE;
+
+    g_rw_lock_writer_lock(&msg_dispatch_handler_lock);
+
+    if (entry->handler_count < MSG_DISPATCH_MAX_HANDLER)
     {
-        // todo: deal with this
-        break;
+        entry->handlers[entry->handler_count].func = func;
+        entry->handlers[entry->handler_count].user_data = user_data;
+        g_atomic_int_inc(&entry->handler_count);
+        added = TRUE;
     }
 
-    case MAVLINK_MSG_ID_EKF_STATUS_REPORT:
+    g_rw_lock_writer_unlock(&msg_dispatch_handler_lock);
+
+    if (FALSE == added)
     {
-        // todo: deal with this
-        break;
+        g_warning("MSG_DISPATCH_MAX_HANDLER reached! msgid: %d.", msgid);
     }
 
-    default:
+    return added;
+}
+
+/**
+ * @brief remove a handler added by as_msg_dispatch_add_handler.
+ * 
+ * @param msgid 
+ * @param func 
+ * @param user_data 
+ * @return gboolean FALSE if not found
+ */
+gboolean as_msg_dispatch_remove_handler(guint32 msgid,
+                                        as_msg_handler_func_t func,
+                                        gpointer user_data)
+{
+    if (msgid >= MSG_DISPATCH_TABLE_SIZE)
     {
-        g_warning("Warning, did not handle message id %i.", message.msgid);
-        break;
+        return FALSE;
     }
 
-    } // end: switch msgid
+    Msg_Dispatch_Entry_t *entry = msg_dispatch_table + msgid;
+    gboolean removed = FALSE;
 
-    g_mutex_unlock(&message_mutex[message.sysid]);
+    g_rw_lock_writer_lock(&msg_dispatch_handler_lock);
 
-    if (TRUE == queue_push)
+    for (gint i = 0; i < entry->handler_count; i++)
     {
-        message_queue_push(target_system, current_messages);
+        if (entry->handlers[i].func == func &&
+            entry->handlers[i].user_data == user_data)
+        {
+            // keep handlers in order
+            memmove(entry->handlers + i, entry->handlers + i + 1,
+                    sizeof(Msg_Handler_t) * (entry->handler_count - i - 1));
+            g_atomic_int_add(&entry->handler_count, -1);
+            removed = TRUE;
+            break;
+        }
     }
+
+    g_rw_lock_writer_unlock(&msg_dispatch_handler_lock);
+
+    return removed;
 }
 
 void as_handle_named_value_float(guint8 target_system,
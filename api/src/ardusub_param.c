@@ -0,0 +1,941 @@
+/**
+ * @file ardusub_param.c
+ * @author ztluo (me@ztluo.dev)
+ * @brief windowed parameter download, only missing indices are requested.
+ * @version
+ * @date 2019-05-29
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#define G_LOG_DOMAIN "[ardusub param     ]"
+
+#include "../inc/ardusub_param.h"
+#include "../inc/ardusub_interface.h"
+
+static Param_Sync_t param_sync[MAX_VEHICLE_SLOT];
+
+// param_id -> index + 1 of each vehicle, guarded by parameter_mutex
+static GHashTable *param_name_index[MAX_VEHICLE_SLOT];
+
+#define PARAM_SYNC_BIT_TEST(sync, i) ((sync)->received[(i) >> 3] & (1U << ((i)&7)))
+#define PARAM_SYNC_BIT_SET(sync, i) ((sync)->received[(i) >> 3] |= (1U << ((i)&7)))
+
+/**
+ * @brief mark a PARAM_VALUE as received, called by PARAM_VALUE built-in handler.
+ *
+ * @param target_system
+ * @param param_value
+ */
+void as_param_sync_received(guint8 target_system,
+                            const mavlink_param_value_t *param_value)
+{
+    Param_Sync_t *sync = param_sync + target_system;
+
+    g_mutex_lock(&sync->mutex);
+
+    for (GList *l = sync->set_wait; NULL != l; l = l->next)
+    {
+        Param_Set_Wait_t *wait = l->data;
+
+        if (0 == strncmp(wait->param_id, param_value->param_id, sizeof(wait->param_id)))
+        {
+            wait->value = param_value->param_value;
+            wait->done = TRUE;
+            g_cond_broadcast(&sync->cond);
+        }
+    }
+
+    if (0 == strncmp(param_value->param_id, PARAM_HASH_CHECK_ID,
+                     sizeof(param_value->param_id)))
+    {
+        // not a parameter, sent as int32 in float bits, also read after sync is done
+        memcpy(&sync->vehicle_hash, &param_value->param_value, sizeof(guint32));
+        sync->hash_received = TRUE;
+
+        g_cond_broadcast(&sync->cond);
+        g_mutex_unlock(&sync->mutex);
+        return;
+    }
+
+    if (AS_PARAM_SYNC_RUNNING != sync->state)
+    {
+        g_mutex_unlock(&sync->mutex);
+        return;
+    }
+
+    if (0 == sync->param_count && 0 != param_value->param_count)
+    {
+        if (param_value->param_count > PARAM_COUNT)
+        {
+            g_warning("vehicle id:%d has %d parameters, only %d are kept.",
+                      target_system, param_value->param_count, PARAM_COUNT);
+        }
+
+        sync->param_count = MIN(param_value->param_count, PARAM_COUNT);
+        sync->received = g_new0(guint8, (sync->param_count + 7) / 8);
+        if (NULL == sync->received)
+        {
+            g_error("Out of memory!");
+        }
+    }
+
+    guint16 index = param_value->param_index;
+
+    if (index < sync->param_count && !PARAM_SYNC_BIT_TEST(sync, index))
+    {
+        PARAM_SYNC_BIT_SET(sync, index);
+        sync->received_count++;
+        sync->last_receive_time = g_get_monotonic_time();
+
+        for (guint i = 0; i < sync->outstanding_count; i++)
+        {
+            if (sync->outstanding[i].index == index)
+            {
+                // link keeps up, one more request in flight
+                sync->outstanding[i] = sync->outstanding[--sync->outstanding_count];
+                sync->window = MIN(sync->window + 1, PARAM_SYNC_MAX_WINDOW);
+                break;
+            }
+        }
+
+        g_cond_broadcast(&sync->cond);
+    }
+
+    g_mutex_unlock(&sync->mutex);
+}
+
+/**
+ * @brief next index not received nor in flight, from next_index, with mutex locked.
+ *
+ * @param sync
+ * @return gint -1 if none
+ */
+static gint as_param_sync_next_gap(Param_Sync_t *sync)
+{
+    for (guint n = 0; n < sync->param_count; n++)
+    {
+        guint16 index = (sync->next_index + n) % sync->param_count;
+
+        if (PARAM_SYNC_BIT_TEST(sync, index))
+        {
+            continue;
+        }
+
+        gboolean in_flight = FALSE;
+        for (guint i = 0; i < sync->outstanding_count; i++)
+        {
+            if (sync->outstanding[i].index == index)
+            {
+                in_flight = TRUE;
+                break;
+            }
+        }
+
+        if (FALSE == in_flight)
+        {
+            sync->next_index = (index + 1) % sync->param_count;
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief file of parameter cache, by identity in last HEARTBEAT.
+ *
+ * @param target_system
+ * @return gchar* g_free it
+ */
+static gchar *as_param_cache_path(guint8 target_system)
+{
+    Mavlink_Messages_t *current_messages = vehicle_slot[target_system].messages;
+
+    g_mutex_lock(&message_mutex[target_system]);
+    guint8 autopilot = current_messages->heartbeat.autopilot;
+    guint8 type = current_messages->heartbeat.type;
+    g_mutex_unlock(&message_mutex[target_system]);
+
+    return g_strdup_printf(PARAM_CACHE_FILE, target_system, autopilot, type);
+}
+
+/**
+ * @brief FNV-1a of param_id, type and value of parameters in index order,
+ * checks cache file is complete.
+ *
+ * @param parameter
+ * @param param_count
+ * @return guint32
+ */
+static guint32 as_param_cache_hash(const Mavlink_Parameter_t *parameter, guint16 param_count)
+{
+    guint32 hash = 2166136261U;
+
+    for (guint16 i = 0; i < param_count; i++)
+    {
+        for (gsize j = 0; j < sizeof(parameter[i].param_id) && '\0' != parameter[i].param_id[j]; j++)
+        {
+            hash = (hash ^ (guint8)parameter[i].param_id[j]) * 16777619U;
+        }
+
+        hash = (hash ^ (guint8)parameter[i].param_type) * 16777619U;
+
+        guint32 bits;
+        memcpy(&bits, &parameter[i].param_value.param_float, sizeof(bits));
+
+        for (gsize j = 0; j < sizeof(bits); j++)
+        {
+            hash = (hash ^ ((bits >> (8 * j)) & 0xFF)) * 16777619U;
+        }
+    }
+
+    return hash;
+}
+
+/**
+ * @brief save parameters of a vehicle after sync is done.
+ *
+ * @param target_system
+ * @param param_count
+ * @param hash_received
+ * @param vehicle_hash _HASH_CHECK of vehicle
+ */
+static void as_param_cache_save(guint8 target_system, guint16 param_count,
+                                gboolean hash_received, guint32 vehicle_hash)
+{
+    g_autoptr(GKeyFile) key_file = g_key_file_new();
+    g_autoptr(GError) error = NULL;
+    g_autofree gchar *path = as_param_cache_path(target_system);
+    Mavlink_Parameter_t *current_parameter = vehicle_slot[target_system].parameter;
+
+    g_mutex_lock(&parameter_mutex[target_system]);
+
+    guint32 content_hash = as_param_cache_hash(current_parameter, param_count);
+
+    for (guint16 i = 0; i < param_count; i++)
+    {
+        g_autofree gchar *param_id =
+            g_strndup(current_parameter[i].param_id, sizeof(current_parameter[i].param_id));
+
+        // index, type, value
+        gdouble value[3] = {i, current_parameter[i].param_type,
+                            current_parameter[i].param_value.param_float};
+
+        g_key_file_set_double_list(key_file, "param", param_id, value, 3);
+    }
+
+    g_mutex_unlock(&parameter_mutex[target_system]);
+
+    g_key_file_set_integer(key_file, "vehicle", "param_count", param_count);
+    g_key_file_set_boolean(key_file, "vehicle", "hash_check", hash_received);
+    g_key_file_set_uint64(key_file, "vehicle", "hash", vehicle_hash);
+    g_key_file_set_uint64(key_file, "vehicle", "content_hash", content_hash);
+
+    if (!g_key_file_save_to_file(key_file, path, &error))
+    {
+        g_warning("Error saving %s: %s", path, error->message);
+    }
+}
+
+/**
+ * @brief load parameter cache into parameters of a vehicle, if it has
+ * the same _HASH_CHECK and is complete.
+ *
+ * @param target_system
+ * @param path
+ * @param vehicle_hash _HASH_CHECK of vehicle
+ * @return guint16 param_count, 0 if cache is not used
+ */
+static guint16 as_param_cache_load(guint8 target_system, const gchar *path,
+                                   guint32 vehicle_hash)
+{
+    g_autoptr(GKeyFile) key_file = g_key_file_new();
+    g_autoptr(GError) error = NULL;
+
+    if (!g_key_file_load_from_file(key_file, path, G_KEY_FILE_NONE, &error))
+    {
+        g_warning("Error loading %s: %s", path, error->message);
+        return 0;
+    }
+
+    gboolean hash_check = g_key_file_get_boolean(key_file, "vehicle", "hash_check", NULL);
+    guint64 hash = g_key_file_get_uint64(key_file, "vehicle", "hash", NULL);
+    guint64 content_hash = g_key_file_get_uint64(key_file, "vehicle", "content_hash", NULL);
+    gint param_count = g_key_file_get_integer(key_file, "vehicle", "param_count", NULL);
+
+    if (FALSE == hash_check || vehicle_hash != hash ||
+        0 >= param_count || PARAM_COUNT < param_count)
+    {
+        return 0;
+    }
+
+    gsize key_count = 0;
+    g_auto(GStrv) keys = g_key_file_get_keys(key_file, "param", &key_count, NULL);
+
+    if (NULL == keys || (gsize)param_count != key_count)
+    {
+        return 0;
+    }
+
+    g_autofree Mavlink_Parameter_t *cached = g_new0(Mavlink_Parameter_t, param_count);
+    if (NULL == cached)
+    {
+        g_error("Out of memory!");
+    }
+
+    for (gsize i = 0; i < key_count; i++)
+    {
+        gsize length = 0;
+        g_autofree gdouble *value =
+            g_key_file_get_double_list(key_file, "param", keys[i], &length, NULL);
+
+        if (NULL == value || 3 != length || 0 > value[0] || param_count <= value[0])
+        {
+            return 0;
+        }
+
+        Mavlink_Parameter_t *my_parameter = cached + (gint)value[0];
+
+        strncpy(my_parameter->param_id, keys[i], sizeof(my_parameter->param_id));
+        my_parameter->param_type = (enum MAV_PARAM_TYPE)value[1];
+        my_parameter->param_value.param_float = (gfloat)value[2];
+    }
+
+    if (content_hash != as_param_cache_hash(cached, param_count))
+    {
+        g_warning("%s is broken.", path);
+        return 0;
+    }
+
+    Mavlink_Parameter_t *current_parameter = vehicle_slot[target_system].parameter;
+
+    g_mutex_lock(&parameter_mutex[target_system]);
+    memcpy(current_parameter, cached, sizeof(Mavlink_Parameter_t) * param_count);
+    for (guint16 i = 0; i < param_count; i++)
+    {
+        as_param_index_update(target_system, i);
+    }
+    g_mutex_unlock(&parameter_mutex[target_system]);
+
+    return param_count;
+}
+
+/**
+ * @brief read _HASH_CHECK of a vehicle, if not received yet.
+ *
+ * @param target_system
+ * @param target_component
+ * @param vehicle_hash [out]
+ * @return gboolean FALSE if vehicle does not answer
+ */
+static gboolean as_param_sync_hash_check(guint8 target_system, guint8 target_component,
+                                         guint32 *vehicle_hash)
+{
+    Param_Sync_t *sync = param_sync + target_system;
+
+    g_mutex_lock(&sync->mutex);
+    gboolean hash_received = sync->hash_received;
+    g_mutex_unlock(&sync->mutex);
+
+    if (FALSE == hash_received)
+    {
+        send_param_request_read_by_id(target_system, target_component, PARAM_HASH_CHECK_ID);
+    }
+
+    gint64 end_time = g_get_monotonic_time() + PARAM_HASH_CHECK_TIMEOUT;
+
+    g_mutex_lock(&sync->mutex);
+
+    while (FALSE == sync->hash_received &&
+           1 == g_atomic_int_get(parameters_request_worker_run + target_system))
+    {
+        if (FALSE == g_cond_wait_until(&sync->cond, &sync->mutex, end_time))
+        {
+            break;
+        }
+    }
+
+    hash_received = sync->hash_received;
+    *vehicle_hash = sync->vehicle_hash;
+
+    g_mutex_unlock(&sync->mutex);
+
+    return hash_received;
+}
+
+/**
+ * @brief skip download if parameter cache has the same _HASH_CHECK as vehicle.
+ *
+ * @param target_system
+ * @param target_component
+ * @return gboolean TRUE if parameters are loaded from cache
+ */
+static gboolean as_param_sync_warm_start(guint8 target_system, guint8 target_component)
+{
+    Param_Sync_t *sync = param_sync + target_system;
+    g_autofree gchar *path = as_param_cache_path(target_system);
+    guint32 vehicle_hash = 0;
+
+    if (FALSE == g_file_test(path, G_FILE_TEST_EXISTS))
+    {
+        return FALSE;
+    }
+
+    if (FALSE == as_param_sync_hash_check(target_system, target_component, &vehicle_hash))
+    {
+        g_message("no %s from vehicle id:%d, %s is not used.",
+                  PARAM_HASH_CHECK_ID, target_system, path);
+        return FALSE;
+    }
+
+    guint16 param_count = as_param_cache_load(target_system, path, vehicle_hash);
+
+    if (0 == param_count)
+    {
+        g_message("%s is out of date.", path);
+        return FALSE;
+    }
+
+    g_mutex_lock(&sync->mutex);
+
+    g_free(sync->received);
+    sync->received = g_malloc((param_count + 7) / 8);
+    if (NULL == sync->received)
+    {
+        g_error("Out of memory!");
+    }
+    memset(sync->received, 0xFF, (param_count + 7) / 8);
+
+    sync->param_count = param_count;
+    sync->received_count = param_count;
+    g_atomic_int_set(&sync->state, AS_PARAM_SYNC_DONE);
+
+    as_api_param_progress_callback_t callback = sync->callback;
+    gpointer user_data = sync->user_data;
+
+    g_mutex_unlock(&sync->mutex);
+
+    if (NULL != callback)
+    {
+        callback(target_system, param_count, param_count, AS_PARAM_SYNC_DONE, user_data);
+    }
+
+    g_message("Fetch all parameter from %s! vehicle id:%d, %d parameters.",
+              path, target_system, param_count);
+
+    return TRUE;
+}
+
+/**
+ * @brief download all parameters of a vehicle, returns when done, failed
+ * or stopped. runs on parameters_request_worker of this vehicle.
+ *
+ * with F_STORAGE_INI, parameter cache is used if vehicle _HASH_CHECK is
+ * unchanged. otherwise PARAM_REQUEST_LIST is sent first, after its stream
+ * is idle, missing indices are requested with a window of PARAM_REQUEST_READ
+ * in flight.
+ *
+ * @param target_system
+ * @param target_component
+ */
+void as_param_sync_run(guint8 target_system, guint8 target_component)
+{
+    Param_Sync_t *sync = param_sync + target_system;
+    guint16 request[PARAM_SYNC_MAX_WINDOW];
+    guint16 reported_count = G_MAXUINT16;
+    guint list_attempts = 1;
+
+    if ((thread_flag & F_STORAGE_INI) &&
+        TRUE == as_param_sync_warm_start(target_system, target_component))
+    {
+        return;
+    }
+
+    send_param_request_list(target_system, target_component);
+
+    g_mutex_lock(&sync->mutex);
+
+    // time out of PARAM_REQUEST_LIST from now
+    sync->last_receive_time = MAX(sync->last_receive_time, g_get_monotonic_time());
+
+    while (1 == g_atomic_int_get(parameters_request_worker_run + target_system))
+    {
+        gint64 now = g_get_monotonic_time();
+        gint64 end_time = now + PARAM_SYNC_STREAM_IDLE;
+        guint request_count = 0;
+        gboolean list_resend = FALSE;
+
+        if (0 == sync->param_count)
+        {
+            // no PARAM_VALUE yet
+            if (now - sync->last_receive_time >= PARAM_SYNC_LIST_TIMEOUT)
+            {
+                if (list_attempts >= PARAM_SYNC_LIST_RETRIES)
+                {
+                    g_atomic_int_set(&sync->state, AS_PARAM_SYNC_FAILED);
+                }
+                else
+                {
+                    list_attempts++;
+                    sync->last_receive_time = now;
+                    list_resend = TRUE;
+                }
+            }
+
+            end_time = sync->last_receive_time + PARAM_SYNC_LIST_TIMEOUT;
+        }
+        else if (sync->received_count == sync->param_count)
+        {
+            g_atomic_int_set(&sync->state, AS_PARAM_SYNC_DONE);
+        }
+        else if (TRUE == sync->streaming &&
+                 now - sync->last_receive_time < PARAM_SYNC_STREAM_IDLE)
+        {
+            end_time = sync->last_receive_time + PARAM_SYNC_STREAM_IDLE;
+        }
+        else
+        {
+            sync->streaming = FALSE;
+
+            // resend timeout requests, window shrinks
+            for (guint i = 0; i < sync->outstanding_count; i++)
+            {
+                Param_Request_t *my_request = sync->outstanding + i;
+
+                if (now - my_request->sent_time >= PARAM_SYNC_TIMEOUT)
+                {
+                    if (my_request->attempts >= PARAM_SYNC_RETRIES)
+                    {
+                        g_atomic_int_set(&sync->state, AS_PARAM_SYNC_FAILED);
+                        break;
+                    }
+
+                    my_request->attempts++;
+                    my_request->sent_time = now;
+                    request[request_count++] = my_request->index;
+                    sync->window = MAX(sync->window / 2, PARAM_SYNC_MIN_WINDOW);
+                }
+            }
+
+            // fill window with gaps
+            while (AS_PARAM_SYNC_RUNNING == sync->state &&
+                   sync->outstanding_count < sync->window &&
+                   request_count < PARAM_SYNC_MAX_WINDOW)
+            {
+                gint index = as_param_sync_next_gap(sync);
+
+                if (0 > index)
+                {
+                    break;
+                }
+
+                Param_Request_t *my_request = sync->outstanding + sync->outstanding_count++;
+                my_request->index = index;
+                my_request->attempts = 1;
+                my_request->sent_time = now;
+                request[request_count++] = index;
+            }
+
+            for (guint i = 0; i < sync->outstanding_count; i++)
+            {
+                end_time = MIN(end_time, sync->outstanding[i].sent_time + PARAM_SYNC_TIMEOUT);
+            }
+        }
+
+        gint state = sync->state;
+        as_api_param_progress_callback_t callback = NULL;
+        gpointer user_data = sync->user_data;
+        guint16 received_count = sync->received_count;
+        guint16 param_count = sync->param_count;
+
+        if (received_count != reported_count || AS_PARAM_SYNC_RUNNING != state)
+        {
+            reported_count = received_count;
+            callback = sync->callback;
+        }
+
+        if (0 < request_count || TRUE == list_resend || NULL != callback)
+        {
+            // send and call back without lock, PARAM_VALUE may come at once
+            g_mutex_unlock(&sync->mutex);
+
+            if (TRUE == list_resend)
+            {
+                send_param_request_list(target_system, target_component);
+            }
+
+            for (guint i = 0; i < request_count; i++)
+            {
+                send_param_request_read(target_system, target_component, request[i]);
+            }
+
+            if (NULL != callback)
+            {
+                callback(target_system, received_count, param_count, state, user_data);
+            }
+
+            g_mutex_lock(&sync->mutex);
+        }
+
+        if (AS_PARAM_SYNC_RUNNING != state)
+        {
+            break;
+        }
+
+        if (0 == request_count)
+        {
+            g_cond_wait_until(&sync->cond, &sync->mutex, end_time);
+        }
+    }
+
+    gint state = sync->state;
+    guint16 received_count = sync->received_count;
+    guint16 param_count = sync->param_count;
+    gint64 start_time = sync->start_time;
+
+    if (AS_PARAM_SYNC_RUNNING == state)
+    {
+        // stopped
+        g_atomic_int_set(&sync->state, AS_PARAM_SYNC_FAILED);
+    }
+
+    g_mutex_unlock(&sync->mutex);
+
+    if (AS_PARAM_SYNC_DONE == state)
+    {
+        g_message("Fetch all parameter SUCCEED! vehicle id:%d, %d parameters in %.1f s.",
+                  target_system, param_count,
+                  (g_get_monotonic_time() - start_time) / (gdouble)G_USEC_PER_SEC);
+
+        if (thread_flag & F_STORAGE_INI)
+        {
+            guint32 vehicle_hash = 0;
+            gboolean hash_received =
+                as_param_sync_hash_check(target_system, target_component, &vehicle_hash);
+
+            as_param_cache_save(target_system, param_count, hash_received, vehicle_hash);
+        }
+    }
+    else
+    {
+        g_message("Fetch all parameter FAILED! vehicle id:%d, %d of %d received.",
+                  target_system, received_count, param_count);
+    }
+}
+
+/**
+ * @brief reset sync state and set it running, before parameters_request_worker starts.
+ *
+ * @param target_system
+ * @param callback
+ * @param user_data
+ * @return gboolean FALSE if it is running
+ */
+static gboolean as_param_sync_reset(guint8 target_system,
+                                    as_api_param_progress_callback_t callback,
+                                    gpointer user_data)
+{
+    Param_Sync_t *sync = param_sync + target_system;
+
+    g_mutex_lock(&sync->mutex);
+
+    if (AS_PARAM_SYNC_RUNNING == sync->state)
+    {
+        g_mutex_unlock(&sync->mutex);
+        return FALSE;
+    }
+
+    g_free(sync->received);
+    sync->received = NULL;
+    sync->param_count = 0;
+    sync->received_count = 0;
+    sync->start_time = g_get_monotonic_time();
+    sync->last_receive_time = sync->start_time;
+    sync->streaming = TRUE;
+    sync->hash_received = FALSE;
+    sync->window = PARAM_SYNC_MIN_WINDOW;
+    sync->outstanding_count = 0;
+    sync->next_index = 0;
+    sync->callback = callback;
+    sync->user_data = user_data;
+    g_atomic_int_set(&sync->state, AS_PARAM_SYNC_RUNNING);
+
+    g_mutex_unlock(&sync->mutex);
+
+    return TRUE;
+}
+
+/**
+ * @brief wake parameters_request_worker of a vehicle, after its run flag is cleared.
+ *
+ * @param target_system
+ */
+void as_param_sync_stop(guint8 target_system)
+{
+    Param_Sync_t *sync = param_sync + target_system;
+
+    g_mutex_lock(&sync->mutex);
+    g_cond_broadcast(&sync->cond);
+    g_mutex_unlock(&sync->mutex);
+}
+
+/**
+ * @brief download all parameters of a vehicle again, in background.
+ * parameters already received are kept until overwritten.
+ *
+ * @param target_system
+ * @param callback NULL-able, called on parameters_request_worker on progress,
+ * last call has state AS_PARAM_SYNC_DONE or AS_PARAM_SYNC_FAILED.
+ * @param user_data
+ * @return int 1 for started, 0 if no vehicle or sync is running
+ */
+int as_api_param_sync(uint8_t target_system,
+                      as_api_param_progress_callback_t callback, void *user_data)
+{
+    if (0 == as_api_check_vehicle(target_system))
+    {
+        g_warning("no vehicle id:%d, in file: %s, func: %s, line: %d",
+                  target_system, __FILE__, __FUNCTION__, __LINE__);
+        return 0;
+    }
+
+    if (FALSE == as_param_sync_reset(target_system, callback, user_data))
+    {
+        g_warning("parameter sync of vehicle id:%d is running.", target_system);
+        return 0;
+    }
+
+    as_request_full_parameters(target_system, vehicle_slot[target_system].primary_compid);
+
+    return 1;
+}
+
+/**
+ * @brief progress of last parameter sync.
+ *
+ * @param target_system
+ * @param received [out] NULL-able
+ * @param count [out] NULL-able, 0 until first PARAM_VALUE
+ * @return int AS_PARAM_SYNC_IDLE ...
+ */
+int as_api_param_sync_progress(uint8_t target_system,
+                               uint16_t *received, uint16_t *count)
+{
+    Param_Sync_t *sync = param_sync + target_system;
+
+    g_mutex_lock(&sync->mutex);
+
+    if (NULL != received)
+    {
+        *received = sync->received_count;
+    }
+
+    if (NULL != count)
+    {
+        *count = sync->param_count;
+    }
+
+    gint state = sync->state;
+
+    g_mutex_unlock(&sync->mutex);
+
+    return state;
+}
+
+/**
+ * @brief start sync without callback, from as_system_add.
+ *
+ * @param target_system
+ * @param target_component
+ */
+void as_param_sync_start(guint8 target_system, guint8 target_component)
+{
+    if (TRUE == as_param_sync_reset(target_system, NULL, NULL))
+    {
+        as_request_full_parameters(target_system, target_component);
+    }
+}
+
+/**
+ * @brief index param_id of a stored parameter, with parameter_mutex locked.
+ *
+ * @param target_system
+ * @param param_index
+ */
+void as_param_index_update(guint8 target_system, guint16 param_index)
+{
+    Mavlink_Parameter_t *my_parameter = vehicle_slot[target_system].parameter + param_index;
+
+    if (NULL == param_name_index[target_system])
+    {
+        param_name_index[target_system] =
+            g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    }
+
+    g_hash_table_replace(param_name_index[target_system],
+                         g_strndup(my_parameter->param_id, sizeof(my_parameter->param_id)),
+                         GINT_TO_POINTER(param_index + 1));
+}
+
+/**
+ * @brief index of a parameter by param_id, with parameter_mutex locked.
+ *
+ * @param target_system
+ * @param param_id
+ * @return gint -1 if not found
+ */
+static gint as_param_index_lookup(guint8 target_system, const gchar *param_id)
+{
+    if (NULL == param_name_index[target_system])
+    {
+        return -1;
+    }
+
+    gint index = GPOINTER_TO_INT(g_hash_table_lookup(param_name_index[target_system], param_id)) - 1;
+
+    if (0 > index)
+    {
+        return -1;
+    }
+
+    // index is reused by another parameter, e.g. after firmware update
+    Mavlink_Parameter_t *my_parameter = vehicle_slot[target_system].parameter + index;
+    if (0 != strncmp(my_parameter->param_id, param_id, sizeof(my_parameter->param_id)))
+    {
+        return -1;
+    }
+
+    return index;
+}
+
+/**
+ * @brief get a parameter by name, from parameters received so far.
+ *
+ * @param target_system
+ * @param param_id e.g. "SURFACE_DEPTH"
+ * @param value [out]
+ * @return int 1 for success, 0 if not found
+ */
+int as_api_param_get(uint8_t target_system, const char *param_id, float *value)
+{
+    g_assert(NULL != param_id);
+    g_assert(NULL != value);
+
+    if (0 == as_api_check_vehicle(target_system))
+    {
+        g_warning("no vehicle id:%d, in file: %s, func: %s, line: %d",
+                  target_system, __FILE__, __FUNCTION__, __LINE__);
+        return 0;
+    }
+
+    Mavlink_Parameter_t *current_parameter = vehicle_slot[target_system].parameter;
+
+    g_mutex_lock(&parameter_mutex[target_system]);
+
+    gint index = as_param_index_lookup(target_system, param_id);
+
+    if (0 <= index)
+    {
+        *value = current_parameter[index].param_value.param_float;
+    }
+
+    g_mutex_unlock(&parameter_mutex[target_system]);
+
+    return (0 <= index) ? 1 : 0;
+}
+
+/**
+ * @brief set a parameter by name with PARAM_SET, returns when vehicle echoes
+ * PARAM_VALUE of it. resent only on timeout, an echo of another value is
+ * a rejection. parameter must be received before, for its type.
+ *
+ * @param target_system
+ * @param param_id e.g. "SURFACE_DEPTH"
+ * @param value
+ * @return int 1 if echoed value is the new value, 0 for unknown parameter,
+ * timeout or rejected
+ */
+int as_api_param_set(uint8_t target_system, const char *param_id, float value)
+{
+    g_assert(NULL != param_id);
+
+    if (0 == as_api_check_vehicle(target_system))
+    {
+        g_warning("no vehicle id:%d, in file: %s, func: %s, line: %d",
+                  target_system, __FILE__, __FUNCTION__, __LINE__);
+        return 0;
+    }
+
+    Mavlink_Parameter_t *current_parameter = vehicle_slot[target_system].parameter;
+
+    g_mutex_lock(&parameter_mutex[target_system]);
+
+    gint index = as_param_index_lookup(target_system, param_id);
+    guint8 param_type = (0 <= index) ? current_parameter[index].param_type : 0;
+
+    g_mutex_unlock(&parameter_mutex[target_system]);
+
+    if (0 > index)
+    {
+        g_warning("unknown parameter %s of vehicle id:%d.", param_id, target_system);
+        return 0;
+    }
+
+    Param_Sync_t *sync = param_sync + target_system;
+    Param_Set_Wait_t wait = {0};
+    gboolean confirmed = FALSE;
+    gboolean rejected = FALSE;
+
+    strncpy(wait.param_id, param_id, sizeof(wait.param_id));
+
+    g_mutex_lock(&sync->mutex);
+    sync->set_wait = g_list_prepend(sync->set_wait, &wait);
+    g_mutex_unlock(&sync->mutex);
+
+    for (gint i = 0; i < PARAM_SET_RETRIES && FALSE == confirmed && FALSE == rejected; i++)
+    {
+        // reset before send, echo may be handled before we wait
+        g_mutex_lock(&sync->mutex);
+        wait.done = FALSE;
+        g_mutex_unlock(&sync->mutex);
+
+        send_param_set(target_system, vehicle_slot[target_system].primary_compid,
+                       param_id, value, param_type);
+
+        gint64 end_time = g_get_monotonic_time() + PARAM_SET_TIMEOUT;
+
+        g_mutex_lock(&sync->mutex);
+
+        while (FALSE == wait.done)
+        {
+            if (FALSE == g_cond_wait_until(&sync->cond, &sync->mutex, end_time))
+            {
+                break;
+            }
+        }
+
+        // vehicle keeps old value, e.g. out of range or read only
+        confirmed = (TRUE == wait.done) && (value == wait.value);
+        rejected = (TRUE == wait.done) && (value != wait.value);
+
+        g_mutex_unlock(&sync->mutex);
+    }
+
+    g_mutex_lock(&sync->mutex);
+    sync->set_wait = g_list_remove(sync->set_wait, &wait);
+    g_mutex_unlock(&sync->mutex);
+
+    if (TRUE == rejected)
+    {
+        g_warning("set parameter %s of vehicle id:%d REJECTED, value is %f.",
+                  param_id, target_system, wait.value);
+    }
+    else if (FALSE == confirmed)
+    {
+        g_warning("set parameter %s of vehicle id:%d FAILED!", param_id, target_system);
+    }
+
+    return (TRUE == confirmed) ? 1 : 0;
+}
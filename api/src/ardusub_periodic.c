@@ -0,0 +1,360 @@
+/**
+ * @file ardusub_periodic.c
+ * @author ztluo (me@ztluo.dev)
+ * @brief periodic executor of user control loops, absolute deadlines on
+ * CLOCK_MONOTONIC, optional SCHED_FIFO, cpu pinning and mlock.
+ * @version
+ * @date 2019-06-02
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+// pthread_setaffinity_np, clock_nanosleep and mlockall in -std=c99
+#define _GNU_SOURCE
+
+#define G_LOG_DOMAIN "[ardusub periodic  ]"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+#endif
+
+#include "../inc/ardusub_periodic.h"
+#include "../inc/ardusub_interface.h"
+
+// slots are never freed, same as subscriptions
+static Periodic_t periodic[MAX_PERIODIC];
+static GMutex periodic_mutex;
+
+/**
+ * @brief monotonic time in nanoseconds.
+ *
+ * @return gint64
+ */
+static gint64 as_periodic_now()
+{
+#ifndef _WIN32
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (gint64)now.tv_sec * 1000000000 + now.tv_nsec;
+#else
+    return g_get_monotonic_time() * 1000;
+#endif
+}
+
+/**
+ * @brief sleep until absolute monotonic time, no drift from wake up latency.
+ *
+ * @param deadline in nanoseconds
+ */
+static void as_periodic_sleep_until(gint64 deadline)
+{
+#ifndef _WIN32
+    struct timespec wake;
+    wake.tv_sec = deadline / 1000000000;
+    wake.tv_nsec = deadline % 1000000000;
+
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, NULL))
+    {
+        ;
+    }
+#else
+    gint64 remain = deadline - as_periodic_now();
+    if (0 < remain)
+    {
+        g_usleep(remain / 1000);
+    }
+#endif
+}
+
+/**
+ * @brief apply real-time options on executor thread, failure of each one
+ * is logged and the loop runs without it.
+ *
+ * @param my_periodic
+ */
+static void as_periodic_setup(const Periodic_t *my_periodic)
+{
+#ifndef _WIN32
+    if (my_periodic->options & F_PERIODIC_MLOCK)
+    {
+        if (0 != mlockall(MCL_CURRENT | MCL_FUTURE))
+        {
+            g_warning("mlockall failed: %s.", g_strerror(errno));
+        }
+
+        // fault in stack now, not in first cycles
+        volatile guint8 stack[PERIODIC_PREFAULT_STACK];
+        for (gsize i = 0; i < sizeof(stack); i += 4096)
+        {
+            stack[i] = 0;
+        }
+    }
+
+#ifdef __linux__
+    if (0 <= my_periodic->cpu)
+    {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(my_periodic->cpu, &cpu_set);
+
+        gint ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+        if (0 != ret)
+        {
+            g_warning("pin to cpu %d failed: %s.", my_periodic->cpu, g_strerror(ret));
+        }
+    }
+#endif
+
+    if (my_periodic->options & F_PERIODIC_SCHED_FIFO)
+    {
+        struct sched_param param;
+        param.sched_priority = CLAMP(my_periodic->priority,
+                                     sched_get_priority_min(SCHED_FIFO),
+                                     sched_get_priority_max(SCHED_FIFO));
+
+        gint ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (0 != ret)
+        {
+            g_warning("SCHED_FIFO priority %d failed: %s.",
+                      param.sched_priority, g_strerror(ret));
+        }
+    }
+#endif
+}
+
+/**
+ * @brief executor thread, one cycle per period. a cycle finished after
+ * next deadline is an overrun, missed deadlines are skipped to keep phase.
+ *
+ * @param data Periodic_t
+ * @return gpointer
+ */
+static gpointer periodic_worker(gpointer data)
+{
+    Periodic_t *my_periodic = (Periodic_t *)data;
+
+    as_periodic_setup(my_periodic);
+
+    Vehicle_Data_t vehicle_data;
+    guint64 cycle = 0;
+    gint64 jitter_sum = 0;
+    gint64 deadline = as_periodic_now();
+
+    while (1 == g_atomic_int_get(&my_periodic->run))
+    {
+        deadline += my_periodic->period;
+        as_periodic_sleep_until(deadline);
+
+        gint64 wake_time = as_periodic_now();
+        gint64 jitter = wake_time - deadline;
+
+        if (0 == g_atomic_int_get(&my_periodic->run))
+        {
+            break;
+        }
+
+        const Vehicle_Data_t *snapshot = NULL;
+        if (0 != as_api_check_vehicle(my_periodic->target_system) &&
+            0 != as_api_get_vehicle_data2(my_periodic->target_system, &vehicle_data))
+        {
+            snapshot = &vehicle_data;
+        }
+
+        my_periodic->callback(my_periodic->target_system, snapshot, cycle,
+                              my_periodic->user_data);
+        cycle++;
+
+        gint64 end_time = as_periodic_now();
+
+        // deadlines passed while running, next one included
+        gint64 missed = (end_time - deadline) / my_periodic->period;
+        deadline += missed * my_periodic->period;
+
+        jitter_sum += jitter;
+
+        g_mutex_lock(&my_periodic->stats_mutex);
+
+        Periodic_Stats_t *stats = &my_periodic->stats;
+        if (0 == stats->cycles || jitter < stats->jitter_min)
+        {
+            stats->jitter_min = jitter;
+        }
+        if (0 == stats->cycles || jitter > stats->jitter_max)
+        {
+            stats->jitter_max = jitter;
+        }
+        stats->cycles = cycle;
+        stats->jitter_mean = jitter_sum / (gint64)cycle;
+        stats->exec_last = end_time - wake_time;
+        stats->exec_max = MAX(stats->exec_max, stats->exec_last);
+        if (0 < missed)
+        {
+            stats->overruns++;
+            stats->skipped += missed;
+        }
+
+        g_mutex_unlock(&my_periodic->stats_mutex);
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief run callback at a fixed rate on its own thread, with latest
+ * vehicle data. replaces a busy wait loop of user control code.
+ *
+ * @param target_system vehicle of snapshot
+ * @param period_us period, at least PERIODIC_MIN_PERIOD
+ * @param callback
+ * @param user_data
+ * @param options F_PERIODIC_SCHED_FIFO, F_PERIODIC_MLOCK
+ * @param priority SCHED_FIFO priority, 1 - 99
+ * @param cpu cpu to pin thread to, -1 for no pinning
+ * @return int periodic id, 0 for failed
+ */
+int as_api_periodic_start(uint8_t target_system, unsigned int period_us,
+                          as_api_periodic_callback_t callback, void *user_data,
+                          unsigned int options, int priority, int cpu)
+{
+    if (NULL == callback || PERIODIC_MIN_PERIOD > period_us)
+    {
+        return 0;
+    }
+
+    g_mutex_lock(&periodic_mutex);
+
+    gint index = -1;
+    for (gint i = 0; i < MAX_PERIODIC; i++)
+    {
+        if (FALSE == g_atomic_int_get(&periodic[i].active))
+        {
+            index = i;
+            break;
+        }
+    }
+
+    if (0 > index)
+    {
+        g_mutex_unlock(&periodic_mutex);
+        g_warning("MAX_PERIODIC reached!");
+        return 0;
+    }
+
+    Periodic_t *my_periodic = periodic + index;
+
+    my_periodic->target_system = target_system;
+    my_periodic->period = (gint64)period_us * 1000;
+    my_periodic->options = options;
+    my_periodic->priority = priority;
+    my_periodic->cpu = cpu;
+    my_periodic->callback = callback;
+    my_periodic->user_data = user_data;
+    memset(&my_periodic->stats, 0, sizeof(Periodic_Stats_t));
+
+    // id = generation * MAX_PERIODIC + index, stale id never matches a reused slot
+    gint generation = g_atomic_int_get(&my_periodic->id) / MAX_PERIODIC + 1;
+    if (generation >= G_MAXINT / MAX_PERIODIC)
+    {
+        generation = 1;
+    }
+
+    gint id = generation * MAX_PERIODIC + index;
+    g_atomic_int_set(&my_periodic->id, id);
+    g_atomic_int_set(&my_periodic->run, 1);
+    g_atomic_int_set(&my_periodic->active, TRUE);
+
+    my_periodic->thread = g_thread_new("periodic_worker", &periodic_worker, my_periodic);
+
+    g_mutex_unlock(&periodic_mutex);
+
+    return id;
+}
+
+/**
+ * @brief stop periodic executor and wait for its last cycle,
+ * do not call from its own callback.
+ *
+ * @param periodic_id
+ * @return int 0 for not found
+ */
+int as_api_periodic_stop(int periodic_id)
+{
+    if (periodic_id <= 0)
+    {
+        return 0;
+    }
+
+    Periodic_t *my_periodic = periodic + periodic_id % MAX_PERIODIC;
+
+    g_mutex_lock(&periodic_mutex);
+
+    if ((FALSE == my_periodic->active) || (periodic_id != my_periodic->id) ||
+        (NULL == my_periodic->thread))
+    {
+        g_mutex_unlock(&periodic_mutex);
+        return 0;
+    }
+
+    GThread *this_thread = my_periodic->thread;
+    my_periodic->thread = NULL;
+    g_atomic_int_set(&my_periodic->run, 0);
+
+    g_mutex_unlock(&periodic_mutex);
+
+    g_thread_join(this_thread);
+
+    // slot is reusable only after its thread is gone
+    g_atomic_int_set(&my_periodic->active, FALSE);
+
+    return 1;
+}
+
+/**
+ * @brief get timing of periodic executor, also valid after stop until
+ * slot is reused.
+ *
+ * @param periodic_id
+ * @param stats
+ * @return int 0 for not found
+ */
+int as_api_periodic_get_stats(int periodic_id, Periodic_Stats_t *stats)
+{
+    g_assert(NULL != stats);
+
+    if (periodic_id <= 0)
+    {
+        return 0;
+    }
+
+    Periodic_t *my_periodic = periodic + periodic_id % MAX_PERIODIC;
+
+    if (periodic_id != g_atomic_int_get(&my_periodic->id))
+    {
+        return 0;
+    }
+
+    g_mutex_lock(&my_periodic->stats_mutex);
+    memcpy(stats, &my_periodic->stats, sizeof(Periodic_Stats_t));
+    g_mutex_unlock(&my_periodic->stats_mutex);
+
+    return 1;
+}
+
+/**
+ * @brief stop all periodic executors, call before I/O is stopped,
+ * callbacks may still send.
+ *
+ */
+void as_periodic_deinit()
+{
+    for (gint i = 0; i < MAX_PERIODIC; i++)
+    {
+        as_api_periodic_stop(g_atomic_int_get(&periodic[i].id));
+    }
+}
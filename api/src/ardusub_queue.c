@@ -0,0 +1,493 @@
+/**
+ * @file ardusub_queue.c
+ * @author ztluo (me@ztluo.dev)
+ * @brief
+ * @version
+ * @date 2019-05-24
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#define G_LOG_DOMAIN "[ardusub queue     ]"
+
+// mavlink before ardusub_api.h, as in ardusub_def.h
+#include "../inc/ardusub_def.h"
+#include "../inc/ardusub_queue.h"
+
+static As_Queue_Config_t as_queue_config[AS_QUEUE_COUNT] = {
+    {AS_QUEUE_DROP_OLDEST, MAX_MESSAGE, 0},
+    {AS_QUEUE_DROP_OLDEST, MAX_STATUSTEX, 0},
+    {AS_QUEUE_DROP_OLDEST, MAX_NAMED_VALUE_FLOAT, 0},
+    {AS_QUEUE_DROP_OLDEST, MAX_SERIAL_PORT_WRITE_BUF_COUNT, 0},
+};
+
+static const gchar *as_queue_names[AS_QUEUE_COUNT] = {
+    "message",
+    "statustext",
+    "named_value_float",
+    "serial_write_buf",
+};
+
+static const gchar *as_queue_policy_names[] = {
+    "drop_oldest",
+    "drop_newest",
+    "block",
+    "coalesce",
+};
+
+/**
+ * @brief hash of a string field, not null terminated if it is full.
+ *
+ * @param str
+ * @param len
+ * @return guint
+ */
+static guint as_queue_str_hash(const gchar *str, gsize len)
+{
+    guint hash = 5381;
+
+    for (gsize i = 0; i < len && '\0' != str[i]; i++)
+    {
+        hash = hash * 33 + str[i];
+    }
+
+    return hash;
+}
+
+static guint as_queue_message_hash(gconstpointer item)
+{
+    return ((const Mavlink_Messages_t *)item)->msg_id;
+}
+
+static gboolean as_queue_message_equal(gconstpointer a, gconstpointer b)
+{
+    return ((const Mavlink_Messages_t *)a)->msg_id ==
+           ((const Mavlink_Messages_t *)b)->msg_id;
+}
+
+static guint as_queue_statustex_hash(gconstpointer item)
+{
+    const mavlink_statustext_t *statustext = item;
+
+    return as_queue_str_hash(statustext->text, sizeof(statustext->text));
+}
+
+static gboolean as_queue_statustex_equal(gconstpointer a, gconstpointer b)
+{
+    return 0 == strncmp(((const mavlink_statustext_t *)a)->text,
+                        ((const mavlink_statustext_t *)b)->text,
+                        sizeof(((const mavlink_statustext_t *)a)->text));
+}
+
+static guint as_queue_named_val_float_hash(gconstpointer item)
+{
+    const mavlink_named_value_float_t *named_value_float = item;
+
+    return as_queue_str_hash(named_value_float->name, sizeof(named_value_float->name));
+}
+
+static gboolean as_queue_named_val_float_equal(gconstpointer a, gconstpointer b)
+{
+    return 0 == strncmp(((const mavlink_named_value_float_t *)a)->name,
+                        ((const mavlink_named_value_float_t *)b)->name,
+                        sizeof(((const mavlink_named_value_float_t *)a)->name));
+}
+
+/**
+ * @brief new queue, config of its kind applies.
+ *
+ * @param kind AS_QUEUE_MESSAGE ...
+ * @return As_Queue_t*
+ */
+As_Queue_t *as_queue_new(guint kind)
+{
+    g_assert(kind < AS_QUEUE_COUNT);
+
+    As_Queue_t *queue = g_new0(As_Queue_t, 1);
+
+    if (NULL == queue)
+    {
+        g_error("Out of memory!");
+    }
+
+    queue->kind = kind;
+    g_mutex_init(&queue->mutex);
+    g_cond_init(&queue->cond);
+    g_cond_init(&queue->not_empty);
+    g_queue_init(&queue->queue);
+
+    switch (kind)
+    {
+    case AS_QUEUE_MESSAGE:
+        queue->key_index = g_hash_table_new(as_queue_message_hash,
+                                            as_queue_message_equal);
+        break;
+    case AS_QUEUE_STATUSTEX:
+        queue->key_index = g_hash_table_new(as_queue_statustex_hash,
+                                            as_queue_statustex_equal);
+        break;
+    case AS_QUEUE_NAMED_VAL_FLOAT:
+        queue->key_index = g_hash_table_new(as_queue_named_val_float_hash,
+                                            as_queue_named_val_float_equal);
+        break;
+    default:
+        // serial write buf is never coalesced, frames of one msgid may
+        // differ in target, command or param, e.g. COMMAND_LONG, PARAM_SET
+        queue->key_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+        break;
+    }
+
+    return queue;
+}
+
+/**
+ * @brief pop head, call with queue mutex locked.
+ *
+ * @param queue
+ * @return gpointer NULL if empty
+ */
+static gpointer as_queue_pop_head(As_Queue_t *queue)
+{
+    GList *link = g_queue_peek_head_link(&queue->queue);
+
+    if (NULL == link)
+    {
+        return NULL;
+    }
+
+    gpointer item = link->data;
+
+    // only items pushed with AS_QUEUE_COALESCE are indexed
+    if (0 != g_hash_table_size(queue->key_index) &&
+        link == g_hash_table_lookup(queue->key_index, item))
+    {
+        g_hash_table_remove(queue->key_index, item);
+    }
+
+    g_queue_pop_head(&queue->queue);
+
+    g_cond_signal(&queue->cond);
+
+    return item;
+}
+
+/**
+ * @brief push item by policy of this kind, item is owned by queue after push.
+ *
+ * @param queue
+ * @param item g_malloc item
+ * @param depth [out] queue length after push, may be NULL
+ * @return queue_push_t
+ */
+queue_push_t as_queue_push(As_Queue_t *queue, gpointer item, gint *depth)
+{
+    g_assert(NULL != queue);
+    g_assert(NULL != item);
+
+    As_Queue_Config_t *config = as_queue_config + queue->kind;
+    gint policy = g_atomic_int_get(&config->policy);
+    guint capacity = MAX(g_atomic_int_get(&config->capacity), 1);
+    queue_push_t rt = QUEUE_PUSHED;
+
+    g_mutex_lock(&queue->mutex);
+
+    if (AS_QUEUE_COALESCE == policy)
+    {
+        GList *link = g_hash_table_lookup(queue->key_index, item);
+
+        if (NULL != link)
+        {
+            // keep place in queue, only data is newer
+            gpointer old_item = link->data;
+            link->data = item;
+            g_hash_table_replace(queue->key_index, item, link);
+            g_free(old_item);
+
+            rt = QUEUE_COALESCED;
+        }
+    }
+
+    if (QUEUE_PUSHED == rt && queue->queue.length >= capacity)
+    {
+        if (AS_QUEUE_BLOCK == policy)
+        {
+            gint64 end_time = g_get_monotonic_time() +
+                              g_atomic_int_get(&config->timeout_ms) * G_TIME_SPAN_MILLISECOND;
+
+            while (queue->queue.length >= capacity)
+            {
+                if (FALSE == g_cond_wait_until(&queue->cond, &queue->mutex, end_time))
+                {
+                    break;
+                }
+            }
+        }
+
+        // still full after wait
+        if (queue->queue.length >= capacity)
+        {
+            if (AS_QUEUE_DROP_NEWEST == policy || AS_QUEUE_BLOCK == policy)
+            {
+                g_free(item);
+                rt = QUEUE_DROPPED_NEWEST;
+            }
+            else
+            {
+                g_free(as_queue_pop_head(queue));
+                rt = QUEUE_DROPPED_OLDEST;
+            }
+        }
+    }
+
+    if (QUEUE_PUSHED == rt || QUEUE_DROPPED_OLDEST == rt)
+    {
+        g_queue_push_tail(&queue->queue, item);
+
+        if (AS_QUEUE_COALESCE == policy)
+        {
+            g_hash_table_replace(queue->key_index, item,
+                                 g_queue_peek_tail_link(&queue->queue));
+        }
+
+        // no wake up syscall on push without a waiting reader
+        if (0 != queue->pop_waiting)
+        {
+            g_cond_signal(&queue->not_empty);
+        }
+    }
+
+    if (NULL != depth)
+    {
+        *depth = queue->queue.length;
+    }
+
+    g_mutex_unlock(&queue->mutex);
+
+    return rt;
+}
+
+/**
+ * @brief pop without waiting, caller frees item.
+ *
+ * @param queue
+ * @return gpointer NULL if empty
+ */
+gpointer as_queue_try_pop(As_Queue_t *queue)
+{
+    g_assert(NULL != queue);
+
+    g_mutex_lock(&queue->mutex);
+
+    gpointer item = as_queue_pop_head(queue);
+
+    g_mutex_unlock(&queue->mutex);
+
+    return item;
+}
+
+/**
+ * @brief pop without waiting, item is freed on next call on this queue.
+ *
+ * @param queue
+ * @return gpointer NULL if empty
+ */
+gpointer as_queue_pop_last(As_Queue_t *queue)
+{
+    g_assert(NULL != queue);
+
+    g_mutex_lock(&queue->mutex);
+
+    // free last item after pop
+    g_free(queue->last_pop);
+
+    queue->last_pop = as_queue_pop_head(queue);
+
+    gpointer item = queue->last_pop;
+
+    g_mutex_unlock(&queue->mutex);
+
+    return item;
+}
+
+/**
+ * @brief pop, wait for a push if empty, item is freed on next call on this queue.
+ *
+ * @param queue
+ * @param worker_run running flag of the reader, cleared before as_queue_wake
+ * @return gpointer NULL if the reader is stopped
+ */
+gpointer as_queue_wait_pop_last(As_Queue_t *queue, volatile gint *worker_run)
+{
+    g_assert(NULL != queue);
+    g_assert(NULL != worker_run);
+
+    g_mutex_lock(&queue->mutex);
+
+    // free last item before wait
+    g_free(queue->last_pop);
+    queue->last_pop = NULL;
+
+    // flag is checked under queue mutex, as_queue_wake is not lost
+    queue->pop_waiting++;
+    while (0 == queue->queue.length && 1 == g_atomic_int_get(worker_run))
+    {
+        g_cond_wait(&queue->not_empty, &queue->mutex);
+    }
+    queue->pop_waiting--;
+
+    queue->last_pop = as_queue_pop_head(queue);
+
+    gpointer item = queue->last_pop;
+
+    g_mutex_unlock(&queue->mutex);
+
+    return item;
+}
+
+/**
+ * @brief wake readers in as_queue_wait_pop_last after their running flag
+ * is cleared.
+ *
+ * @param queue NULL-able
+ */
+void as_queue_wake(As_Queue_t *queue)
+{
+    if (NULL == queue)
+    {
+        return;
+    }
+
+    g_mutex_lock(&queue->mutex);
+
+    g_cond_broadcast(&queue->not_empty);
+
+    g_mutex_unlock(&queue->mutex);
+}
+
+/**
+ * @brief as_queue_length
+ *
+ * @param queue
+ * @return gint
+ */
+gint as_queue_length(As_Queue_t *queue)
+{
+    g_assert(NULL != queue);
+
+    g_mutex_lock(&queue->mutex);
+
+    gint length = queue->queue.length;
+
+    g_mutex_unlock(&queue->mutex);
+
+    return length;
+}
+
+/**
+ * @brief free all queued items, item of last as_queue_pop_last is kept
+ * for its reader.
+ *
+ * @param queue NULL-able
+ */
+void as_queue_clear(As_Queue_t *queue)
+{
+    if (NULL == queue)
+    {
+        return;
+    }
+
+    g_mutex_lock(&queue->mutex);
+
+    gpointer item;
+    while (NULL != (item = as_queue_pop_head(queue)))
+    {
+        g_free(item);
+    }
+
+    g_mutex_unlock(&queue->mutex);
+}
+
+/**
+ * @brief policy name in ini file to AS_QUEUE_DROP_OLDEST ...
+ *
+ * @param policy
+ * @return gint -1 if unknown
+ */
+gint as_queue_policy_from_string(const gchar *policy)
+{
+    for (gsize i = 0; i < G_N_ELEMENTS(as_queue_policy_names); i++)
+    {
+        if (0 == g_strcmp0(policy, as_queue_policy_names[i]))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief queue name in ini file
+ *
+ * @param kind
+ * @return const gchar*
+ */
+const gchar *as_queue_name(guint kind)
+{
+    g_assert(kind < AS_QUEUE_COUNT);
+
+    return as_queue_names[kind];
+}
+
+/**
+ * @brief set policy and capacity of a kind of queue, applies to all vehicles
+ * from next push. ini config is applied in as_api_init, call after it to
+ * override ini.
+ *
+ * @param queue AS_QUEUE_MESSAGE ...
+ * @param policy AS_QUEUE_DROP_OLDEST ...
+ * @param capacity max items in queue, 0 to keep current
+ * @param timeout_ms wait for space with AS_QUEUE_BLOCK
+ * @return int 1 on success, 0 on invalid queue or policy, e.g. AS_QUEUE_BLOCK
+ * of a receive queue
+ */
+int as_api_set_queue_policy(unsigned int queue, unsigned int policy,
+                            unsigned int capacity, unsigned int timeout_ms)
+{
+    if (queue >= AS_QUEUE_COUNT || policy >= G_N_ELEMENTS(as_queue_policy_names))
+    {
+        g_warning("invalid queue: %u or policy: %u.", queue, policy);
+        return 0;
+    }
+
+    if (AS_QUEUE_SERIAL_WRITE_BUF == queue && AS_QUEUE_COALESCE == policy)
+    {
+        g_warning("queue %s can not be coalesced.", as_queue_names[queue]);
+        return 0;
+    }
+
+    // receive queues are pushed by I/O thread, which must not wait
+    if (AS_QUEUE_SERIAL_WRITE_BUF != queue && AS_QUEUE_BLOCK == policy)
+    {
+        g_warning("queue %s can not block.", as_queue_names[queue]);
+        return 0;
+    }
+
+    As_Queue_Config_t *config = as_queue_config + queue;
+
+    g_atomic_int_set(&config->policy, policy);
+    g_atomic_int_set(&config->timeout_ms, MIN(timeout_ms, G_MAXINT / 1000));
+
+    if (0 != capacity)
+    {
+        g_atomic_int_set(&config->capacity, MIN(capacity, G_MAXINT));
+    }
+
+    g_message("queue %s: policy %s, capacity %d, timeout %d ms.",
+              as_queue_names[queue], as_queue_policy_names[policy],
+              g_atomic_int_get(&config->capacity),
+              g_atomic_int_get(&config->timeout_ms));
+
+    return 1;
+}
@@ -135,13 +135,19 @@ static gchar *sql_str_creat_vechle_table =
     `vx` INTEGER,\
     `vy` INTEGER,\
     `vz` INTEGER,\
-    `hdg` INTEGER\
+    `hdg` INTEGER,\
+    `vehicle_time` INTEGER\
     );";
 
+// columns added after first release, for tables created by older version
+static const gchar *sql_str_vechle_table_new_columns[] = {
+    "`vehicle_time` INTEGER",
+};
+
 static gchar *sql_str_insert_vechle_table =
     "INSERT INTO `vehicle_%d` "
-    "(date, time, monotonic_time, test_id, type, autopilot, base_mode, custom_mode, system_status, mavlink_version, load, voltage_battery, current_battery, drop_rate_comm, errors_comm, errors_count1, errors_count2, errors_count3, errors_count4, battery_remaining, onboard_control_sensors_present, onboard_control_sensors_enabled, onboard_control_sensors_health, current_consumed, energy_consumed, temperature_bs, current_battery_bs, battery_id, battery_function, type_bs, battery_remaining_bs, time_remaining, charge_state, Vcc_ps, Vservo_ps, flags_ps, time_unix_usec, time_boot_ms, time_boot_ms_at, roll, pitch, yaw, rollspeed, pitchspeed, yawspeed, time_boot_ms_sp, press_abs, press_diff, temperature_sp, time_boot_ms_sp2, press_abs2, press_diff2, temperature2, time_usec_sor, servo1_raw, servo2_raw, servo3_raw, servo4_raw, servo5_raw, servo6_raw, servo7_raw, servo8_raw, port, servo9_raw, servo10_raw, servo11_raw, servo12_raw, servo13_raw, servo14_raw, servo15_raw, servo16_raw, time_usec_ri, xacc, yacc, zacc, xgyro, ygyro, zgyro, xmag, ymag, zmag, time_boot_ms_rc, chan1_raw, chan2_raw, chan3_raw, chan4_raw, chan5_raw, chan6_raw, chan7_raw, chan8_raw, chan9_raw, chan10_raw, chan11_raw, chan12_raw, chan13_raw, chan14_raw, chan15_raw, chan16_raw, chan17_raw, chan18_raw, chancount, rssi, time_boot_ms_gpi, lat, lon, alt, relative_alt, vx, vy, vz, hdg)"
-    "VALUES ('%s', '%s', %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %f, %f, %f, %f, %f, %f, %d, %f, %f, %d, %d, %f, %f, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d);";
+    "(date, time, monotonic_time, test_id, type, autopilot, base_mode, custom_mode, system_status, mavlink_version, load, voltage_battery, current_battery, drop_rate_comm, errors_comm, errors_count1, errors_count2, errors_count3, errors_count4, battery_remaining, onboard_control_sensors_present, onboard_control_sensors_enabled, onboard_control_sensors_health, current_consumed, energy_consumed, temperature_bs, current_battery_bs, battery_id, battery_function, type_bs, battery_remaining_bs, time_remaining, charge_state, Vcc_ps, Vservo_ps, flags_ps, time_unix_usec, time_boot_ms, time_boot_ms_at, roll, pitch, yaw, rollspeed, pitchspeed, yawspeed, time_boot_ms_sp, press_abs, press_diff, temperature_sp, time_boot_ms_sp2, press_abs2, press_diff2, temperature2, time_usec_sor, servo1_raw, servo2_raw, servo3_raw, servo4_raw, servo5_raw, servo6_raw, servo7_raw, servo8_raw, port, servo9_raw, servo10_raw, servo11_raw, servo12_raw, servo13_raw, servo14_raw, servo15_raw, servo16_raw, time_usec_ri, xacc, yacc, zacc, xgyro, ygyro, zgyro, xmag, ymag, zmag, time_boot_ms_rc, chan1_raw, chan2_raw, chan3_raw, chan4_raw, chan5_raw, chan6_raw, chan7_raw, chan8_raw, chan9_raw, chan10_raw, chan11_raw, chan12_raw, chan13_raw, chan14_raw, chan15_raw, chan16_raw, chan17_raw, chan18_raw, chancount, rssi, time_boot_ms_gpi, lat, lon, alt, relative_alt, vx, vy, vz, hdg, vehicle_time)"
+    "VALUES ('%s', '%s', %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %f, %f, %f, %f, %f, %f, %d, %f, %f, %d, %d, %f, %f, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %d, %s);";
 
 /**
  * @brief as_sql_open_db
@@ -178,6 +184,30 @@ void as_sql_close_db()
     }
 }
 
+/**
+ * @brief add columns missing in table created by older version,
+ * column already there is skipped.
+ * 
+ * @param table 
+ * @param columns column definitions, e.g. "`name` REAL"
+ * @param count 
+ */
+static void as_sql_add_columns(const gchar *table, const gchar *const *columns, guint count)
+{
+    for (guint i = 0; i < count; i++)
+    {
+        gchar *sql = g_strdup_printf("ALTER TABLE `%s` ADD COLUMN %s;", table, columns[i]);
+
+        // fails with duplicate column name once migrated
+        if (SQLITE_OK == sqlite3_exec(sql_db, sql, NULL, 0, NULL))
+        {
+            g_message("ALTER TABLE `%s` ADD COLUMN %s.", table, columns[i]);
+        }
+
+        g_free(sql);
+    }
+}
+
 /**
  * @brief as_sql_check_vechle_table
  * 
@@ -214,6 +244,10 @@ void as_sql_check_vechle_table(guint8 sys_id)
     else
     {
         g_message("TABLE `vehicle_%d` exist, skip table creat.", sys_id);
+
+        sprintf(sql, "vehicle_%d", sys_id);
+        as_sql_add_columns(sql, sql_str_vechle_table_new_columns,
+                           G_N_ELEMENTS(sql_str_vechle_table_new_columns));
     }
     g_free(sql);
 }
@@ -234,12 +268,21 @@ void as_sql_insert_vechle_table(guint8 sys_id, Vehicle_Data_t *vehicle_data)
     gchar *date_str = g_date_time_format(data_time, "%F");
     gchar *time_str = g_date_time_format(data_time, "%T");
 
+    // vehicle clock at monotonic_time, NULL until timesync
+    gint64 monotonic_time = g_get_monotonic_time();
+    guint64 vehicle_time = 0;
+    gchar vehicle_time_str[24] = "NULL";
+    if (as_api_host_to_vehicle_time(sys_id, monotonic_time, &vehicle_time))
+    {
+        g_snprintf(vehicle_time_str, sizeof(vehicle_time_str), "%" G_GUINT64_FORMAT, vehicle_time);
+    }
+
     g_mutex_lock(&vehicle_data_mutex[sys_id]);
 
     sprintf(sql, sql_str_insert_vechle_table, sys_id,
             date_str,
             time_str,
-            g_get_monotonic_time(),
+            monotonic_time,
             g_atomic_int_get(&test_id),
             vehicle_data->type,
             vehicle_data->autopilot,
@@ -347,7 +390,8 @@ void as_sql_insert_vechle_table(guint8 sys_id, Vehicle_Data_t *vehicle_data)
             vehicle_data->vx,
             vehicle_data->vy,
             vehicle_data->vz,
-            vehicle_data->hdg);
+            vehicle_data->hdg,
+            vehicle_time_str);
 
     g_mutex_unlock(&vehicle_data_mutex[sys_id]);
 
@@ -557,13 +601,26 @@ static gchar *sql_str_creat_command_table =
     `attitude_hold_pitch`	REAL, \
     `attitude_hold_roll`	REAL, \
     `flip_trick_type`	    INTEGER, \
-    `flip_trick_value`	    REAL)";
+    `flip_trick_value`	    REAL, \
+    `control_setpoint`	    REAL, \
+    `control_error`	        REAL, \
+    `control_output`	    REAL, \
+    `vehicle_time`	        INTEGER)";
+
+// columns added after first release, for tables created by older version
+static const gchar *sql_str_command_table_new_columns[] = {
+    "`control_setpoint` REAL",
+    "`control_error` REAL",
+    "`control_output` REAL",
+    "`vehicle_time` INTEGER",
+};
 
 static gchar *sql_str_insert_command_table =
     "INSERT INTO `as_command` "
-    "(target_system, test_id, date, time, monotonic_time, depth_hold_cmd, depth_hold_depth, attitude_hold_cmd, attitude_hold_yaw, attitude_hold_pitch, attitude_hold_roll, flip_trick_type, flip_trick_value)"
+    "(target_system, test_id, date, time, monotonic_time, depth_hold_cmd, depth_hold_depth, attitude_hold_cmd, attitude_hold_yaw, attitude_hold_pitch, attitude_hold_roll, flip_trick_type, flip_trick_value, control_setpoint, control_error, control_output, vehicle_time)"
     "VALUES "
-    "('%d', '%d', '%s', '%s', %d, '%d', '%f', '%d','%f','%f','%f', '%d', '%f');";
+    "('%d', '%d', '%s', '%s', %d, '%d', '%f', '%d','%f','%f','%f', '%d', '%f', '%f', '%f', '%f', %s);";
+
 
 void as_sql_check_command_table()
 {
@@ -595,6 +652,19 @@ void as_sql_check_command_table()
     else
     {
         // g_message("TABLE `as_command` exist, skip table creat.");
+
+        // once per run, insert checks table every time, others wait for it
+        static GMutex command_table_mutex;
+        static gboolean command_table_migrated = FALSE;
+
+        g_mutex_lock(&command_table_mutex);
+        if (FALSE == command_table_migrated)
+        {
+            as_sql_add_columns("as_command", sql_str_command_table_new_columns,
+                               G_N_ELEMENTS(sql_str_command_table_new_columns));
+            command_table_migrated = TRUE;
+        }
+        g_mutex_unlock(&command_table_mutex);
     }
     g_free(sql);
 }
@@ -609,12 +679,21 @@ void as_sql_insert_command(as_command_t as_command)
     gchar *date_str = g_date_time_format(data_time, "%F");
     gchar *time_str = g_date_time_format(data_time, "%T");
 
+    // vehicle clock at monotonic_time, NULL until timesync
+    gint64 monotonic_time = g_get_monotonic_time();
+    guint64 vehicle_time = 0;
+    gchar vehicle_time_str[24] = "NULL";
+    if (as_api_host_to_vehicle_time(as_command.target_system, monotonic_time, &vehicle_time))
+    {
+        g_snprintf(vehicle_time_str, sizeof(vehicle_time_str), "%" G_GUINT64_FORMAT, vehicle_time);
+    }
+
     sprintf(sql, sql_str_insert_command_table,
             as_command.target_system,
             g_atomic_int_get(&test_id),
             date_str,
             time_str,
-            g_get_monotonic_time(),
+            monotonic_time,
             as_command.depth_hold_cmd,
             as_command.depth_hold_depth,
             as_command.attitude_hold_cmd,
@@ -622,7 +701,11 @@ void as_sql_insert_command(as_command_t as_command)
             as_command.attitude_hold_pitch,
             as_command.attitude_hold_roll,
             as_command.flip_trick_type,
-            as_command.flip_trick_value
+            as_command.flip_trick_value,
+            as_command.control_setpoint,
+            as_command.control_error,
+            as_command.control_output,
+            vehicle_time_str
             );
 
     g_date_time_unref(data_time);
@@ -639,3 +722,105 @@ void as_sql_insert_command(as_command_t as_command)
 
     g_free(sql);
 }
+
+static gchar *sql_str_creat_link_loss_table =
+    "CREATE TABLE `link_loss` \
+    (\
+    `id`	                INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT, \
+    `test_id`	            INTEGER, \
+    `date`	                TEXT, \
+    `time`	                TEXT, \
+    `monotonic_time`	    INTEGER, \
+    `link_id`	            INTEGER, \
+    `sysid`	                INTEGER, \
+    `compid`	            INTEGER, \
+    `received`	            INTEGER, \
+    `lost`	                INTEGER, \
+    `out_of_order`	        INTEGER, \
+    `crc_failed`	        INTEGER, \
+    `loss_rate`	            REAL)";
+
+static gchar *sql_str_insert_link_loss_table =
+    "INSERT INTO `link_loss` "
+    "(test_id, date, time, monotonic_time, link_id, sysid, compid, received, lost, out_of_order, crc_failed, loss_rate)"
+    "VALUES "
+    "('%d', '%s', '%s', %" G_GINT64_FORMAT ", '%u', '%d', '%d', "
+    "%" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT ", '%f');";
+
+/**
+ * @brief check link_loss table, if not exist creat one.
+ * 
+ */
+void as_sql_check_link_loss_table()
+{
+    // sql statement
+    gchar *sql;
+    sql = g_new0(gchar, 300);
+
+    sprintf(sql, "select * from `link_loss`;");
+
+    gint rc;
+    rc = sqlite3_exec(sql_db, sql, NULL, 0, NULL);
+
+    if (SQLITE_OK != rc)
+    {
+        gchar *errmsg;
+        errmsg = g_new0(gchar, 100);
+        rc = sqlite3_exec(sql_db, sql_str_creat_link_loss_table, NULL, 0, &errmsg);
+
+        if (SQLITE_OK != rc)
+        {
+            g_error(errmsg);
+        }
+        else
+        {
+            g_message("CREATE TABLE `link_loss`.");
+        }
+        g_free(errmsg);
+    }
+    g_free(sql);
+}
+
+/**
+ * @brief insert one row of link loss stats.
+ * 
+ * @param link_loss_stats 
+ */
+void as_sql_insert_link_loss(const Link_Loss_Stats_t *link_loss_stats)
+{
+    // sql statement
+    gchar *sql;
+    sql = g_new0(gchar, 3000);
+
+    GDateTime *data_time = g_date_time_new_now_local();
+    gchar *date_str = g_date_time_format(data_time, "%F");
+    gchar *time_str = g_date_time_format(data_time, "%T");
+
+    sprintf(sql, sql_str_insert_link_loss_table,
+            g_atomic_int_get(&test_id),
+            date_str,
+            time_str,
+            g_get_monotonic_time(),
+            link_loss_stats->link_id,
+            link_loss_stats->sysid,
+            link_loss_stats->compid,
+            link_loss_stats->received,
+            link_loss_stats->lost,
+            link_loss_stats->out_of_order,
+            link_loss_stats->crc_failed,
+            link_loss_stats->loss_rate);
+
+    g_date_time_unref(data_time);
+    g_free(date_str);
+    g_free(time_str);
+
+    gint rc;
+    rc = sqlite3_exec(sql_db, sql, NULL, 0, NULL);
+
+    if (SQLITE_OK != rc)
+    {
+        g_error(sqlite3_errmsg(sql_db));
+    }
+
+    g_free(sql);
+}
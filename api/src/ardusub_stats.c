@@ -0,0 +1,528 @@
+/**
+ * @file ardusub_stats.c
+ * @author ztluo (me@ztluo.dev)
+ * @brief
+ * @version
+ * @date 2019-05-20
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#define G_LOG_DOMAIN "[ardusub stats     ]"
+
+#include "../inc/ardusub_stats.h"
+
+// MAX_COMPONENT * MAX_LINK_PER_COMPONENT entries for each sysid,
+// allocated on first frame of this sysid.
+static Link_Loss_t *link_loss[MAX_VEHICLE_SLOT];
+static GMutex link_loss_mutex[MAX_VEHICLE_SLOT];
+
+/**
+ * @brief get a new link id, for a UDP source or a serial port.
+ *
+ * @return guint
+ */
+guint as_link_id_new()
+{
+    static volatile gint link_count;
+
+    return (guint)g_atomic_int_add(&link_count, 1);
+}
+
+/**
+ * @brief find entry of (link, component), call with link_loss_mutex locked.
+ *
+ * @param target_system
+ * @param index index + 1 in component list
+ * @param link_id
+ * @return Link_Loss_t* NULL if MAX_LINK_PER_COMPONENT reached
+ */
+static Link_Loss_t *as_link_loss_entry(guint8 target_system, gint index, guint link_id)
+{
+    if (NULL == link_loss[target_system])
+    {
+        link_loss[target_system] =
+            g_new0(Link_Loss_t, MAX_COMPONENT * MAX_LINK_PER_COMPONENT);
+
+        if (NULL == link_loss[target_system])
+        {
+            g_error("Out of memory!");
+        }
+    }
+
+    Link_Loss_t *entry = link_loss[target_system] + (index - 1) * MAX_LINK_PER_COMPONENT;
+
+    for (gint i = 0; i < MAX_LINK_PER_COMPONENT; i++, entry++)
+    {
+        if (FALSE == entry->used)
+        {
+            entry->used = TRUE;
+            entry->stats.link_id = link_id;
+            entry->stats.sysid = target_system;
+            entry->stats.compid = vehicle_slot[target_system].component_id[index - 1];
+            return entry;
+        }
+
+        if (link_id == entry->stats.link_id)
+        {
+            return entry;
+        }
+    }
+
+    as_log_rate_limited(G_LOG_LEVEL_WARNING, target_system, index,
+                        "MAX_LINK_PER_COMPONENT reached! sysid: %d, link: %u.",
+                        target_system, link_id);
+
+    return NULL;
+}
+
+/**
+ * @brief close loss rate window if it is over, with link_loss_mutex locked.
+ * called on frame and on read, a link without frames still closes windows.
+ *
+ * @param entry
+ * @param now
+ */
+static void as_link_loss_window(Link_Loss_t *entry, gint64 now)
+{
+    if (0 == entry->window_start)
+    {
+        entry->window_start = now;
+        return;
+    }
+
+    if (now - entry->window_start < LINK_LOSS_WINDOW)
+    {
+        return;
+    }
+
+    guint64 total = entry->window_received + entry->window_lost;
+
+    entry->stats.loss_rate = (0 == total) ? 0.0f : (gfloat)entry->window_lost / total;
+
+    entry->window_received = 0;
+    entry->window_lost = 0;
+    entry->window_start = now;
+}
+
+/**
+ * @brief count a frame passed CRC check, called by the read thread of the link.
+ *
+ * @param link_id
+ * @param message
+ * @param index index + 1 in component list of message->sysid
+ */
+void as_link_loss_frame(guint link_id, const mavlink_message_t *message, gint index)
+{
+    guint8 target_system = message->sysid;
+    gint64 now = g_get_monotonic_time();
+
+    g_mutex_lock(link_loss_mutex + target_system);
+
+    Link_Loss_t *entry = as_link_loss_entry(target_system, index, link_id);
+
+    if (NULL != entry)
+    {
+        as_link_loss_window(entry, now);
+
+        if (TRUE == entry->seq_valid)
+        {
+            // seq is 8 bits and wraps, a small gap is loss,
+            // a large one is a frame behind last_seq.
+            guint8 gap = (guint8)(message->seq - (guint8)(entry->last_seq + 1));
+
+            if (gap < LINK_LOSS_MAX_GAP)
+            {
+                entry->stats.lost += gap;
+                entry->window_lost += gap;
+                entry->last_seq = message->seq;
+                entry->out_of_range = 0;
+            }
+            else if (++entry->out_of_range < LINK_LOSS_RESYNC)
+            {
+                entry->stats.out_of_order++;
+            }
+            else
+            {
+                // a forward jump, not late frames, loss of the jump is unknown
+                entry->stats.out_of_order -= entry->out_of_range - 1;
+                entry->last_seq = message->seq;
+                entry->out_of_range = 0;
+            }
+        }
+        else
+        {
+            entry->seq_valid = TRUE;
+            entry->last_seq = message->seq;
+        }
+
+        entry->stats.received++;
+        entry->window_received++;
+        entry->stats.last_time = now;
+    }
+
+    g_mutex_unlock(link_loss_mutex + target_system);
+}
+
+/**
+ * @brief count a frame dropped by CRC check, header of a bad frame may be
+ * corrupted too, so only known components are counted.
+ *
+ * @param link_id
+ * @param target_system
+ * @param target_component
+ */
+void as_link_loss_crc_failed(guint link_id, guint8 target_system, guint8 target_component)
+{
+    Vehicle_Slot_t *my_slot = vehicle_slot + target_system;
+
+    if (FALSE == g_atomic_int_get(&my_slot->ready))
+    {
+        return;
+    }
+
+    gint index = my_slot->comp_index[target_component];
+
+    if (0 == index)
+    {
+        return;
+    }
+
+    g_mutex_lock(link_loss_mutex + target_system);
+
+    Link_Loss_t *entry = as_link_loss_entry(target_system, index, link_id);
+
+    if (NULL != entry)
+    {
+        entry->stats.crc_failed++;
+    }
+
+    g_mutex_unlock(link_loss_mutex + target_system);
+}
+
+/**
+ * @brief get frame accounting of all (link, component) of a vehicle.
+ *
+ * @param sysid
+ * @param stats array of max_count
+ * @param max_count
+ * @return int count of entries copied
+ */
+int as_api_get_link_loss(uint8_t sysid, Link_Loss_Stats_t *stats, int max_count)
+{
+    g_assert(NULL != stats);
+
+    gint count = 0;
+    gint64 now = g_get_monotonic_time();
+
+    g_mutex_lock(link_loss_mutex + sysid);
+
+    Link_Loss_t *entry = link_loss[sysid];
+
+    for (gint i = 0;
+         NULL != entry && i < MAX_COMPONENT * MAX_LINK_PER_COMPONENT && count < max_count;
+         i++, entry++)
+    {
+        if (TRUE == entry->used)
+        {
+            as_link_loss_window(entry, now);
+            stats[count++] = entry->stats;
+        }
+    }
+
+    g_mutex_unlock(link_loss_mutex + sysid);
+
+    return count;
+}
+
+static Pipeline_Counter_t pipeline_counter[MAX_VEHICLE_SLOT];
+static volatile gsize global_drop[STATS_GLOBAL_DROP_COUNT];
+
+#ifndef NO_SERISL
+static volatile gint serial_queue_high[MAVLINK_COMM_NUM_BUFFERS];
+static volatile gsize serial_drop[MAVLINK_COMM_NUM_BUFFERS];
+#endif
+
+// allocated on first as_api_get_link_stats of this sysid
+static Pipeline_Rate_t *pipeline_rate[MAX_VEHICLE_SLOT];
+static GMutex pipeline_rate_mutex;
+
+/**
+ * @brief raise high-water mark, one atomic read if not raised.
+ *
+ * @param high
+ * @param value
+ */
+static void as_stats_high(volatile gint *high, gint value)
+{
+    gint old = g_atomic_int_get(high);
+
+    while (value > old && FALSE == g_atomic_int_compare_and_exchange(high, old, value))
+    {
+        old = g_atomic_int_get(high);
+    }
+}
+
+/**
+ * @brief count a frame passed CRC check, called by read threads.
+ *
+ * @param message
+ */
+void as_stats_frame(const mavlink_message_t *message)
+{
+    Pipeline_Counter_t *my_counter = pipeline_counter + message->sysid;
+
+    gsize frame_len = message->len;
+
+    if (MAVLINK_STX_MAVLINK1 == message->magic)
+    {
+        // STX, v1 header and CRC
+        frame_len += 1 + MAVLINK_CORE_HEADER_MAVLINK1_LEN + 2;
+    }
+    else
+    {
+        frame_len += MAVLINK_NUM_NON_PAYLOAD_BYTES;
+
+        if (message->incompat_flags & MAVLINK_IFLAG_SIGNED)
+        {
+            frame_len += MAVLINK_SIGNATURE_BLOCK_LEN;
+        }
+    }
+
+    g_atomic_pointer_add(my_counter->msg_received +
+                             MIN(message->msgid, LINK_STATS_MSGID_COUNT),
+                         1);
+    g_atomic_pointer_add(&my_counter->bytes_in, frame_len);
+}
+
+/**
+ * @brief count a frame failed CRC or signature check, sysid from its header.
+ *
+ * @param target_system
+ */
+void as_stats_parse_error(guint8 target_system)
+{
+    g_atomic_pointer_add(&pipeline_counter[target_system].parse_errors, 1);
+}
+
+/**
+ * @brief count bytes sent to a vehicle.
+ *
+ * @param target_system
+ * @param len
+ */
+void as_stats_bytes_out(guint8 target_system, gsize len)
+{
+    g_atomic_pointer_add(&pipeline_counter[target_system].bytes_out, len);
+}
+
+/**
+ * @brief record queue depth after push.
+ *
+ * @param target_system
+ * @param queue
+ * @param depth
+ */
+void as_stats_queue_depth(guint8 target_system, stats_queue_t queue, gint depth)
+{
+    as_stats_high(pipeline_counter[target_system].queue_high + queue, depth);
+}
+
+/**
+ * @brief count a drop on MAX_* overflow path of a vehicle.
+ *
+ * @param target_system
+ * @param drop
+ */
+void as_stats_drop(guint8 target_system, stats_drop_t drop)
+{
+    g_atomic_pointer_add(pipeline_counter[target_system].drop + drop, 1);
+}
+
+/**
+ * @brief count a drop on MAX_* overflow path, when vehicle is unknown.
+ *
+ * @param drop
+ */
+void as_stats_drop_global(stats_global_drop_t drop)
+{
+    g_atomic_pointer_add(global_drop + drop, 1);
+}
+
+#ifndef NO_SERISL
+/**
+ * @brief record serial_write_buf_queue depth after push.
+ *
+ * @param chan
+ * @param depth
+ */
+void as_stats_serial_queue_depth(guint8 chan, gint depth)
+{
+    as_stats_high(serial_queue_high + chan, depth);
+}
+
+/**
+ * @brief count a drop at MAX_SERIAL_PORT_WRITE_BUF_COUNT.
+ *
+ * @param chan
+ */
+void as_stats_serial_drop(guint8 chan)
+{
+    g_atomic_pointer_add(serial_drop + chan, 1);
+}
+#endif
+
+/**
+ * @brief current length of a queue, 0 if not created.
+ *
+ * @param queue
+ * @return guint32
+ */
+static guint32 as_stats_queue_length(As_Queue_t *queue)
+{
+    if (NULL == queue)
+    {
+        return 0;
+    }
+
+    return as_queue_length(queue);
+}
+
+/**
+ * @brief get live counters, rates, queue depths and drops of a vehicle.
+ * rates are measured between calls at least LINK_STATS_RATE_WINDOW apart,
+ * previous rates are returned in between.
+ *
+ * @param sysid
+ * @param stats
+ * @return int 1 if vehicle exists, 0 if not
+ */
+int as_api_get_link_stats(uint8_t sysid, Link_Stats_t *stats)
+{
+    g_assert(NULL != stats);
+
+    if (0 == as_api_check_vehicle(sysid))
+    {
+        g_warning("no vehicle id:%d, in file: %s, func: %s, line: %d",
+                  sysid, __FILE__, __FUNCTION__, __LINE__);
+        return 0;
+    }
+
+    Pipeline_Counter_t *my_counter = pipeline_counter + sysid;
+    gint64 now = g_get_monotonic_time();
+
+    memset(stats, 0, sizeof(Link_Stats_t));
+    stats->monotonic_time = now;
+
+    for (gint i = 0; i < LINK_STATS_MSGID_COUNT; i++)
+    {
+        stats->msg_received[i] = (gsize)g_atomic_pointer_get(my_counter->msg_received + i);
+    }
+    stats->msg_received_other =
+        (gsize)g_atomic_pointer_get(my_counter->msg_received + LINK_STATS_MSGID_COUNT);
+
+    stats->bytes_in = (gsize)g_atomic_pointer_get(&my_counter->bytes_in);
+    stats->bytes_out = (gsize)g_atomic_pointer_get(&my_counter->bytes_out);
+    stats->parse_errors = (gsize)g_atomic_pointer_get(&my_counter->parse_errors);
+
+    // rates
+    g_mutex_lock(&pipeline_rate_mutex);
+
+    Pipeline_Rate_t *my_rate = pipeline_rate[sysid];
+
+    if (NULL == my_rate)
+    {
+        my_rate = g_new0(Pipeline_Rate_t, 1);
+
+        if (NULL == my_rate)
+        {
+            g_error("Out of memory!");
+        }
+
+        pipeline_rate[sysid] = my_rate;
+    }
+
+    if (0 != my_rate->sample_time &&
+        now - my_rate->sample_time >= LINK_STATS_RATE_WINDOW)
+    {
+        gfloat interval = (now - my_rate->sample_time) / 1000000.0f;
+
+        for (gint i = 0; i < LINK_STATS_MSGID_COUNT; i++)
+        {
+            my_rate->msg_rate[i] =
+                (stats->msg_received[i] - my_rate->msg_received[i]) / interval;
+        }
+        my_rate->bytes_in_rate = (stats->bytes_in - my_rate->bytes_in) / interval;
+        my_rate->bytes_out_rate = (stats->bytes_out - my_rate->bytes_out) / interval;
+        my_rate->interval = interval;
+    }
+
+    if (0 == my_rate->sample_time ||
+        now - my_rate->sample_time >= LINK_STATS_RATE_WINDOW)
+    {
+        for (gint i = 0; i < LINK_STATS_MSGID_COUNT; i++)
+        {
+            my_rate->msg_received[i] = stats->msg_received[i];
+        }
+        my_rate->bytes_in = stats->bytes_in;
+        my_rate->bytes_out = stats->bytes_out;
+        my_rate->sample_time = now;
+    }
+
+    memcpy(stats->msg_rate, my_rate->msg_rate, sizeof(stats->msg_rate));
+    stats->bytes_in_rate = my_rate->bytes_in_rate;
+    stats->bytes_out_rate = my_rate->bytes_out_rate;
+    stats->rate_interval = my_rate->interval;
+
+    g_mutex_unlock(&pipeline_rate_mutex);
+
+    // queues
+    stats->message_queue_depth =
+        as_stats_queue_length(g_atomic_pointer_get(message_queue + sysid));
+    stats->statustex_queue_depth =
+        as_stats_queue_length(g_atomic_pointer_get(statustex_queue + sysid));
+    stats->named_val_float_queue_depth =
+        as_stats_queue_length(g_atomic_pointer_get(named_val_float_queue + sysid));
+
+    stats->message_queue_high =
+        g_atomic_int_get(my_counter->queue_high + STATS_QUEUE_MESSAGE);
+    stats->statustex_queue_high =
+        g_atomic_int_get(my_counter->queue_high + STATS_QUEUE_STATUSTEX);
+    stats->named_val_float_queue_high =
+        g_atomic_int_get(my_counter->queue_high + STATS_QUEUE_NAMED_VAL_FLOAT);
+
+#ifndef NO_SERISL
+    if (NULL == subnet_address)
+    {
+        // for serial port "target" is target serial chan
+        guint8 chan = *(guint8 *)vehicle_slot[sysid].target;
+
+        stats->serial_write_buf_queue_depth =
+            as_stats_queue_length(g_atomic_pointer_get(serial_write_buf_queue + chan));
+        stats->serial_write_buf_queue_high = g_atomic_int_get(serial_queue_high + chan);
+        stats->drop_serial_write_buf = (gsize)g_atomic_pointer_get(serial_drop + chan);
+    }
+#endif
+
+    // drops
+    stats->drop_not_ready =
+        (gsize)g_atomic_pointer_get(my_counter->drop + STATS_DROP_NOT_READY);
+    stats->drop_component =
+        (gsize)g_atomic_pointer_get(my_counter->drop + STATS_DROP_COMPONENT);
+    stats->drop_message_queue =
+        (gsize)g_atomic_pointer_get(my_counter->drop + STATS_DROP_MESSAGE);
+    stats->drop_statustex_queue =
+        (gsize)g_atomic_pointer_get(my_counter->drop + STATS_DROP_STATUSTEX);
+    stats->drop_named_val_float_queue =
+        (gsize)g_atomic_pointer_get(my_counter->drop + STATS_DROP_NAMED_VAL_FLOAT);
+    stats->drop_subscribe_task =
+        (gsize)g_atomic_pointer_get(my_counter->drop + STATS_DROP_SUBSCRIBE_TASK);
+
+    stats->drop_udp_source =
+        (gsize)g_atomic_pointer_get(global_drop + STATS_DROP_UDP_SOURCE);
+    stats->drop_udp_parse_queue =
+        (gsize)g_atomic_pointer_get(global_drop + STATS_DROP_UDP_PARSE_QUEUE);
+
+    return 1;
+}
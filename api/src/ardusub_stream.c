@@ -0,0 +1,382 @@
+/**
+ * @file ardusub_stream.c
+ * @author ztluo (me@ztluo.dev)
+ * @brief telemetry rates of vehicle, set per message by SET_MESSAGE_INTERVAL.
+ * @version
+ * @date 2019-05-30
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#define G_LOG_DOMAIN "[ardusub stream    ]"
+
+#include "../inc/ardusub_stream.h"
+#include "../inc/ardusub_command.h"
+#include "../inc/ardusub_interface.h"
+
+// telemetry stored by this library, "other messages" of a profile
+static const guint32 stream_msgid[] = {
+    MAVLINK_MSG_ID_SYS_STATUS,
+    MAVLINK_MSG_ID_SYSTEM_TIME,
+    MAVLINK_MSG_ID_RAW_IMU,
+    MAVLINK_MSG_ID_SCALED_PRESSURE,
+    MAVLINK_MSG_ID_ATTITUDE,
+    MAVLINK_MSG_ID_GLOBAL_POSITION_INT,
+    MAVLINK_MSG_ID_SERVO_OUTPUT_RAW,
+    MAVLINK_MSG_ID_RC_CHANNELS,
+    MAVLINK_MSG_ID_VFR_HUD,
+    MAVLINK_MSG_ID_POWER_STATUS,
+    MAVLINK_MSG_ID_SCALED_PRESSURE2,
+    MAVLINK_MSG_ID_BATTERY_STATUS,
+};
+
+// built-in ones first, rates of default are same as legacy stream groups
+static Stream_Profile_t stream_profile[MAX_STREAM_PROFILE] = {
+    {
+        .name = "legacy",
+        .legacy = TRUE,
+        .other_rate_hz = -1,
+    },
+    {
+        .name = "default",
+        .count = 12,
+        .rate = {
+            {MAVLINK_MSG_ID_RAW_IMU, 10},
+            {MAVLINK_MSG_ID_SCALED_PRESSURE, 10},
+            {MAVLINK_MSG_ID_SCALED_PRESSURE2, 10},
+            {MAVLINK_MSG_ID_ATTITUDE, 10},
+            {MAVLINK_MSG_ID_GLOBAL_POSITION_INT, 10},
+            {MAVLINK_MSG_ID_VFR_HUD, 10},
+            {MAVLINK_MSG_ID_SYS_STATUS, 4},
+            {MAVLINK_MSG_ID_POWER_STATUS, 4},
+            {MAVLINK_MSG_ID_RC_CHANNELS, 4},
+            {MAVLINK_MSG_ID_SERVO_OUTPUT_RAW, 4},
+            {MAVLINK_MSG_ID_SYSTEM_TIME, 3},
+            {MAVLINK_MSG_ID_BATTERY_STATUS, 3},
+        },
+        .other_rate_hz = -1,
+    },
+    {
+        .name = "control",
+        .count = 2,
+        .rate = {
+            {MAVLINK_MSG_ID_ATTITUDE, 50},
+            {MAVLINK_MSG_ID_SCALED_PRESSURE2, 50},
+        },
+        .other_rate_hz = 1,
+    },
+};
+static guint stream_profile_count = STREAM_PROFILE_BUILTIN;
+static guint stream_profile_current = 1; // default
+static GMutex stream_mutex;
+
+// TRUE while SET_MESSAGE_INTERVAL of vehicle in flight
+static volatile gint stream_applying[MAX_VEHICLE_SLOT];
+
+static void as_stream_ack_callback(uint8_t target_system,
+                                   uint8_t target_component,
+                                   uint16_t command,
+                                   int result,
+                                   void *user_data);
+
+/**
+ * @brief find profile by name, call with stream_mutex locked.
+ *
+ * @param name
+ * @return gint index, -1 for not found
+ */
+static gint as_stream_profile_find(const gchar *name)
+{
+    for (guint i = 0; i < stream_profile_count; i++)
+    {
+        if (0 == g_strcmp0(stream_profile[i].name, name))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @brief send REQUEST_DATA_STREAM of all stream groups at once.
+ *
+ * @param apply
+ */
+static void as_stream_legacy(const Stream_Apply_t *apply)
+{
+    as_reauest_data_stream(apply->target_system, apply->target_component);
+
+    g_message("request data stream of vehicle id:%d.", apply->target_system);
+}
+
+/**
+ * @brief release vehicle for next apply and free it.
+ *
+ * @param apply
+ */
+static void as_stream_finish(Stream_Apply_t *apply)
+{
+    g_message("stream profile %s of vehicle id:%d, %d of %d accepted in %.1f ms.",
+              apply->name, apply->target_system, apply->accepted, apply->count,
+              (g_get_monotonic_time() - apply->start_time) / 1000.0);
+
+    g_atomic_int_set(stream_applying + apply->target_system, FALSE);
+    g_free(apply);
+}
+
+/**
+ * @brief send SET_MESSAGE_INTERVAL of next message, apply is owned by
+ * ack callback once command is in flight.
+ *
+ * @param apply
+ * @return gboolean FALSE for nothing sent, apply is still owned by caller
+ */
+static gboolean as_stream_send_next(Stream_Apply_t *apply)
+{
+    if (apply->next >= apply->count)
+    {
+        return FALSE;
+    }
+
+    const Stream_Rate_t *my_rate = apply->rate + apply->next;
+
+    // rate 0 stops the message, interval -1
+    float param[7] = {0};
+    param[0] = my_rate->msgid;
+    param[1] = (0 < my_rate->rate_hz) ? 1000000.0f / my_rate->rate_hz : -1;
+
+    // callback may run before return, never touch apply after sent
+    apply->next++;
+
+    return 0 != as_api_command_long_async(apply->target_system, apply->target_component,
+                                          MAV_CMD_SET_MESSAGE_INTERVAL, param,
+                                          STREAM_COMMAND_TIMEOUT, STREAM_COMMAND_RETRIES,
+                                          &as_stream_ack_callback, apply);
+}
+
+/**
+ * @brief ack of SET_MESSAGE_INTERVAL, send next one at once. vehicle
+ * without SET_MESSAGE_INTERVAL gets legacy stream groups.
+ *
+ * @param target_system
+ * @param target_component
+ * @param command
+ * @param result
+ * @param user_data Stream_Apply_t
+ */
+static void as_stream_ack_callback(uint8_t target_system,
+                                   uint8_t target_component G_GNUC_UNUSED,
+                                   uint16_t command G_GNUC_UNUSED,
+                                   int result,
+                                   void *user_data)
+{
+    Stream_Apply_t *apply = (Stream_Apply_t *)user_data;
+
+    if (MAV_RESULT_ACCEPTED == result)
+    {
+        apply->accepted++;
+    }
+    else if (AS_COMMAND_CANCELLED == result)
+    {
+        as_stream_finish(apply);
+        return;
+    }
+    else if (0 == apply->accepted &&
+             (MAV_RESULT_UNSUPPORTED == result || AS_COMMAND_TIMEOUT == result))
+    {
+        // first one, old firmware ignores or rejects SET_MESSAGE_INTERVAL
+        as_stream_legacy(apply);
+        as_stream_finish(apply);
+        return;
+    }
+    else
+    {
+        as_log_rate_limited(G_LOG_LEVEL_WARNING, target_system, 0,
+                            "SET_MESSAGE_INTERVAL %d of vehicle id:%d, result: %d.",
+                            apply->rate[apply->next - 1].msgid, target_system, result);
+    }
+
+    if (FALSE == as_stream_send_next(apply))
+    {
+        as_stream_finish(apply);
+    }
+}
+
+/**
+ * @brief add or replace a stream profile, built-in ones can not be replaced.
+ *
+ * @param name
+ * @param rate explicit rate of messages
+ * @param count count of rate, up to MAX_STREAM_RATE
+ * @param other_rate_hz rate of other telemetry messages, < 0 to keep them
+ * @return int 0 for failed
+ */
+int as_api_add_stream_profile(const char *name, const Stream_Rate_t *rate,
+                              int count, float other_rate_hz)
+{
+    if (NULL == name || MAX_STREAM_PROFILE_NAME <= strlen(name) ||
+        0 > count || MAX_STREAM_RATE < count || (0 < count && NULL == rate))
+    {
+        return 0;
+    }
+
+    g_mutex_lock(&stream_mutex);
+
+    gint index = as_stream_profile_find(name);
+
+    if (0 <= index && STREAM_PROFILE_BUILTIN > index)
+    {
+        g_mutex_unlock(&stream_mutex);
+        g_warning("stream profile %s is built-in.", name);
+        return 0;
+    }
+
+    if (0 > index)
+    {
+        if (MAX_STREAM_PROFILE <= stream_profile_count)
+        {
+            g_mutex_unlock(&stream_mutex);
+            g_warning("MAX_STREAM_PROFILE reached!");
+            return 0;
+        }
+
+        index = stream_profile_count++;
+    }
+
+    Stream_Profile_t *my_profile = stream_profile + index;
+
+    g_strlcpy(my_profile->name, name, MAX_STREAM_PROFILE_NAME);
+    my_profile->legacy = FALSE;
+    my_profile->count = count;
+    if (0 < count)
+    {
+        memcpy(my_profile->rate, rate, count * sizeof(Stream_Rate_t));
+    }
+    my_profile->other_rate_hz = other_rate_hz;
+
+    g_mutex_unlock(&stream_mutex);
+
+    return 1;
+}
+
+/**
+ * @brief select stream profile of vehicles found later, call before
+ * as_api_run to cover all vehicles.
+ *
+ * @param name legacy, default, control or one added
+ * @return int 0 for not found
+ */
+int as_api_set_stream_profile(const char *name)
+{
+    g_mutex_lock(&stream_mutex);
+
+    gint index = as_stream_profile_find(name);
+    if (0 <= index)
+    {
+        stream_profile_current = index;
+    }
+
+    g_mutex_unlock(&stream_mutex);
+
+    if (0 > index)
+    {
+        g_warning("no stream profile %s.", name);
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @brief apply selected stream profile to vehicle, one SET_MESSAGE_INTERVAL
+ * in flight at a time, next one is sent from ack of last one. COMMAND_ACK
+ * has no param1, acks of two in flight to a component can not be told
+ * apart, so a profile takes one round trip per message.
+ *
+ * @param target_system
+ * @return int 0 for vehicle not found or last apply in progress
+ */
+int as_api_apply_stream_profile(uint8_t target_system)
+{
+    if (0 == as_api_check_vehicle(target_system))
+    {
+        return 0;
+    }
+
+    return as_stream_start(target_system, vehicle_slot[target_system].primary_compid);
+}
+
+/**
+ * @brief apply selected stream profile to vehicle.
+ *
+ * @param target_system
+ * @param target_component
+ * @return gboolean FALSE for last apply in progress
+ */
+gboolean as_stream_start(guint8 target_system, guint8 target_component)
+{
+    if (FALSE == g_atomic_int_compare_and_exchange(stream_applying + target_system,
+                                                   FALSE, TRUE))
+    {
+        g_warning("stream profile of vehicle id:%d in progress.", target_system);
+        return FALSE;
+    }
+
+    Stream_Apply_t *apply = g_new0(Stream_Apply_t, 1);
+    if (NULL == apply)
+    {
+        g_error("Out of memory!");
+    }
+
+    apply->target_system = target_system;
+    apply->target_component = target_component;
+    apply->start_time = g_get_monotonic_time();
+
+    g_mutex_lock(&stream_mutex);
+
+    const Stream_Profile_t *my_profile = stream_profile + stream_profile_current;
+    gboolean legacy = my_profile->legacy;
+
+    g_strlcpy(apply->name, my_profile->name, MAX_STREAM_PROFILE_NAME);
+    memcpy(apply->rate, my_profile->rate, my_profile->count * sizeof(Stream_Rate_t));
+    apply->count = my_profile->count;
+
+    // other telemetry messages not given explicitly
+    for (guint i = 0; 0 <= my_profile->other_rate_hz && i < G_N_ELEMENTS(stream_msgid); i++)
+    {
+        guint j = 0;
+        while (j < my_profile->count && my_profile->rate[j].msgid != stream_msgid[i])
+        {
+            j++;
+        }
+
+        if (j == my_profile->count)
+        {
+            apply->rate[apply->count].msgid = stream_msgid[i];
+            apply->rate[apply->count].rate_hz = my_profile->other_rate_hz;
+            apply->count++;
+        }
+    }
+
+    g_mutex_unlock(&stream_mutex);
+
+    if (legacy)
+    {
+        as_stream_legacy(apply);
+        as_stream_finish(apply);
+    }
+    else if (0 == apply->count)
+    {
+        as_stream_finish(apply);
+    }
+    else if (FALSE == as_stream_send_next(apply))
+    {
+        // command manager full or vehicle gone
+        as_stream_legacy(apply);
+        as_stream_finish(apply);
+    }
+
+    return TRUE;
+}
@@ -0,0 +1,447 @@
+/**
+ * @file ardusub_subscribe.c
+ * @author ztluo (me@ztluo.dev)
+ * @brief push-style subscription on top of msg dispatch handlers,
+ * one handler of each msgid fans out to its subscriptions.
+ * @version
+ * @date 2019-05-08
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#define G_LOG_DOMAIN "[ardusub subscribe ]"
+
+#include "../inc/ardusub_subscribe.h"
+#include "../inc/ardusub_stats.h"
+
+// slots are never freed, an in-flight handler always points to valid memory
+static Subscription_t subscription[MAX_SUBSCRIPTION];
+static GMutex subscription_mutex;
+// subscriptions of each msgid, changed with both locks held
+static Subscription_t *msgid_subscription[MSG_DISPATCH_TABLE_SIZE];
+static GRWLock msgid_subscription_lock;
+// broadcast when running of a subscription drops to 0
+static GMutex subscription_idle_mutex;
+static GCond subscription_idle_cond;
+static GThreadPool *subscribe_worker[SUBSCRIBE_WORKER_COUNT];
+
+static void as_subscribe_dispatch(guint8 target_system,
+                                  guint8 target_component,
+                                  guint32 msgid,
+                                  gconstpointer decoded,
+                                  gpointer user_data);
+static void as_subscribe_call(Subscription_t *my_subscription, gint id,
+                              guint8 target_system, guint32 msgid,
+                              gconstpointer decoded);
+static void as_subscribe_worker_func(gpointer data, gpointer user_data);
+
+/**
+ * @brief subscribe a msgid of primary component (autopilot),
+ * callback is called as soon as msg is decoded.
+ * 
+ * @param sysid 0 for all vehicles
+ * @param msgid 
+ * @param callback 
+ * @param user_data 
+ * @param options F_SUBSCRIBE_INLINE or F_SUBSCRIBE_WORKER
+ * @return int subscription id, 0 for failed
+ */
+int as_api_subscribe(uint8_t sysid, uint32_t msgid,
+                     as_api_subscribe_callback_t callback,
+                     void *user_data, unsigned int options)
+{
+    return as_api_subscribe_component(sysid, 0, msgid,
+                                      callback, user_data, options);
+}
+
+/**
+ * @brief subscribe a msgid of one component.
+ * 
+ * @param sysid 0 for all vehicles
+ * @param compid 0 for primary component
+ * @param msgid 
+ * @param callback 
+ * @param user_data 
+ * @param options F_SUBSCRIBE_INLINE or F_SUBSCRIBE_WORKER
+ * @return int subscription id, 0 for failed
+ */
+int as_api_subscribe_component(uint8_t sysid, uint8_t compid, uint32_t msgid,
+                               as_api_subscribe_callback_t callback,
+                               void *user_data, unsigned int options)
+{
+    if (NULL == callback)
+    {
+        g_warning("can not subscribe msgid %d without callback.", msgid);
+        return 0;
+    }
+
+    if (0 == as_msg_dispatch_storage_size(msgid))
+    {
+        g_warning("can not subscribe, msgid %d is not decoded.", msgid);
+        return 0;
+    }
+
+    g_mutex_lock(&subscription_mutex);
+
+    gint index;
+    // a slot is reused after its last dispatch in flight is done
+    for (index = 0; index < MAX_SUBSCRIPTION; index++)
+    {
+        if (FALSE == g_atomic_int_get(&subscription[index].active) &&
+            0 == g_atomic_int_get(&subscription[index].running))
+        {
+            break;
+        }
+    }
+
+    if (MAX_SUBSCRIPTION == index)
+    {
+        g_mutex_unlock(&subscription_mutex);
+        g_warning("MAX_SUBSCRIPTION reached!");
+        return 0;
+    }
+
+    if (options & F_SUBSCRIBE_WORKER)
+    {
+        gint worker = index % SUBSCRIBE_WORKER_COUNT;
+
+        if (NULL == subscribe_worker[worker])
+        {
+            GError *error = NULL;
+
+            // exclusive single thread, keep msg order of one subscription
+            subscribe_worker[worker] =
+                g_thread_pool_new(&as_subscribe_worker_func, NULL,
+                                  1, TRUE, &error);
+
+            if (NULL == subscribe_worker[worker])
+            {
+                g_mutex_unlock(&subscription_mutex);
+                g_warning("can not start subscribe worker: %s", error->message);
+                g_error_free(error);
+                return 0;
+            }
+        }
+    }
+
+    Subscription_t *my_subscription = subscription + index;
+
+    // id = generation * MAX_SUBSCRIPTION + index, stale id never matches a reused slot
+    gint generation = g_atomic_int_get(&my_subscription->id) / MAX_SUBSCRIPTION + 1;
+    if (generation >= G_MAXINT / MAX_SUBSCRIPTION)
+    {
+        generation = 1;
+    }
+
+    // first subscription of msgid adds the only dispatch handler of subscriptions
+    if ((NULL == msgid_subscription[msgid]) &&
+        (FALSE == as_msg_dispatch_add_handler(msgid,
+                                              &as_subscribe_dispatch,
+                                              NULL)))
+    {
+        g_mutex_unlock(&subscription_mutex);
+        return 0;
+    }
+
+    my_subscription->sysid = sysid;
+    my_subscription->compid = compid;
+    my_subscription->msgid = msgid;
+    my_subscription->callback = callback;
+    my_subscription->user_data = user_data;
+    my_subscription->options = options;
+    g_atomic_int_set(&my_subscription->id, generation * MAX_SUBSCRIPTION + index);
+    g_atomic_int_set(&my_subscription->active, TRUE);
+
+    g_rw_lock_writer_lock(&msgid_subscription_lock);
+    my_subscription->next = msgid_subscription[msgid];
+    msgid_subscription[msgid] = my_subscription;
+    g_rw_lock_writer_unlock(&msgid_subscription_lock);
+
+    g_mutex_unlock(&subscription_mutex);
+
+    return g_atomic_int_get(&my_subscription->id);
+}
+
+/**
+ * @brief take subscription out of its msgid, last one removes
+ * dispatch handler of msgid. subscription_mutex should be locked.
+ * 
+ * @param my_subscription 
+ */
+static void as_subscribe_remove(Subscription_t *my_subscription)
+{
+    guint32 msgid = my_subscription->msgid;
+
+    g_atomic_int_set(&my_subscription->active, FALSE);
+
+    g_rw_lock_writer_lock(&msgid_subscription_lock);
+
+    Subscription_t **link = msgid_subscription + msgid;
+    while (*link != my_subscription)
+    {
+        link = &(*link)->next;
+    }
+    *link = my_subscription->next;
+    my_subscription->next = NULL;
+
+    g_rw_lock_writer_unlock(&msgid_subscription_lock);
+
+    if (NULL == msgid_subscription[msgid])
+    {
+        as_msg_dispatch_remove_handler(msgid, &as_subscribe_dispatch, NULL);
+    }
+}
+
+/**
+ * @brief a dispatch or worker task of subscription is done.
+ * 
+ * @param my_subscription 
+ */
+static void as_subscribe_unref(Subscription_t *my_subscription)
+{
+    if (TRUE == g_atomic_int_dec_and_test(&my_subscription->running))
+    {
+        g_mutex_lock(&subscription_idle_mutex);
+        g_cond_broadcast(&subscription_idle_cond);
+        g_mutex_unlock(&subscription_idle_mutex);
+    }
+}
+
+/**
+ * @brief wait for dispatches and worker tasks of a removed subscription.
+ * 
+ * @param my_subscription 
+ */
+static void as_subscribe_wait_idle(Subscription_t *my_subscription)
+{
+    g_mutex_lock(&subscription_idle_mutex);
+
+    while (0 != g_atomic_int_get(&my_subscription->running))
+    {
+        g_cond_wait(&subscription_idle_cond, &subscription_idle_mutex);
+    }
+
+    g_mutex_unlock(&subscription_idle_mutex);
+}
+
+/**
+ * @brief unsubscribe, waits for callbacks running at that moment,
+ * user_data can be freed after return. never call it in the callback
+ * of this subscription, it waits for itself.
+ * 
+ * @param subscription_id 
+ * @return int 1 for success, 0 for not found
+ */
+int as_api_unsubscribe(int subscription_id)
+{
+    if (subscription_id <= 0)
+    {
+        return 0;
+    }
+
+    Subscription_t *my_subscription = subscription + subscription_id % MAX_SUBSCRIPTION;
+
+    g_mutex_lock(&subscription_mutex);
+
+    if ((FALSE == g_atomic_int_get(&my_subscription->active)) ||
+        (subscription_id != g_atomic_int_get(&my_subscription->id)))
+    {
+        g_mutex_unlock(&subscription_mutex);
+        return 0;
+    }
+
+    as_subscribe_remove(my_subscription);
+
+    g_mutex_unlock(&subscription_mutex);
+
+    // slot is not reused until then
+    as_subscribe_wait_idle(my_subscription);
+
+    return 1;
+}
+
+/**
+ * @brief remove all subscriptions and stop worker executors,
+ * call after I/O is stopped.
+ * 
+ */
+void as_subscribe_deinit()
+{
+    g_mutex_lock(&subscription_mutex);
+
+    for (gint i = 0; i < MAX_SUBSCRIPTION; i++)
+    {
+        if (TRUE == g_atomic_int_get(&subscription[i].active))
+        {
+            as_subscribe_remove(subscription + i);
+        }
+    }
+
+    g_mutex_unlock(&subscription_mutex);
+
+    for (gint i = 0; i < SUBSCRIBE_WORKER_COUNT; i++)
+    {
+        if (NULL != subscribe_worker[i])
+        {
+            // pending tasks are dropped by worker, subscription is inactive
+            g_thread_pool_free(subscribe_worker[i], FALSE, TRUE);
+            subscribe_worker[i] = NULL;
+        }
+    }
+
+    for (gint i = 0; i < MAX_SUBSCRIPTION; i++)
+    {
+        as_subscribe_wait_idle(subscription + i);
+    }
+}
+
+/**
+ * @brief msg dispatch handler of all subscriptions of msgid,
+ * call each subscription of this vehicle and component.
+ * 
+ * @param target_system 
+ * @param target_component 
+ * @param msgid 
+ * @param decoded 
+ * @param user_data 
+ */
+static void as_subscribe_dispatch(guint8 target_system,
+                                  guint8 target_component,
+                                  guint32 msgid,
+                                  gconstpointer decoded,
+                                  gpointer user_data)
+{
+    g_assert(NULL == user_data);
+
+    Subscription_t *matched[MAX_SUBSCRIPTION];
+    gint matched_id[MAX_SUBSCRIPTION];
+    gint matched_count = 0;
+    guint8 primary_compid = vehicle_slot[target_system].primary_compid;
+
+    // match under read lock, a callback can unsubscribe itself
+    g_rw_lock_reader_lock(&msgid_subscription_lock);
+
+    for (Subscription_t *my_subscription = msgid_subscription[msgid];
+         NULL != my_subscription;
+         my_subscription = my_subscription->next)
+    {
+        if ((0 != my_subscription->sysid) &&
+            (target_system != my_subscription->sysid))
+        {
+            continue;
+        }
+
+        guint8 my_compid = my_subscription->compid;
+
+        if (0 == my_compid)
+        {
+            my_compid = primary_compid;
+        }
+
+        if (target_component != my_compid)
+        {
+            continue;
+        }
+
+        // unsubscribe waits for it, unlink takes writer lock
+        g_atomic_int_inc(&my_subscription->running);
+
+        matched[matched_count] = my_subscription;
+        matched_id[matched_count] = g_atomic_int_get(&my_subscription->id);
+        matched_count++;
+    }
+
+    g_rw_lock_reader_unlock(&msgid_subscription_lock);
+
+    for (gint i = 0; i < matched_count; i++)
+    {
+        as_subscribe_call(matched[i], matched_id[i],
+                          target_system, msgid, decoded);
+        as_subscribe_unref(matched[i]);
+    }
+}
+
+/**
+ * @brief call subscription inline or push it to worker executor,
+ * task copies msg at once.
+ * 
+ * @param my_subscription 
+ * @param id subscription id when matched
+ * @param target_system 
+ * @param msgid 
+ * @param decoded copy of msg on stack of I/O thread
+ */
+static void as_subscribe_call(Subscription_t *my_subscription, gint id,
+                              guint8 target_system, guint32 msgid,
+                              gconstpointer decoded)
+{
+    // unsubscribed by a callback called before
+    if ((FALSE == g_atomic_int_get(&my_subscription->active)) ||
+        (id != g_atomic_int_get(&my_subscription->id)))
+    {
+        return;
+    }
+
+    if (0 == (my_subscription->options & F_SUBSCRIBE_WORKER))
+    {
+        my_subscription->callback(target_system, msgid, decoded,
+                                  my_subscription->user_data);
+        return;
+    }
+
+    GThreadPool *my_worker =
+        subscribe_worker[(my_subscription - subscription) % SUBSCRIBE_WORKER_COUNT];
+
+    if (g_thread_pool_unprocessed(my_worker) >= MAX_SUBSCRIBE_WORKER_TASK)
+    {
+        as_log_rate_limited(G_LOG_LEVEL_WARNING, target_system, msgid,
+                            "MAX_SUBSCRIBE_WORKER_TASK reached! subscription id: %d.", id);
+        as_stats_drop(target_system, STATS_DROP_SUBSCRIBE_TASK);
+        return;
+    }
+
+    gsize msg_size = as_msg_dispatch_storage_size(msgid);
+    Subscribe_Task_t *task = g_malloc(sizeof(Subscribe_Task_t) + msg_size);
+
+    if (NULL == task)
+    {
+        g_error("Out of memory!");
+    }
+
+    task->subscription = my_subscription;
+    task->id = id;
+    task->target_system = target_system;
+    task->msgid = msgid;
+    memcpy(task->msg, decoded, msg_size);
+
+    // released by worker after callback
+    g_atomic_int_inc(&my_subscription->running);
+
+    g_thread_pool_push(my_worker, task, NULL);
+}
+
+/**
+ * @brief worker executor, call callback with copy of msg.
+ * 
+ * @param data Subscribe_Task_t
+ * @param user_data 
+ */
+static void as_subscribe_worker_func(gpointer data, gpointer user_data)
+{
+    g_assert(NULL == user_data);
+
+    Subscribe_Task_t *task = data;
+    Subscription_t *my_subscription = task->subscription;
+
+    if ((TRUE == g_atomic_int_get(&my_subscription->active)) &&
+        (task->id == g_atomic_int_get(&my_subscription->id)))
+    {
+        my_subscription->callback(task->target_system, task->msgid,
+                                  task->msg, my_subscription->user_data);
+    }
+
+    as_subscribe_unref(my_subscription);
+
+    g_free(task);
+}
@@ -15,12 +15,33 @@
 #include "../inc/ardusub_thread.h"
 #include "../inc/ardusub_interface.h"
 #include "../inc/ardusub_sqlite.h"
+#include "../inc/ardusub_stats.h"
+#include "../inc/ardusub_param.h"
 
-#ifndef NO_SERISL
-gint serial_port_thread_count = 0;
-#endif
+// all sleeps of as_thread_msleep wait on shutdown_cond, woken at once on shutdown
+static GMutex shutdown_mutex;
+static GCond shutdown_cond;
+static volatile gint shutdown_requested;
+
+// broadcast when workers of a vehicle are stopped, wakes their sleeps
+static GMutex vehicle_stop_mutex[255];
+static GCond vehicle_stop_cond[255];
+
+// broadcast under vehicle_data_mutex when vehicle data is updated, or
+// db_update_worker is stopped
+static GCond vehicle_data_cond[255];
+static guint vehicle_data_seq[255];
+
+// pushed to db_insert_command_queue to stop db_insert_command_worker
+static as_command_t db_insert_command_stop;
 
-gint db_insert_command_thread_count = 0;
+// pushed to each udp_parse_queue to stop udp_parse_worker
+static Udp_Datagram_t udp_parse_stop;
+static GMutex db_insert_command_mutex;
+
+// MANUAL_CONTROL send period and min spacing of sends on change, in microseconds
+static volatile gint manual_control_interval = G_USEC_PER_SEC / MANUAL_CONTROL_RATE;
+static volatile gint manual_control_min_interval = MANUAL_CONTROL_MIN_INTERVAL * 1000;
 
 /**
  * @brief init thread prt and running flag
@@ -55,10 +76,22 @@ void as_thread_init_ptr_flag()
         statustex_wall_thread[i] = NULL;
     }
 
-    parameters_request_thread = NULL;
-    request_data_stream_thread = NULL;
+    for (gsize i = 0; i < 255; i++)
+    {
+        parameters_request_thread[i] = NULL;
+    }
+
     log_str_write_thread = NULL;
 
+    db_insert_command_thread = NULL;
+
+#ifndef NO_SERISL
+    for (gsize i = 0; i < MAVLINK_COMM_NUM_BUFFERS; i++)
+    {
+        serial_port_thread[i] = NULL;
+    }
+#endif
+
     //
     // thread running flag
 
@@ -67,6 +100,11 @@ void as_thread_init_ptr_flag()
         manual_control_worker_run[i] = 1;
     }
 
+    for (gsize i = 0; i < 255; i++)
+    {
+        parameters_request_worker_run[i] = 1;
+    }
+
     for (gsize i = 0; i < 255; i++)
     {
         named_val_float_handle_worker_run[i] = 1;
@@ -93,6 +131,101 @@ void as_thread_init_ptr_flag()
     }
 
     log_str_write_worker_run = 1;
+
+    g_atomic_int_set(&shutdown_requested, 0);
+}
+
+/**
+ * @brief wake all threads in as_thread_msleep, later sleeps return at once.
+ * 
+ */
+void as_thread_shutdown()
+{
+    g_mutex_lock(&shutdown_mutex);
+    g_atomic_int_set(&shutdown_requested, 1);
+    g_cond_broadcast(&shutdown_cond);
+    g_mutex_unlock(&shutdown_mutex);
+}
+
+/**
+ * @brief publish main loop, wakes as_thread_wait_main_loop.
+ * 
+ * @param main_loop 
+ */
+void as_thread_main_loop_ready(GMainLoop *main_loop)
+{
+    g_mutex_lock(&shutdown_mutex);
+    g_atomic_pointer_set(&as_main_loop, main_loop);
+    g_cond_broadcast(&shutdown_cond);
+    g_mutex_unlock(&shutdown_mutex);
+}
+
+/**
+ * @brief wait until main loop is created, or shutdown.
+ * 
+ */
+void as_thread_wait_main_loop()
+{
+    g_mutex_lock(&shutdown_mutex);
+
+    while (NULL == g_atomic_pointer_get(&as_main_loop) &&
+           0 == g_atomic_int_get(&shutdown_requested))
+    {
+        g_cond_wait(&shutdown_cond, &shutdown_mutex);
+    }
+
+    g_mutex_unlock(&shutdown_mutex);
+}
+
+/**
+ * @brief wake manual_control_worker after vehicle is armed or mode is
+ * changed, it waits for ARMED and MANUAL.
+ * 
+ * @param target_system 
+ */
+void as_thread_manual_control_wake(guint8 target_system)
+{
+    g_mutex_lock(&manual_control_mutex[target_system]);
+    g_cond_signal(&manual_control_cond[target_system]);
+    g_mutex_unlock(&manual_control_mutex[target_system]);
+}
+
+/**
+ * @brief check shutdown of api.
+ * 
+ * @return gboolean TRUE after as_thread_shutdown
+ */
+gboolean as_thread_shutdown_requested()
+{
+    return 1 == g_atomic_int_get(&shutdown_requested);
+}
+
+/**
+ * @brief sleep ms milliseconds in a worker of vehicle, returns early
+ * when the worker is stopped by as_thread_stop_vehicle_join.
+ * 
+ * @param target_system 
+ * @param worker_run running flag of the worker
+ * @param ms 
+ */
+static void as_thread_vehicle_msleep(guint8 target_system,
+                                     volatile gint *worker_run, guint ms)
+{
+    gint64 end_time = g_get_monotonic_time() + (gint64)ms * G_TIME_SPAN_MILLISECOND;
+
+    g_mutex_lock(vehicle_stop_mutex + target_system);
+
+    // flag is cleared before broadcast, no wakeup is lost
+    while (1 == g_atomic_int_get(worker_run))
+    {
+        if (FALSE == g_cond_wait_until(vehicle_stop_cond + target_system,
+                                       vehicle_stop_mutex + target_system, end_time))
+        {
+            break; // timed out
+        }
+    }
+
+    g_mutex_unlock(vehicle_stop_mutex + target_system);
 }
 
 /**
@@ -101,6 +234,23 @@ void as_thread_init_ptr_flag()
  */
 void as_thread_stop_all_join()
 {
+    // send stop signal to all workers before waking them, so none of
+    // them runs another cycle with sleeps returning at once
+    for (gsize i = 0; i < 255; i++)
+    {
+        g_atomic_int_set(manual_control_worker_run + i, 0);
+        g_atomic_int_set(named_val_float_handle_worker_run + i, 0);
+        g_atomic_int_set(vehicle_data_update_worker_run + i, 0);
+        g_atomic_int_set(db_update_worker_run + i, 0);
+        g_atomic_int_set(statustex_wall_worker_run + i, 0);
+        g_atomic_int_set(heartbeat_worker_run + i, 0);
+        g_atomic_int_set(parameters_request_worker_run + i, 0);
+    }
+    g_atomic_int_set(&log_str_write_worker_run, 0);
+
+    as_thread_shutdown();
+    wake_log_str();
+
     // exit main loop
     if (as_main_loop != NULL && TRUE == g_main_loop_is_running(as_main_loop))
     {
@@ -109,13 +259,28 @@ void as_thread_stop_all_join()
     g_thread_join(as_api_main_thread);
     g_message("exit main loop.");
 
+    // stop udp parse threads, main loop doesn't push any more
+    for (gint i = 0; i < MAX_UDP_PARSE_THREAD; i++)
+    {
+        if (NULL != udp_parse_thread[i])
+        {
+            g_async_queue_push(udp_parse_queue[i], &udp_parse_stop);
+            g_thread_join(udp_parse_thread[i]);
+            udp_parse_thread[i] = NULL;
+        }
+    }
+
 #ifndef NO_SERISL
     if (NULL == subnet_address) // this means serial port connection
     {
-        // wait serial port thread exit
-        while (0 != g_atomic_int_get(&serial_port_thread_count))
+        // serial port read returns in SERIAL_READ_TIMEOUT
+        for (gsize i = 0; i < MAVLINK_COMM_NUM_BUFFERS; i++)
         {
-            as_thread_msleep(10);
+            if (NULL != serial_port_thread[i])
+            {
+                g_thread_join(serial_port_thread[i]);
+                serial_port_thread[i] = NULL;
+            }
         }
         g_message("exit all serial port thread.");
     }
@@ -125,225 +290,263 @@ void as_thread_stop_all_join()
     {
         if (SYS_UN_INIT != g_atomic_int_get(vehicle_status + i))
         {
-            // send stop signal
-            g_atomic_int_set(manual_control_worker_run + i, 0);
-            g_atomic_int_set(named_val_float_handle_worker_run + i, 0);
-            g_atomic_int_set(vehicle_data_update_worker_run + i, 0);
-            g_atomic_int_set(db_update_worker_run + i, 0);
-            g_atomic_int_set(statustex_wall_worker_run + i, 0);
-            g_atomic_int_set(heartbeat_worker_run + i, 0);
-
-            // join
-            GThread *this_thread;
-            this_thread = manual_control_thread[i];
-            if (NULL != this_thread)
-            {
-                g_thread_join(this_thread);
-            }
-            manual_control_thread[i] = NULL;
-            
-            this_thread = named_val_float_handle_thread[i];
-            if (NULL != this_thread)
-            {
-                g_thread_join(this_thread);
-            }
-            named_val_float_handle_thread[i] = NULL;
-
-            this_thread = vehicle_data_update_thread[i];
-            if (NULL != this_thread)
-            {
-                g_thread_join(this_thread);
-            }
-            vehicle_data_update_thread[i] = NULL;
-
-            this_thread = db_update_thread[i];
-            if (NULL != this_thread)
-            {
-                g_thread_join(this_thread);
-            }
-            db_update_thread[i] = NULL;
-
-            this_thread = statustex_wall_thread[i];
-            if (NULL != this_thread)
-            {
-                g_thread_join(this_thread);
-            }
-            statustex_wall_thread[i] = NULL;
-
-            this_thread = heartbeat_thread[i];
-            if (NULL != this_thread)
-            {
-                g_thread_join(this_thread);
-            }
-            heartbeat_thread[i] = NULL;
+            as_thread_stop_vehicle_join(i);
         }
     }
 
-    // send stop signal
-    g_atomic_int_set(&log_str_write_worker_run, 0);
-
     // join
     if (NULL != log_str_write_thread)
     {
         g_thread_join(log_str_write_thread);
+        log_str_write_thread = NULL;
     }
 
-    if (NULL != parameters_request_thread)
+    // commands queued before stop are still inserted
+    g_mutex_lock(&db_insert_command_mutex);
+    GThread *this_thread = db_insert_command_thread;
+    db_insert_command_thread = NULL;
+    if (NULL != this_thread)
     {
-        g_thread_join(parameters_request_thread);
-    }
-    if (NULL != request_data_stream_thread)
-    {
-        g_thread_join(request_data_stream_thread);
+        g_async_queue_push(db_insert_command_queue, &db_insert_command_stop);
     }
+    g_mutex_unlock(&db_insert_command_mutex);
 
-    // wait db_insert_command thread exit
-    while (0 != g_atomic_int_get(&db_insert_command_thread_count))
+    if (NULL != this_thread)
     {
-        as_thread_msleep(10);
+        g_thread_join(this_thread);
+        g_message("exit db_insert_command_worker.");
     }
-    g_message("exit all db_insert_command thread.");
+
+    // stop test
+    as_sql_test_stop();
 
     // close database
     as_sql_close_db();
 }
 
 /**
- * @brief manual_control_worker
+ * @brief set running flags of workers of a vehicle, before they are started
+ * on rejoin.
  * 
- * @param data 
- * @return gpointer 
+ * @param target_system 
  */
-gpointer manual_control_worker(gpointer data)
+void as_thread_init_vehicle_flag(guint8 target_system)
 {
-    g_assert(NULL != data);
+    g_atomic_int_set(manual_control_worker_run + target_system, 1);
+    g_atomic_int_set(named_val_float_handle_worker_run + target_system, 1);
+    g_atomic_int_set(vehicle_data_update_worker_run + target_system, 1);
+    g_atomic_int_set(db_update_worker_run + target_system, 1);
+    g_atomic_int_set(statustex_wall_worker_run + target_system, 1);
+    g_atomic_int_set(heartbeat_worker_run + target_system, 1);
+    g_atomic_int_set(parameters_request_worker_run + target_system, 1);
+}
 
-    guint8 my_target_system = *(guint8 *)data;
-    gpointer system_key_ = g_atomic_pointer_get(sys_key + my_target_system);
-    g_assert(NULL != system_key_);
+/**
+ * @brief stop workers of a vehicle and join, on deinit or lost vehicle.
+ * 
+ * @param target_system 
+ */
+void as_thread_stop_vehicle_join(guint8 target_system)
+{
+    // send stop signal
+    g_atomic_int_set(manual_control_worker_run + target_system, 0);
+    g_atomic_int_set(named_val_float_handle_worker_run + target_system, 0);
+    g_atomic_int_set(vehicle_data_update_worker_run + target_system, 0);
+    g_atomic_int_set(db_update_worker_run + target_system, 0);
+    g_atomic_int_set(statustex_wall_worker_run + target_system, 0);
+    g_atomic_int_set(heartbeat_worker_run + target_system, 0);
+    g_atomic_int_set(parameters_request_worker_run + target_system, 0);
+
+    // wake workers waiting on their own cond
+    as_thread_manual_control_wake(target_system);
+    g_mutex_lock(&vehicle_data_mutex[target_system]);
+    g_cond_broadcast(&vehicle_data_cond[target_system]);
+    g_mutex_unlock(&vehicle_data_mutex[target_system]);
+    g_mutex_lock(vehicle_stop_mutex + target_system);
+    g_cond_broadcast(vehicle_stop_cond + target_system);
+    g_mutex_unlock(vehicle_stop_mutex + target_system);
+    as_queue_wake(g_atomic_pointer_get(message_queue + target_system));
+    if (TRUE == g_atomic_int_get(&vehicle_slot[target_system].ready))
+    {
+        as_msg_mailbox_wake(vehicle_slot[target_system].mailbox);
+    }
+    as_queue_wake(g_atomic_pointer_get(statustex_queue + target_system));
+    as_queue_wake(g_atomic_pointer_get(named_val_float_queue + target_system));
+    as_param_sync_stop(target_system);
 
-    while (1 == g_atomic_int_get(manual_control_worker_run + my_target_system))
+    // join
+    GThread *this_thread;
+    this_thread = manual_control_thread[target_system];
+    if (NULL != this_thread)
     {
-        if (SYS_ARMED == g_atomic_int_get(vehicle_status + my_target_system) &&
-            MANUAL == g_atomic_int_get(vehicle_mode + my_target_system)) // Atomic Operation
-        {
-            g_rw_lock_reader_lock(&manual_control_hash_table_lock);
-            mavlink_manual_control_t *my_manual_control =
-                g_hash_table_lookup(manual_control_table, system_key_);
-            g_rw_lock_reader_unlock(&manual_control_hash_table_lock);
+        g_thread_join(this_thread);
+    }
+    manual_control_thread[target_system] = NULL;
+    
+    this_thread = named_val_float_handle_thread[target_system];
+    if (NULL != this_thread)
+    {
+        g_thread_join(this_thread);
+    }
+    named_val_float_handle_thread[target_system] = NULL;
 
-            g_mutex_lock(&manual_control_mutex[my_target_system]); // lock
-            mavlink_manual_control_t *safe_manual_control =
-                g_memdup(my_manual_control, sizeof(mavlink_manual_control_t)); // memdup
-            g_mutex_unlock(&manual_control_mutex[my_target_system]);           // unlock
+    this_thread = vehicle_data_update_thread[target_system];
+    if (NULL != this_thread)
+    {
+        g_thread_join(this_thread);
+    }
+    vehicle_data_update_thread[target_system] = NULL;
 
-            mavlink_message_t message;
-            mavlink_msg_manual_control_encode(STATION_SYSYEM_ID, STATION_COMPONENT_ID,
-                                              &message, safe_manual_control);
-            send_mavlink_message(my_target_system, &message);
+    this_thread = db_update_thread[target_system];
+    if (NULL != this_thread)
+    {
+        g_thread_join(this_thread);
+    }
+    db_update_thread[target_system] = NULL;
 
-            g_free(safe_manual_control); // free
+    this_thread = statustex_wall_thread[target_system];
+    if (NULL != this_thread)
+    {
+        g_thread_join(this_thread);
+    }
+    statustex_wall_thread[target_system] = NULL;
 
-            // g_usleep(100000);
-            as_thread_msleep(100);
-        }
-        else
-        {
-            // g_usleep(100000);
-            as_thread_msleep(20);
-        }
+    this_thread = heartbeat_thread[target_system];
+    if (NULL != this_thread)
+    {
+        g_thread_join(this_thread);
     }
+    heartbeat_thread[target_system] = NULL;
 
-    g_message("exit manual_control_worker, sysid: %d.", my_target_system);
+    // started by as_api_param_sync too, joined under its lock
+    as_request_full_parameters_join(target_system);
+}
 
-    return NULL;
+/**
+ * @brief set MANUAL_CONTROL send rate of all vehicles. input changed by
+ * as_api_manual_control is sent at once, but not within min_interval_ms
+ * of last send.
+ * 
+ * @param rate_hz periodic send rate, 0 to keep current
+ * @param min_interval_ms min spacing of sends
+ */
+void as_api_set_manual_control_rate(unsigned int rate_hz, unsigned int min_interval_ms)
+{
+    if (0 != rate_hz)
+    {
+        g_atomic_int_set(&manual_control_interval,
+                         G_USEC_PER_SEC / MIN(rate_hz, G_USEC_PER_SEC));
+    }
+
+    g_atomic_int_set(&manual_control_min_interval,
+                     MIN(min_interval_ms, G_MAXINT / 1000) * 1000);
+
+    g_message("manual control: interval %d us, min interval %d us.",
+              g_atomic_int_get(&manual_control_interval),
+              g_atomic_int_get(&manual_control_min_interval));
 }
 
 /**
- * @brief parameters_request_worker
+ * @brief manual_control_worker, sends every manual_control_interval,
+ * or on change after manual_control_min_interval.
  * 
  * @param data 
  * @return gpointer 
  */
-gpointer parameters_request_worker(gpointer data)
+gpointer manual_control_worker(gpointer data)
 {
-    guint16 target_ = 0;
-    target_ = *(guint16 *)data;
-    g_free(data);
-    guint8 target_system = 0, target_component = 0xFF;
-    target_system = target_ >> 8;
-    target_component &= target_;
+    g_assert(NULL != data);
 
-    send_param_request_list(target_system, target_component); // no guarantee
-    as_thread_msleep(3000);
+    guint8 my_target_system = *(guint8 *)data;
+    g_assert(TRUE == g_atomic_int_get(&vehicle_slot[my_target_system].ready));
+    Vehicle_Slot_t *my_slot = vehicle_slot + my_target_system;
+    mavlink_manual_control_t *my_manual_control = my_slot->manual_control;
 
-    g_rw_lock_reader_lock(&parameter_hash_table_lock);
-    Mavlink_Parameter_t *current_parameter =
-        g_hash_table_lookup(parameter_hash_table,
-                            g_atomic_pointer_get(sys_key + target_system));
-    g_rw_lock_reader_unlock(&parameter_hash_table_lock);
+    mavlink_manual_control_t safe_manual_control;
+    mavlink_message_t message;
+    gint64 last_send_time = 0;
 
-    for (gsize j = 0; j < 10; j++)
+    while (1 == g_atomic_int_get(manual_control_worker_run + my_target_system))
     {
-        if (FALSE == g_main_loop_is_running(as_main_loop))
+        if (SYS_ARMED == g_atomic_int_get(vehicle_status + my_target_system) &&
+            MANUAL == g_atomic_int_get(vehicle_mode + my_target_system)) // Atomic Operation
         {
-            break;
-        }
+            gint64 interval = g_atomic_int_get(&manual_control_interval);
+            gint64 min_interval = g_atomic_int_get(&manual_control_min_interval);
 
-        for (gsize i = 0; i < PARAM_COUNT; i++)
-        {
-            if (FALSE == g_main_loop_is_running(as_main_loop))
+            g_mutex_lock(&manual_control_mutex[my_target_system]); // lock
+
+            gint64 now = g_get_monotonic_time();
+
+            // wait for next period, or for a change out of min interval
+            while (now - last_send_time < interval &&
+                   1 == g_atomic_int_get(manual_control_worker_run + my_target_system))
             {
-                break;
+                gint64 end_time = last_send_time + interval;
+
+                if (TRUE == my_slot->manual_control_changed)
+                {
+                    if (now - last_send_time >= min_interval)
+                    {
+                        break;
+                    }
+
+                    end_time = last_send_time + min_interval;
+                }
+
+                g_cond_wait_until(&manual_control_cond[my_target_system],
+                                  &manual_control_mutex[my_target_system], end_time);
+
+                now = g_get_monotonic_time();
             }
 
-            g_mutex_lock(&parameter_mutex[target_system]);
-            gchar param_id_stx = current_parameter[i].param_id[0];
-            g_mutex_unlock(&parameter_mutex[target_system]);
+            safe_manual_control = *my_manual_control;
+            my_slot->manual_control_changed = FALSE;
 
-            if (0 == param_id_stx)
+            g_mutex_unlock(&manual_control_mutex[my_target_system]); // unlock
+
+            // stopped, disarmed or mode changed while waiting
+            if (1 != g_atomic_int_get(manual_control_worker_run + my_target_system) ||
+                SYS_ARMED != g_atomic_int_get(vehicle_status + my_target_system) ||
+                MANUAL != g_atomic_int_get(vehicle_mode + my_target_system))
             {
-                send_param_request_read(target_system, target_component, i);
-                as_thread_msleep(100);
+                continue;
             }
-        }
 
-        as_thread_msleep(100);
-    }
+            mavlink_msg_manual_control_encode(STATION_SYSYEM_ID, STATION_COMPONENT_ID,
+                                              &message, &safe_manual_control);
+            send_mavlink_message(my_target_system, &message);
 
-    g_mutex_lock(&parameter_mutex[target_system]);
-    for (gsize i = 0; i < PARAM_COUNT; i++)
-    {
-        if (FALSE == g_main_loop_is_running(as_main_loop))
-        {
-            break;
+            last_send_time = now;
         }
-
-        if (0 == current_parameter[i].param_id[0])
+        else
         {
-            if (FALSE == g_main_loop_is_running(as_main_loop))
+            // woken by as_thread_manual_control_wake on arm, mode change or stop
+            g_mutex_lock(&manual_control_mutex[my_target_system]);
+            while (1 == g_atomic_int_get(manual_control_worker_run + my_target_system) &&
+                   (SYS_ARMED != g_atomic_int_get(vehicle_status + my_target_system) ||
+                    MANUAL != g_atomic_int_get(vehicle_mode + my_target_system)))
             {
-                break;
+                g_cond_wait(&manual_control_cond[my_target_system],
+                            &manual_control_mutex[my_target_system]);
             }
-
-            g_message("Fetch all parameter FAILED!");
-            return NULL;
+            g_mutex_unlock(&manual_control_mutex[my_target_system]);
         }
     }
-    g_mutex_unlock(&parameter_mutex[target_system]);
 
-    g_message("Fetch all parameter SUCCEED!");
+    g_message("exit manual_control_worker, sysid: %d.", my_target_system);
 
     return NULL;
 }
 
 /**
- * @brief request_data_stream_worker
+ * @brief parameters_request_worker, one per vehicle, exits when sync is
+ * done, failed or stopped.
  * 
  * @param data 
  * @return gpointer 
  */
-gpointer request_data_stream_worker(gpointer data)
+gpointer parameters_request_worker(gpointer data)
 {
     guint16 target_ = 0;
     target_ = *(guint16 *)data;
@@ -352,32 +555,9 @@ gpointer request_data_stream_worker(gpointer data)
     target_system = target_ >> 8;
     target_component &= target_;
 
-    // g_message("start request_data_stream.");
-    // g_message("target_system: %d, target_component: %d.", target_system, target_component);
-
-    as_send_request_data_stream(target_system, target_component,
-                                1, 10, 1);
-    as_thread_msleep(500);
-    as_send_request_data_stream(target_system, target_component,
-                                2, 4, 1);
-    as_thread_msleep(500);
-    as_send_request_data_stream(target_system, target_component,
-                                3, 4, 1);
-    as_thread_msleep(500);
-    as_send_request_data_stream(target_system, target_component,
-                                6, 10, 1);
-    as_thread_msleep(500);
-    as_send_request_data_stream(target_system, target_component,
-                                10, 10, 1);
-    as_thread_msleep(500);
-    as_send_request_data_stream(target_system, target_component,
-                                11, 10, 1);
-    as_thread_msleep(500);
-    as_send_request_data_stream(target_system, target_component,
-                                12, 3, 1);
-    as_thread_msleep(500);
-
-    // g_message("finish request_data_stream.");
+    g_assert(TRUE == g_atomic_int_get(&vehicle_slot[target_system].ready));
+
+    as_param_sync_run(target_system, target_component);
 
     return NULL;
 }
@@ -393,16 +573,13 @@ gpointer named_val_float_handle_worker(gpointer data)
     g_assert(NULL != data);
 
     guint8 my_target_system = *(guint8 *)data;
+    volatile gint *my_worker_run = named_val_float_handle_worker_run + my_target_system;
 
-    // wait for named_val_float_queue ready
-    while (NULL == g_atomic_pointer_get(
-                       named_val_float_queue + my_target_system))
-    {
-        as_thread_msleep(100);
-    }
+    // queue is created by as_system_add before workers are started
+    g_assert(NULL != g_atomic_pointer_get(named_val_float_queue + my_target_system));
 
     mavlink_named_value_float_t *my_named_value_float =
-        named_val_float_queue_pop(my_target_system);
+        named_val_float_queue_pop(my_target_system, my_worker_run);
 
     while (1 == g_atomic_int_get(named_val_float_handle_worker_run + my_target_system))
     {
@@ -413,13 +590,9 @@ gpointer named_val_float_handle_worker(gpointer data)
             //           my_named_value_float->name,
             //           my_named_value_float->value);
         }
-        else
-        {
-            as_thread_msleep(10);
-        }
 
         my_named_value_float =
-            named_val_float_queue_pop(my_target_system);
+            named_val_float_queue_pop(my_target_system, my_worker_run);
     }
 
     g_message("exit named_val_float_handle_worker, sysid: %d.", my_target_system);
@@ -438,18 +611,31 @@ gpointer vehicle_data_update_worker(gpointer data)
     g_assert(NULL != data);
 
     guint8 my_target_system = *(guint8 *)data;
+    volatile gint *my_worker_run = vehicle_data_update_worker_run + my_target_system;
 
-    while (NULL == g_atomic_pointer_get(vehicle_data_array + my_target_system))
-    {
-        as_thread_msleep(10);
-    }
-
+    // vehicle data is created by as_system_add before workers are started
     Vehicle_Data_t *my_vehicle_data = g_atomic_pointer_get(vehicle_data_array + my_target_system);
     g_assert(NULL != my_vehicle_data);
 
-    Mavlink_Messages_t *my_mavlink_message = message_queue_pop(my_target_system);
+    // with F_MSG_MAILBOX only the newest msg of each msgid is read
+    Msg_Mailbox_t *my_mailbox = vehicle_slot[my_target_system].mailbox;
+    Msg_Mailbox_Reader_t *my_mailbox_reader = NULL;
+
+    if (NULL != my_mailbox)
+    {
+        my_mailbox_reader = g_new0(Msg_Mailbox_Reader_t, 1);
+
+        if (NULL == my_mailbox_reader)
+        {
+            g_error("Out of memory!");
+        }
+    }
+
+    Mavlink_Messages_t *my_mavlink_message =
+        (NULL != my_mailbox) ? as_msg_mailbox_next(my_mailbox, my_mailbox_reader)
+                             : message_queue_pop(my_target_system, my_worker_run);
 
-    while (1 == g_atomic_int_get(vehicle_data_update_worker_run + my_target_system))
+    while (1 == g_atomic_int_get(my_worker_run))
     {
         if (NULL != my_mavlink_message)
         {
@@ -621,22 +807,33 @@ gpointer vehicle_data_update_worker(gpointer data)
                 break;
             }
 
+            // wake db_update_worker
+            vehicle_data_seq[my_target_system]++;
+            g_cond_broadcast(&vehicle_data_cond[my_target_system]);
+
             g_mutex_unlock(&vehicle_data_mutex[my_target_system]);
         }
-        else
+        else if (NULL != my_mailbox)
         {
-            as_thread_msleep(10);
+            // nothing changed since last read, queue pop waits itself
+            as_msg_mailbox_wait(my_mailbox, my_mailbox_reader, my_worker_run);
         }
-        my_mavlink_message = message_queue_pop(my_target_system);
+        my_mavlink_message =
+            (NULL != my_mailbox) ? as_msg_mailbox_next(my_mailbox, my_mailbox_reader)
+                                 : message_queue_pop(my_target_system, my_worker_run);
     }
 
+    g_free(my_mailbox_reader);
+
     g_message("exit vehicle_data_update_worker, sysid: %d.", my_target_system);
 
     return NULL;
 }
 
 /**
- * @brief db_update_worker
+ * @brief db_update_worker, inserts a row when vehicle data is updated,
+ * updates during an insert go into one next row. link loss stats are
+ * inserted every LINK_LOSS_DB_INTERVAL.
  * 
  * @param data 
  * @return gpointer 
@@ -648,19 +845,60 @@ gpointer db_update_worker(gpointer data)
     guint8 my_target_system = *(guint8 *)data;
 
     as_sql_check_vechle_table(my_target_system);
+    as_sql_check_link_loss_table();
 
     Vehicle_Data_t *my_vehicle_data = g_atomic_pointer_get(vehicle_data_array + my_target_system);
     g_assert(NULL != my_vehicle_data);
 
-    while (1 == g_atomic_int_get(db_update_worker_run + my_target_system))
+    volatile gint *my_worker_run = db_update_worker_run + my_target_system;
+    Link_Loss_Stats_t link_loss_stats[MAX_COMPONENT * MAX_LINK_PER_COMPONENT];
+    gint64 link_loss_time = g_get_monotonic_time();
+    guint last_seq = 0;
+
+    while (1 == g_atomic_int_get(my_worker_run))
     {
-        as_sql_insert_vechle_table(my_target_system, my_vehicle_data);
+        g_mutex_lock(&vehicle_data_mutex[my_target_system]);
 
-        as_thread_msleep(10);
-    }
+        // wait for an update, stop, or next link loss insert
+        while (last_seq == vehicle_data_seq[my_target_system] &&
+               1 == g_atomic_int_get(my_worker_run))
+        {
+            if (FALSE == g_cond_wait_until(&vehicle_data_cond[my_target_system],
+                                           &vehicle_data_mutex[my_target_system],
+                                           link_loss_time + LINK_LOSS_DB_INTERVAL))
+            {
+                break;
+            }
+        }
 
-    // stop test
-    as_sql_test_stop();
+        gboolean updated = (last_seq != vehicle_data_seq[my_target_system]);
+        last_seq = vehicle_data_seq[my_target_system];
+
+        g_mutex_unlock(&vehicle_data_mutex[my_target_system]);
+
+        if (1 != g_atomic_int_get(my_worker_run))
+        {
+            break;
+        }
+
+        if (TRUE == updated)
+        {
+            as_sql_insert_vechle_table(my_target_system, my_vehicle_data);
+        }
+
+        if (g_get_monotonic_time() - link_loss_time >= LINK_LOSS_DB_INTERVAL)
+        {
+            link_loss_time = g_get_monotonic_time();
+
+            gint count = as_api_get_link_loss(my_target_system, link_loss_stats,
+                                              MAX_COMPONENT * MAX_LINK_PER_COMPONENT);
+
+            for (gint i = 0; i < count; i++)
+            {
+                as_sql_insert_link_loss(link_loss_stats + i);
+            }
+        }
+    }
 
     g_message("exit db_update_worker, sysid: %d.", my_target_system);
 
@@ -690,10 +928,6 @@ gpointer log_str_write_worker(gpointer data)
             g_io_channel_write_chars(api_log_file_ch, log_str, -1, &bytes_written, &error);
             g_io_channel_flush(api_log_file_ch, &error);
         }
-        else
-        {
-            as_thread_msleep(10);
-        }
 
         log_str = pop_log_str();
     }
@@ -710,19 +944,21 @@ gpointer log_str_write_worker(gpointer data)
  * 
  * @param channel 
  * @param condition 
- * @param data 
+ * @param data read socket
  * @return gboolean 
  */
 gboolean udp_read_callback(GIOChannel *channel,
                            GIOCondition condition,
                            gpointer data)
 {
-    g_assert(NULL == data);
+    g_assert(NULL != data);
+    g_assert(NULL != channel);
 
-    // g_print("Received data from client!\n");
+    // only main loop thread reach here
+    static guint8 datagram[MAX_UDP_DATAGRAM];
 
-    gchar msg_tmp[MAX_BYTES] = {'\0'};
-    gsize bytes_read;
+    GSocket *socket_udp_read = data;
+    GSocketAddress *address = NULL;
     GError *error = NULL;
 
     if (condition & G_IO_HUP)
@@ -730,34 +966,66 @@ gboolean udp_read_callback(GIOChannel *channel,
         return FALSE; /* this channel is done */
     }
 
-    g_io_channel_read_chars(channel, msg_tmp, sizeof(msg_tmp), &bytes_read, &error);
+    gssize bytes_read = g_socket_receive_from(socket_udp_read, &address,
+                                              (gchar *)datagram, sizeof(datagram),
+                                              NULL, &error);
 
     /* don't forget to check for errors */
     if (error != NULL)
     {
-        g_error(error->message);
+        as_log_rate_limited(G_LOG_LEVEL_WARNING, 0, 0,
+                            "failed in udp read: %s", error->message);
+        g_error_free(error);
+        return TRUE;
     }
 
-    // g_print("%s", msg_tmp);
+    Udp_Source_t *source = as_udp_source_lookup(address);
+    g_object_unref(address);
 
-    mavlink_message_t message;
-    mavlink_status_t status;
-    gboolean msg_received = FALSE;
+    if ((NULL == source) || (bytes_read <= 0))
+    {
+        return TRUE;
+    }
 
-    for (gsize i = 0; i < (bytes_read < MAX_BYTES ? bytes_read : MAX_BYTES) && FALSE == msg_received; i++)
+    if (as_config_udp_parse_threads > 1)
     {
-        msg_received =
-            mavlink_parse_char(MAVLINK_COMM_1, msg_tmp[i], &message, &status);
+        udp_parse_queue_push(source, datagram, bytes_read);
     }
+    else
+    {
+        as_udp_parse_datagram(source, datagram, bytes_read);
+    }
+
+    return TRUE;
+}
 
-    if (TRUE == msg_received)
+/**
+ * @brief udp_parse_worker, parse datagrams of sources sharded to this thread.
+ * 
+ * @param data GAsyncQueue of this thread
+ * @return gpointer 
+ */
+gpointer udp_parse_worker(gpointer data)
+{
+    g_assert(NULL != data);
+
+    GAsyncQueue *my_queue = data;
+    Udp_Datagram_t *datagram = g_async_queue_pop(my_queue);
+
+    while (&udp_parse_stop != datagram)
     {
-        as_find_new_system(message, NULL);
+        as_udp_parse_datagram(datagram->source, datagram->buf, datagram->len);
 
-        as_handle_messages(message);
+        g_free(datagram);
+
+        datagram = g_async_queue_pop(my_queue);
     }
 
-    return TRUE;
+    // main loop is stopped before udp_parse_stop is pushed, nothing is left
+
+    g_message("exit udp_parse_worker.");
+
+    return NULL;
 }
 
 /**
@@ -781,25 +1049,19 @@ gpointer serial_port_read_write_worker(gpointer data)
         g_error("MAVLINK_COMM_NUM_BUFFERS reached!");
     }
 
-    g_atomic_int_inc(&serial_port_thread_count);
-
     g_atomic_int_inc((gint *)&serial_chan);
 
     guint8 buf;
-    gboolean msg_received = FALSE;
-    gboolean fin_new_system = FALSE;
+    guint8 framing = MAVLINK_FRAMING_INCOMPLETE;
+    guint my_link_id = as_link_id_new();
     mavlink_message_t message;
     mavlink_status_t status;
 
     enum sp_return sp_rt = SP_OK;
 
-    while (NULL == as_main_loop)
-    {
-        as_thread_msleep(10);
-        g_message("wait main loop");
-    }
+    as_thread_wait_main_loop();
 
-    while (g_main_loop_is_running(as_main_loop))
+    while (FALSE == as_thread_shutdown_requested())
     {
         gchar *write_buf = serial_write_buf_queue_pop(my_chan);
         if (NULL != write_buf)
@@ -811,48 +1073,103 @@ gpointer serial_port_read_write_worker(gpointer data)
             }
         }
 
-        sp_rt = sp_blocking_read(my_serial_port, &buf, 1, 0);
+        sp_rt = sp_blocking_read(my_serial_port, &buf, 1, SERIAL_READ_TIMEOUT);
         if (SP_OK > sp_rt)
         {
             g_error("failed in serial port read: %d", sp_rt);
         }
+        else if (SP_OK == sp_rt)
+        {
+            continue; // timeout, nothing read
+        }
 
-        msg_received =
-            mavlink_parse_char(my_chan, buf, &message, &status);
+        framing =
+            mavlink_frame_char(my_chan, buf, &message, &status);
 
-        if (TRUE == msg_received)
+        if (MAVLINK_FRAMING_OK == framing)
         {
-            if (FALSE == fin_new_system)
-            {
-                // find new system
-                fin_new_system = as_find_new_system(message, &my_chan);
-            }
+            // find new system, or heartbeat of a found one
+            as_find_new_system(message, &my_chan);
 
-            as_handle_messages(message);
+            as_handle_messages(message, my_link_id);
+        }
+        else if (MAVLINK_FRAMING_BAD_CRC == framing)
+        {
+            // message holds header of the bad frame
+            as_link_loss_crc_failed(my_link_id, message.sysid, message.compid);
+            as_stats_parse_error(message.sysid);
+        }
+        else if (MAVLINK_FRAMING_BAD_SIGNATURE == framing)
+        {
+            as_stats_parse_error(message.sysid);
         }
     }
 
-    g_atomic_int_dec_and_test(&serial_port_thread_count);
-
     return NULL;
 }
 #endif
 
+/**
+ * @brief queue command for db_insert_command_worker, which is started on
+ * first command. dropped after shutdown.
+ * 
+ * @param as_command as_command_t, freed by db_insert_command_worker
+ */
+void db_insert_command_queue_push(gpointer as_command)
+{
+    g_assert(NULL != as_command);
+
+    g_mutex_lock(&db_insert_command_mutex);
+
+    if (TRUE == as_thread_shutdown_requested())
+    {
+        g_mutex_unlock(&db_insert_command_mutex);
+        g_free(as_command);
+        return;
+    }
+
+    if (NULL == db_insert_command_thread)
+    {
+        if (NULL == db_insert_command_queue)
+        {
+            db_insert_command_queue = g_async_queue_new();
+        }
+
+        db_insert_command_thread =
+            g_thread_new("db_insert_command_worker", &db_insert_command_worker,
+                         db_insert_command_queue);
+    }
+
+    g_async_queue_push(db_insert_command_queue, as_command);
+
+    g_mutex_unlock(&db_insert_command_mutex);
+}
+
+/**
+ * @brief db_insert_command_worker, inserts queued commands in order until
+ * db_insert_command_stop is popped.
+ * 
+ * @param data GAsyncQueue of commands
+ * @return gpointer 
+ */
 gpointer db_insert_command_worker(gpointer data)
 {
     g_assert(NULL != data);
-    as_command_t *as_command = (as_command_t *)data;
 
-    g_atomic_int_inc(&db_insert_command_thread_count);
+    GAsyncQueue *my_queue = data;
 
     as_sql_check_command_table();
 
-    as_sql_insert_command(*as_command);
+    as_command_t *as_command = g_async_queue_pop(my_queue);
+
+    while (&db_insert_command_stop != as_command)
+    {
+        as_sql_insert_command(*as_command);
 
-    g_free(as_command);
+        g_free(as_command);
 
-    // g_message("exit db_insert_command_worker");
-    g_atomic_int_dec_and_test(&db_insert_command_thread_count);
+        as_command = g_async_queue_pop(my_queue);
+    }
 
     return NULL;
 }
@@ -863,6 +1180,7 @@ gpointer statustex_wall_worker(gpointer data)
 
     guint8 my_target_system = *(guint8 *)data;
 
+    volatile gint *my_worker_run = statustex_wall_worker_run + my_target_system;
     mavlink_statustext_t *statustxt;
     gchar *severity_tex[8] = {"EMERGENCY", "ALERT",
                               "CRITICAL", "ERROR",
@@ -871,9 +1189,9 @@ gpointer statustex_wall_worker(gpointer data)
     GDateTime *data_time;
     gchar *data_time_str;
 
-    while (1 == g_atomic_int_get(statustex_wall_worker_run + my_target_system))
+    while (1 == g_atomic_int_get(my_worker_run))
     {
-        statustxt = as_api_statustex_queue_pop(my_target_system);
+        statustxt = statustex_queue_pop(my_target_system, my_worker_run);
 
         if (NULL != statustxt)
         {
@@ -888,10 +1206,6 @@ gpointer statustex_wall_worker(gpointer data)
             g_date_time_unref(data_time);
             g_free(data_time_str);
         }
-        else
-        {
-            as_thread_msleep(10);
-        }
     }
 
     g_message("exit statustex_wall_worker.");
@@ -909,7 +1223,7 @@ gpointer heartbeat_worker(gpointer data)
     {
         send_heartbeat(my_target_system);
 
-        as_thread_msleep(500);
+        as_thread_vehicle_msleep(my_target_system, heartbeat_worker_run + my_target_system, 500);
     }
 
     g_message("exit heartbeat_worker.");
@@ -917,17 +1231,24 @@ gpointer heartbeat_worker(gpointer data)
     return NULL;
 }
 
+/**
+ * @brief sleep ms milliseconds, returns early on as_thread_shutdown.
+ * 
+ * @param ms 
+ */
 void as_thread_msleep(gint ms)
 {
-    for (gint i = 0; i < ms; i++)
+    gint64 end_time = g_get_monotonic_time() + (gint64)ms * 1000;
+
+    g_mutex_lock(&shutdown_mutex);
+
+    while (0 == g_atomic_int_get(&shutdown_requested))
     {
-        if (as_main_loop != NULL && TRUE == g_main_loop_is_running(as_main_loop))
+        if (FALSE == g_cond_wait_until(&shutdown_cond, &shutdown_mutex, end_time))
         {
-            g_usleep(1000);
-        }
-        else
-        {
-            break;
+            break; // time is up
         }
     }
+
+    g_mutex_unlock(&shutdown_mutex);
 }
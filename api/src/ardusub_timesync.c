@@ -0,0 +1,371 @@
+/**
+ * @file ardusub_timesync.c
+ * @author ztluo (me@ztluo.dev)
+ * @brief vehicle clock offset and skew from TIMESYNC round trips.
+ * @version
+ * @date 2019-06-05
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#define G_LOG_DOMAIN "[ardusub timesync  ]"
+
+#include "../inc/ardusub_timesync.h"
+#include "../inc/ardusub_latency.h"
+#include "../inc/ardusub_interface.h"
+
+static Timesync_t timesync[MAX_VEHICLE_SLOT];
+
+static GMutex timesync_worker_mutex;
+static GCond timesync_worker_cond; // signalled on stop
+static GThread *timesync_thread;
+static volatile gint timesync_worker_run;
+static volatile gint timesync_closed; // no restart after deinit
+
+/**
+ * @brief host time of TIMESYNC, monotonic in nanoseconds.
+ *
+ * @return gint64
+ */
+static gint64 as_timesync_now()
+{
+    return g_get_monotonic_time() * 1000;
+}
+
+/**
+ * @brief send TIMESYNC, tc1 0 for request.
+ *
+ * @param target_system
+ * @param tc1
+ * @param ts1
+ */
+static void as_timesync_send(guint8 target_system, gint64 tc1, gint64 ts1)
+{
+    mavlink_timesync_t my_timesync;
+    my_timesync.tc1 = tc1;
+    my_timesync.ts1 = ts1;
+
+    mavlink_message_t message;
+    mavlink_msg_timesync_encode(STATION_SYSYEM_ID, STATION_COMPONENT_ID, &message, &my_timesync);
+
+    send_mavlink_message(target_system, &message);
+}
+
+/**
+ * @brief vehicle time at host time, call with timesync mutex locked.
+ *
+ * @param my_timesync
+ * @param host_time in nanoseconds
+ * @return gint64 in nanoseconds
+ */
+static gint64 as_timesync_predict(const Timesync_t *my_timesync, gint64 host_time)
+{
+    return host_time + my_timesync->offset +
+           (gint64)(my_timesync->skew * (host_time - my_timesync->ref_time));
+}
+
+/**
+ * @brief fit offset and skew to samples of short round trip, call with
+ * timesync mutex locked. skew is 0 until samples span TIMESYNC_MIN_SPAN.
+ *
+ * @param my_timesync
+ */
+static void as_timesync_fit(Timesync_t *my_timesync)
+{
+    gint64 rtt_min = G_MAXINT64;
+    for (guint i = 0; i < my_timesync->count; i++)
+    {
+        rtt_min = MIN(rtt_min, my_timesync->sample[i].rtt);
+    }
+
+    // relative to newest sample, keeps doubles exact enough
+    const Timesync_Sample_t *newest =
+        my_timesync->sample + (my_timesync->next + TIMESYNC_WINDOW - 1) % TIMESYNC_WINDOW;
+
+    gdouble n = 0, sum_x = 0, sum_y = 0, sum_xx = 0, sum_xy = 0;
+    gint64 span_start = newest->host_time;
+
+    for (guint i = 0; i < my_timesync->count; i++)
+    {
+        const Timesync_Sample_t *my_sample = my_timesync->sample + i;
+
+        // queued in switch or link, one side of round trip is longer
+        if (my_sample->rtt > 2 * rtt_min + TIMESYNC_RTT_MARGIN)
+        {
+            continue;
+        }
+
+        gdouble x = my_sample->host_time - newest->host_time;
+        gdouble y = my_sample->offset - newest->offset;
+
+        n++;
+        sum_x += x;
+        sum_y += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+        span_start = MIN(span_start, my_sample->host_time);
+    }
+
+    gdouble skew = 0;
+    gdouble det = n * sum_xx - sum_x * sum_x;
+    if (TIMESYNC_MIN_SPAN <= newest->host_time - span_start && 0 < det)
+    {
+        skew = (n * sum_xy - sum_x * sum_y) / det;
+    }
+
+    my_timesync->ref_time = newest->host_time;
+    my_timesync->offset = newest->offset + (gint64)((sum_y - skew * sum_x) / n);
+    my_timesync->skew = skew;
+    my_timesync->rtt_min = rtt_min;
+    my_timesync->synced = (TIMESYNC_MIN_SAMPLES <= my_timesync->count);
+}
+
+/**
+ * @brief TIMESYNC handler, runs on I/O thread. request of vehicle is
+ * answered, reply to host adds a sample.
+ *
+ * @param target_system
+ * @param timesync_msg
+ */
+void as_timesync_received(guint8 target_system, const mavlink_timesync_t *timesync_msg)
+{
+    gint64 now = as_timesync_now();
+
+    if (0 == timesync_msg->tc1)
+    {
+        as_timesync_send(target_system, now, timesync_msg->ts1);
+        return;
+    }
+
+    // reply of latency probe request is a sample as well
+    as_latency_timesync_received(target_system, timesync_msg->ts1);
+
+    Timesync_t *my_timesync = timesync + target_system;
+    gint64 rtt = now - timesync_msg->ts1;
+
+    g_mutex_lock(&my_timesync->mutex);
+
+    // ts1 is host time of request, other values are not ours
+    if (0 > rtt || TIMESYNC_MAX_RTT < rtt)
+    {
+        my_timesync->rejected++;
+        g_mutex_unlock(&my_timesync->mutex);
+        return;
+    }
+
+    // vehicle time at middle of round trip
+    gint64 offset = timesync_msg->tc1 - (timesync_msg->ts1 + rtt / 2);
+
+    if (my_timesync->synced &&
+        TIMESYNC_RESET_THRESHOLD < ABS(offset - (as_timesync_predict(my_timesync, now) - now)))
+    {
+        g_message("vehicle id:%d clock jumped, timesync restarted.", target_system);
+        my_timesync->count = 0;
+        my_timesync->next = 0;
+        my_timesync->synced = FALSE;
+        my_timesync->next_send = 0;
+    }
+
+    Timesync_Sample_t *my_sample = my_timesync->sample + my_timesync->next;
+    my_sample->host_time = now;
+    my_sample->offset = offset;
+    my_sample->rtt = rtt;
+
+    my_timesync->next = (my_timesync->next + 1) % TIMESYNC_WINDOW;
+    my_timesync->count = MIN(my_timesync->count + 1, TIMESYNC_WINDOW);
+    my_timesync->rtt_last = rtt;
+    my_timesync->samples++;
+
+    gboolean was_synced = my_timesync->synced;
+    as_timesync_fit(my_timesync);
+    gboolean synced = my_timesync->synced;
+
+    g_mutex_unlock(&my_timesync->mutex);
+
+    if (FALSE == was_synced && synced)
+    {
+        g_message("vehicle id:%d timesync, offset: %" G_GINT64_FORMAT " us, rtt: %" G_GINT64_FORMAT " us.",
+                  target_system, offset / 1000, rtt / 1000);
+    }
+}
+
+/**
+ * @brief send TIMESYNC request to each vehicle, fast until synced.
+ *
+ * @param data
+ * @return gpointer
+ */
+static gpointer timesync_worker(gpointer data)
+{
+    g_assert(NULL == data);
+
+    g_mutex_lock(&timesync_worker_mutex);
+
+    while (1 == g_atomic_int_get(&timesync_worker_run))
+    {
+        gint64 now = g_get_monotonic_time();
+        gint64 wake_time = now + TIMESYNC_INTERVAL;
+
+        gint count = g_atomic_int_get(&active_sysid_count);
+        for (gint i = 0; i < count; i++)
+        {
+            guint8 sysid = active_sysid[i];
+            Timesync_t *my_timesync = timesync + sysid;
+
+            g_mutex_lock(&my_timesync->mutex);
+            gboolean send = (now >= my_timesync->next_send);
+            if (send)
+            {
+                my_timesync->next_send =
+                    now + (my_timesync->synced ? TIMESYNC_INTERVAL : TIMESYNC_FAST_INTERVAL);
+            }
+            wake_time = MIN(wake_time, my_timesync->next_send);
+            g_mutex_unlock(&my_timesync->mutex);
+
+            if (send && 0 != as_api_check_vehicle(sysid))
+            {
+                as_timesync_send(sysid, 0, as_timesync_now());
+            }
+        }
+
+        g_cond_wait_until(&timesync_worker_cond, &timesync_worker_mutex, wake_time);
+    }
+
+    g_mutex_unlock(&timesync_worker_mutex);
+
+    return NULL;
+}
+
+/**
+ * @brief start timesync worker once, on first vehicle, not after deinit.
+ *
+ */
+void as_timesync_start()
+{
+    g_mutex_lock(&timesync_worker_mutex);
+
+    if (NULL == timesync_thread && 0 == g_atomic_int_get(&timesync_closed))
+    {
+        g_atomic_int_set(&timesync_worker_run, 1);
+        timesync_thread = g_thread_new("timesync_worker", &timesync_worker, NULL);
+    }
+
+    g_mutex_unlock(&timesync_worker_mutex);
+}
+
+/**
+ * @brief stop timesync worker, call before I/O is stopped.
+ *
+ */
+void as_timesync_deinit()
+{
+    g_mutex_lock(&timesync_worker_mutex);
+
+    GThread *this_thread = timesync_thread;
+    timesync_thread = NULL;
+
+    g_atomic_int_set(&timesync_closed, 1);
+    g_atomic_int_set(&timesync_worker_run, 0);
+    g_cond_signal(&timesync_worker_cond);
+
+    g_mutex_unlock(&timesync_worker_mutex);
+
+    if (NULL != this_thread)
+    {
+        g_thread_join(this_thread);
+        g_message("exit timesync_worker.");
+    }
+}
+
+/**
+ * @brief get clock estimate of vehicle.
+ *
+ * @param target_system
+ * @param stats
+ * @return int 0 for no vehicle
+ */
+int as_api_timesync_get_stats(uint8_t target_system, Timesync_Stats_t *stats)
+{
+    g_assert(NULL != stats);
+
+    if (0 == as_api_check_vehicle(target_system))
+    {
+        return 0;
+    }
+
+    Timesync_t *my_timesync = timesync + target_system;
+    gint64 now = as_timesync_now();
+
+    g_mutex_lock(&my_timesync->mutex);
+    stats->synced = my_timesync->synced;
+    stats->offset = (as_timesync_predict(my_timesync, now) - now) / 1000;
+    stats->skew_ppm = my_timesync->skew * 1e6;
+    stats->rtt_min = my_timesync->rtt_min / 1000;
+    stats->rtt_last = my_timesync->rtt_last / 1000;
+    stats->samples = my_timesync->samples;
+    stats->rejected = my_timesync->rejected;
+    g_mutex_unlock(&my_timesync->mutex);
+
+    return 1;
+}
+
+/**
+ * @brief convert vehicle time since boot, e.g. time_boot_ms * 1000 of
+ * ATTITUDE, to host time of g_get_monotonic_time.
+ *
+ * @param target_system
+ * @param vehicle_time_us
+ * @param host_time_us
+ * @return int 0 for not synced
+ */
+int as_api_vehicle_to_host_time(uint8_t target_system, uint64_t vehicle_time_us,
+                                int64_t *host_time_us)
+{
+    g_assert(NULL != host_time_us);
+
+    Timesync_t *my_timesync = timesync + target_system;
+
+    g_mutex_lock(&my_timesync->mutex);
+
+    gboolean synced = my_timesync->synced;
+    if (synced)
+    {
+        // first order inverse of as_timesync_predict, skew is a ratio, 1e-6 for 1 ppm
+        gint64 host_time = (gint64)vehicle_time_us * 1000 - my_timesync->offset;
+        host_time -= (gint64)(my_timesync->skew * (host_time - my_timesync->ref_time));
+        *host_time_us = host_time / 1000;
+    }
+
+    g_mutex_unlock(&my_timesync->mutex);
+
+    return synced;
+}
+
+/**
+ * @brief convert host time of g_get_monotonic_time to vehicle time since boot.
+ *
+ * @param target_system
+ * @param host_time_us
+ * @param vehicle_time_us
+ * @return int 0 for not synced
+ */
+int as_api_host_to_vehicle_time(uint8_t target_system, int64_t host_time_us,
+                                uint64_t *vehicle_time_us)
+{
+    g_assert(NULL != vehicle_time_us);
+
+    Timesync_t *my_timesync = timesync + target_system;
+
+    g_mutex_lock(&my_timesync->mutex);
+
+    gboolean synced = my_timesync->synced;
+    if (synced)
+    {
+        *vehicle_time_us = as_timesync_predict(my_timesync, host_time_us * 1000) / 1000;
+    }
+
+    g_mutex_unlock(&my_timesync->mutex);
+
+    return synced;
+}
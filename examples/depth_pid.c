@@ -15,15 +15,36 @@
 #include <stdio.h>
 
 #include <glib.h>
+#include <ardupilotmega/mavlink.h>
 
 #include "../api/inc/ardusub_api.h"
 
-volatile int depth_controller_run = 1;
 float yaw, pitch, roll, depth;
 
-void update_vehicle_data();
-gpointer depth_controller(gpointer data);
-GThread *depth_controller_thread;
+// latest depth pushed by subscription callback
+static GMutex vehicle_state_mutex;
+static float depth_now;
+
+// state of depth controller kept between cycles
+typedef struct Depth_Controller_s
+{
+    double z_d;        // [m] desired depth
+    double K_P;        // gains for depth controller
+    double K_I;
+    double K_D;
+    int pwm_limit;
+    double I_term_max; // I_term_min and max prevent integral windup by saturating the I_term
+    double I_term_min; //
+    double z_vel_lim;  // [m/s] this is added to prevent setpoint kick in the derivative term
+    double I_term;
+    double z_now;      // depth in this iteration
+} Depth_Controller_t;
+
+void depth_callback(uint8_t target_system, uint32_t msgid,
+                    const void *msg, void *user_data);
+void update_vehicle_data(const Vehicle_Data_t *vehicle_data);
+void depth_controller(uint8_t target_system, const Vehicle_Data_t *vehicle_data,
+                      uint64_t cycle, void *user_data);
 
 /**
  * @brief 
@@ -45,157 +66,167 @@ int main()
 
     g_message("system 1 is active.");
 
+    // callback runs on I/O thread right after decode, no polling delay
+    int depth_id = as_api_subscribe(1, MAVLINK_MSG_ID_GLOBAL_POSITION_INT,
+                                    &depth_callback, NULL,
+                                    F_SUBSCRIBE_INLINE);
+
+    as_api_test_start("depth_control", NULL);
+
+    g_message("set LAB_REMOTE mode.");
+    as_api_set_mode(1, LAB_REMOTE);
+
+    g_message("vehicle arm");
+    as_api_vehicle_arm(1, 1);
+
+    Depth_Controller_t controller = {
+        .z_d = -0.5,
+        .K_P = 300,
+        .K_I = 0,
+        .K_D = 0,
+        .pwm_limit = 150,
+        .I_term_max = -600,
+        .I_term_min = -700,
+        .z_vel_lim = 1,
+    };
+
+    // 20 Hz on absolute deadlines, SCHED_FIFO is skipped without permission
     g_message("start depth_controller");
-    depth_controller_thread = g_thread_new("depth_controller",
-                                           &depth_controller, NULL);
+    int periodic_id = as_api_periodic_start(1, 50000, &depth_controller, &controller,
+                                            F_PERIODIC_SCHED_FIFO | F_PERIODIC_MLOCK,
+                                            50, -1);
 
     getchar();
-    g_atomic_int_set(&depth_controller_run, 0);
-    g_thread_join(depth_controller_thread);
+    as_api_periodic_stop(periodic_id);
+
+    Periodic_Stats_t stats;
+    if (as_api_periodic_get_stats(periodic_id, &stats))
+    {
+        g_message("cycles: %lu, overruns: %lu, jitter: %ld / %ld / %ld us, exec max: %ld us.",
+                  (unsigned long)stats.cycles, (unsigned long)stats.overruns,
+                  (long)(stats.jitter_min / 1000), (long)(stats.jitter_mean / 1000),
+                  (long)(stats.jitter_max / 1000), (long)(stats.exec_max / 1000));
+    }
+
+    g_message("vehicle disarm");
+    as_api_vehicle_disarm(1, 1);
+
+    g_message("set MANUAL mode.");
+    as_api_set_mode(1, MANUAL);
+
+    as_api_unsubscribe(depth_id);
 
     as_api_deinit();
 
     return 0;
 }
 
-void update_vehicle_data()
+void depth_callback(uint8_t target_system G_GNUC_UNUSED, uint32_t msgid,
+                    const void *msg, void *user_data)
 {
-    Vehicle_Data_t *vehicle_data;
+    g_assert(MAVLINK_MSG_ID_GLOBAL_POSITION_INT == msgid);
+    g_assert(NULL != msg);
+    g_assert(NULL == user_data);
 
-    vehicle_data = as_api_get_vehicle_data(1);
+    const mavlink_global_position_int_t *global_position_int = msg;
+
+    g_mutex_lock(&vehicle_state_mutex);
+    depth_now = global_position_int->alt / 1000.0; // m
+    g_mutex_unlock(&vehicle_state_mutex);
+}
 
+void update_vehicle_data(const Vehicle_Data_t *vehicle_data)
+{
     yaw = vehicle_data->yaw * D_PER_RAD;
     pitch = vehicle_data->pitch * D_PER_RAD;
     roll = vehicle_data->roll * D_PER_RAD;
-    depth = vehicle_data->alt / 1000.0; // m
-    // depth = vehicle_data->press_abs2 / 9800.0; // m
+
+    g_mutex_lock(&vehicle_state_mutex);
+    depth = depth_now;
+    g_mutex_unlock(&vehicle_state_mutex);
 
     g_message("yaw: %f, pitch: %f, roll: %f, depth: %f m.\n", yaw, pitch, roll, depth);
 }
 
-gpointer depth_controller(gpointer data)
+void depth_controller(uint8_t target_system, const Vehicle_Data_t *vehicle_data,
+                      uint64_t cycle, void *user_data)
 {
-    g_assert(NULL == data);
-
-    as_api_test_start("depth_control", NULL);
+    Depth_Controller_t *controller = user_data;
 
-    g_message("set LAB_REMOTE mode.");
-    as_api_set_mode(1, LAB_REMOTE);
+    if (NULL == vehicle_data)
+    {
+        return;
+    }
 
-    g_message("vehicle arm");
-    as_api_vehicle_arm(1, 1);
+    update_vehicle_data(vehicle_data);
 
-    double z_d = -0.5; // [m] desired depth
+    gint64 dt = 50000;
     int pwm_out = 1500;
 
-    gint64 tnow, dt = 50000;
-
-    // gains for depth controller
-    double K_P = 300;
-    double K_I = 0;
-    double K_D = 0;
-
-    int pwm_limit = 150;
-
-    double I_term_max = -600; // I_term_min and max prevent integral windup by saturating the I_term
-    double I_term_min = -700; //
-    double z_vel_lim = 1;     // [m/s] this is added to prevent setpoint kick in the derivative term
-
     double P_term = 0;
-    double I_term = 0;
     double D_term = 0;
-    double z_now = 0; // depth in this iteration
     double z_old = 0; // depth in the previous iteration
     double z_err = 0; // declare the depth error
     double z_vel = 0; // declare the derivative term for z
 
-    while (1 == g_atomic_int_get(&depth_controller_run))
+    // update ROV's state
+    z_old = (0 == cycle) ? depth : controller->z_now;
+    controller->z_now = depth;
+    z_err = controller->z_d - controller->z_now;
+    z_vel = (controller->z_now - z_old) / (dt / 1000);
+
+    // clamp the value of z_vel
+    if (z_vel < -controller->z_vel_lim)
     {
-        tnow = g_get_monotonic_time();
-        update_vehicle_data();
-        // g_message("update time : %ld.", g_get_monotonic_time() - tnow);
-
-        // update ROV's state
-        z_old = z_now;
-        z_now = depth;
-        z_err = z_d - z_now;
-        z_vel = (z_now - z_old) / (dt / 1000);
-
-        // clamp the value of z_vel
-        if (z_vel < -z_vel_lim)
-        {
-            z_vel = -z_vel_lim;
-        }
-        if (z_vel > z_vel_lim)
-        {
-            z_vel = z_vel_lim;
-        }
+        z_vel = -controller->z_vel_lim;
+    }
+    if (z_vel > controller->z_vel_lim)
+    {
+        z_vel = controller->z_vel_lim;
+    }
 
-        P_term = K_P * z_err;
-        if (K_I == 0)
-        {
-            I_term = 0;
-        }
-        else
+    P_term = controller->K_P * z_err;
+    if (controller->K_I == 0)
+    {
+        controller->I_term = 0;
+    }
+    else
+    {
+        if (controller->z_d < -0.2) // dont do this while disarm
         {
-            if (z_d < -0.2) // dont do this while disarm
+            controller->I_term = controller->I_term + controller->K_I * z_err * (dt / 1000);
+            // clamp the value of I_term
+            if (controller->I_term < controller->I_term_min)
             {
-                I_term = I_term + K_I * z_err * (dt / 1000);
-                // clamp the value of I_term
-                if (I_term < I_term_min)
-                {
-                    I_term = I_term_min;
-                }
-                if (I_term > I_term_max)
-                {
-                    I_term = I_term_max;
-                }
+                controller->I_term = controller->I_term_min;
+            }
+            if (controller->I_term > controller->I_term_max)
+            {
+                controller->I_term = controller->I_term_max;
             }
         }
-        D_term = K_D * z_vel;
-
-        pwm_out = P_term + I_term + D_term;
-
-        // clamp the value of pwm_out
-        if (pwm_out < -pwm_limit)
-        {
-            pwm_out = -pwm_limit;
-        }
-        if (pwm_out > pwm_limit)
-        {
-            pwm_out = pwm_limit;
-        }
+    }
+    D_term = controller->K_D * z_vel;
 
-        as_api_send_rc_channels_override(1, 1,
-                                         1500, 1500,
-                                         1500, 1500,
-                                         1500 + pwm_out,
-                                         1500 - pwm_out,
-                                         1500 - pwm_out,
-                                         1500 + pwm_out);
-
-        // as_api_send_rc_channels_override(1, 1,
-        //                                  1500, 1500,
-        //                                  1500, 1500,
-        //                                  1500 - pwm_out,
-        //                                  1500 + pwm_out,
-        //                                  1500 - pwm_out,
-        //                                  1500 + pwm_out);
-
-        while (tnow + dt > g_get_monotonic_time())
-        {
-            g_usleep(20);
-        }
+    pwm_out = P_term + controller->I_term + D_term;
 
-        // g_print("time error: %ld.\n", tnow + dt - g_get_monotonic_time());
-        g_print("pwm_out: %d\n", pwm_out);
+    // clamp the value of pwm_out
+    if (pwm_out < -controller->pwm_limit)
+    {
+        pwm_out = -controller->pwm_limit;
+    }
+    if (pwm_out > controller->pwm_limit)
+    {
+        pwm_out = controller->pwm_limit;
     }
 
-    g_message("vehicle disarm");
-    as_api_vehicle_disarm(1, 1);
-
-    g_message("set MANUAL mode.");
-    as_api_set_mode(1, MANUAL);
+    as_api_send_rc_channels_override(target_system, 1,
+                                     1500, 1500,
+                                     1500, 1500,
+                                     1500 + pwm_out,
+                                     1500 - pwm_out,
+                                     1500 - pwm_out,
+                                     1500 + pwm_out);
 
-    return NULL;
+    g_print("pwm_out: %d\n", pwm_out);
 }
@@ -14,10 +14,12 @@
 #include <stdio.h>
 
 #include <glib.h>
+#include <ardupilotmega/mavlink.h>
 
 #include "../api/inc/ardusub_api.h"
 
-gpointer monitoring_thread(gpointer data);
+void monitoring_callback(uint8_t target_system, uint32_t msgid,
+                         const void *msg, void *user_data);
 
 /**
  * @brief 
@@ -76,8 +78,9 @@ int main(int argc, char *argv[])
     g_message("system 1 is active.");
 
     g_message("Start monitoring...");
-    g_thread_new("monitoring_thread",
-                 &monitoring_thread, NULL);
+    int monitoring_id = as_api_subscribe(1, MAVLINK_MSG_ID_HEARTBEAT,
+                                         &monitoring_callback, NULL,
+                                         F_SUBSCRIBE_WORKER);
 
     g_message("vehicle arm...");
     as_api_vehicle_arm(1, 1);
@@ -122,63 +125,62 @@ int main(int argc, char *argv[])
     g_message("vehicle disarm...");
     as_api_vehicle_disarm(1, 1);
 
+    as_api_unsubscribe(monitoring_id);
+
     as_api_deinit();
 
     return 0;
 }
 
 /**
- * @brief get and print vehicle data.
+ * @brief get and print vehicle data on every heartbeat.
  * 
- * @param data 
- * @return gpointer 
+ * @param target_system 
+ * @param msgid 
+ * @param msg mavlink_heartbeat_t
+ * @param user_data 
  */
-gpointer monitoring_thread(gpointer data)
+void monitoring_callback(uint8_t target_system, uint32_t msgid,
+                         const void *msg, void *user_data)
 {
-    g_assert(NULL == data);
-    Vehicle_Data_t *vehicle_data;
+    g_assert(MAVLINK_MSG_ID_HEARTBEAT == msgid);
+    g_assert(NULL != msg);
+    g_assert(NULL == user_data);
+
+    Vehicle_Data_t vehicle_data;
 
-    while (TRUE)
+    if (0 == as_api_get_vehicle_data2(target_system, &vehicle_data))
     {
-        vehicle_data = as_api_get_vehicle_data(1);
-
-        if (NULL == vehicle_data)
-        {
-            continue;
-        }
-
-        g_print("\n===================================\n");
-        g_print("System ID: %d\n", 1);
-        g_print("System status: %d\n", vehicle_data->system_status);
-        g_print("Time unix: %llu\n", vehicle_data->time_unix_usec);
-        g_print("Mode: %d\n", vehicle_data->base_mode);
-        g_print("MAVLink version: %d\n", vehicle_data->mavlink_version);
-        g_print("------------------------------------\n");
-        g_print("Battery voltage: %d\n", vehicle_data->voltage_battery);
-        g_print("Battery current: %d\n", vehicle_data->current_battery);
-        g_print("------------------------------------\n");
-        g_print("Roll: %f\n", vehicle_data->roll);
-        g_print("Pitch: %f\n", vehicle_data->pitch);
-        g_print("Yaw: %f\n", vehicle_data->yaw);
-        g_print("Roll speed: %f\n", vehicle_data->rollspeed);
-        g_print("Pitch speed: %f\n", vehicle_data->pitchspeed);
-        g_print("Yaw speed: %f\n", vehicle_data->yawspeed);
-        g_print("------------------------------------\n");
-        g_print("Depth sensor:\n %f(abs), %f(diff)\n", vehicle_data->press_abs2, vehicle_data->press_diff2);
-        g_print("------------------------------------\n");
-        g_print("Servo output raw:\n");
-        g_print("servo1_raw: %d\n", vehicle_data->servo1_raw);
-        g_print("servo2_raw: %d\n", vehicle_data->servo2_raw);
-        g_print("servo3_raw: %d\n", vehicle_data->servo3_raw);
-        g_print("servo4_raw: %d\n", vehicle_data->servo4_raw);
-        g_print("servo5_raw: %d\n", vehicle_data->servo5_raw);
-        g_print("servo6_raw: %d\n", vehicle_data->servo6_raw);
-        g_print("servo7_raw: %d\n", vehicle_data->servo7_raw);
-        g_print("servo8_raw: %d\n", vehicle_data->servo8_raw);
-        g_print("====================================\n");
-
-        g_usleep(2000000);
+        return;
     }
 
-    return NULL;
+    g_print("\n===================================\n");
+    g_print("System ID: %d\n", target_system);
+    g_print("System status: %d\n", vehicle_data.system_status);
+    g_print("Time unix: %llu\n", vehicle_data.time_unix_usec);
+    g_print("Mode: %d\n", vehicle_data.base_mode);
+    g_print("MAVLink version: %d\n", vehicle_data.mavlink_version);
+    g_print("------------------------------------\n");
+    g_print("Battery voltage: %d\n", vehicle_data.voltage_battery);
+    g_print("Battery current: %d\n", vehicle_data.current_battery);
+    g_print("------------------------------------\n");
+    g_print("Roll: %f\n", vehicle_data.roll);
+    g_print("Pitch: %f\n", vehicle_data.pitch);
+    g_print("Yaw: %f\n", vehicle_data.yaw);
+    g_print("Roll speed: %f\n", vehicle_data.rollspeed);
+    g_print("Pitch speed: %f\n", vehicle_data.pitchspeed);
+    g_print("Yaw speed: %f\n", vehicle_data.yawspeed);
+    g_print("------------------------------------\n");
+    g_print("Depth sensor:\n %f(abs), %f(diff)\n", vehicle_data.press_abs2, vehicle_data.press_diff2);
+    g_print("------------------------------------\n");
+    g_print("Servo output raw:\n");
+    g_print("servo1_raw: %d\n", vehicle_data.servo1_raw);
+    g_print("servo2_raw: %d\n", vehicle_data.servo2_raw);
+    g_print("servo3_raw: %d\n", vehicle_data.servo3_raw);
+    g_print("servo4_raw: %d\n", vehicle_data.servo4_raw);
+    g_print("servo5_raw: %d\n", vehicle_data.servo5_raw);
+    g_print("servo6_raw: %d\n", vehicle_data.servo6_raw);
+    g_print("servo7_raw: %d\n", vehicle_data.servo7_raw);
+    g_print("servo8_raw: %d\n", vehicle_data.servo8_raw);
+    g_print("====================================\n");
 }
@@ -0,0 +1,333 @@
+/**
+ * @file dispatch_bench.c
+ * @author ztluo (me@ztluo.dev)
+ * @brief microbenchmark of msg dispatch table against the old msgid switch.
+ * @version 0.1
+ * @date 2019-05-06
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+
+#define G_LOG_DOMAIN "[dispatch_bench    ]"
+
+#include <stdio.h>
+
+#include <glib.h>
+
+#include "../../api/inc/ardusub_msg.h"
+
+#define BENCH_SYSID (1)
+#define BENCH_COMPID (1)
+#define BENCH_FRAME_COUNT (12)
+#define BENCH_ROUNDS (200000)
+
+static mavlink_message_t frames[BENCH_FRAME_COUNT];
+
+void prepare_frames();
+void switch_handle_message_id(mavlink_message_t message,
+                              Mavlink_Messages_t *current_messages);
+gdouble bench_switch(Mavlink_Messages_t *current_messages);
+gdouble bench_table(Mavlink_Messages_t *current_messages,
+                    Mavlink_Parameter_t *current_parameter);
+
+int main()
+{
+    Mavlink_Messages_t *current_messages = g_new0(Mavlink_Messages_t, 1);
+    Mavlink_Parameter_t *current_parameter = g_new0(Mavlink_Parameter_t, PARAM_COUNT);
+
+    if ((NULL == current_messages) ||
+        (NULL == current_parameter))
+    {
+        g_error("Out of memory!");
+    }
+
+    current_messages->sysid = BENCH_SYSID;
+    current_messages->compid = BENCH_COMPID;
+
+    as_msg_dispatch_init();
+    prepare_frames();
+
+    // warm up
+    bench_switch(current_messages);
+    bench_table(current_messages, current_parameter);
+
+    gdouble switch_ns = bench_switch(current_messages);
+    gdouble table_ns = bench_table(current_messages, current_parameter);
+
+    g_print("frames dispatched: %d\n", BENCH_FRAME_COUNT * BENCH_ROUNDS);
+    g_print("switch: %8.2f ns/frame\n", switch_ns);
+    g_print("table : %8.2f ns/frame\n", table_ns);
+
+    g_free(current_messages);
+    g_free(current_parameter);
+
+    return 0;
+}
+
+/**
+ * @brief encode a typical telemetry mix.
+ * 
+ */
+void prepare_frames()
+{
+    gint i = 0;
+
+    mavlink_heartbeat_t hb = {0};
+    hb.type = MAV_TYPE_SUBMARINE;
+    hb.autopilot = MAV_AUTOPILOT_ARDUPILOTMEGA;
+    mavlink_msg_heartbeat_encode(BENCH_SYSID, BENCH_COMPID, frames + i++, &hb);
+
+    mavlink_sys_status_t ss = {0};
+    ss.voltage_battery = 16000;
+    mavlink_msg_sys_status_encode(BENCH_SYSID, BENCH_COMPID, frames + i++, &ss);
+
+    mavlink_attitude_t at = {0};
+    at.roll = 0.1F;
+    at.pitch = 0.2F;
+    at.yaw = 0.3F;
+    mavlink_msg_attitude_encode(BENCH_SYSID, BENCH_COMPID, frames + i++, &at);
+
+    mavlink_scaled_pressure2_t sp2 = {0};
+    sp2.press_abs = 1100.0F;
+    mavlink_msg_scaled_pressure2_encode(BENCH_SYSID, BENCH_COMPID, frames + i++, &sp2);
+
+    mavlink_global_position_int_t gpi = {0};
+    gpi.alt = -500;
+    mavlink_msg_global_position_int_encode(BENCH_SYSID, BENCH_COMPID, frames + i++, &gpi);
+
+    mavlink_raw_imu_t ri = {0};
+    ri.zacc = 1000;
+    mavlink_msg_raw_imu_encode(BENCH_SYSID, BENCH_COMPID, frames + i++, &ri);
+
+    mavlink_rc_channels_t rc = {0};
+    rc.chan1_raw = 1500;
+    mavlink_msg_rc_channels_encode(BENCH_SYSID, BENCH_COMPID, frames + i++, &rc);
+
+    mavlink_servo_output_raw_t sor = {0};
+    sor.servo1_raw = 1500;
+    mavlink_msg_servo_output_raw_encode(BENCH_SYSID, BENCH_COMPID, frames + i++, &sor);
+
+    mavlink_vibration_t vib = {0};
+    mavlink_msg_vibration_encode(BENCH_SYSID, BENCH_COMPID, frames + i++, &vib);
+
+    mavlink_vfr_hud_t vh = {0};
+    mavlink_msg_vfr_hud_encode(BENCH_SYSID, BENCH_COMPID, frames + i++, &vh);
+
+    mavlink_timesync_t ts = {0};
+    mavlink_msg_timesync_encode(BENCH_SYSID, BENCH_COMPID, frames + i++, &ts);
+
+    mavlink_system_time_t st = {0};
+    mavlink_msg_system_time_encode(BENCH_SYSID, BENCH_COMPID, frames + i++, &st);
+
+    g_assert(BENCH_FRAME_COUNT == i);
+}
+
+/**
+ * @brief time the old msgid switch.
+ * 
+ * @param current_messages 
+ * @return gdouble ns per frame
+ */
+gdouble bench_switch(Mavlink_Messages_t *current_messages)
+{
+    gint64 start = g_get_monotonic_time();
+
+    for (gint round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (gint i = 0; i < BENCH_FRAME_COUNT; i++)
+        {
+            switch_handle_message_id(frames[i], current_messages);
+        }
+    }
+
+    gint64 elapsed = g_get_monotonic_time() - start;
+
+    return elapsed * 1000.0 / (BENCH_FRAME_COUNT * (gdouble)BENCH_ROUNDS);
+}
+
+/**
+ * @brief time the msg dispatch table.
+ * 
+ * @param current_messages 
+ * @param current_parameter 
+ * @return gdouble ns per frame
+ */
+gdouble bench_table(Mavlink_Messages_t *current_messages,
+                    Mavlink_Parameter_t *current_parameter)
+{
+    gint64 start = g_get_monotonic_time();
+
+    for (gint round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (gint i = 0; i < BENCH_FRAME_COUNT; i++)
+        {
+            as_handle_message_id(frames[i], current_messages, current_parameter);
+        }
+    }
+
+    gint64 elapsed = g_get_monotonic_time() - start;
+
+    return elapsed * 1000.0 / (BENCH_FRAME_COUNT * (gdouble)BENCH_ROUNDS);
+}
+
+/**
+ * @brief the msgid switch replaced by the dispatch table, kept as reference.
+ * 
+ * @param message 
+ * @param current_messages 
+ */
+void switch_handle_message_id(mavlink_message_t message,
+                              Mavlink_Messages_t *current_messages)
+{
+    g_mutex_lock(&message_mutex[message.sysid]);
+
+    guint8 target_system = current_messages->sysid;
+    current_messages->msg_id = message.msgid;
+    gboolean queue_push = FALSE;
+
+    switch (message.msgid)
+    {
+    case MAVLINK_MSG_ID_HEARTBEAT:
+        mavlink_msg_heartbeat_decode(&message, &(current_messages->heartbeat));
+        current_messages->time_stamps.heartbeat = g_get_monotonic_time();
+        queue_push = TRUE;
+        break;
+
+    case MAVLINK_MSG_ID_SYS_STATUS:
+        mavlink_msg_sys_status_decode(&message, &(current_messages->sys_status));
+        current_messages->time_stamps.sys_status = g_get_monotonic_time();
+        queue_push = TRUE;
+        break;
+
+    case MAVLINK_MSG_ID_BATTERY_STATUS:
+        mavlink_msg_battery_status_decode(&message, &(current_messages->battery_status));
+        current_messages->time_stamps.battery_status = g_get_monotonic_time();
+        queue_push = TRUE;
+        break;
+
+    case MAVLINK_MSG_ID_RADIO_STATUS:
+        mavlink_msg_radio_status_decode(&message, &(current_messages->radio_status));
+        current_messages->time_stamps.radio_status = g_get_monotonic_time();
+        break;
+
+    case MAVLINK_MSG_ID_LOCAL_POSITION_NED:
+        mavlink_msg_local_position_ned_decode(&message, &(current_messages->local_position_ned));
+        current_messages->time_stamps.local_position_ned = g_get_monotonic_time();
+        break;
+
+    case MAVLINK_MSG_ID_GLOBAL_POSITION_INT:
+        mavlink_msg_global_position_int_decode(&message, &(current_messages->global_position_int));
+        current_messages->time_stamps.global_position_int = g_get_monotonic_time();
+        queue_push = TRUE;
+        break;
+
+    case MAVLINK_MSG_ID_HIGHRES_IMU:
+        mavlink_msg_highres_imu_decode(&message, &(current_messages->highres_imu));
+        current_messages->time_stamps.highres_imu = g_get_monotonic_time();
+        break;
+
+    case MAVLINK_MSG_ID_ATTITUDE:
+        mavlink_msg_attitude_decode(&message, &(current_messages->attitude));
+        current_messages->time_stamps.attitude = g_get_monotonic_time();
+        queue_push = TRUE;
+        break;
+
+    case MAVLINK_MSG_ID_SERVO_OUTPUT_RAW:
+        mavlink_msg_servo_output_raw_decode(&message, &(current_messages->servo_output_raw));
+        current_messages->time_stamps.servo_output_raw = g_get_monotonic_time();
+        queue_push = TRUE;
+        break;
+
+    case MAVLINK_MSG_ID_COMMAND_ACK:
+        mavlink_msg_command_ack_decode(&message, &(current_messages->command_ack));
+        current_messages->time_stamps.command_ack = g_get_monotonic_time();
+        break;
+
+    case MAVLINK_MSG_ID_VFR_HUD:
+        mavlink_msg_vfr_hud_decode(&message, &(current_messages->vfr_hud));
+        current_messages->time_stamps.vfr_hud = g_get_monotonic_time();
+        break;
+
+    case MAVLINK_MSG_ID_POWER_STATUS:
+        mavlink_msg_power_status_decode(&message, &(current_messages->power_status));
+        current_messages->time_stamps.power_status = g_get_monotonic_time();
+        queue_push = TRUE;
+        break;
+
+    case MAVLINK_MSG_ID_SYSTEM_TIME:
+        mavlink_msg_system_time_decode(&message, &(current_messages->system_time));
+        current_messages->time_stamps.system_time = g_get_monotonic_time();
+        queue_push = TRUE;
+        break;
+
+    case MAVLINK_MSG_ID_MISSION_CURRENT:
+        mavlink_msg_mission_current_decode(&message, &(current_messages->mission_current));
+        current_messages->time_stamps.mission_current = g_get_monotonic_time();
+        break;
+
+    case MAVLINK_MSG_ID_GPS_RAW_INT:
+        mavlink_msg_gps_raw_int_decode(&message, &(current_messages->gps_raw_int));
+        current_messages->time_stamps.gps_raw_int = g_get_monotonic_time();
+        break;
+
+    case MAVLINK_MSG_ID_NAV_CONTROLLER_OUTPUT:
+        mavlink_msg_nav_controller_output_decode(&message, &(current_messages->nav_controller_output));
+        current_messages->time_stamps.nav_controller_output = g_get_monotonic_time();
+        break;
+
+    case MAVLINK_MSG_ID_RC_CHANNELS:
+        mavlink_msg_rc_channels_decode(&message, &(current_messages->rc_channels));
+        current_messages->time_stamps.rc_channels = g_get_monotonic_time();
+        queue_push = TRUE;
+        break;
+
+    case MAVLINK_MSG_ID_VIBRATION:
+        mavlink_msg_vibration_decode(&message, &(current_messages->vibration));
+        current_messages->time_stamps.vibration = g_get_monotonic_time();
+        break;
+
+    case MAVLINK_MSG_ID_RAW_IMU:
+        mavlink_msg_raw_imu_decode(&message, &(current_messages->raw_imu));
+        current_messages->time_stamps.raw_imu = g_get_monotonic_time();
+        queue_push = TRUE;
+        break;
+
+    case MAVLINK_MSG_ID_SCALED_PRESSURE:
+        mavlink_msg_scaled_pressure_decode(&message, &(current_messages->scaled_pressure));
+        current_messages->time_stamps.scaled_pressure = g_get_monotonic_time();
+        queue_push = TRUE;
+        break;
+
+    case MAVLINK_MSG_ID_SCALED_IMU2:
+        mavlink_msg_scaled_imu2_decode(&message, &(current_messages->scaled_imu2));
+        current_messages->time_stamps.scaled_imu2 = g_get_monotonic_time();
+        break;
+
+    case MAVLINK_MSG_ID_SCALED_PRESSURE2:
+        mavlink_msg_scaled_pressure2_decode(&message, &(current_messages->scaled_pressure2));
+        current_messages->time_stamps.scaled_pressure2 = g_get_monotonic_time();
+        queue_push = TRUE;
+        break;
+
+    case MAVLINK_MSG_ID_RC_CHANNELS_RAW:
+        mavlink_msg_rc_channels_raw_decode(&message, &(current_messages->rc_channels_raw));
+        current_messages->time_stamps.rc_channels_raw = g_get_monotonic_time();
+        break;
+
+    case MAVLINK_MSG_ID_TIMESYNC:
+        mavlink_msg_timesync_decode(&message, &(current_messages->timesync));
+        current_messages->time_stamps.timesync = g_get_monotonic_time();
+        break;
+
+    default:
+        break;
+    }
+
+    g_mutex_unlock(&message_mutex[message.sysid]);
+
+    if (TRUE == queue_push)
+    {
+        message_queue_push(target_system, current_messages);
+    }
+}